@@ -17,9 +17,11 @@
 #include <vector>
 
 #include "config.hpp"
+#include "dir_snapshot.hpp"
 #include "file_info.hpp"
 #include "file_info_md5.hpp"
 #include "nlohmann/json.hpp"
+#include "object_store.hpp"
 #include "thread_pool.hpp"
 
 /// @brief 创建备份文件夹并打开相关文件流。
@@ -43,65 +45,60 @@ bool create_backup_folder(std::ofstream &directories_output_stream,
 bool parse_command_line_args(int argc, char *argv[], int &threads,
                           std::vector<std::string> &folders);
 
-/// @brief 使用BFS遍历搜索指定的备份文件夹路径，收集其中的所有目录和文件。
+/// @brief 规范化备份文件夹路径，得到用于遍历的根目录。
 ///
-/// 该函数通过广度优先搜索（BFS）遍历给定的目录路径，收集找到的所有目录和文件。对于传入的路径，合并重复的情况，处理目录不存在的情况，并相应地记录警告或错误信息。
+/// 不存在的路径记录警告后忽略；每个新的根目录记录一条`[INFO] Folder path: `日志（restore据此解析备份的元路径）。
+/// 重复的路径合并，嵌套在其他根目录中的路径不单独遍历。
 ///
-/// @param backup_folder_paths [in] 要搜索的文件路径列表。
-/// @param directories [out] 存储找到的目录。
-/// @param files [out] 存储找到的文件。
-void search_directories_and_files(const std::vector<u8string> &backup_folder_paths,
-                               std::vector<u8string> &directories,
-                               std::vector<u8string> &files);
+/// @param backup_folder_paths [in] 命令行及标准输入给出的备份文件夹路径。
+/// @return 互不包含的规范路径。
+std::vector<fs::path>
+get_traversal_roots(const std::vector<u8string> &backup_folder_paths);
 
-/// @brief 获取每个文件的信息（路径，修改时间，大小）并将其存储在 `file_infos`
-/// 中。
+/// @brief 载入最近一次备份保存的目录快照。
 ///
-/// 该函数遍历文件路径列表，使用 `FileInfo`
-/// 构造函数检索其信息（路径，修改时间，大小），然后将此信息附加到 `file_infos`
-/// 中。执行过程中打印状态消息。
+/// 在`config::PATH_BACKUP_DATA`下按名称（以调用时间开头）找到最新的、含有
+/// `config::DIRECTORY_SNAPSHOT_FILE_NAME`的备份数据目录，本次的目录除外。
 ///
-/// @param files [in] 表示文件路径。
-/// @param file_infos [out] 对 `fileinfo::FileInfo`
-/// 对象的向量的引用，这些对象的信息将被存储。
-void get_file_infos(const std::vector<u8string> &files,
-                  std::vector<fileinfo::FileInfo> &file_infos);
+/// @param previous [out] 载入的快照。
+/// @return 找到并成功载入时返回true。
+bool load_previous_snapshot(snapshot::DirectorySnapshot &previous);
 
-/// @brief 计算文件的MD5值，并将它们复制到备份目录。
+/// @brief 将本次遍历的目录快照保存到本次的备份数据目录。
 ///
-/// 该函数初始化线程池和文件复制器，然后为每个文件生成一个任务来计算其MD5值，并在完成后将其复制到备份目录。
+/// 上次快照中不在本次根目录之下的记录一并保存，供以后备份这些目录时使用。
 ///
-/// @param pool [in, out] 指向ThreadPool对象的指针，用于管理并行计算MD5。
-/// @param copier [in, out] 指向FilesCopier对象的指针，用于文件复制操作。
-/// @param file_infos [in, out] 传入需要计算MD5值的文件信息，保存对应文件的MD5。
-void calculate_md5_values(ThreadPool *&pool, FilesCopier *&copier,
-                        std::vector<fileinfo::FileInfo> &file_infos);
+/// @param current [in, out] 本次遍历的快照。
+/// @param previous [in] 上次的快照。
+/// @param roots [in] 本次遍历的根目录。
+void save_snapshot(snapshot::DirectorySnapshot &current,
+                   const snapshot::DirectorySnapshot &previous,
+                   const std::vector<fs::path> &roots);
 
-/// @brief 将目录路径和文件信息写入JSON文件。
+/// @brief 并行遍历指定的备份文件夹路径，收集其中的所有目录和文件。
 ///
-/// 此函数将目录列表和文件信息写入各自的目标流中，以JSON格式呈现。
-/// 使用`nlohmann/json`库进行序列化。JSON数据采用`config`中指定的缩进级别和字符进行格式化。
+/// 该函数使用`scanner::DirectoryScanner`以`config::THREAD_NUM`个线程遍历给定的目录路径，收集找到的所有目录和文件。对于传入的路径，合并重复及相互嵌套的情况，处理目录不存在的情况，并相应地记录警告或错误信息。遍历结束后记录目录/s和目录项/s。
 ///
-/// @param file_info_output_stream [in] 用于将文件信息写入JSON文件的输出流。
-/// @param directories_output_stream [in] 用于将目录路径写入JSON文件的输出流。
-/// @param directories [in] 目录路径。
-/// @param file_infos [in] 文件信息。
-void write_to_json(std::ofstream &file_info_output_stream,
-                 std::ofstream &directories_output_stream,
-                 const std::vector<u8string> &directories,
-                 const std::vector<fileinfo::FileInfo> &file_infos);
-
-/// @brief 展示进度条，等待复制文件完成。
+/// 文件信息（路径，修改时间，大小）在遍历时由一次`statx`直接填好，不再单独获取。
+/// 与备份相同，复用并更新目录快照。
 ///
-/// @param copier FilesCopier 对象的指针。函数将管理此对象的生命周期。
-///                     执行后，`copier` 将被设置为 nullptr。
-void copy_files(FilesCopier *&copier);
+/// @param backup_folder_paths [in] 要搜索的文件路径列表。
+/// @param directories [out] 存储找到的目录的路径编号。
+/// @param file_infos [out] 存储找到的文件的信息。
+void search_directories_and_files(const std::vector<u8string> &backup_folder_paths,
+                               std::vector<pathstore::PathId> &directories,
+                               std::vector<fileinfo::FileInfo> &file_infos);
 
-/// @brief 检查文件的完整性，通过比较其元数据与备份进行。
+/// @brief 检查单个文件的完整性，通过比较其元数据与备份进行。
 ///
-/// 该函数会遍历一组文件信息，并检查每个文件的元数据是否与其备份副本匹配。如果发现差异，它会记录这些差异并在必要时删除损坏的备份。
+/// 若源文件、备份文件与记录的元数据不一致，记录差异，该条目记为失败。只有本次
+/// 运行由复制线程复制的单独副本可能与副本名不符，会被删除（见
+/// `objectstore::ObjectStore::discard`）；已存在的副本可能被之前的清单引用，
+/// 计算哈希值时写入的副本总是与副本名一致，都不会被删除。
 ///
-/// @param file_infos 对包含 `fileinfo::FileInfo`
-/// 对象的向量的引用，这些对象持有待检查文件的路径和其他元数据。
-void check(const std::vector<fileinfo::FileInfo> &file_infos);
+/// @param file_info 待检查文件的路径和其他元数据。
+/// @param objects 副本所在的对象存储。
+/// @return 错误代码，各位含义见README；0表示一致。
+unsigned char check_file(const fileinfo::FileInfo &file_info,
+                         objectstore::ObjectStore &objects);
 #endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+/// @file backup/include/pipeline.hpp
+/// @brief 流式备份流水线。
+///
+/// 备份的各个阶段由有界队列连接，同时运行：
+/// 遍历（遍历时已由`statx`获取文件信息）→ 计算MD5 → 复制 → 检查并写入清单。
+/// 第一个文件被发现后即开始计算MD5，不必等待遍历结束；清单逐条写入。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _BACKUP_PIPELINE_HPP
+#define _BACKUP_PIPELINE_HPP
+
+#include <fstream>
+#include <vector>
+
+#include "config.hpp"
+
+/// @brief 以流水线方式执行备份。
+///
+/// 遍历使用`config::THREAD_NUM`个线程，计算MD5使用`config::THREAD_NUM`个线程，
+/// 复制、检查各使用一个线程。阶段之间的队列容量为`config::PIPELINE_QUEUE_CAPACITY`。
+/// 结束后记录首个文件复制完成的时间和总耗时。
+///
+/// @param roots [in] 互不包含的规范根目录，见`get_traversal_roots`。
+/// @param directories_output_stream [in] 遍历结束后写入目录路径的JSON文件流。
+/// @param file_info_output_stream [in] 逐条写入文件信息的JSON文件流。
+void run_backup_pipeline(const std::vector<fs::path> &roots,
+                         std::ofstream &directories_output_stream,
+                         std::ofstream &file_info_output_stream);
+
+#endif
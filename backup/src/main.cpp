@@ -14,6 +14,7 @@
 #include "env.hpp"
 #include "file_info.hpp"
 #include "head.hpp"
+#include "pipeline.hpp"
 #include "print.hpp"
 #include "str_encode.hpp"
 #include "thread_pool.hpp"
@@ -22,8 +23,7 @@ using config::THREAD_NUM;
 const string PROJECT_NAME = "backup";
 
 vector<u8string> backup_folder_paths;
-vector<u8string> directories;
-vector<u8string> files;
+vector<pathstore::PathId> directories;
 vector<fileinfo::FileInfo> file_infos;
 
 std::ofstream file_info_output_stream;
@@ -58,29 +58,24 @@ int main(int argc, char *argv[]) {
              "[INFO] Encoding: " + strencode::get_console_encoding());
     cprintln(IMPORTANT, format("[INFO] Thread number: {}", THREAD_NUM));
 
-    // get file infos
-    search_directories_and_files(backup_folder_paths, directories, files);
-    print::pause();
-    get_file_infos(files, file_infos);
-
-    // calculate md5
-    ThreadPool *pool = nullptr;
-    FilesCopier *copier = nullptr;
-    calculate_md5_values(pool, copier, file_infos);
+    // scan only
+    if (config::SCAN_ONLY) {
+        search_directories_and_files(backup_folder_paths, directories,
+                                     file_infos);
+        CLOSE_LOG();
+        return 0;
+    }
 
-    // write to json
-    write_to_json(file_info_output_stream, directories_output_stream,
-                  directories, file_infos);
+    // scan, calculate hash, copy, check and write to json
+    auto roots = get_traversal_roots(backup_folder_paths);
+    if (!config::NON_INTERACTIVE)
+        print::pause();
+    run_backup_pipeline(roots, directories_output_stream,
+                        file_info_output_stream);
     file_info_output_stream.close(), directories_output_stream.close();
 
-    // copy files
-    copy_files(copier);
-
-    // check
-    check(file_infos);
-
     //
-    fileinfo::update_cached_md5();
+    fileinfo::update_cached_hash();
 
     // rename beta
     CLOSE_LOG();
@@ -0,0 +1,363 @@
+/// @file backup/src/pipeline.cpp
+/// @brief 实现 pipeline.hpp 的功能
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <tuple>
+
+#include "bounded_queue.hpp"
+#include "dir_scanner.hpp"
+#include "extent.hpp"
+#include "hard_links.hpp"
+#include "head.hpp"
+#include "pipeline.hpp"
+#include "print.hpp"
+#include "read_engine.hpp"
+#include "str_encode.hpp"
+
+using nlohmann::json;
+
+namespace {
+/// 在复制和检查阶段之间传递的条目。
+struct PipelineItem {
+    fileinfo::FileInfo file_info;
+    bool hashed; /// 哈希值是否计算成功；失败的条目只写入清单。
+};
+
+/// 刷新进度条的最小间隔。
+constexpr auto PROGRESS_INTERVAL = std::chrono::milliseconds(100);
+
+/// @brief 按物理位置调度的统计。
+struct ScheduleStats {
+    ull windows = 0;     /// 排序的批次数
+    ull files = 0;       /// 经过调度的文件数
+    ull approximate = 0; /// 未取得物理偏移、按inode号排序的文件数
+};
+
+/// @brief 将`input`中的文件按（设备号，物理位置）分批排序后转发到`output`。
+/// @details 流水线不等待遍历结束：每次取出队列中已有的文件（至多
+/// `config::EXTENT_SCHEDULE_WINDOW`个）排序，遍历越快于读取，批次越大、越接近
+/// 全局顺序。
+ScheduleStats schedule_by_extent(BoundedQueue<fileinfo::FileInfo> &input,
+                                 BoundedQueue<fileinfo::FileInfo> &output) {
+    struct Entry {
+        ull device;
+        extent::PhysicalKey key;
+        fileinfo::FileInfo file_info;
+    };
+    ScheduleStats stats;
+    std::vector<Entry> window;
+    auto add = [&](fileinfo::FileInfo &&file_info) {
+        auto key = extent::physical_key(file_info.get_path(),
+                                        file_info.get_inode());
+        stats.approximate += key.approximate;
+        window.push_back(
+            {file_info.get_device(), key, std::move(file_info)});
+    };
+    while (auto first = input.pop()) {
+        add(std::move(*first));
+        while (window.size() < config::EXTENT_SCHEDULE_WINDOW) {
+            auto next = input.try_pop();
+            if (!next)
+                break;
+            add(std::move(*next));
+        }
+        std::sort(window.begin(), window.end(),
+                  [](const Entry &a, const Entry &b) {
+                      return std::tie(a.device, a.key) <
+                             std::tie(b.device, b.key);
+                  });
+        stats.windows++, stats.files += window.size();
+        for (auto &entry : window)
+            output.push(std::move(entry.file_info));
+        window.clear();
+    }
+    output.close();
+    return stats;
+}
+} // namespace
+
+void run_backup_pipeline(const std::vector<fs::path> &roots,
+                         std::ofstream &directories_output_stream,
+                         std::ofstream &file_info_output_stream) {
+    using namespace print;
+    using clock = std::chrono::steady_clock;
+    cprintln(INFO, "Running backup pipeline...");
+    const auto start = clock::now();
+    auto seconds_since_start = [&] {
+        return std::chrono::duration<double>(clock::now() - start).count();
+    };
+
+    BoundedQueue<fileinfo::FileInfo> hash_queue(
+        config::PIPELINE_QUEUE_CAPACITY);
+    BoundedQueue<PipelineItem> verify_queue(config::PIPELINE_QUEUE_CAPACITY);
+    // With --hdd-schedule, a scheduler stage sits between the scan and the
+    // hash workers and reorders the files by their physical position.
+    BoundedQueue<fileinfo::FileInfo> scheduled_queue(
+        config::PIPELINE_QUEUE_CAPACITY);
+    auto &read_queue =
+        config::SCHEDULE_BY_EXTENT ? scheduled_queue : hash_queue;
+    DeviceLimiter device_readers(
+        config::SCHEDULE_BY_EXTENT ? config::READERS_PER_DEVICE : 0);
+    FilesCopier *copier =
+        new FilesCopier(false, config::PIPELINE_QUEUE_CAPACITY,
+                        config::COPY_THREADS, config::COPIES_PER_DEVICE);
+    // Small objects are appended to packs, see object_store.hpp.
+    objectstore::ObjectStore objects(config::PATH_BACKUP_COPIES);
+    objects.open();
+    objects.set_compression(config::COMPRESSION_LEVEL,
+                            config::COMPRESSION_THREADS);
+
+    std::atomic<ull> discovered_num = 0, discovered_size = 0;
+    std::atomic<ull> done_num = 0, done_size = 0, error_num = 0;
+    std::atomic<bool> first_copied = false;
+    double first_copy_seconds = 0;
+    hardlinks::HardLinkGroups hard_links(
+        [&](fileinfo::FileInfo &&file_info, bool hashed) {
+            if (!hashed)
+                error_num++;
+            verify_queue.push({std::move(file_info), hashed});
+        });
+
+    // Stage 1: scan. File metadata is filled by the scanner's statx.
+    std::thread scan_thread([&] {
+        scanner::DirectoryScanner directory_scanner(config::THREAD_NUM,
+                                                    config::USE_IO_URING);
+        snapshot::DirectorySnapshot previous_snapshot, current_snapshot;
+        const bool has_previous =
+            config::USE_DIRECTORY_SNAPSHOT &&
+            load_previous_snapshot(previous_snapshot);
+        directory_scanner.set_snapshots(
+            has_previous ? &previous_snapshot : nullptr, &current_snapshot,
+            config::TRUST_DIRECTORY_SNAPSHOT);
+        std::vector<std::vector<pathstore::PathId>> worker_directories(
+            directory_scanner.get_thread_num());
+        directory_scanner.scan(
+            roots,
+            [&](int id, pathstore::PathId path_id) {
+                worker_directories[id].push_back(path_id);
+            },
+            [&](int, fileinfo::FileInfo &&file_info) {
+                discovered_num++, discovered_size += file_info.get_file_size();
+                hash_queue.push(std::move(file_info));
+            });
+        hash_queue.close();
+
+        json directories = json::array();
+        for (const auto &part : worker_directories)
+            for (auto path_id : part)
+                directories.push_back(
+                    pathstore::arena().get_path(path_id).u8string());
+        directories_output_stream << directories.dump(
+            config::JSON_DUMP_INDENT, config::JSON_DUMP_INDENT_CHAR);
+        save_snapshot(current_snapshot, previous_snapshot, roots);
+        directory_scanner.get_exclude_engine().report();
+
+        const auto &stats = directory_scanner.get_stats();
+        log(RESET,
+            format("[INFO] Scan: {} directories ({} reused from snapshot), "
+                   "{} files, {:.3f} s, {} stat calls, {} engine",
+                   stats.directories, stats.reused_directories, stats.files,
+                   stats.seconds, stats.stat_calls, stats.engine),
+            false);
+    });
+
+    // Optional stage: order the reads by physical position.
+    ScheduleStats schedule_stats;
+    std::thread schedule_thread;
+    if (config::SCHEDULE_BY_EXTENT)
+        schedule_thread = std::thread([&] {
+            schedule_stats = schedule_by_extent(hash_queue, scheduled_queue);
+        });
+
+    // Stage 2: hash, then hand over to the copier. Files read for hashing are
+    // written to the copies in the same pass and skip the copier, except
+    // those the copier can reflink (see `ObjectStore::prefers_import`).
+    auto copied = [&](PipelineItem &&item) {
+        if (!first_copied.exchange(true))
+            first_copy_seconds = seconds_since_start();
+        hard_links.finish(item.file_info, true);
+        verify_queue.push(std::move(item));
+    };
+    std::atomic<ull> stored_num = 0, stored_size = 0;
+    std::atomic<ull> chunked_num = 0, chunked_size = 0, chunk_num = 0;
+    std::atomic<ull> new_chunk_num = 0, new_chunk_size = 0;
+    auto hand_over = [&](fileinfo::FileInfo &&file_info,
+                         const fileinfo::HashResult &result) {
+        if (const auto &error = result.error) {
+            try {
+                std::rethrow_exception(error);
+            } catch (const std::exception &e) {
+                log(ERROR, std::format("[ERROR]: {}", e.what()));
+            }
+            error_num++;
+            hard_links.finish(file_info, false);
+            verify_queue.push({std::move(file_info), false});
+            return;
+        }
+        if (result.stored) {
+            stored_num++, stored_size += file_info.get_file_size();
+            if (const auto &chunks = file_info.get_chunks(); !chunks.empty()) {
+                chunked_num++, chunked_size += file_info.get_file_size();
+                chunk_num += chunks.size();
+                new_chunk_num += result.new_chunks;
+                new_chunk_size += result.new_chunk_bytes;
+            }
+            copied({std::move(file_info), true});
+            return;
+        }
+        const auto name = file_info.get_object_name();
+        // Cached hashes of unchanged files: the copier would not see objects
+        // that live in a pack.
+        if (objects.contains(name)) {
+            copied({std::move(file_info), true});
+            return;
+        }
+        auto from = file_info.get_path_id();
+        auto to = pathstore::arena().intern(objects.object_path(name));
+        auto size = file_info.get_file_size();
+        // The object store compresses the copy when enabled.
+        copier->enqueue(
+            from, to, size,
+            [&objects, from, name](const fs::path &) {
+                return objects.import(pathstore::arena().get_path(from), name);
+            },
+            [&, item = PipelineItem{std::move(file_info), true}](
+                bool) mutable { copied(std::move(item)); });
+    };
+    // Small MD5 files are hashed several at a time (see md5_multi.hpp), so
+    // each worker takes whatever is queued. The HDD schedule keeps one file
+    // per worker so that the per-device limit and the order hold.
+    const size_t batch_files =
+        config::HASH_ALGORITHM == config::HashAlgorithm::MD5 &&
+                !config::SCHEDULE_BY_EXTENT
+            ? fileinfo::HASH_BATCH_FILES
+            : 1;
+    std::vector<std::thread> hash_workers;
+    for (int i = 0; i < std::max(config::THREAD_NUM, 1); ++i) {
+        hash_workers.emplace_back([&] {
+            std::vector<fileinfo::FileInfo> batch;
+            while (auto file_info = read_queue.pop()) {
+                batch.clear();
+                do {
+                    if (hard_links.join(*file_info))
+                        batch.push_back(std::move(*file_info));
+                } while (batch.size() < batch_files &&
+                         (file_info = read_queue.try_pop()));
+                if (batch.empty())
+                    continue;
+
+                std::vector<fileinfo::HashResult> results;
+                {
+                    DeviceLimiter::Guard guard(device_readers,
+                                               batch.front().get_device());
+                    results = fileinfo::calculate_hash_values(batch, &objects);
+                }
+                for (size_t j = 0; j < batch.size(); ++j)
+                    hand_over(std::move(batch[j]), results[j]);
+            }
+        });
+    }
+
+    // Stage 3: verify each copy and append it to the manifest.
+    std::thread verify_thread([&] {
+        file_info_output_stream << '[';
+        bool first_item = true;
+        auto last_shown = clock::now();
+        while (auto item = verify_queue.pop()) {
+            if (item->hashed) {
+                try {
+                    if (check_file(item->file_info, objects))
+                        error_num++;
+                } catch (const std::exception &e) {
+                    log(ERROR, std::format("[ERROR] Check: {}", e.what()));
+                    error_num++;
+                }
+            }
+            file_info_output_stream
+                << (first_item ? "" : ",")
+                << json(item->file_info)
+                       .dump(config::JSON_DUMP_INDENT,
+                             config::JSON_DUMP_INDENT_CHAR);
+            first_item = false;
+
+            done_num++, done_size += item->file_info.get_file_size();
+            if (clock::now() - last_shown >= PROGRESS_INTERVAL) {
+                last_shown = clock::now();
+                progress_bar::print_double_progress_bar(
+                    static_cast<double>(done_num) / discovered_num,
+                    discovered_size ? static_cast<double>(done_size) /
+                                          discovered_size
+                                    : 1.0);
+            }
+        }
+        file_info_output_stream << ']';
+    });
+
+    // Each stage closes its output once all of its producers have finished.
+    scan_thread.join();
+    if (schedule_thread.joinable())
+        schedule_thread.join();
+    for (auto &worker : hash_workers)
+        worker.join();
+    // Every path has been registered: free the groups whose other links lie
+    // outside the roots.
+    hard_links.close();
+    delete copier; // waits for the queued copies
+    verify_queue.close();
+    verify_thread.join();
+    try {
+        objects.close();
+    } catch (const std::exception &e) {
+        log(ERROR, std::format("[ERROR] Failed to write the pack index: {}",
+                               e.what()));
+        error_num++;
+    }
+    progress_bar::print_double_progress_bar(1.0, 1.0);
+
+    cprintln(SUCCESS, format("\n  Backup pipeline done: {} files, {:.2f} MB, "
+                             "{} errors.",
+                             done_num.load(), done_size / (1024.0 * 1024),
+                             error_num.load()));
+    log(INFO, format("[INFO] Pipeline: first copy after {:.3f} s, total {:.3f} "
+                     "s, {} read engine",
+                     first_copy_seconds, seconds_since_start(),
+                     readengine::read_engine_name(config::READ_ENGINE)));
+    log(INFO, format("[INFO] Single read: {} files and {:.2f} MB stored while "
+                     "hashing",
+                     stored_num.load(), stored_size / (1024.0 * 1024)));
+    log(INFO, format("[INFO] Packs: {} objects in {} pack files",
+                     objects.pack_object_count(), objects.pack_count()));
+    log(INFO, format("[INFO] Objects: {} loose objects, index {}, {} migrated "
+                     "to the fan-out layout",
+                     objects.loose_object_count(),
+                     objects.is_index_rebuilt() ? "rebuilt by scanning"
+                                                : "loaded",
+                     objects.get_migrated()));
+    if (config::COMPRESSION_LEVEL != 0)
+        log(INFO, format("[INFO] Compression: zstd level {}, {}",
+                         config::COMPRESSION_LEVEL,
+                         objects.get_compression_stats().summary()));
+    if (config::CHUNKED_STORAGE)
+        log(INFO, format("[INFO] Chunked: {} files, {:.2f} MB in {} chunks, "
+                         "{} new chunks with {:.2f} MB written",
+                         chunked_num.load(), chunked_size / (1024.0 * 1024),
+                         chunk_num.load(), new_chunk_num.load(),
+                         new_chunk_size / (1024.0 * 1024)));
+    log(INFO, format("[INFO] Hard links: {} reads and {:.2f} MB saved",
+                     hard_links.get_saved_reads(),
+                     hard_links.get_saved_bytes() / (1024.0 * 1024)));
+    if (config::SCHEDULE_BY_EXTENT)
+        log(INFO, format("[INFO] HDD schedule: {} files in {} windows, {} "
+                         "ordered by inode, {} readers per device",
+                         schedule_stats.files, schedule_stats.windows,
+                         schedule_stats.approximate,
+                         config::READERS_PER_DEVICE));
+}
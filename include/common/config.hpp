@@ -71,9 +71,65 @@ const int JSON_DUMP_INDENT_CHAR = ' ';
 /// 一组将被忽略的路径。
 extern std::set<fs::path> IGNORED_PATH;
 
+/// 备份流水线各阶段之间队列的容量。
+const size_t PIPELINE_QUEUE_CAPACITY = 1 << 14;
+
+/// io_uring元数据引擎一次提交的最大请求数。
+const unsigned IO_URING_QUEUE_DEPTH = 256;
+
+/// 遍历时预先打开的子目录数量上限，用于限制文件描述符的占用。
+const int SCANNER_MAX_OPEN_DIRECTORIES = 256;
+
+/// 目录中排除规则文件的名称，语义同`.gitignore`。
+const string IGNORE_FILE_NAME = ".backupignore";
+
+/// 目录快照的文件名，与`directories.json`保存在同一备份数据目录中。
+const string DIRECTORY_SNAPSHOT_FILE_NAME = "directory_snapshot.bin";
+
+/// 按物理位置调度时，一次排序的最多文件数量。
+const size_t EXTENT_SCHEDULE_WINDOW = 4096;
+
 // the following are defined by command line arguments
 extern int THREAD_NUM;
 extern bool SHOULD_CHECK_CACHED_MD5;
+/// 命中缓存时仍重新读取文件，与缓存的哈希值比较，不一致时报错。
+extern bool VERIFY_CACHED_HASH;
+/// 仅遍历源目录并报告遍历速度，不进行备份。
+extern bool SCAN_ONLY;
+/// 非交互模式：不从标准输入读取更多路径，不暂停。
+extern bool NON_INTERACTIVE;
+/// 遍历时使用io_uring批量获取元数据。
+extern bool USE_IO_URING;
+/// 复用上次备份的目录快照，跳过未变化目录的列举。
+extern bool USE_DIRECTORY_SNAPSHOT;
+/// 快速增量模式：未变化目录中文件的元数据也直接取自快照。
+extern bool TRUST_DIRECTORY_SNAPSHOT;
+/// 命令行给出的排除模式，见exclude.hpp。
+extern std::vector<string> EXCLUDE_PATTERNS;
+/// 读取文件内容的方式，见read_engine.hpp。
+enum class ReadEngine { STREAM, PREAD, DIRECT, MMAP };
+/// 计算校验值时读取文件内容的方式。
+extern ReadEngine READ_ENGINE;
+/// 内容寻址使用的哈希算法，见content_hash.hpp。
+enum class HashAlgorithm { MD5, SHA256, BLAKE2B };
+/// 新备份的文件使用的哈希算法。
+extern HashAlgorithm HASH_ALGORITHM;
+/// 大文件按块并行计算树哈希，见tree_hash.hpp。
+extern bool TREE_HASH;
+/// 按文件数据的物理位置排序后再读取，适用于机械硬盘，见extent.hpp。
+extern bool SCHEDULE_BY_EXTENT;
+/// 按物理位置调度时，每个设备上同时读取的线程数上限，`0`为不限制。
+extern int READERS_PER_DEVICE;
+/// 复制文件的线程数。
+extern int COPY_THREADS;
+/// 每个源设备、每个目标设备上同时进行的复制数上限，`0`为不限制。
+extern int COPIES_PER_DEVICE;
+/// 副本的zstd压缩级别，`0`为不压缩，见compression.hpp。
+extern int COMPRESSION_LEVEL;
+/// 压缩大副本时zstd使用的线程数。
+extern int COMPRESSION_THREADS;
+/// 大文件按内容定义分块保存，见fastcdc.hpp。
+extern bool CHUNKED_STORAGE;
 } // namespace config
 
 namespace print::progress_bar {
@@ -99,6 +155,33 @@ const char *const DOUBLE_PROGRESS_MIXED_COLOR = "\033[38;2;150;75;150m";
 namespace fileinfo {
 /// 读取文件时使用的缓冲区大小。
 const size_t READ_FILE_BUFFER_SIZE = 1 << 15;
+
+/// `pread`/`O_DIRECT`读取时缓冲区大小的下限，小文件一次读完。
+const size_t READ_BUFFER_MIN_SIZE = 1 << 16;
+
+/// `pread`/`O_DIRECT`读取时缓冲区大小的上限。
+const size_t READ_BUFFER_MAX_SIZE = 1 << 22;
+
+/// `O_DIRECT`要求的缓冲区地址、偏移和长度的对齐。
+const size_t DIRECT_IO_ALIGNMENT = 4096;
+
+/// 不超过该大小的文件整个读入内存，多个文件同时计算MD5。
+const size_t SMALL_FILE_SIZE = 1 << 16;
+
+/// 计算哈希值的线程一次从队列中取出的最多文件数。
+const size_t HASH_BATCH_FILES = 64;
+
+/// 启用树哈希时，不小于该大小的文件按块并行计算哈希值。
+const unsigned long long TREE_HASH_MIN_SIZE = 1ull << 30;
+
+/// 树哈希的块大小。
+const unsigned long long TREE_HASH_CHUNK_SIZE = 1ull << 26;
+
+/// 启用分块保存时，不小于该大小的文件按内容定义分块保存。
+const unsigned long long CHUNKED_MIN_SIZE = 1ull << 26;
+
+/// 副本目录中存放计算哈希值时写入的未完成副本的子目录，每次备份开始时清空。
+const char *const PARTIAL_OBJECTS_DIRECTORY = ".partial";
 } // namespace fileinfo
 
 // str_encode.cpp: 额外定义了编码识别的默认语言
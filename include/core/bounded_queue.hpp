@@ -0,0 +1,96 @@
+/// @file bounded_queue.hpp
+/// @brief 有界阻塞队列，用于连接流水线的各个阶段。
+///
+/// 队列满时`push`阻塞，从而让下游的速度反压上游，避免在内存中堆积整棵目录树；
+/// 上游全部结束后调用`close`，下游取空后`pop`返回`std::nullopt`。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _BOUNDED_QUEUE_HPP_
+#define _BOUNDED_QUEUE_HPP_
+
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <queue>
+
+/// @brief 多生产者多消费者的有界阻塞队列。
+/// @tparam T 元素类型。
+template <typename T> class BoundedQueue {
+  public:
+    /// @brief 构造函数。
+    /// @param capacity 队列容量，至少为1。
+    explicit BoundedQueue(size_t capacity)
+        : capacity(capacity ? capacity : 1), closed(false) {}
+
+    /// @brief 入队，队列满时阻塞。
+    /// @param value 要入队的元素。
+    /// @return 队列已关闭时返回false，元素被丢弃。
+    bool push(T value) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock,
+                          [this] { return closed || items.size() < capacity; });
+            if (closed)
+                return false;
+            items.push(std::move(value));
+        }
+        not_empty.notify_one();
+        return true;
+    }
+
+    /// @brief 出队，队列空且未关闭时阻塞。
+    /// @return 队列已关闭且取空时返回`std::nullopt`。
+    std::optional<T> pop() {
+        std::optional<T> value;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this] { return closed || !items.empty(); });
+            if (items.empty())
+                return std::nullopt;
+            value.emplace(std::move(items.front()));
+            items.pop();
+        }
+        not_full.notify_one();
+        return value;
+    }
+
+    /// @brief 不阻塞地出队。
+    /// @return 队列为空时返回`std::nullopt`。
+    std::optional<T> try_pop() {
+        std::optional<T> value;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (items.empty())
+                return std::nullopt;
+            value.emplace(std::move(items.front()));
+            items.pop();
+        }
+        not_full.notify_one();
+        return value;
+    }
+
+    /// @brief 关闭队列：不再接受新元素，已入队的元素仍可取出。
+    void close() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+  private:
+    std::queue<T> items;                /// 元素
+    const size_t capacity;              /// 容量
+    bool closed;                        /// 是否已关闭
+    std::mutex mutex;                   /// 保护以上成员
+    std::condition_variable not_empty;  /// 通知消费者有新元素
+    std::condition_variable not_full;   /// 通知生产者有空位
+};
+
+#endif
@@ -0,0 +1,148 @@
+/// @file compression.hpp
+/// @brief 副本的zstd压缩：先采样判断是否值得压缩，再整块或流式压缩、解压。
+///
+/// 已压缩的格式（图片、音视频、压缩包等）再压缩只会浪费CPU，因此压缩前先检查：
+/// - 开头的魔数是否属于已知的压缩格式；
+/// - 采样（开头`SAMPLE_SIZE`字节）的字节熵是否超过`MAX_ENTROPY`位/字节。
+/// 不值得压缩的对象按原样保存。
+///
+/// 不小于`MULTITHREAD_MIN_SIZE`的对象由zstd的多个工作线程压缩。
+///
+/// zstd是可选的依赖：构建时未找到zstd则不定义`BACKUP_HAVE_ZSTD`，`available()`为
+/// false，压缩总是按原样保存，解压抛出异常。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _COMPRESSION_HPP_
+#define _COMPRESSION_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace compression {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+
+/// 判断是否值得压缩时采样的字节数。
+const size_t SAMPLE_SIZE = 1 << 16;
+
+/// 采样的字节熵超过该值（位/字节）时不压缩。
+const double MAX_ENTROPY = 7.5;
+
+/// 不小于该大小的对象用多个线程压缩。
+const ull MULTITHREAD_MIN_SIZE = 1ull << 25;
+
+/// 压缩文件名的后缀。
+const char *const COMPRESSED_SUFFIX = ".zst";
+
+/// @brief 是否编译了zstd支持。
+bool available();
+
+/// @brief 可用的压缩级别范围。
+int min_level();
+int max_level();
+
+/// @brief 采样的字节熵（位/字节，0到8）。
+double entropy(std::string_view sample);
+
+/// @brief 以内容的开头判断是否值得压缩。
+/// @param sample 内容开头的至多`SAMPLE_SIZE`字节。
+bool worth_compressing(std::string_view sample);
+
+/// @brief 整块压缩。
+/// @param [out] output 压缩后的内容（zstd帧，记录原始大小）。
+/// @return 压缩后是否更小；为false时`output`无意义。
+bool compress(std::string_view input, int level, std::string &output);
+
+/// @brief 整块解压。
+/// @param size 原始大小。
+/// @throw std::runtime_error 内容损坏或未编译zstd支持。
+std::string decompress(std::string_view input, size_t size);
+
+/// @brief 流式压缩，写入`output`。
+class Compressor {
+  public:
+    /// @param expected_size 预计的原始大小，只用于决定线程数；不记录在帧头中，
+    /// 实际写入的字节数可以与之不同（如读取时仍在增长的日志）。实际的大小由
+    /// `finish`记录在帧后的可跳过帧（skippable frame）中。
+    /// @param threads 不小于`MULTITHREAD_MIN_SIZE`的对象使用的工作线程数。
+    /// @throw std::runtime_error 未编译zstd支持。
+    Compressor(std::ostream &output, int level, ull expected_size,
+               int threads);
+    ~Compressor();
+    Compressor(const Compressor &) = delete;
+    Compressor &operator=(const Compressor &) = delete;
+
+    /// @throw std::runtime_error 压缩或写入失败。
+    void write(const char *data, size_t size);
+
+    /// @brief 结束帧，之后写入记录原始大小的可跳过帧。
+    /// @throw std::runtime_error 压缩或写入失败。
+    void finish();
+
+    /// @brief 压缩所用的CPU时间（纳秒）。只计调用线程，多线程压缩时不含zstd的
+    /// 工作线程。
+    ull get_cpu_ns() const { return cpu_ns; }
+
+    /// @brief 已写入的原始字节数。
+    ull get_size() const { return size; }
+
+  private:
+    void compress(const char *data, size_t size, bool end);
+
+    std::ostream &output;
+    void *context = nullptr;
+    std::string buffer;
+    ull cpu_ns = 0;
+    ull size = 0;
+};
+
+/// @brief 把zstd流`input`解压写入`output`。
+/// @throw std::runtime_error 内容损坏、读写失败或未编译zstd支持。
+void decompress_stream(std::istream &input, std::ostream &output);
+
+/// @brief 压缩文件的原始大小：取自帧头，帧头中没有记录（流式压缩）时取自
+/// `Compressor::finish`写在末尾的可跳过帧，不需要解压。
+/// @return 无法确定（内容损坏或截断）时为空。
+std::optional<ull> frame_content_size(const fs::path &path);
+
+/// @brief 当前线程已使用的CPU时间（纳秒）。
+ull thread_cpu_ns();
+
+/// @brief 一次运行的压缩统计，可由多个线程同时更新。
+class CompressionStats {
+  public:
+    /// @brief 记录一个对象。
+    /// @param size 原始大小。
+    /// @param stored 保存的字节数。
+    /// @param compressed 是否压缩（否则按原样保存）。
+    /// @param cpu_ns 判断与压缩所用的CPU时间。
+    void add(ull size, ull stored, bool compressed, ull cpu_ns);
+
+    ull get_objects(bool compressed) const {
+        return (compressed ? compressed_objects : raw_objects).load();
+    }
+    ull get_size() const { return size; }
+    ull get_stored() const { return stored; }
+    ull get_cpu_ns() const { return cpu_ns; }
+
+    /// @brief 形如"12 objects compressed, 3 stored raw, 10.00 MB -> 4.00 MB
+    /// (ratio 2.50), 0.12 s CPU"。
+    std::string summary() const;
+
+  private:
+    std::atomic<ull> compressed_objects = 0, raw_objects = 0;
+    std::atomic<ull> size = 0, stored = 0, cpu_ns = 0;
+};
+} // namespace compression
+#endif
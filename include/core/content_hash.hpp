@@ -0,0 +1,128 @@
+/// @file content_hash.hpp
+/// @brief 内容寻址使用的哈希算法。
+///
+/// 备份副本以内容的哈希值命名，保存在`PATH_BACKUP_COPIES`下。支持的算法：
+/// - `md5`：原有算法，副本名为32位十六进制数，已有的备份仓库保持可读；
+/// - `sha256`：OpenSSL在支持SHA-NI的CPU上自动使用硬件指令；
+/// - `blake2b`：BLAKE2b-512，无硬件加速时也明显快于MD5。
+///
+/// 除MD5外，副本名带有算法前缀（如`sha256-…`），不同算法的副本可共存于同一
+/// 仓库；清单中的每一项记录其使用的算法。树哈希（见tree_hash.hpp）的副本名为
+/// `算法-tree-…`，MD5也不例外。
+///
+/// 哈希值在内存中以定长的二进制`Digest`保存、比较和传递，只在副本名与清单中
+/// 转换为十六进制（`to_hex`、`from_hex`，每次处理16字节的向量实现）。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _CONTENT_HASH_HPP_
+#define _CONTENT_HASH_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "config.hpp"
+
+struct evp_md_ctx_st;
+
+namespace contenthash {
+using config::HashAlgorithm;
+
+/// @brief 二进制的哈希值，就地保存，不分配内存。
+class Digest {
+  public:
+    /// 最长的哈希值（BLAKE2b-512）的字节数。
+    static constexpr size_t MAX_SIZE = 64;
+
+    /// @brief 空的哈希值，表示尚未计算。
+    Digest() = default;
+    /// @throw std::length_error 超过`MAX_SIZE`字节。
+    Digest(const void *data, size_t size);
+    explicit Digest(std::string_view bytes)
+        : Digest(bytes.data(), bytes.size()) {}
+
+    const unsigned char *data() const { return bytes.data(); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    /// @brief 以字节串的形式访问。
+    std::string_view view() const {
+        return {reinterpret_cast<const char *>(bytes.data()), size_};
+    }
+
+    bool operator==(const Digest &other) const {
+        return size_ == other.size_ &&
+               std::memcmp(bytes.data(), other.bytes.data(), size_) == 0;
+    }
+
+  private:
+    std::array<unsigned char, MAX_SIZE> bytes{};
+    unsigned char size_ = 0;
+};
+
+/// @brief 增量计算一个哈希值。
+class Hasher {
+  public:
+    /// @throw std::runtime_error 无法初始化。
+    explicit Hasher(HashAlgorithm algorithm);
+    ~Hasher();
+    Hasher(const Hasher &) = delete;
+    Hasher &operator=(const Hasher &) = delete;
+
+    /// @brief 追加数据。
+    void update(const void *data, size_t size);
+
+    /// @brief 结束计算。
+    /// @return 哈希值，长度为`digest_size(algorithm)`。
+    /// @throw std::runtime_error 计算失败。
+    Digest final();
+
+  private:
+    evp_md_ctx_st *context;
+};
+
+/// @brief 哈希值的字节数。
+size_t digest_size(HashAlgorithm algorithm);
+
+/// @brief 算法名称："md5"、"sha256"或"blake2b"。
+const char *algorithm_name(HashAlgorithm algorithm);
+
+/// @brief 解析算法名称。
+/// @return 名称无效时返回false。
+bool parse_algorithm(const std::string &name, HashAlgorithm &algorithm);
+
+/// @brief 将二进制数据转换为大写十六进制字符串。
+std::string to_hex(std::string_view bytes);
+inline std::string to_hex(const Digest &digest) {
+    return to_hex(digest.view());
+}
+
+/// @brief 解析十六进制的哈希值，大小写均可。
+/// @return 长度为奇数、超过`Digest::MAX_SIZE`字节或含有非十六进制字符时返回
+/// false，此时`digest`不变。
+bool from_hex(std::string_view hex, Digest &digest);
+
+/// @brief 副本的文件名：MD5为十六进制哈希值，其余算法加上算法前缀。
+/// @param algorithm 算法。
+/// @param digest 哈希值。
+/// @param tree 是否为树哈希的根哈希值。
+std::string object_name(HashAlgorithm algorithm, const Digest &digest,
+                        bool tree = false);
+} // namespace contenthash
+
+/// 哈希值本身已均匀分布，取其前8个字节即可。
+template <> struct std::hash<contenthash::Digest> {
+    size_t operator()(const contenthash::Digest &digest) const noexcept {
+        unsigned long long value = 0;
+        std::memcpy(&value, digest.data(), sizeof(value));
+        return static_cast<size_t>(value);
+    }
+};
+#endif
@@ -0,0 +1,69 @@
+/// @file copy_engine.hpp
+/// @brief 复制整个文件，尽量避免经过用户空间。
+///
+/// 依次尝试以下方式（`CopyMethod`），前一种不被支持时退回后一种：
+/// - `REFLINK`：`ioctl(FICLONE)`，btrfs、XFS等文件系统上源与目标共享数据块，
+///   几乎不花时间；只能在同一文件系统内使用；
+/// - `COPY_FILE_RANGE`：`copy_file_range`，数据只在内核中搬运，NFS、SMB等可在
+///   服务器端完成；较旧的内核不支持跨文件系统；
+/// - `SENDFILE`：`sendfile`，同样不经过用户空间；
+/// - `BUFFERED`：`pread`/`pwrite`与缓冲区。
+///
+/// 后三种方式从前一种停下的位置继续。Windows下使用`std::filesystem::copy_file`，
+/// 记为`BUFFERED`。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _COPY_ENGINE_HPP_
+#define _COPY_ENGINE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+namespace copyengine {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+
+/// 复制所用的方式，按尝试的顺序排列。
+enum class CopyMethod { REFLINK, COPY_FILE_RANGE, SENDFILE, BUFFERED };
+
+/// 复制方式的数量。
+constexpr size_t COPY_METHOD_COUNT = 4;
+
+/// @brief 复制方式的名称，用于日志。
+const char *copy_method_name(CopyMethod method);
+
+/// @brief 把`from`复制为新文件`to`，权限与源文件相同。
+/// @return 完成复制的方式；一次复制中途换用其他方式时，返回最后一种。
+/// @throw std::runtime_error 目标已存在，或打开、读写失败；失败时删除已写入
+/// 一部分的目标。
+CopyMethod copy_file(const fs::path &from, const fs::path &to);
+
+/// @brief 目录`directory`所在的文件系统是否支持`REFLINK`：在其中创建两个临时
+/// 文件试一次`FICLONE`，之后删除。
+bool supports_reflink(const fs::path &directory);
+
+/// @brief 按复制方式统计文件数与字节数，可在多个线程中同时累加。
+class CopyStats {
+  public:
+    void add(CopyMethod method, ull size);
+
+    ull get_files(CopyMethod method) const;
+    ull get_bytes(CopyMethod method) const;
+
+    /// @brief 如“reflink 3 files (1.50 MB), buffered 1 files (0.01 MB)”，
+    /// 只列出用到的方式。
+    std::string summary() const;
+
+  private:
+    std::atomic<ull> files[COPY_METHOD_COUNT] = {};
+    std::atomic<ull> bytes[COPY_METHOD_COUNT] = {};
+};
+} // namespace copyengine
+#endif
@@ -0,0 +1,179 @@
+/// @file dir_scanner.hpp
+/// @brief 并行目录遍历引擎。
+///
+/// 使用`config::THREAD_NUM`个工作线程遍历若干根目录：每个工作线程拥有自己的
+/// 双端队列，从队尾取出待列举的目录（深度优先，局部性好），空闲时从其他线程
+/// 队列的队首窃取任务（广度优先，窃取到的子树更大）。
+///
+/// 在Linux下直接读取`getdents`返回的`d_type`判断条目类型，只对普通文件
+/// （及符号链接）调用一次`statx`，并据此直接构造`fileinfo::FileInfo`，
+/// 不再需要后续单独获取文件信息。每个目录项的名称只在`pathstore::arena()`中
+/// 保存一次，回调得到的是路径编号。
+///
+/// 同一目录下的`statx`以及子目录的`openat`通过`metadata::MetadataEngine`
+/// 批量执行（同步或io_uring）。预先打开的子目录在列举时直接`fdopendir`，省去
+/// 按完整路径逐级解析；同时打开的目录数不超过`config::SCANNER_MAX_OPEN_DIRECTORIES`。
+///
+/// 条目按`exclude::ExcludeEngine`的规则（内置规则、`config::EXCLUDE_PATTERNS`
+/// 以及遍历中遇到的`.backupignore`文件）过滤，被排除的目录不会被打开。
+///
+/// 设置了目录快照（见`snapshot::DirectorySnapshot`）时，每个目录先`statx`
+/// 自身：mtime和ctime与上次记录一致的目录直接复用上次的子项列表，不再列举。
+/// 同时把本次的记录写入新的快照。快照仅在Linux下使用。
+///
+/// 发现的目录和文件通过回调交给调用者，回调参数中带有工作线程编号，
+/// 调用者可以按线程分别收集结果而无需加锁。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _DIR_SCANNER_HPP_
+#define _DIR_SCANNER_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "dir_snapshot.hpp"
+#include "exclude.hpp"
+#include "file_info.hpp"
+
+namespace scanner {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+
+/// @brief 一次遍历的统计信息。
+struct ScanStats {
+    ull directories = 0; /// 列举过的目录数量
+    ull entries = 0;     /// 遍历到的目录项数量
+    ull files = 0;       /// 交给回调的普通文件数量
+    ull stat_calls = 0;  /// 获取元数据的系统调用次数
+    ull reused_directories = 0; /// 复用快照中子项列表的目录数量
+    double seconds = 0;  /// 遍历耗时（秒）
+    std::string engine;  /// 元数据引擎名称
+};
+
+#ifndef _WIN32
+/// @brief 获取目录项的类型（`DT_REG`、`DT_DIR`等）。
+/// @param type `getdents`返回的`d_type`，少数文件系统不填写而为`DT_UNKNOWN`，
+/// 此时改用`fstatat`获取（不跟随符号链接），并计入`stat_calls`。
+/// @return 条目类型，`fstatat`失败时为`DT_UNKNOWN`。
+unsigned char entry_type(int directory_fd, const char *name,
+                         unsigned char type, ull &stat_calls);
+#endif
+
+/// @brief 基于工作窃取的并行目录遍历器。
+class DirectoryScanner {
+  public:
+    /// @brief 发现目录时的回调，参数为工作线程编号和目录的路径编号。
+    using DirectoryCallback = std::function<void(int, pathstore::PathId)>;
+    /// @brief 发现普通文件时的回调，参数为工作线程编号和已填好元数据的文件信息。
+    using FileCallback = std::function<void(int, fileinfo::FileInfo &&)>;
+
+    /// @brief 构造函数。
+    /// @param thread_num 工作线程数量，小于1时按1处理。
+    /// @param use_io_uring 是否使用io_uring引擎批量获取元数据；不可用时退回同步引擎。
+    DirectoryScanner(int thread_num, bool use_io_uring = false);
+
+    ~DirectoryScanner();
+
+    /// @brief 设置目录快照，在`scan`之前调用。
+    /// @param previous 上次遍历的快照，为nullptr时不复用。
+    /// @param current [out] 记录本次遍历的快照，为nullptr时不记录。
+    /// @param trust_file_stats 快速增量模式：复用目录时连同文件的大小和修改时间
+    /// 一起复用，不再`statx`。目录未变而文件内容被原地修改时，修改不会被发现。
+    void set_snapshots(const snapshot::DirectorySnapshot *previous,
+                       snapshot::DirectorySnapshot *current,
+                       bool trust_file_stats = false);
+
+    /// @brief 遍历给定的根目录，阻塞直到所有子目录都被列举完。
+    /// @param roots 根目录，应当是互不包含的规范路径。
+    /// @param on_directory 每个目录（包括根目录）调用一次。
+    /// @param on_file 每个普通文件调用一次。
+    /// @details 被排除规则屏蔽的条目会被跳过；不跟随指向目录的
+    /// 符号链接，以免在并行遍历中出现环。
+    void scan(const std::vector<fs::path> &roots,
+              const DirectoryCallback &on_directory,
+              const FileCallback &on_file);
+
+    /// @brief 获取最近一次遍历的统计信息。
+    const ScanStats &get_stats() const { return stats; }
+
+    /// @brief 获取工作线程数量。
+    int get_thread_num() const { return thread_num; }
+
+    /// @brief 获取排除规则引擎，可用于报告各规则的命中次数。
+    const exclude::ExcludeEngine &get_exclude_engine() const {
+        return *exclude_engine;
+    }
+
+  private:
+    /// @brief 待列举的目录。
+    struct PendingDirectory {
+        fs::path path;
+        pathstore::PathId id;
+        int fd = -1; /// 已预先打开时为目录的文件描述符
+        std::shared_ptr<const exclude::MatchState> exclude_state;
+    };
+
+    /// @brief 工作线程私有的状态：元数据引擎和可复用的缓冲区。
+    struct WorkerState;
+
+    /// @brief 单个工作线程的任务队列。
+    struct WorkerQueue {
+        std::deque<PendingDirectory> directories;
+        std::mutex mutex;
+    };
+
+    /// @brief 工作线程主循环。
+    void worker_loop(int id, const DirectoryCallback &on_directory,
+                     const FileCallback &on_file);
+
+    /// @brief 将目录压入第`id`个工作线程的队列。
+    void push(int id, PendingDirectory directory);
+
+    /// @brief 从自己的队尾取出目录，失败时从其他线程的队首窃取。
+    bool pop_or_steal(int id, PendingDirectory &directory);
+
+    /// @brief 唤醒等待任务的工作线程。
+    /// @param all 是否唤醒全部（遍历结束时）。
+    void wake_idle(bool all);
+
+    /// @brief 列举一个目录。
+    void list_directory(int id, const PendingDirectory &directory,
+                        const DirectoryCallback &on_directory,
+                        const FileCallback &on_file);
+
+    int thread_num;
+    bool use_io_uring;
+    const snapshot::DirectorySnapshot *previous_snapshot;
+    snapshot::DirectorySnapshot *current_snapshot;
+    bool trust_file_stats;
+    std::unique_ptr<exclude::ExcludeEngine> exclude_engine;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::unique_ptr<WorkerState>> worker_states;
+    std::atomic<int> open_directory_fds; /// 预先打开的目录数量
+    std::atomic<ull> pending;     /// 已入队但尚未列举完成的目录数量
+    std::atomic<ull> queued;      /// 在队列中等待列举的目录数量
+    /// 没有目录可取的工作线程在此等待，有目录入队或遍历结束时被唤醒
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+    std::atomic<int> idle_workers; /// 正在等待的工作线程数量
+    std::atomic<ull> directories; /// 统计：目录数量
+    std::atomic<ull> entries;     /// 统计：目录项数量
+    std::atomic<ull> files;       /// 统计：文件数量
+    std::atomic<ull> stat_calls;  /// 统计：元数据系统调用次数
+    std::atomic<ull> reused_directories; /// 统计：复用快照的目录数量
+    ScanStats stats;
+};
+} // namespace scanner
+#endif
@@ -0,0 +1,112 @@
+/// @file dir_snapshot.hpp
+/// @brief 目录快照索引：记录每个目录的修改时间和子项列表，供下次备份复用。
+///
+/// 每次遍历为每个目录记录(路径, mtime, ctime, 子项列表)，与`directories.json`
+/// 一起保存在备份数据目录中。下次遍历时，若某目录的mtime和ctime都未变化，则其
+/// 子项集合也未变化（增删、重命名子项都会更新目录的mtime），可以直接复用上次的
+/// 子项列表而不必重新列举；文件的元数据仍重新获取，或在信任快照的“快速增量”模式下
+/// 也直接复用。
+///
+/// 为避免时间戳精度带来的误判，修改时间不早于上次遍历开始时间的目录不被复用。
+/// 记录的是排除规则生效之前的子项列表，规则改变后快照仍然有效。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _DIR_SNAPSHOT_HPP_
+#define _DIR_SNAPSHOT_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace snapshot {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+
+/// 子项类型。
+enum class ChildKind : uint8_t {
+    DIRECTORY, /// 子目录
+    FILE,      /// 普通文件（或指向普通文件的符号链接）
+    OTHER,     /// 被排除、获取元数据失败或不是普通文件，快速增量模式下重新获取
+};
+
+/// @brief 目录中的一个子项。
+struct ChildEntry {
+    uint32_t name_offset;  /// 名称在`DirectoryRecord::names`中的偏移
+    ChildKind kind;        /// 子项类型
+    int64_t modified_time; /// 文件的修改时间，仅对`FILE`有效
+    ull file_size;         /// 文件大小，仅对`FILE`有效
+    ull inode;             /// inode号，仅对`FILE`有效
+    uint32_t link_count;   /// 硬链接数，仅对`FILE`有效
+    uint32_t modified_nsec = 0; /// 修改时间的纳秒部分，仅对`FILE`有效
+    int64_t change_time = 0;    /// 文件的状态改变时间，仅对`FILE`有效
+    uint32_t change_nsec = 0;   /// 状态改变时间的纳秒部分，仅对`FILE`有效
+};
+
+/// @brief 一个目录的记录。
+struct DirectoryRecord {
+    int64_t mtime_sec = 0;
+    uint32_t mtime_nsec = 0;
+    int64_t ctime_sec = 0;
+    uint32_t ctime_nsec = 0;
+    std::string names; /// 子项名称，以'\0'分隔
+    std::vector<ChildEntry> children;
+
+    /// @brief 获取子项名称。
+    const char *name_of(const ChildEntry &child) const {
+        return names.data() + child.name_offset;
+    }
+};
+
+/// @brief 一次遍历得到的全部目录记录。
+class DirectorySnapshot {
+  public:
+    DirectorySnapshot() : created_time(0) {}
+
+    /// @brief 从文件载入。
+    /// @return 文件不存在、损坏或版本不符时返回false，此时快照为空。
+    bool load(const fs::path &file);
+
+    /// @brief 保存到文件。
+    /// @return 写入失败时返回false。
+    bool save(const fs::path &file) const;
+
+    /// @brief 查找目录的记录。
+    /// @param path 目录的完整路径（UTF-8）。
+    /// @return 不存在时返回nullptr。
+    const DirectoryRecord *find(const std::u8string &path) const;
+
+    /// @brief 判断目录自记录以来是否未变化，即可以复用子项列表。
+    /// @param record 上次的记录。
+    /// @param current 目录当前的时间戳，只使用其中的mtime和ctime。
+    bool is_unchanged(const DirectoryRecord &record,
+                      const DirectoryRecord &current) const;
+
+    /// @brief 插入或替换目录的记录。
+    void insert(std::u8string path, DirectoryRecord record);
+
+    /// @brief 保留`previous`中不在任何`roots`之下的记录，使仅备份部分目录时，
+    /// 其他目录的记录可以传给再下一次备份。
+    void merge_outside(const DirectorySnapshot &previous,
+                       const std::vector<fs::path> &roots);
+
+    /// @brief 遍历开始的时间（自纪元起的秒数）。
+    int64_t get_created_time() const { return created_time; }
+    void set_created_time(int64_t time) { created_time = time; }
+
+    /// @brief 获取记录数量。
+    size_t size() const { return records.size(); }
+
+  private:
+    std::unordered_map<std::u8string, DirectoryRecord> records;
+    int64_t created_time;
+};
+} // namespace snapshot
+#endif
@@ -0,0 +1,165 @@
+/// @file exclude.hpp
+/// @brief 排除规则引擎：gitignore语义的通配符模式。
+///
+/// 规则来自三处，优先级依次升高（后定义的规则覆盖先定义的）：
+/// - 内置的`config::IGNORED_PATH`；
+/// - 命令行`--exclude`给出的模式，相对于每个根目录；
+/// - 遍历时发现的`.backupignore`文件，相对于该文件所在的目录，越深的文件优先级越高。
+///
+/// 模式的语义与`.gitignore`一致：`#`开头为注释；`!`开头表示重新包含；以`/`结尾
+/// 只匹配目录；除结尾外含有`/`的模式相对于规则所在目录锚定，否则匹配任意深度的
+/// 名称；支持`*`、`?`、`[...]`和`**`。被排除的目录在列举之前即被剪除，其中的内容
+/// 不会被重新包含。
+///
+/// 每个规则来源（一组规则）把所有分量的通配符编译为一个位并行的NFA，匹配一个路径
+/// 分量只需扫描一遍名称，即可同时得到所有通配符的匹配结果。遍历时每个目录携带一个
+/// `MatchState`，记录各规则已匹配到第几个分量；子目录的状态由父目录的状态推出，
+/// 与父目录相同时共享同一对象。
+///
+/// 匹配按字节进行，`?`匹配一个字节而非一个UTF-8字符。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _EXCLUDE_HPP_
+#define _EXCLUDE_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace exclude {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+
+/// @brief 一组规则（一个规则来源），编译为一个自动机。不可变，可被多线程共享。
+class RuleSet {
+  public:
+    /// @brief 编译规则。
+    /// @param lines 规则文本，每行一个，按gitignore的规则忽略空行和注释。
+    /// @param source 规则来源，用于报告。
+    RuleSet(const std::vector<std::string> &lines, std::string source);
+
+    /// @brief 从文件读取并编译规则。
+    /// @return 文件无法读取或不含任何规则时返回nullptr。
+    static std::shared_ptr<RuleSet> load(const fs::path &file);
+
+    /// @brief 规则数量。
+    size_t size() const { return rules.size(); }
+
+    /// @brief 规则来源。
+    const std::string &get_source() const { return source; }
+
+    /// @brief 第`i`条规则的原始文本。
+    const std::string &get_pattern(size_t i) const { return rules[i].pattern; }
+
+    /// @brief 第`i`条规则决定了多少个条目的去留。
+    ull get_hits(size_t i) const {
+        return rules[i].hits.load(std::memory_order_relaxed);
+    }
+
+  private:
+    friend class ExcludeEngine;
+
+    /// 表示`**`分量的通配符编号。
+    static constexpr uint32_t DOUBLE_STAR = UINT32_MAX;
+
+    struct Rule {
+        std::string pattern;
+        std::vector<uint32_t> components; /// 各分量的通配符编号或`DOUBLE_STAR`
+        bool negated = false;
+        bool directory_only = false;
+        mutable std::atomic<ull> hits = 0;
+
+        Rule() = default;
+        Rule(Rule &&other) noexcept
+            : pattern(std::move(other.pattern)),
+              components(std::move(other.components)), negated(other.negated),
+              directory_only(other.directory_only), hits(other.hits.load()) {}
+    };
+
+    /// @brief 用自动机匹配名称。
+    /// @param name 路径分量。
+    /// @param matched [out] 按通配符编号的位集，匹配的位被置1。
+    void match(std::string_view name, std::vector<uint64_t> &matched) const;
+
+    std::vector<Rule> rules;
+    std::string source;
+
+    // Bit-parallel NFA over all globs: bit `i` is state `i`; each glob of `n`
+    // tokens owns `n + 1` consecutive states, the last one accepting.
+    size_t state_count = 0;
+    std::vector<uint64_t> char_masks; /// 256个掩码，状态i的token接受该字节
+    std::vector<uint64_t> star_mask;  /// token为`*`的状态
+    std::vector<uint64_t> start_mask; /// 各通配符的初始状态
+    std::vector<uint32_t> accept_states; /// 各通配符的接受状态
+};
+
+/// @brief 一个目录的匹配状态：各规则下一个待匹配的分量。不可变。
+class MatchState {
+  public:
+    struct Active {
+        uint32_t rule;      /// 规则编号
+        uint32_t component; /// 下一个待匹配的分量
+        bool operator==(const Active &) const = default;
+    };
+    /// 同一规则来源中的活跃项，组按优先级从低到高排列。
+    struct Group {
+        std::shared_ptr<const RuleSet> rule_set;
+        std::vector<Active> active;
+        bool operator==(const Group &) const = default;
+    };
+
+    std::vector<Group> groups;
+};
+
+/// @brief 排除规则引擎。
+class ExcludeEngine {
+  public:
+    /// @brief 构造函数。
+    /// @param patterns 命令行给出的模式。
+    explicit ExcludeEngine(const std::vector<std::string> &patterns);
+
+    /// @brief 根目录的匹配状态。
+    std::shared_ptr<const MatchState> root_state() const { return root; }
+
+    /// @brief 判断目录中的一个条目是否被排除。
+    /// @param state 所在目录的匹配状态。
+    /// @param name 条目名称。
+    /// @param is_directory 条目是否为目录。
+    /// @param child_state [out] 条目是未被排除的目录时，设为其匹配状态。
+    /// @return 被排除时返回true。
+    bool is_excluded(const std::shared_ptr<const MatchState> &state,
+                     std::string_view name, bool is_directory,
+                     std::shared_ptr<const MatchState> *child_state) const;
+
+    /// @brief 读取目录中的规则文件，返回追加了其规则的匹配状态。
+    /// @param state 目录的匹配状态。
+    /// @param file 规则文件的路径。
+    /// @return 文件无法读取或为空时返回`state`本身。
+    std::shared_ptr<const MatchState>
+    with_ignore_file(const std::shared_ptr<const MatchState> &state,
+                     const fs::path &file);
+
+    /// @brief 记录每条规则的命中次数。
+    void report() const;
+
+  private:
+    /// @brief 把规则集的全部规则以第0个分量加入组中。
+    static MatchState::Group start_group(std::shared_ptr<const RuleSet> set);
+
+    std::shared_ptr<const MatchState> root;
+    /// 所有规则集，用于报告
+    std::vector<std::shared_ptr<const RuleSet>> rule_sets;
+    mutable std::mutex mutex; /// 保护rule_sets
+};
+} // namespace exclude
+#endif
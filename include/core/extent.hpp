@@ -0,0 +1,39 @@
+/// @file extent.hpp
+/// @brief 查询文件数据在磁盘上的物理位置，用于按物理顺序调度读取。
+///
+/// 在机械硬盘上按遍历顺序读取文件相当于随机读，多个线程同时读取会使磁头来回
+/// 移动。按文件第一个extent的物理偏移排序后读取，可以把随机读变为近似顺序的扫描。
+///
+/// Linux下使用`FS_IOC_FIEMAP`查询；文件系统不支持（如tmpfs、网络文件系统）或
+/// 文件没有数据时，退回使用inode号作为近似（多数文件系统按inode号顺序分配数据）。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _EXTENT_HPP_
+#define _EXTENT_HPP_
+
+#include <filesystem>
+
+namespace extent {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+
+/// @brief 排序键：先按是否取得物理偏移，再按偏移或inode号。
+struct PhysicalKey {
+    bool approximate = true; /// 未取得物理偏移，`position`为inode号
+    ull position = 0;
+
+    auto operator<=>(const PhysicalKey &) const = default;
+};
+
+/// @brief 查询文件第一个extent的物理偏移。
+/// @param path 文件路径。
+/// @param inode 文件的inode号，查询失败时用作近似。
+/// @return 排序键。
+PhysicalKey physical_key(const fs::path &path, ull inode);
+} // namespace extent
+#endif
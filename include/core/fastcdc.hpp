@@ -0,0 +1,87 @@
+/// @file fastcdc.hpp
+/// @brief FastCDC内容定义分块：按内容而非固定偏移切分数据。
+///
+/// 切点由最近64个字节的gear哈希决定，文件中间插入或删除数据只影响附近的块，
+/// 其余块的内容和摘要不变，适合体积大、每次只改动一小部分的文件（数据库转储、
+/// 虚拟机镜像、邮箱）。采用归一化分块：块长度小于平均值时使用更严格的掩码，
+/// 超过平均值后使用更宽松的掩码，使块长度集中在平均值附近。
+///
+/// 每个位置的哈希只依赖最近64个字节，可以把一段数据分成几个通道同时扫描：
+/// 各通道的哈希链互不依赖，CPU可以重叠它们的延迟；结果与逐字节扫描完全相同。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _FASTCDC_HPP_
+#define _FASTCDC_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace fastcdc {
+/// 块的最小长度。
+constexpr size_t MIN_CHUNK_SIZE = 1 << 18;
+/// 块的平均长度，须为2的幂。
+constexpr size_t AVERAGE_CHUNK_SIZE = 1 << 20;
+/// 块的最大长度，到达后强制切分。
+constexpr size_t MAX_CHUNK_SIZE = 1 << 22;
+
+/// gear哈希的窗口长度：每个位置的哈希只依赖最近这么多字节。
+constexpr size_t WINDOW_SIZE = 64;
+
+/// @brief 块长度的参数。
+struct Params {
+    size_t min_size = MIN_CHUNK_SIZE;
+    size_t average_size = AVERAGE_CHUNK_SIZE;
+    size_t max_size = MAX_CHUNK_SIZE;
+};
+
+/// @brief 查找第一个满足`(hash & mask) == 0`的位置。
+/// @param data 数据，`data[begin - WINDOW_SIZE + 1, end)`须可读。
+/// @param begin 开始检查的位置，不小于`WINDOW_SIZE - 1`。
+/// @param end 结束位置（不含）。
+/// @return 位置`i`：其哈希覆盖`data[i - 63, i]`；没有时返回`end`。
+size_t scan(const unsigned char *data, size_t begin, size_t end,
+            unsigned long long mask);
+
+/// @brief `scan`的单通道实现，用于测试与性能比较。
+size_t scan_scalar(const unsigned char *data, size_t begin, size_t end,
+                   unsigned long long mask);
+
+/// @brief 计算一个块的长度。
+/// @param data 从块的开头开始的数据。
+/// @param size `data`的字节数；不足`max_size`时视为数据在此结束。
+/// @return 块的长度，不超过`size`。
+size_t cut(const unsigned char *data, size_t size, const Params &params = {});
+
+/// @brief 流式分块：逐段写入数据，每确定一个块就调用回调。
+class Chunker {
+  public:
+    /// 回调的参数只在调用期间有效。
+    using Callback = std::function<void(std::string_view chunk)>;
+
+    /// @throw std::invalid_argument 参数不满足`WINDOW_SIZE <= min <= average
+    /// <= max`或平均长度不是2的幂。
+    explicit Chunker(const Params &params = {});
+
+    void update(const char *data, size_t size, const Callback &on_chunk);
+
+    /// @brief 输出剩余的数据，之后可以开始新的数据。
+    void finish(const Callback &on_chunk);
+
+  private:
+    /// @brief 输出已能确定的块；`end`时输出全部数据。
+    void emit(bool end, const Callback &on_chunk);
+
+    Params params;
+    std::string buffer;
+    /// 已输出的字节数，之后的数据为当前块。
+    size_t start = 0;
+};
+} // namespace fastcdc
+#endif
@@ -2,7 +2,7 @@
 /// @brief 该文件声明了用于处理文件信息的类和函数。
 /// 
 /// 这个模块包含以下主要功能：
-/// - 描述文件信息，包括文件名及路径、修改时间、文件大小和 MD5 校验值。
+/// - 描述文件信息，包括文件名及路径、修改时间、文件大小和内容哈希值。
 /// 
 /// 该模块依赖于以下其他模块：
 /// - config.hpp: 配置相关的功能。
@@ -30,7 +30,9 @@
 #pragma GCC diagnostic pop
 
 #include "config.hpp"
+#include "content_hash.hpp"
 #include "env.hpp"
+#include "path_store.hpp"
 #include "print.hpp"
 
 namespace fileinfo {
@@ -44,32 +46,125 @@ typedef unsigned long long ull;
 /// @return 转换后的时间，格式为 std::time_t。
 time_t file_time_type2time_t(fs::file_time_type ftime);
 
-/// @brief: 描述文件信息：文件名及路径、修改时间、文件大小、md5校验值
+/// @brief 将 filesystem::file_time_type 转换为自1970年起的纳秒数。
+long long file_time_type2ns(fs::file_time_type ftime);
+
+/// @brief: 描述文件信息：文件名及路径、修改时间、文件大小、内容哈希值
+/// @details 路径以`pathstore::PathId`的形式保存在`pathstore::arena()`中，需要时再重建。
+/// 修改时间与状态改变时间（ctime）精确到纳秒，与设备号、inode号一起用于判断文件
+/// 是否变化（见`metadata_matches`）；取不到时为`0`，比较时忽略。
 class FileInfo {
     friend void from_json(const json &j, FileInfo &f);
     friend void to_json(json &j, const FileInfo &f);
-    friend void calculate_md5_value(FileInfo &);
+    friend void calculate_hash_value(FileInfo &);
 
   public:
     /// @brief 默认构造函数，将文件大小初始化为 0。
-    FileInfo() : file_size(0) {}
+    FileInfo()
+        : path_id(pathstore::INVALID_PATH_ID), modified_time_ns(0),
+          change_time_ns(0), file_size(0), device(0), inode(0), link_count(1),
+          hash_algorithm(config::HashAlgorithm::MD5), tree_chunk_size(0) {}
 
     /// @brief 为给定路径构造一个 FileInfo 对象。
-    /// @details 初始化文件的路径、修改时间、大小和 MD5 值。如果文件不存在，记录错误信息并设置默认值。
+    /// @details 驻留路径，初始化文件的修改时间和大小。如果文件不存在，记录错误信息并设置默认值。
     /// @param path 文件的路径。
     FileInfo(const fs::path &path);
 
-    const fs::path &get_path() const { return path; }
-    const time_t &get_modified_time() const { return modified_time; }
+    /// @brief 使用已驻留的路径和已获取的元数据构造 FileInfo 对象，不访问文件系统。
+    /// @param path_id 文件路径在`pathstore::arena()`中的编号。
+    /// @param modified_time 修改时间（秒），更精确的时间由`set_times`设置。
+    /// @param file_size 文件大小。
+    FileInfo(pathstore::PathId path_id, time_t modified_time, ull file_size)
+        : path_id(path_id), modified_time_ns(modified_time * NS_PER_SECOND),
+          change_time_ns(0), file_size(file_size), device(0), inode(0),
+          link_count(1),
+          hash_algorithm(config::HashAlgorithm::MD5), tree_chunk_size(0) {}
+
+    /// @brief 重建文件的完整路径。
+    fs::path get_path() const { return pathstore::arena().get_path(path_id); }
+    pathstore::PathId get_path_id() const { return path_id; }
+    /// @brief 修改时间，向下取整到秒。
+    time_t get_modified_time() const {
+        return static_cast<time_t>(
+            modified_time_ns >= 0
+                ? modified_time_ns / NS_PER_SECOND
+                : -((-modified_time_ns + NS_PER_SECOND - 1) / NS_PER_SECOND));
+    }
+    /// @brief 自1970年起的修改时间（纳秒）。
+    long long get_modified_time_ns() const { return modified_time_ns; }
+    /// @brief 自1970年起的状态改变时间（纳秒），未知时为`0`。
+    long long get_change_time_ns() const { return change_time_ns; }
     const ull &get_file_size() const { return file_size; }
-    const string &get_md5_value() const { return md5_value; }
+    /// @brief 内容哈希值，未计算时为空。
+    const contenthash::Digest &get_hash_value() const { return hash_value; }
+    config::HashAlgorithm get_hash_algorithm() const { return hash_algorithm; }
+    /// @brief 树哈希的块大小，`0`表示哈希值按整个文件计算（见tree_hash.hpp）。
+    ull get_tree_chunk_size() const { return tree_chunk_size; }
+    /// @brief 副本在`PATH_BACKUP_COPIES`中的文件名。
+    /// @details 分块保存的文件没有整个文件的副本，见`get_chunk_object_names`。
+    string get_object_name() const {
+        return contenthash::object_name(hash_algorithm, hash_value,
+                                        tree_chunk_size != 0);
+    }
+    /// @brief 分块保存时各块的哈希值（见fastcdc.hpp），依次拼接即为文件内容；
+    /// 为空表示副本为整个文件。
+    const vector<contenthash::Digest> &get_chunks() const { return chunks; }
+    /// @brief 各块副本的文件名，与`get_chunks`一一对应。
+    vector<string> get_chunk_object_names() const {
+        vector<string> names;
+        names.reserve(chunks.size());
+        for (const auto &chunk : chunks)
+            names.push_back(contenthash::object_name(hash_algorithm, chunk));
+        return names;
+    }
+
+    /// @brief 设置文件所在的设备号、inode号和硬链接数（遍历时由`statx`得到）。
+    /// @details 未设置时硬链接数为1，即不参与按inode去重。
+    void set_identity(ull device, ull inode, unsigned link_count) {
+        this->device = device, this->inode = inode,
+        this->link_count = link_count;
+    }
+    /// @brief 设置纳秒精度的修改时间与状态改变时间（遍历时由`statx`得到）。
+    void set_times(long long modified_time_ns, long long change_time_ns) {
+        this->modified_time_ns = modified_time_ns,
+        this->change_time_ns = change_time_ns;
+    }
+    /// @brief 设置哈希值，用于与已计算的文件共享inode的硬链接。
+    void set_hash_value(config::HashAlgorithm algorithm,
+                        const contenthash::Digest &digest,
+                        ull tree_chunk_size = 0) {
+        hash_algorithm = algorithm, hash_value = digest;
+        this->tree_chunk_size = tree_chunk_size;
+    }
+    /// @brief 设置分块保存时各块的哈希值，算法与整个文件的相同。
+    void set_chunks(vector<contenthash::Digest> chunks) {
+        this->chunks = std::move(chunks);
+    }
+
+    ull get_device() const { return device; }
+    ull get_inode() const { return inode; }
+    unsigned get_link_count() const { return link_count; }
 
   private:
-    fs::path path;
-    time_t modified_time;
+    static constexpr long long NS_PER_SECOND = 1000000000;
+
+    pathstore::PathId path_id;
+    long long modified_time_ns;
+    long long change_time_ns;
     ull file_size;
+    ull device;
+    ull inode;
+    unsigned link_count;
 
-    string md5_value;
+    config::HashAlgorithm hash_algorithm;
+    ull tree_chunk_size;
+    contenthash::Digest hash_value;
+    vector<contenthash::Digest> chunks;
 };
+
+/// @brief 文件当前的元数据是否与记录一致。
+/// @details 比较大小、纳秒精度的修改时间，以及记录中不为`0`的状态改变时间、设备号
+/// 与inode号。读取元数据失败时返回false。
+bool metadata_matches(const FileInfo &file);
 } // namespace fileinfo
 #endif //_FILEINFO_H_
\ No newline at end of file
@@ -1,10 +1,22 @@
 /// @file file_info_md5.hpp
-/// @brief 该头文件声明了与文件信息和MD5计算相关的函数。这些函数用于初始化系统、更新缓存的MD5数据以及计算文件的MD5值。
+/// @brief 该头文件声明了与文件信息和哈希计算相关的函数。这些函数用于初始化系统、更新缓存的哈希值以及计算文件的哈希值。
 /// 
 /// 它包括以下主要功能：
-/// - `init()`: 初始化系统，加载必要的配置和缓存的MD5数据（如果可用）。
-/// - `update_cached_md5()`: 更新缓存中的当前MD5值。
-/// - `calculate_md5_value(FileInfo &file)`: 计算给定文件的MD5值并相应地进行更新。
+/// - `init()`: 初始化系统，加载必要的配置和缓存的哈希值（如果可用）。
+/// - `update_cached_hash()`: 写出缓存的日志并等待后台合并结束。
+/// - `calculate_hash_value(FileInfo &file)`: 用`config::HASH_ALGORITHM`计算给定文件的哈希值并相应地进行更新。
+/// - `calculate_hash_values(files)`: 批量计算，小文件的MD5用多缓冲区实现同时计算（见md5_multi.hpp）。
+///
+/// 给出副本目录时，需要读取的文件只读取一次：内容在计算哈希值的同时写入副本
+/// （见object_store.hpp）。小文件的内容留在内存中，得到哈希值后追加到pack；
+/// 其余文件写入`PARTIAL_OBJECTS_DIRECTORY`中的临时文件，得到哈希值后改名为副本名，
+/// 副本已存在时删除临时文件；但源文件与副本目录在同一设备上、不压缩且文件系统
+/// 支持reflink时只计算哈希值，由调用者用`ObjectStore::import`复制（见copy_engine.hpp）。启用`config::CHUNKED_STORAGE`时，不小于
+/// `CHUNKED_MIN_SIZE`的文件按内容定义分块（见fastcdc.hpp），每块以自己的哈希值为
+/// 副本名保存，已有的块不再写入：只改动一小部分的大文件只增加改动处的块。
+///
+/// 缓存按算法分文件保存（见hash_store.hpp），启动时映射而不读入内存，新增的项
+/// 在运行中陆续写入日志。
 /// 
 /// 该模块依赖于`file_info.hpp`，并且所有函数和类都位于`file_info`命名空间中。
 //
@@ -16,17 +28,49 @@
 #ifndef _FILE_INFO_MD5_HPP_
 #define _FILE_INFO_MD5_HPP_
 
+#include <exception>
+#include <span>
+#include <vector>
+
 #include "file_info.hpp"
+#include "object_store.hpp"
 
 namespace fileinfo {
-/// @brief 初始化系统，加载必要的配置并加载缓存的MD5数据（如果可用）。
+/// @brief 初始化系统，加载必要的配置并加载缓存的哈希值（如果可用）。
 void init();
 
-/// @brief 更新缓存中的当前MD5值。
-void update_cached_md5();
+/// @brief 写出缓存中尚未保存的哈希值，等待后台合并结束。失败时仅记录警告。
+/// @details 本次用到了块列表时，删除本次既未读取也未写入的块列表（已删除或
+/// 不再分块保存的文件的列表），因此应在整个备份完成后调用。
+void update_cached_hash();
+
+/// @brief 计算给定文件的哈希值并相应地进行更新。
+/// @details 启用`config::TREE_HASH`时，不小于`TREE_HASH_MIN_SIZE`的文件由多个
+/// 线程按块计算树哈希（见tree_hash.hpp），这类文件不在计算时写入副本。分块保存
+/// 优先于树哈希；分块保存的文件的块列表保存在缓存目录中，文件未变化且各块都在
+/// 副本目录中时不再读取。
+/// @param [in,out] file 需要计算其哈希值的FileInfo对象。
+/// @param store 副本目录，为空时只计算哈希值。
+/// @return 副本是否已在计算时写好（或已存在）；为false时需另行复制。
+bool calculate_hash_value(FileInfo &file,
+                          objectstore::ObjectStore *store = nullptr);
+
+/// @brief 一个文件的批量计算结果。
+struct HashResult {
+    std::exception_ptr error; /// 计算失败时为其异常
+    bool stored = false;      /// 副本是否已在计算时写好（或已存在）
+    ull new_chunks = 0;       /// 分块保存时新写入的块数（已存在的块不计）
+    ull new_chunk_bytes = 0;  /// 分块保存时新写入的块的字节数
+};
 
-/// @brief 计算给定文件的MD5值并相应地进行更新。
-/// @param [in,out] file 需要计算其MD5值的FileInfo对象。
-void calculate_md5_value(FileInfo &file);
+/// @brief 批量计算一组文件的哈希值。
+/// @details 算法为MD5时，不超过`SMALL_FILE_SIZE`的文件被整个读入内存，按大小
+/// 排序后每`md5multi::LANES`个同时计算；其余文件逐个计算。
+/// @param [in,out] files 需要计算哈希值的FileInfo对象。
+/// @param store 副本目录，为空时只计算哈希值。
+/// @return 与`files`一一对应。
+std::vector<HashResult>
+calculate_hash_values(std::span<FileInfo> files,
+                      objectstore::ObjectStore *store = nullptr);
 } // namespace fileinfo
 #endif
\ No newline at end of file
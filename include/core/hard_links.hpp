@@ -0,0 +1,81 @@
+/// @file hard_links.hpp
+/// @brief 按(设备号, inode号)对硬链接分组，同一inode只读取一次。
+///
+/// 每个inode只由最先到达的路径（领头者）计算哈希值并复制，其余路径等待领头者
+/// 的副本写好后直接使用其哈希值，不再读取文件。硬链接数为1的文件不登记。
+///
+/// 所有链接都已登记且领头者已完成时，分组即被删除。链接不全在备份范围内的分组
+/// 等不到其余的链接，由`close`在不再有文件登记时释放。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _HARD_LINKS_HPP_
+#define _HARD_LINKS_HPP_
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "file_info.hpp"
+
+namespace hardlinks {
+typedef unsigned long long ull;
+
+/// @brief 按inode分组的硬链接。
+/// @details 各函数可由多个线程同时调用。
+class HardLinkGroups {
+  public:
+    /// @brief 放行一个等待中的路径，哈希值已从领头者复制；第二个参数表示领头者
+    /// 是否成功。
+    using Release = std::function<void(fileinfo::FileInfo &&, bool)>;
+
+    /// @param release 放行一个等待中的路径，在调用`join`或`finish`的线程中调用。
+    explicit HardLinkGroups(Release release)
+        : release(std::move(release)), saved_reads(0), saved_bytes(0) {}
+
+    /// @brief 登记一个文件。
+    /// @return true表示调用者是领头者，需计算并复制，然后调用`finish`；
+    /// false表示文件已被接管（此时`file`已被移走）。
+    bool join(fileinfo::FileInfo &file);
+
+    /// @brief 领头者已完成（或失败），放行等待中的路径。
+    void finish(const fileinfo::FileInfo &leader, bool hashed);
+
+    /// @brief 不再有文件登记：释放领头者已完成的分组，之后完成的分组立即释放。
+    void close();
+
+    /// @brief 尚未释放的分组数量。
+    size_t size() const;
+
+    /// @brief 因共享inode而省去的读取次数。
+    ull get_saved_reads() const { return saved_reads; }
+    /// @brief 因共享inode而省去读取的字节数。
+    ull get_saved_bytes() const { return saved_bytes; }
+
+  private:
+    struct Group {
+        unsigned seen = 0;     /// 已登记的路径数量
+        bool finished = false; /// 领头者是否已完成
+        bool hashed = false;   /// 领头者是否成功
+        config::HashAlgorithm algorithm = config::HashAlgorithm::MD5;
+        contenthash::Digest hash;
+        ull tree_chunk_size = 0;
+        std::vector<contenthash::Digest> chunks;
+        std::vector<fileinfo::FileInfo> waiting;
+    };
+
+    Release release;
+    mutable std::mutex mutex;
+    std::map<std::pair<ull, ull>, Group> groups;
+    bool closed = false;
+    std::atomic<ull> saved_reads, saved_bytes;
+};
+} // namespace hardlinks
+#endif
@@ -0,0 +1,94 @@
+/// @file hash_cache.hpp
+/// @brief 分片的并发哈希值缓存。
+///
+/// 缓存以文件的128位键（见file_info_md5.cpp）查找定长的值：文件的元数据与二进制
+/// 哈希值。表分为`SHARDS`个分片，每个分片是一张开放寻址表：键与值分别保存在连续的
+/// 数组中，不为每一项单独分配内存。分片各有一把读写锁并按缓存行对齐，多个线程
+/// 可以同时查找，只有落在同一分片上的插入才互相等待。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _HASH_CACHE_HPP_
+#define _HASH_CACHE_HPP_
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hashcache {
+typedef unsigned long long ull;
+
+/// @brief 128位的键。
+struct Key {
+    ull low = 0;
+    ull high = 0;
+    bool operator==(const Key &) const = default;
+};
+
+/// @brief 打散各位（splitmix64的末尾步骤），用于选择分片与槽。
+inline ull mix(ull x) {
+    x ^= x >> 30, x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27, x *= 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+inline ull mix(const Key &key) { return mix(key.low ^ mix(key.high)); }
+
+/// @brief 键到定长值的并发缓存。
+class HashCache {
+  public:
+    /// 分片数量，须为2的幂。
+    static constexpr size_t SHARDS = 64;
+
+    /// @param value_size 值的字节数。
+    explicit HashCache(size_t value_size = 16);
+
+    /// @brief 清空缓存并设置值的字节数。
+    void reset(size_t value_size);
+
+    /// @brief 查找。
+    /// @param key 键。
+    /// @param value [out] 找到时为值。
+    /// @return 是否找到。
+    bool find(const Key &key, std::string &value) const;
+
+    /// @brief 插入或覆盖。
+    /// @param value 值，长度不为`value_size`时忽略。
+    void insert(const Key &key, std::string_view value);
+
+    /// @brief 缓存中的项数。
+    size_t size() const;
+
+    /// @brief 依次访问每一项（期间不可插入）。
+    void for_each(
+        const std::function<void(const Key &, std::string_view)> &visit) const;
+
+  private:
+    /// @brief 一个分片：开放寻址（线性探测），全0的键单独保存。
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::vector<Key> keys;             /// 全0表示空槽
+        std::vector<unsigned char> values; /// 第i个槽的值位于i * value_size
+        size_t used = 0;
+        bool has_zero = false;
+        std::string zero_value;
+    };
+
+    Shard &shard_of(const Key &key) const;
+    /// @brief 在`shard`中查找`key`的槽，找不到时返回其应插入的空槽。
+    size_t probe(const Shard &shard, const Key &key) const;
+    void grow(Shard &shard);
+
+    size_t value_size;
+    mutable std::array<Shard, SHARDS> shards;
+};
+} // namespace hashcache
+#endif
@@ -0,0 +1,112 @@
+/// @file hash_store.hpp
+/// @brief 持久化的哈希值缓存：内存映射的哈希表加追加写的日志。
+///
+/// 缓存由三部分组成：
+/// - 表文件（`*.tbl`）：开放寻址的哈希表，启动时整体`mmap`，查找直接访问映射，
+///   不需要先读入内存；
+/// - 日志文件（`*.tbl.journal`）：本次运行新增的项按固定长度的记录追加写入，
+///   每攒够`HASH_JOURNAL_FLUSH_ENTRIES`项写出一次，进程中途退出最多丢失这些项；
+/// - 内存中的`HashCache`：保存日志中的项与新增的项，查找时先于表文件。
+///
+/// 键为128位，值的长度固定（见hash_cache.hpp）。
+///
+/// 日志较长时（不少于`HASH_JOURNAL_COMPACT_MIN_ENTRIES`项且超过表中项数的
+/// 十六分之一），打开时将其改名为`*.tbl.journal.old`，并在后台线程中把表与旧日志
+/// 合并成新的表文件，写完后原子地替换。合并期间的查找仍使用原来的映射，新增的项
+/// 写入新的日志。合并中途退出时，下次打开会重新回放旧日志并再次合并。
+///
+/// 格式版本不符或值的长度不符的文件被忽略，并在下次合并时被覆盖。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _HASH_STORE_HPP_
+#define _HASH_STORE_HPP_
+
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "hash_cache.hpp"
+
+namespace hashstore {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+using hashcache::Key;
+
+/// 日志每攒够该数量的新增项写出一次。
+const size_t HASH_JOURNAL_FLUSH_ENTRIES = 4096;
+
+/// 日志中的项数不少于该值（且超过表中项数的十六分之一）时在后台合并。
+const size_t HASH_JOURNAL_COMPACT_MIN_ENTRIES = 1 << 16;
+
+class Table;
+
+/// @brief 键到定长二进制哈希值的持久化并发缓存。
+/// @details 未调用`open`时只是一个内存中的缓存。
+class HashStore {
+  public:
+    /// @param value_size 值的字节数。
+    explicit HashStore(size_t value_size = 16);
+    /// @brief 调用`close`，忽略其中的错误。
+    ~HashStore();
+    HashStore(const HashStore &) = delete;
+    HashStore &operator=(const HashStore &) = delete;
+
+    /// @brief 打开缓存文件，回放日志，必要时开始后台合并。
+    /// @param table 表文件的路径，日志文件与其同名并加上后缀。
+    /// @param value_size 值的字节数，与文件中的不符时丢弃该文件。
+    /// @throw std::runtime_error 无法创建日志文件。
+    void open(const fs::path &table, size_t value_size);
+
+    /// @brief 查找，不加锁地访问表文件的映射。
+    bool find(const Key &key, std::string &value) const;
+
+    /// @brief 插入或覆盖；与已有的值相同时不写日志。
+    /// @param value 值，长度不为`value_size`时忽略。
+    void insert(const Key &key, std::string_view value);
+
+    /// @brief 把尚未写出的新增项追加到日志。
+    void checkpoint();
+
+    /// @brief 写出日志，等待后台合并结束并关闭文件。
+    /// @throw std::runtime_error 写日志或合并失败，已写出的项不受影响。
+    void close();
+
+    /// @brief 表文件与内存中的项数之和（同一键可能被计入两次）。
+    size_t size() const;
+
+    /// @brief 合并：把表与若干日志写成新的表文件。
+    /// @param table 表文件，不存在时视为空表；新表写完后原子地替换它。
+    /// @param journals 依次回放的日志，后出现的项覆盖先出现的。
+    /// @throw std::runtime_error 写入失败。
+    static void compact(const fs::path &table, size_t value_size,
+                        const std::vector<fs::path> &journals);
+
+  private:
+    void write_pending();
+
+    size_t value_size;
+    std::unique_ptr<Table> table;
+    hashcache::HashCache recent;
+
+    std::mutex journal_mutex;
+    std::ofstream journal;
+    std::string pending;
+    size_t pending_entries = 0;
+
+    std::thread compactor;
+    std::exception_ptr compact_error;
+};
+} // namespace hashstore
+#endif
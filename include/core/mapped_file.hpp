@@ -0,0 +1,60 @@
+/// @file mapped_file.hpp
+/// @brief 内存映射的文件，不支持`mmap`的平台上退回读入缓冲区。
+///
+/// 用于哈希值缓存的表文件（见hash_store.hpp）与pack文件的索引（见pack_store.hpp）：
+/// 打开时整体映射，查找直接访问映射而不需要先读入内存。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _MAPPED_FILE_HPP_
+#define _MAPPED_FILE_HPP_
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+namespace mappedfile {
+namespace fs = std::filesystem;
+
+/// @brief 映射到内存中的文件，或在无法`mmap`时读入缓冲区。
+class MappedFile {
+  public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { unmap(); }
+
+    /// @brief 以只读方式映射已有的文件。
+    /// @param random 访问是否是随机的（提示内核不必预读）。
+    /// @return 文件不存在、为空或映射失败时为false。
+    bool open_read(const fs::path &path, bool random = true);
+
+    /// @brief 创建含`size`个0字节的文件`path`并以可写方式映射。
+    /// @throw std::runtime_error 创建或映射失败。
+    void create(const fs::path &path, size_t size);
+
+    /// @brief 把由`create`创建的文件写到磁盘并解除映射。
+    /// @throw std::runtime_error 写入失败。
+    void commit();
+
+    unsigned char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+  private:
+    void unmap();
+
+    unsigned char *data_ = nullptr;
+    size_t size_ = 0;
+    fs::path path;
+#ifndef _WIN32
+    int fd = -1;
+#else
+    std::vector<char> buffer;
+#endif
+};
+} // namespace mappedfile
+#endif
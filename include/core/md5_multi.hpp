@@ -0,0 +1,39 @@
+/// @file md5_multi.hpp
+/// @brief 多缓冲区MD5：同时计算多条独立消息的MD5。
+///
+/// MD5的每一步都依赖上一步的结果，单条消息无法利用向量单元。把`LANES`条消息
+/// 分别放在向量的各个通道中同步计算，一条指令即可推进所有消息。向量宽度由运行
+/// 时的CPU决定（Linux x86-64下分别编译SSE2、AVX2、AVX-512版本并自动选择），
+/// 其他平台由编译器按目标架构生成。
+///
+/// 适合大量小文件：各通道的消息长度相近时效率最高，调用者应先按长度分组。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _MD5_MULTI_HPP_
+#define _MD5_MULTI_HPP_
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+namespace md5multi {
+/// 一次同时计算的消息数。
+constexpr size_t LANES = 16;
+
+/// MD5值的字节数。
+constexpr size_t DIGEST_SIZE = 16;
+
+using Digest = std::array<unsigned char, DIGEST_SIZE>;
+
+/// @brief 计算至多`LANES`条消息的MD5。
+/// @param messages 消息，数量不超过`LANES`。
+/// @param digests [out] 与`messages`一一对应的MD5值，数量须相同。
+void md5(std::span<const std::string_view> messages, std::span<Digest> digests);
+} // namespace md5multi
+#endif
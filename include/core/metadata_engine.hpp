@@ -0,0 +1,79 @@
+/// @file metadata_engine.hpp
+/// @brief 批量获取文件元数据、打开目录的引擎。
+///
+/// 提供两种实现：
+/// - `SYNC`：逐个调用`statx`/`openat`，多个遍历线程各自阻塞调用，即按线程并行；
+/// - `IO_URING`：把一批（数百个）`IORING_OP_STATX`/`IORING_OP_OPENAT`一次提交，
+///   单个线程即可让设备队列保持较深，适合高延迟的网络文件系统和机械硬盘。
+///
+/// 引擎实例不是线程安全的，每个遍历线程持有一个。内核不支持io_uring（或被seccomp
+/// 禁止）时，`create_engine`退回同步实现。仅在Linux下可用。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _METADATA_ENGINE_HPP_
+#define _METADATA_ENGINE_HPP_
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <memory>
+#include <span>
+#include <sys/stat.h>
+
+namespace metadata {
+
+/// 引擎类型。
+enum class EngineType { SYNC, IO_URING };
+
+/// @brief 一个`statx`请求。
+struct StatRequest {
+    const char *name; /// 相对于目录的文件名
+    int flags;        /// `statx`的flags
+    unsigned mask;    /// `statx`的mask
+    struct statx stx; /// [out] 结果
+    int result;       /// [out] 0表示成功，否则为-errno
+};
+
+/// @brief 一个`openat`请求。
+struct OpenRequest {
+    const char *name; /// 相对于目录的文件名
+    int flags;        /// `openat`的flags
+    int fd;           /// [out] 成功时为文件描述符，否则为-errno
+};
+
+/// @brief 元数据引擎接口。
+class MetadataEngine {
+  public:
+    virtual ~MetadataEngine() = default;
+
+    /// @brief 对同一目录下的一批文件执行`statx`，返回时全部完成。
+    /// @param dir_fd 目录的文件描述符。
+    /// @param requests [in, out] 请求。
+    virtual void statx_batch(int dir_fd, std::span<StatRequest> requests) = 0;
+
+    /// @brief 对同一目录下的一批文件执行`openat`，返回时全部完成。
+    /// @param dir_fd 目录的文件描述符。
+    /// @param requests [in, out] 请求。
+    virtual void openat_batch(int dir_fd, std::span<OpenRequest> requests) = 0;
+
+    /// @brief 引擎名称，用于日志。
+    virtual const char *name() const = 0;
+};
+
+/// @brief 创建引擎。
+/// @param type 引擎类型；io_uring不可用时退回同步引擎。
+/// @param queue_depth io_uring的队列深度，即一次提交的最大请求数。
+std::unique_ptr<MetadataEngine> create_engine(EngineType type,
+                                              unsigned queue_depth);
+
+/// @brief 检测当前内核是否可以使用io_uring。
+bool io_uring_available();
+} // namespace metadata
+
+#endif
+#endif
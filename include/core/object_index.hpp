@@ -0,0 +1,90 @@
+/// @file object_index.hpp
+/// @brief 副本目录中单独保存的对象的内存索引：哈希表加Bloom过滤器。
+///
+/// 判断对象是否存在、取对象大小时不访问文件系统：启动时从索引文件
+/// （`OBJECT_INDEX_FILE`）载入全部对象，之后的写入与删除同步更新内存中的索引，
+/// 结束时整体写回。查找先经Bloom过滤器，新对象（不存在）大多在这一步得到答案。
+///
+/// 以可写方式打开时删除索引文件，正常结束时才重新写出，因此中途退出后索引文件
+/// 缺失，下次打开时扫描目录重建，不会把已删除的对象当作存在。
+///
+/// 键为对象名的128位SipHash（与pack的键相同，见pack_store.hpp）。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _OBJECT_INDEX_HPP_
+#define _OBJECT_INDEX_HPP_
+
+#include <filesystem>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "pack_store.hpp"
+
+namespace objectindex {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+using packstore::Key;
+
+/// 副本目录中的索引文件名。
+const char *const OBJECT_INDEX_FILE = "objects.idx";
+
+/// @brief 固定误判率的Bloom过滤器：每个元素10位、7个哈希函数，约1%误判。
+class BloomFilter {
+  public:
+    /// @param capacity 预计的元素数量，超过后误判率上升。
+    explicit BloomFilter(size_t capacity = 0);
+
+    void add(const Key &key);
+
+    /// @return false表示一定不存在。
+    bool may_contain(const Key &key) const;
+
+    size_t get_capacity() const { return capacity; }
+
+  private:
+    size_t capacity;
+    std::vector<ull> bits;
+};
+
+/// @brief 一个单独保存的对象。
+struct Entry {
+    ull size = 0;            /// 原始大小
+    bool compressed = false; /// 是否保存为`副本名.zst`
+    bool flat = false;       /// 是否仍在旧的平铺目录中（未迁移的只读副本目录）
+};
+
+/// @brief 对象名到`Entry`的索引，可由多个线程同时使用。
+class ObjectIndex {
+  public:
+    /// @brief 载入索引文件。
+    /// @return 文件不存在或无效时返回false，索引为空。
+    bool load(const fs::path &path);
+
+    /// @brief 原子地写出索引文件（先写临时文件再改名）。
+    /// @throw std::runtime_error 写入失败。
+    void save(const fs::path &path) const;
+
+    void insert(std::string_view name, const Entry &entry);
+    void erase(std::string_view name);
+    std::optional<Entry> find(std::string_view name) const;
+
+    size_t size() const;
+
+  private:
+    /// @brief 按元素数量扩大Bloom过滤器，调用时须持有写锁。
+    void grow_filter();
+
+    mutable std::shared_mutex mutex;
+    BloomFilter filter;
+    std::unordered_map<Key, Entry, packstore::KeyHash> entries;
+};
+} // namespace objectindex
+#endif
@@ -0,0 +1,261 @@
+/// @file object_store.hpp
+/// @brief 副本目录（`PATH_BACKUP_COPIES`）中的对象：单独的文件与pack中的小对象。
+///
+/// 以副本名（见content_hash.hpp）存取对象，调用者不需要知道对象保存在哪里：
+/// - 不超过`packstore::PACK_OBJECT_MAX_SIZE`的内容追加到`packs`目录中的pack文件
+///   （见pack_store.hpp）；
+/// - 其余的对象仍是以副本名命名的单独文件，由`Writer`或`import`先写入
+///   `PARTIAL_OBJECTS_DIRECTORY`中的临时文件，写完后改名。单独的文件分散在两级
+///   子目录中（`ab/cd/副本名`，见`object_path`），每个目录的项数保持在较少的水平。
+///
+/// 每次运行的临时文件在`PARTIAL_OBJECTS_DIRECTORY`中各自的子目录里，由同名的
+/// `.lock`文件加锁（`flock`）。打开时只删除锁已释放的子目录，即已结束（或中途
+/// 退出）的运行留下的，同时进行的备份的临时文件不受影响。
+///
+/// 早先版本写入的小文件副本仍作为单独的文件被找到。早先平铺在副本目录中的对象在
+/// 以可写方式打开时迁移到两级子目录，迁移后写入`LAYOUT_FILE`；只读打开未迁移的
+/// 副本目录时按原位置读取。
+///
+/// 单独的文件是否存在、大小多少由内存中的索引回答（见object_index.hpp），
+/// 不访问文件系统。
+///
+/// 设置了压缩级别时（`set_compression`），值得压缩的对象（见compression.hpp）
+/// 以zstd压缩后保存：单独的对象命名为`副本名.zst`，pack中的对象记录原始长度。
+/// 读取与取出时透明地解压，`object_size`总是返回原始大小。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _OBJECT_STORE_HPP_
+#define _OBJECT_STORE_HPP_
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "compression.hpp"
+#include "copy_engine.hpp"
+#include "object_index.hpp"
+#include "pack_store.hpp"
+
+namespace objectstore {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+
+/// 副本目录中存放pack文件的子目录。
+const char *const PACKS_DIRECTORY = "packs";
+
+/// 副本目录已迁移到两级子目录的标记文件。
+const char *const LAYOUT_FILE = "layout";
+
+/// @brief 副本目录中的对象。
+/// @details `object_size`、`store`、`extract`与`Writer`可由多个线程同时使用。
+class ObjectStore {
+  public:
+    explicit ObjectStore(const fs::path &directory);
+
+    /// @brief 删除本次运行的临时文件目录。
+    ~ObjectStore();
+
+    /// @brief 载入pack的索引与单独对象的索引，索引文件缺失时扫描目录重建。
+    /// @param writable 是否会写入对象（见`packstore::PackStore::open`）；可写时
+    /// 先把平铺的对象迁移到两级子目录，并创建本次运行的临时文件目录。
+    void open(bool writable = true);
+
+    /// @brief 写出pack的索引；可写时写出单独对象的索引。
+    /// @throw std::runtime_error 写入失败。
+    void close();
+
+    /// @brief 此后写入的对象使用的压缩。
+    /// @param level zstd压缩级别，`0`为不压缩。
+    /// @param threads 压缩大对象的线程数（见`compression::MULTITHREAD_MIN_SIZE`）。
+    void set_compression(int level, int threads) {
+        compression_level = level, compression_threads = threads;
+    }
+
+    /// @brief 本次写入的对象的压缩统计（仅在设置了压缩级别时记录）。
+    const compression::CompressionStats &get_compression_stats() const {
+        return compression_stats;
+    }
+
+    const fs::path &get_directory() const { return directory; }
+
+    /// @brief pack中的对象数量。
+    size_t pack_object_count() const { return packs.size(); }
+
+    /// @brief pack文件的数量。
+    size_t pack_count() const { return packs.pack_count(); }
+
+    /// @brief 单独保存的对象数量。
+    size_t loose_object_count() const { return loose.size(); }
+
+    /// @brief 打开时从平铺目录迁移的对象数量。
+    ull get_migrated() const { return migrated; }
+
+    /// @brief 打开时单独对象的索引是否由扫描目录重建。
+    bool is_index_rebuilt() const { return index_rebuilt; }
+
+    /// @brief 未压缩的单独对象在两级子目录中的路径：两级目录名为对象名
+    /// SipHash（见`packstore::object_key`）最高的两个字节。
+    fs::path object_path(const std::string &name) const;
+
+    /// @brief 内容是否写入pack。
+    static bool should_pack(ull size) {
+        return size <= packstore::PACK_OBJECT_MAX_SIZE;
+    }
+
+    /// @brief 设备`source_device`上的文件是否更适合由`import`保存，而不是在
+    /// 计算哈希值时写入：不压缩、与副本目录在同一设备上且该文件系统支持reflink
+    /// 时，`import`不复制数据。不能reflink时`import`要再读一遍源文件，不如在
+    /// 计算哈希值时一并写入。
+    bool prefers_import(ull source_device) const {
+        return compression_level <= 0 && reflink && device != 0 &&
+               source_device == device;
+    }
+
+    /// @brief 对象的字节数，不存在时为空。
+    std::optional<ull> object_size(const std::string &name) const;
+
+    /// @brief 对象是否存在。
+    bool contains(const std::string &name) const {
+        return object_size(name).has_value();
+    }
+
+    /// @brief 保存内存中的对象，已存在时不写入。
+    /// @return 是否写入。
+    /// @throw std::runtime_error 写入失败。
+    bool store(const std::string &name, std::string_view content);
+
+    /// @brief 把文件`source`保存为对象，已存在时不写入。先写入本次运行的
+    /// 临时文件目录，完成后改名为副本名；不压缩时使用`copyengine::copy_file`
+    /// （可以reflink）。
+    /// @details 索引中没有、但副本目录中已有的对象（如同时进行的另一次运行
+    /// 写入、而索引被其覆盖）加入索引，不再写入。
+    /// @return 所用的复制方式；对象已存在时为空。
+    /// @throw std::runtime_error 读取或写入失败。
+    std::optional<copyengine::CopyMethod> import(const fs::path &source,
+                                                 const std::string &name);
+
+    /// @brief 删除本次运行由`import`复制的单独对象，用于复制期间源文件发生了
+    /// 变化的情况。其余对象（pack中的对象、`Writer`写入的对象、已存在的对象）
+    /// 总是与副本名一致，且可能被之前的清单引用，不会被删除。
+    /// @return 是否删除。
+    bool discard(const std::string &name);
+
+    /// @brief 把对象写为新文件`target`（`target`不可已存在），压缩的对象流式解压。
+    /// @return 所用的复制方式。
+    /// @throw std::runtime_error 对象不存在或写入失败。
+    copyengine::CopyMethod extract(const std::string &name,
+                                   const fs::path &target) const;
+
+    /// @brief 把各对象依次拼接，写为新文件`target`，用于分块保存的文件。
+    /// @throw std::runtime_error 对象不存在或写入失败。
+    void extract_chunks(const std::vector<std::string> &names,
+                        const fs::path &target) const;
+
+    /// @brief 逐块写入的单独对象：先写入本次运行的临时文件目录，完成后改名为
+    /// 副本名，副本已存在时丢弃；未完成的临时文件在析构时删除。
+    /// @details 副本目录须以可写方式打开，否则构造时抛出`std::runtime_error`。
+    /// @details 设置了压缩级别时，按第一块内容判断是否压缩。
+    class Writer {
+      public:
+        /// @param expected_size 预计的对象大小，只用于选择压缩线程数；对象的
+        /// 大小以实际写入的字节数为准。
+        Writer(ObjectStore &store, ull expected_size);
+        ~Writer();
+        Writer(const Writer &) = delete;
+        Writer &operator=(const Writer &) = delete;
+
+        /// @throw std::runtime_error 写入失败。
+        void write(const char *data, size_t size);
+
+        /// @brief 以`name`完成对象。
+        /// @return 是否写入；副本已存在（如由其他线程先写好）时丢弃临时文件，
+        /// 返回false。
+        /// @throw std::runtime_error 写入失败。
+        bool publish(const std::string &name);
+
+      private:
+        ObjectStore &store;
+        ull expected_size;
+        ull written = 0; /// 已写入的原始字节数
+        fs::path path;
+        std::ofstream output;
+        std::optional<compression::Compressor> compressor;
+        bool decided = false; /// 是否已决定压缩与否
+        ull cpu_ns = 0;       /// 判断是否压缩所用的CPU时间
+        bool published = false;
+    };
+
+  private:
+    /// @brief 单独对象的实际路径。
+    fs::path entry_path(const std::string &name,
+                        const objectindex::Entry &entry) const;
+
+    /// @brief 删除已结束的运行留下的临时文件目录，创建并锁定本次运行的目录。
+    void acquire_partial();
+
+    /// @brief 删除本次运行的临时文件目录并释放锁。
+    void release_partial();
+
+    /// @brief 确保`object_path(name)`所在的子目录存在，每个子目录只创建一次。
+    void prepare_directory(const std::string &name);
+
+    /// @brief 把平铺在副本目录中的对象移到两级子目录，然后写入`LAYOUT_FILE`。
+    void migrate();
+
+    /// @brief 扫描副本目录重建单独对象的索引。
+    void rebuild_index();
+
+    /// @brief 索引中没有的对象若已在副本目录中，把它加入索引。
+    /// @return 是否找到。
+    bool adopt(const std::string &name);
+
+    /// @brief 本次运行的临时文件目录中一个新的文件名。
+    /// @throw std::runtime_error 副本目录未以可写方式打开。
+    fs::path temporary_path();
+
+    /// @brief 记下本次运行由`import`复制的对象（见`discard`）。
+    void remember_import(const std::string &name);
+
+    /// @brief 把对象的内容写入`output`。
+    /// @throw std::runtime_error 对象不存在或读写失败。
+    void write_object(const std::string &name, std::ostream &output) const;
+
+    /// @brief 压缩的单独对象的路径。
+    fs::path compressed_path(const std::string &name) const {
+        return fs::path(object_path(name)) += compression::COMPRESSED_SUFFIX;
+    }
+
+    fs::path directory;
+    packstore::PackStore packs;
+    objectindex::ObjectIndex loose;
+    bool writable = false;
+    ull device = 0; /// 副本目录所在的设备，未知时为`0`
+    bool reflink = false; /// 副本目录所在的文件系统是否支持reflink
+    /// 本次运行的临时文件目录，可写打开时创建
+    fs::path partial;
+    int partial_lock = -1; /// 锁定`partial`的`.lock`文件
+    ull migrated = 0;
+    bool index_rebuilt = false;
+    /// 已创建的两级子目录，按两个字节编号。
+    std::unique_ptr<std::atomic<bool>[]> prepared;
+    /// 本次运行由`import`复制的对象，只有它们可被`discard`删除。
+    std::unordered_set<packstore::Key, packstore::KeyHash> imported;
+    std::mutex imported_mutex;
+    int compression_level = 0;
+    int compression_threads = 1;
+    compression::CompressionStats compression_stats;
+};
+} // namespace objectstore
+#endif
@@ -0,0 +1,167 @@
+/// @file pack_store.hpp
+/// @brief 小对象的pack文件：多个对象追加写入同一个大文件，由排序的索引查找。
+///
+/// 每个小文件单独作为一个副本时，元数据操作（创建、改名、`stat`）与目录项的
+/// 开销远大于写入内容本身。不超过`PACK_OBJECT_MAX_SIZE`的对象因此追加到
+/// `packs`目录中的pack文件里：
+/// - pack文件（`*.pack`）：文件头之后依次是各对象的记录：名称长度（u32）、
+///   原始长度（u32）、保存的长度（u64）、名称、内容；
+/// - 索引文件（`*.idx`）：pack写完后生成，先是文件头与256项的累计计数表
+///   （fanout，按键的最高字节），之后是按键排序的定长项（键、内容偏移、原始长度、
+///   保存的长度）。打开时整体映射，查找先由fanout确定范围，再二分查找。
+///
+/// 内容可由调用者压缩后保存（见compression.hpp），保存的长度小于原始长度即表示
+/// 经过压缩。
+///
+/// 键为对象名的128位SipHash（见siphash.hpp），与标准库版本无关。
+///
+/// 多个线程可以同时追加：每个写入者独占一个pack文件，空闲的写入者放回池中，
+/// 没有空闲的写入者时创建新的pack。同名的对象只写入一次。pack超过
+/// `PACK_FILE_MAX_SIZE`后写出其索引，不再追加。
+///
+/// 索引在pack写完后才原子地生成（先写临时文件再改名），因此中途退出只会留下
+/// 没有索引的pack；下次打开时扫描其中完整的记录重建索引，截去不完整的末尾。
+/// 正在追加的pack同样没有索引：写入者从创建pack起到写出其索引为止持有pack文件
+/// 的锁（`flock`），打开时只修复锁已释放的pack，同时进行的备份正在追加的pack与
+/// 其临时文件不受影响。
+///
+/// 每次运行至少新增一个pack，多个线程同时追加时更多。为使查找不随pack的数量
+/// 变慢，`close`把所有pack的索引合并为一个多pack索引（`MULTI_INDEX_FILE`，格式同
+/// 单个索引，每项另记pack的编号，末尾是各pack的文件名），查找只需一次二分查找。
+/// 多pack索引未覆盖的pack（其他运行中途退出或同时运行时写入的）仍逐个查找其
+/// 索引，下次`close`时并入。多pack索引在`MULTI_INDEX_FILE`加`.lock`文件的锁下写入。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _PACK_STORE_HPP_
+#define _PACK_STORE_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "hash_cache.hpp"
+
+namespace packstore {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+using hashcache::Key;
+
+/// 不超过该大小的对象写入pack。
+const size_t PACK_OBJECT_MAX_SIZE = 1 << 16;
+
+/// 多pack索引的文件名。
+const char *const MULTI_INDEX_FILE = "multi-pack-index";
+
+/// pack文件超过该大小后不再追加。
+const ull PACK_FILE_MAX_SIZE = 1ull << 30;
+
+/// @brief 对象在pack中的位置。
+struct Location {
+    uint32_t pack = 0;   /// pack的编号（仅在同一个`PackStore`中有效）
+    ull offset = 0;      /// 保存的内容在pack文件中的偏移
+    ull size = 0;        /// 对象的原始字节数
+    ull stored_size = 0; /// 保存的字节数，小于`size`时内容经过压缩
+};
+
+/// @brief 对象名在索引中的键。
+Key object_key(std::string_view name);
+
+/// @brief 键的散列函数，用于`std::unordered_map`。
+struct KeyHash {
+    size_t operator()(const Key &key) const { return hashcache::mix(key); }
+};
+
+class Pack;
+class PackWriter;
+class MultiPackIndex;
+
+/// @brief 一个目录中的所有pack文件。
+/// @details `find`、`read`、`add`可由多个线程同时调用。
+class PackStore {
+  public:
+    PackStore();
+    ~PackStore();
+    PackStore(const PackStore &) = delete;
+    PackStore &operator=(const PackStore &) = delete;
+
+    /// @brief 载入`directory`中的pack及其索引，为没有索引的pack重建索引。
+    /// @details 目录不存在时视为空，在第一次`add`时创建。
+    /// @param writable 是否会追加对象；只读时不重建索引，没有索引的pack被忽略。
+    /// 可写时只修复锁已释放的pack（见文件说明）。
+    void open(const fs::path &directory, bool writable = true);
+
+    /// @brief 查找对象。
+    std::optional<Location> find(std::string_view name) const;
+
+    /// @brief 读取对象保存的内容（`stored_size`字节）。
+    /// @throw std::runtime_error 读取失败。
+    std::string read(const Location &location) const;
+
+    /// @brief 追加一个对象，同名的对象已存在时不写入。
+    /// @param content 保存的内容。
+    /// @param size 对象的原始字节数，应不超过`PACK_OBJECT_MAX_SIZE`且不小于
+    /// 保存的内容。
+    /// @return 是否写入。
+    /// @throw std::runtime_error 写入失败。
+    bool add(std::string_view name, std::string_view content, ull size);
+
+    /// @brief 追加一个按原样保存的对象。
+    bool add(std::string_view name, std::string_view content) {
+        return add(name, content, content.size());
+    }
+
+    /// @brief 写出本次追加的pack的索引，可写时再写出多pack索引。之后不可再追加。
+    /// @throw std::runtime_error 写入失败。
+    void close();
+
+    /// @brief 对象的数量。
+    size_t size() const;
+
+    /// @brief pack文件的数量。
+    size_t pack_count() const;
+
+  private:
+    /// @brief 在打开时已有的pack中查找。
+    std::optional<Location> find_indexed(const Key &key) const;
+    /// @brief 新建pack及其写入者。创建文件时不持有锁。
+    PackWriter *create_writer();
+    /// @brief 写完一个写入者的pack并生成其索引。
+    void finish(PackWriter &writer);
+    /// @brief 把所有pack的索引合并写为多pack索引。
+    void write_multi_index();
+
+    fs::path directory;
+    bool writable = false;
+    /// 打开时已有的pack，之后不变，查找不需要加锁；前`covered`个由多pack
+    /// 索引覆盖，编号与其中相同
+    std::vector<std::unique_ptr<Pack>> indexed;
+    std::unique_ptr<MultiPackIndex> multi_index;
+    size_t covered = 0;
+    size_t indexed_objects = 0;
+
+    mutable std::mutex mutex;
+    /// 本次追加的pack，编号在`indexed`之后
+    std::vector<std::unique_ptr<Pack>> written;
+    std::vector<std::unique_ptr<PackWriter>> writers;
+    std::vector<PackWriter *> idle;
+    /// 本次追加（或正在追加）的对象
+    std::unordered_map<Key, Location, KeyHash> pending;
+    /// 有对象写完时通知，见`add`
+    std::condition_variable written_cv;
+    bool closed = false;
+};
+} // namespace packstore
+#endif
@@ -0,0 +1,139 @@
+/// @file path_store.hpp
+/// @brief 路径驻留存储：以(父节点编号, 名称)的形式保存路径，每个名称只存一次。
+///
+/// 遍历得到的千万级路径拥有大量相同的前缀。`PathArena`把每个路径分量保存为
+/// 一个节点，节点只记录父节点编号和自身名称，名称字节存放在按块分配的内存池中，
+/// 对外以32位的`PathId`表示路径。完整路径只在需要时（文件读写、写入清单）重建。
+///
+/// 节点和名称所在的内存块分配后不再移动，因此已发布的编号可以被多个线程并发读取。
+/// 追加节点不使用全局锁：节点编号由原子计数分配，节点块按需以CAS安装；名称与
+/// `intern`的查重表分为`SHARD_COUNT`个分片，各有一把锁。`append`按线程选择分片，
+/// 遍历的各线程通常互不等待；`intern`按(父节点编号, 名称)的哈希选择分片，同一
+/// 子节点总在同一分片中查重。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _PATH_STORE_HPP_
+#define _PATH_STORE_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace pathstore {
+namespace fs = std::filesystem;
+
+/// 路径编号。
+typedef uint32_t PathId;
+
+/// 无效路径编号；作为父节点编号时表示没有父节点。
+constexpr PathId INVALID_PATH_ID = UINT32_MAX;
+
+/// @brief 路径驻留存储。
+class PathArena {
+  public:
+    PathArena();
+    ~PathArena();
+    PathArena(const PathArena &) = delete;
+    PathArena &operator=(const PathArena &) = delete;
+
+    /// @brief 追加一个子节点，不检查是否已存在。
+    /// @details 遍历时每个目录项只出现一次，使用此函数可以省去查重的开销。
+    /// @param parent 父节点编号，`INVALID_PATH_ID`表示没有父节点。
+    /// @param name 路径分量（UTF-8）。
+    /// @return 新节点的编号。
+    PathId append(PathId parent, std::u8string_view name);
+
+    /// @brief 驻留一个完整路径，相同的前缀共享节点。
+    /// @param path 路径，不做规范化。
+    /// @return 路径的编号；空路径返回`INVALID_PATH_ID`。
+    PathId intern(const fs::path &path);
+
+    /// @brief 重建完整路径。
+    /// @param id 路径编号。
+    /// @return 完整路径；`INVALID_PATH_ID`返回空路径。
+    fs::path get_path(PathId id) const;
+
+    /// @brief 获取父节点编号。
+    PathId get_parent(PathId id) const { return node(id).parent; }
+
+    /// @brief 获取路径的最后一个分量。
+    std::u8string_view get_name(PathId id) const {
+        const Node &n = node(id);
+        return {n.name, n.length};
+    }
+
+    /// @brief 获取节点数量。
+    size_t size() const;
+
+  private:
+    /// (父节点编号, 名称)的哈希函数。
+    struct ChildHash {
+        size_t operator()(const std::pair<PathId, std::u8string_view> &key) const {
+            return std::hash<std::u8string_view>()(key.second) ^
+                   (static_cast<size_t>(key.first) * 0x9e3779b97f4a7c15ull);
+        }
+    };
+
+    /// 每个节点占16字节。
+    struct Node {
+        const char8_t *name;
+        uint32_t length;
+        PathId parent;
+    };
+
+    static constexpr size_t NODE_BLOCK_BITS = 16;
+    static constexpr size_t NODE_BLOCK_SIZE = size_t(1) << NODE_BLOCK_BITS;
+    static constexpr size_t MAX_NODE_BLOCKS =
+        (size_t(1) << 32) / NODE_BLOCK_SIZE;
+    static constexpr size_t NAME_BLOCK_SIZE = 1 << 20;
+    static constexpr size_t SHARD_COUNT = 64;
+
+    /// 名称内存池与查重表的一个分片。
+    struct Shard {
+        std::mutex mutex;
+        /// 名称块，最后一块是正在使用的块。
+        std::vector<std::unique_ptr<char8_t[]>> name_blocks;
+        size_t name_block_used = NAME_BLOCK_SIZE; /// 当前名称块已使用的字节数
+        /// `intern`使用的查重表，只包含经`intern`驻留的节点。
+        std::unordered_map<std::pair<PathId, std::u8string_view>, PathId,
+                           ChildHash>
+            children;
+    };
+
+    const Node &node(PathId id) const {
+        return node_blocks[id >> NODE_BLOCK_BITS].load(
+            std::memory_order_acquire)[id & (NODE_BLOCK_SIZE - 1)];
+    }
+
+    /// @brief 在持有分片的锁时追加节点。
+    PathId append_locked(Shard &shard, PathId parent, std::u8string_view name);
+
+    /// @brief 在持有分片的锁时把名称复制到分片的名称内存池中。
+    static const char8_t *store_name(Shard &shard, std::u8string_view name);
+
+    /// @brief 当前线程追加节点使用的分片。
+    Shard &thread_shard();
+
+    /// 节点块；全部块指针的空间一次分配，块由分到其中第一个编号的线程安装，
+    /// 之后不会移动。
+    std::unique_ptr<std::atomic<Node *>[]> node_blocks;
+    std::atomic<size_t> node_count; /// 已分配的节点编号数
+    std::array<Shard, SHARD_COUNT> shards;
+};
+
+/// @brief 获取进程共享的路径存储。
+PathArena &arena();
+} // namespace pathstore
+#endif
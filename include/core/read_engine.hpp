@@ -0,0 +1,50 @@
+/// @file read_engine.hpp
+/// @brief 顺序读取整个文件内容的引擎，供计算校验值使用。
+///
+/// 提供四种方式（`config::ReadEngine`）：
+/// - `STREAM`：`std::ifstream`与32 KiB的缓冲区，即原先的实现；
+/// - `PREAD`：`pread`与随文件大小增长的大缓冲区（64 KiB至4 MiB），并提示内核顺序预读；
+/// - `DIRECT`：`O_DIRECT`与对齐的缓冲区，绕过页缓存，适合一次性读取大量数据；
+///   文件系统不支持时退回`PREAD`；
+/// - `MMAP`：`mmap`整个文件并`madvise(MADV_SEQUENTIAL)`。
+///
+/// 缓冲区按线程复用。Windows下只支持`STREAM`，其余方式均退回`STREAM`。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _READ_ENGINE_HPP_
+#define _READ_ENGINE_HPP_
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+#include "config.hpp"
+
+namespace readengine {
+namespace fs = std::filesystem;
+
+/// 接收一段文件内容的回调。
+using Consumer = std::function<void(const char *data, size_t size)>;
+
+/// @brief 从头到尾读取文件，按顺序把内容分段交给`consume`。
+/// @param path 文件路径。
+/// @param engine 读取方式。
+/// @param consume 接收内容的回调。
+/// @throw std::runtime_error 打开或读取失败。
+void read_file(const fs::path &path, config::ReadEngine engine,
+               const Consumer &consume);
+
+/// @brief 解析读取方式的名称："stream"、"pread"、"direct"或"mmap"。
+/// @return 名称无效时返回false。
+bool parse_read_engine(const std::string &name, config::ReadEngine &engine);
+
+/// @brief 读取方式的名称，用于日志。
+const char *read_engine_name(config::ReadEngine engine);
+} // namespace readengine
+#endif
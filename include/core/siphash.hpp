@@ -0,0 +1,29 @@
+/// @file siphash.hpp
+/// @brief SipHash-2-4的128位输出版本。
+///
+/// 结果只取决于密钥与输入的字节，与编译器和标准库的版本无关，可用作持久化的键。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _SIPHASH_HPP_
+#define _SIPHASH_HPP_
+
+#include <string_view>
+
+#include "hash_cache.hpp"
+
+namespace siphash {
+typedef unsigned long long ull;
+
+/// @brief 计算SipHash-2-4-128。
+/// @param k0 密钥的前8字节（小端）。
+/// @param k1 密钥的后8字节（小端）。
+/// @param data 输入。
+/// @return 输出的前8字节（小端）为`low`，后8字节为`high`。
+hashcache::Key hash128(ull k0, ull k1, std::string_view data);
+} // namespace siphash
+#endif
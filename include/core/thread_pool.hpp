@@ -11,15 +11,22 @@
 #ifndef _THREADPOOL_HPP_
 #define _THREADPOOL_HPP_
 
+#include <atomic>
 #include <condition_variable>
 #include <filesystem>
 #include <functional>
+#include <map>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "copy_engine.hpp"
+#include "path_store.hpp"
+
 using std::u8string;
 namespace fs = std::filesystem;
 typedef unsigned long long ull;
@@ -52,49 +59,139 @@ class ThreadPool {
     bool stop;                         /// 指示线程池是否应停止处理新任务。
 };
 
+/// @brief 限制每个设备上同时进行的操作数。
+///
+/// 机械硬盘上多个线程同时读写会使磁头在各文件之间来回移动，吞吐量反而下降；
+/// NVMe等设备则需要足够的并发才能发挥带宽。
+class DeviceLimiter {
+  public:
+    /// @param limit 每个设备的操作数上限，`0`为不限制。
+    explicit DeviceLimiter(int limit) : limit(limit) {}
+
+    /// @brief 在作用域内占用一个名额。
+    class Guard {
+      public:
+        Guard(DeviceLimiter &limiter, ull device)
+            : limiter(limiter), device(device) {
+            limiter.acquire(device);
+        }
+        ~Guard() { limiter.release(device); }
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+      private:
+        DeviceLimiter &limiter;
+        ull device;
+    };
+
+    bool enabled() const { return limit > 0; }
+
+  private:
+    void acquire(ull device);
+    void release(ull device);
+
+    const int limit;
+    std::mutex mutex;
+    std::condition_variable released;
+    std::map<ull, int> active;
+};
+
 /// @brief 用于管理文件复制任务的类。
+/// @details 由多个工作线程同时复制，可分别限制每个源设备与目标设备上同时进行的
+/// 复制数。目标相同的任务不会同时进行：后到的任务等先到的完成后再执行。
 class FilesCopier {
   public:
+    /// @brief 完成一个复制任务后的回调，参数表示复制是否成功。
+    using FinishedCallback = std::function<void(bool)>;
+
+    /// @brief 把内容写为新文件`to`，返回所用的复制方式；目标已存在时不写入，
+    /// 返回空。失败时抛出异常。
+    using Producer =
+        std::function<std::optional<copyengine::CopyMethod>(const fs::path &to)>;
+
     /// @brief 构造函数。
     /// @param overwrite_existing 复制期间是否覆盖现有文件。
-    FilesCopier(const bool &overwrite_existing);
+    /// @param max_queued_tasks 最多等待的任务数（包括等待同一目标的任务），达到后
+    /// `enqueue`阻塞；0表示不限制。
+    /// @param workers 工作线程数，至少为1。
+    /// @param per_device 每个源设备、每个目标设备上同时进行的复制数上限，`0`为不限制。
+    FilesCopier(const bool &overwrite_existing, size_t max_queued_tasks = 0,
+                int workers = 1, int per_device = 0);
 
-    /// @brief 等待任务完成并销毁FilesCopier。
+    /// @brief 等待任务完成并销毁FilesCopier，在日志中记录各复制方式的统计。
     ~FilesCopier();
 
     /// @brief 将新的文件复制任务入队。
-    /// @param from 要复制的源路径。
-    /// @param to 文件将被复制到的目标路径。
+    /// @param from 要复制的源路径在`pathstore::arena()`中的编号。
+    /// @param to 文件将被复制到的目标路径在`pathstore::arena()`中的编号。
     /// @param file_size 要复制的文件的大小。
-    void enqueue(fs::path from, fs::path to, ull file_size);
+    /// @param on_finished 复制结束（成功、跳过或失败）后在工作线程中调用，可为空；
+    /// 不同任务的回调可能在不同线程中同时调用。
+    void enqueue(pathstore::PathId from, pathstore::PathId to, ull file_size,
+                 FinishedCallback on_finished = nullptr);
+
+    /// @brief 将由`produce`写出目标文件的任务入队，例如pack中的对象（见object_store.hpp）。
+    /// @param from 内容所在的路径，用于按设备限制并发与错误信息。
+    /// @param produce 总是调用，由它判断目标是否已存在，不再检查文件系统；
+    /// `overwrite_existing`对这类任务不起作用。
+    /// 其余参数同上。
+    void enqueue(pathstore::PathId from, pathstore::PathId to, ull file_size,
+                 Producer produce, FinishedCallback on_finished = nullptr);
 
     /// @brief 显示包含要复制的文件总数及其大小的双进度条。
     void show_progress_bar();
 
+    /// @brief 各复制方式完成的文件数与字节数（见copy_engine.hpp）。
+    const copyengine::CopyStats &get_copy_stats() const { return copy_stats; }
+
   private:
     /// @brief 描述一个复制任务。
     struct Task {
-        fs::path from, to;
+        pathstore::PathId from, to;
         ull file_size;
-        Task(const fs::path &from, const fs::path &to, const ull &file_size)
-            : from(from), to(to), file_size(file_size) {}
+        Producer produce; /// 为空时复制`from`
+        FinishedCallback on_finished;
+        Task(pathstore::PathId from, pathstore::PathId to, const ull &file_size,
+             Producer produce, FinishedCallback on_finished)
+            : from(from), to(to), file_size(file_size),
+              produce(std::move(produce)), on_finished(std::move(on_finished)) {}
     };
     std::queue<Task> tasks; /// 任务队列。
     std::mutex queue_mutex;  /// 用于同步对任务队列的访问的互斥锁。
     std::condition_variable
         condition;             /// 条件变量，用于通知工作线程有新任务可用。
+    std::condition_variable
+        not_full;              /// 条件变量，用于通知生产者队列有空位。
+    size_t max_queued_tasks;   /// 最多等待的任务数，0表示不限制。
     bool stop;                 /// FilesCopier是否应停止处理新任务。
-    bool if_show_progress_bar; /// 是否显示进度条。
+    /// 正在复制的目标，以及等它完成后再执行的同一目标的任务。
+    std::unordered_map<pathstore::PathId, std::vector<Task>> in_flight;
+    /// `in_flight`中等待的任务数，与队列中的任务一起计入`max_queued_tasks`。
+    size_t deferred = 0;
+
+    std::atomic<bool> if_show_progress_bar; /// 是否显示进度条。
     bool overwrite_existing;   /// 在复制期间是否覆盖现有文件。
-    ull total_size;            /// 总共要复制的文件大小。
-    ull finished_size;         /// 已经复制的文件大小。
-    int total_num;             /// 总共要复制的文件数量。
-    int finished_num;          /// 已经复制的文件数量。
-    std::thread *worker;       /// 用于执行复制任务的工作线程。
+    std::atomic<ull> total_size;    /// 总共要复制的文件大小。
+    std::atomic<ull> finished_size; /// 已经复制的文件大小。
+    std::atomic<int> total_num;     /// 总共要复制的文件数量。
+    std::atomic<int> finished_num;  /// 已经复制的文件数量。
+    std::mutex progress_mutex;      /// 使进度条逐次输出。
+    copyengine::CopyStats copy_stats; /// 各复制方式的统计。
+
+    DeviceLimiter source_limiter; /// 每个源设备上的复制数。
+    DeviceLimiter target_limiter; /// 每个目标设备上的复制数。
+    std::vector<std::thread> workers; /// 执行复制任务的工作线程。
+
+    /// @brief 取出任务并执行，直到停止。
+    void work();
+
+    /// @brief 在设备名额内复制，并调用回调。
+    void run(const Task &task);
 
     /// @brief 从源路径复制文件到目标路径，并可选地覆盖现有文件。
     /// @param task 包含要复制的路径和文件大小的任务。
-    void copy_func(const Task &task);
+    /// @return 目标文件已存在或复制成功时返回true。
+    bool copy_func(const Task &task);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+/// @file tree_hash.hpp
+/// @brief 大文件的分块树哈希。
+///
+/// 单个大文件（如虚拟机镜像）只能由一个线程顺序计算，备份结束前其他线程空闲。
+/// 树哈希把文件分为固定大小的块，由多个线程分别用`pread`读取并计算各块的哈希值，
+/// 再把块大小与各块哈希值依次连接后计算一次，得到根哈希值：
+///
+///     root = H(le64(chunk_size) || H(chunk_0) || H(chunk_1) || ...)
+///
+/// 根哈希值与整个文件的哈希值不同，因此使用树哈希的副本名带有`tree`标记（见
+/// content_hash.hpp），清单中记录块大小。
+///
+/// 调用者本身是计算哈希值的线程之一，因此协助计算的线程不按文件创建，而是来自
+/// 一个共享的线程池：同时计算多个大文件时，协助线程的总数仍不超过
+/// `threads - 1`。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#pragma once
+#ifndef _TREE_HASH_HPP_
+#define _TREE_HASH_HPP_
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "config.hpp"
+#include "content_hash.hpp"
+
+namespace treehash {
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+
+/// @brief 一个文件的树哈希。
+struct Tree {
+    config::HashAlgorithm algorithm = config::HashAlgorithm::MD5;
+    ull chunk_size = 0;
+    std::vector<contenthash::Digest> chunks; /// 各块的哈希值
+    contenthash::Digest root;                /// 根哈希值
+};
+
+/// @brief 用多个线程计算文件的树哈希。
+/// @param path 文件路径。
+/// @param algorithm 哈希算法。
+/// @param chunk_size 块大小。
+/// @param threads 线程数（包括调用者），不超过块数；协助线程来自共享的线程池。
+/// @throw std::runtime_error 打开或读取失败。
+Tree hash_file(const fs::path &path, config::HashAlgorithm algorithm,
+               ull chunk_size, int threads);
+
+/// @brief 由各块的哈希值计算根哈希值。
+contenthash::Digest combine(config::HashAlgorithm algorithm, ull chunk_size,
+                            const std::vector<contenthash::Digest> &chunks);
+} // namespace treehash
+#endif
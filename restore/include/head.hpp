@@ -23,6 +23,7 @@
 #include "thread_pool.hpp"
 #include "env.hpp"
 #include "file_info.hpp"
+#include "object_store.hpp"
 #include "print.hpp"
 #include "str_encode.hpp"
 #include "str_similarity.hpp"
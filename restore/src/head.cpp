@@ -20,7 +20,9 @@ bool parse_command_line_args(int argc, char *argv[], std::string &input_folder,
         ("help,h", "Display this help message")
         ("input-folder,i", po::value<std::string>(), "Input folder for backup data")
         ("target-folder,t", po::value<std::string>(), "Target folder to store results")
-        ("overwrite,o", "Overwrite existing files when restoring");
+        ("overwrite,o", "Overwrite existing files when restoring")
+        ("copy-threads", po::value<int>()->default_value(config::COPY_THREADS), "Number of threads copying files")
+        ("copies-per-device", po::value<int>()->default_value(config::COPIES_PER_DEVICE), "The maximum number of copies reading from one device or writing to one device at a time; 0 for no limit");
     // clang-format on
 
     // Parse command line arguments
@@ -55,6 +57,17 @@ bool parse_command_line_args(int argc, char *argv[], std::string &input_folder,
 
         // --overwrite
         overwrite_existing_files = variables_map.count("overwrite");
+
+        // --copy-threads, --copies-per-device
+        config::COPY_THREADS = variables_map["copy-threads"].as<int>();
+        config::COPIES_PER_DEVICE =
+            variables_map["copies-per-device"].as<int>();
+        if (config::COPY_THREADS < 1 || config::COPIES_PER_DEVICE < 0) {
+            print::cprintln(print::ERROR,
+                            "[ERROR] --copy-threads must be positive and "
+                            "--copies-per-device must not be negative");
+            return false;
+        }
     } catch (const boost::program_options::required_option &e) {
         print::cprintln(print::ERROR, (string) "[ERROR] " + e.what());
         return false;
@@ -276,27 +289,55 @@ bool copy_files(const fs::path &input_folder, const fs::path &target_folder,
     file_info = json_data.get<std::vector<fileinfo::FileInfo>>();
     file_info_file.close();
 
-    // Copy
-    auto file_copier = new FilesCopier(overwrite_existing_files);
+    // Copy. Small objects are read from the packs, see object_store.hpp.
+    objectstore::ObjectStore objects(config::PATH_BACKUP_COPIES);
+    try {
+        objects.open(false);
+    } catch (const std::exception &e) {
+        print::cprintln(print::ERROR,
+                        std::string("[ERROR] Failed to open the packs: ") +
+                            e.what());
+        return false;
+    }
+    auto &arena = pathstore::arena();
+    const pathstore::PathId backup_copies_id =
+        arena.intern(config::PATH_BACKUP_COPIES);
+    auto file_copier =
+        new FilesCopier(overwrite_existing_files, 0, config::COPY_THREADS,
+                        config::COPIES_PER_DEVICE);
     for (const auto &file : file_info) {
-        if (file.get_md5_value().empty()) {
+        if (file.get_hash_value().empty()) {
             print::log(print::ERROR, "[ERROR] FileInfo corrupted: " +
                                          nlohmann::json(file).dump());
             continue;
         }
-        if (!fs::exists(config::PATH_BACKUP_COPIES / file.get_md5_value())) {
+        const auto object_name = file.get_object_name();
+        // A chunked file is the concatenation of its chunks.
+        const auto chunk_names = file.get_chunk_object_names();
+        if (chunk_names.empty() ? !objects.contains(object_name)
+                                : !std::ranges::all_of(
+                                      chunk_names, [&](const auto &name) {
+                                          return objects.contains(name);
+                                      })) {
             print::log(print::ERROR,
                        "[ERROR] Backup lost: " + nlohmann::json(file).dump());
             continue;
         }
+        const fs::path file_path = file.get_path();
         for (const auto &backup_path : backuped_paths) {
-            if (is_path_contained(backup_path, file.get_path())) {
+            if (is_path_contained(backup_path, file_path)) {
                 auto relative_path =
-                    fs::relative(file.get_path(), backup_path.parent_path());
+                    fs::relative(file_path, backup_path.parent_path());
                 auto target_path = target_folder / relative_path;
-                file_copier->enqueue(config::PATH_BACKUP_COPIES /
-                                         file.get_md5_value(),
-                                     target_path, file.get_file_size());
+                file_copier->enqueue(
+                    backup_copies_id, arena.intern(target_path),
+                    file.get_file_size(),
+                    [&objects, object_name, chunk_names](const fs::path &to) {
+                        if (chunk_names.empty())
+                            return objects.extract(object_name, to);
+                        objects.extract_chunks(chunk_names, to);
+                        return copyengine::CopyMethod::BUFFERED;
+                    });
             }
         }
     }
@@ -12,4 +12,21 @@ fs::path PATH_LOGS;
 std::set <fs::path> IGNORED_PATH{u8"$RECYCLE.BIN", u8"..", u8"."};
 int THREAD_NUM;
 bool SHOULD_CHECK_CACHED_MD5;
+bool VERIFY_CACHED_HASH = false;
+bool SCAN_ONLY = false;
+bool NON_INTERACTIVE = false;
+bool USE_IO_URING = false;
+bool USE_DIRECTORY_SNAPSHOT = true;
+bool TRUST_DIRECTORY_SNAPSHOT = false;
+std::vector<string> EXCLUDE_PATTERNS;
+ReadEngine READ_ENGINE = ReadEngine::PREAD;
+HashAlgorithm HASH_ALGORITHM = HashAlgorithm::MD5;
+bool TREE_HASH = false;
+bool SCHEDULE_BY_EXTENT = false;
+int READERS_PER_DEVICE = 1;
+int COPY_THREADS = 4;
+int COPIES_PER_DEVICE = 0;
+int COMPRESSION_LEVEL = 0;
+int COMPRESSION_THREADS = 4;
+bool CHUNKED_STORAGE = false;
 }
\ No newline at end of file
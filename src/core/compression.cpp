@@ -0,0 +1,348 @@
+/// @file compression.cpp
+/// @brief compression.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#ifdef BACKUP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compression.hpp"
+
+namespace compression {
+namespace {
+/// @brief A signature of an already compressed format at a fixed offset.
+struct Magic {
+    size_t offset;
+    std::string_view bytes;
+};
+
+// Archives, compressed streams, images, audio and video.
+constexpr Magic COMPRESSED_MAGICS[] = {
+    {0, "\x1f\x8b"},                      // gzip
+    {0, "PK\x03\x04"},                    // zip, jar, docx, apk
+    {0, "\x28\xb5\x2f\xfd"},              // zstd
+    {0, "\xfd" "7zXZ"},                   // xz
+    {0, "BZh"},                           // bzip2
+    {0, "7z\xbc\xaf\x27\x1c"},            // 7z
+    {0, "Rar!\x1a\x07"},                  // rar
+    {0, "\x04\x22\x4d\x18"},              // lz4
+    {0, "\x89PNG"},                       // png
+    {0, "\xff\xd8\xff"},                  // jpeg
+    {0, "GIF8"},                          // gif
+    {8, "WEBP"},                          // webp
+    {4, "ftyp"},                          // mp4, mov, heic
+    {0, "\x1a\x45\xdf\xa3"},              // mkv, webm
+    {0, "OggS"},                          // ogg
+    {0, "fLaC"},                          // flac
+    {0, "ID3"},                           // mp3
+};
+
+#ifdef BACKUP_HAVE_ZSTD
+/// The largest zstd frame header. Frames compressed in one piece
+/// (`compress`) record their size in it; streamed ones do not.
+constexpr size_t FRAME_HEADER_MAX_SIZE = 18;
+
+// A streamed frame is followed by a skippable frame, which decoders pass
+// over, holding the original size: magic, payload size (8) and the size,
+// all little-endian.
+constexpr uint32_t SIZE_FRAME_MAGIC = ZSTD_MAGIC_SKIPPABLE_START + 0xB;
+constexpr size_t SIZE_FRAME_PAYLOAD = 8;
+constexpr size_t SIZE_FRAME_SIZE = 8 + SIZE_FRAME_PAYLOAD;
+
+void store_le(unsigned char *p, ull value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i)
+        p[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+ull load_le(const unsigned char *p, size_t bytes) {
+    ull value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+        value |= static_cast<ull>(p[i]) << (8 * i);
+    return value;
+}
+
+void check(size_t result, const char *operation) {
+    if (ZSTD_isError(result))
+        throw std::runtime_error(std::format("Compression: {} failed: {}",
+                                             operation,
+                                             ZSTD_getErrorName(result)));
+}
+
+/// @brief Compression contexts are reused by each thread for small objects.
+struct ContextDeleter {
+    void operator()(ZSTD_CCtx *context) const { ZSTD_freeCCtx(context); }
+};
+#else
+[[noreturn]] void unavailable() {
+    throw std::runtime_error("Compression: zstd support is not compiled in");
+}
+#endif
+} // namespace
+
+bool available() {
+#ifdef BACKUP_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+int min_level() {
+#ifdef BACKUP_HAVE_ZSTD
+    return ZSTD_minCLevel();
+#else
+    return 0;
+#endif
+}
+
+int max_level() {
+#ifdef BACKUP_HAVE_ZSTD
+    return ZSTD_maxCLevel();
+#else
+    return 0;
+#endif
+}
+
+ull thread_cpu_ns() {
+#ifndef _WIN32
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0)
+        return time.tv_sec * 1000000000ull + time.tv_nsec;
+#endif
+    // Wall time where per-thread CPU time is unavailable.
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+double entropy(std::string_view sample) {
+    if (sample.empty())
+        return 0;
+    std::array<size_t, 256> counts{};
+    for (unsigned char c : sample)
+        ++counts[c];
+    double bits = 0;
+    for (size_t count : counts) {
+        if (count == 0)
+            continue;
+        const double p = static_cast<double>(count) / sample.size();
+        bits -= p * std::log2(p);
+    }
+    return bits;
+}
+
+bool worth_compressing(std::string_view sample) {
+    if (sample.empty())
+        return false;
+    for (const auto &magic : COMPRESSED_MAGICS)
+        if (magic.offset <= sample.size() &&
+            sample.substr(magic.offset, magic.bytes.size()) == magic.bytes)
+            return false;
+    return entropy(sample.substr(0, SAMPLE_SIZE)) <= MAX_ENTROPY;
+}
+
+bool compress(std::string_view input, int level, std::string &output) {
+#ifdef BACKUP_HAVE_ZSTD
+    thread_local std::unique_ptr<ZSTD_CCtx, ContextDeleter> context(
+        ZSTD_createCCtx());
+    if (!context)
+        throw std::runtime_error("Compression: Out of memory");
+    ZSTD_CCtx_reset(context.get(), ZSTD_reset_session_and_parameters);
+    check(ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel,
+                                 level),
+          "Setting the level");
+    output.resize(ZSTD_compressBound(input.size()));
+    const size_t size = ZSTD_compress2(context.get(), output.data(),
+                                       output.size(), input.data(),
+                                       input.size());
+    check(size, "Compression");
+    output.resize(size);
+    return size < input.size();
+#else
+    (void)input, (void)level, (void)output;
+    return false;
+#endif
+}
+
+std::string decompress(std::string_view input, size_t size) {
+#ifdef BACKUP_HAVE_ZSTD
+    std::string output(size, '\0');
+    const size_t result =
+        ZSTD_decompress(output.data(), size, input.data(), input.size());
+    check(result, "Decompression");
+    if (result != size)
+        throw std::runtime_error("Compression: Decompressed size mismatch");
+    return output;
+#else
+    (void)input, (void)size;
+    unavailable();
+#endif
+}
+
+Compressor::Compressor(std::ostream &output, int level, ull expected_size,
+                       int threads)
+    : output(output) {
+#ifdef BACKUP_HAVE_ZSTD
+    auto *cctx = ZSTD_createCCtx();
+    if (cctx == nullptr)
+        throw std::runtime_error("Compression: Out of memory");
+    try {
+        check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level),
+              "Setting the level");
+    } catch (...) {
+        ZSTD_freeCCtx(cctx);
+        throw;
+    }
+    // The size is not pledged: a file that grows or shrinks while it is read
+    // is stored as read, and `finish` records the size actually written.
+    // Fails harmlessly on a library built without threads.
+    if (expected_size >= MULTITHREAD_MIN_SIZE && threads > 1)
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers, threads);
+    context = cctx;
+    buffer.resize(ZSTD_CStreamOutSize());
+#else
+    (void)level, (void)expected_size, (void)threads;
+    unavailable();
+#endif
+}
+
+Compressor::~Compressor() {
+#ifdef BACKUP_HAVE_ZSTD
+    ZSTD_freeCCtx(static_cast<ZSTD_CCtx *>(context));
+#endif
+}
+
+void Compressor::write(const char *data, size_t size) {
+    compress(data, size, false);
+    this->size += size;
+}
+
+void Compressor::finish() {
+    compress(nullptr, 0, true);
+#ifdef BACKUP_HAVE_ZSTD
+    unsigned char frame[SIZE_FRAME_SIZE];
+    store_le(frame, SIZE_FRAME_MAGIC, 4);
+    store_le(frame + 4, SIZE_FRAME_PAYLOAD, 4);
+    store_le(frame + 8, size, 8);
+    if (!output.write(reinterpret_cast<const char *>(frame), sizeof(frame)))
+        throw std::runtime_error("Compression: Failed to write");
+#endif
+}
+
+void Compressor::compress(const char *data, size_t size, bool end) {
+#ifdef BACKUP_HAVE_ZSTD
+    const ull start = thread_cpu_ns();
+    ZSTD_inBuffer input{data, size, 0};
+    while (true) {
+        ZSTD_outBuffer out{buffer.data(), buffer.size(), 0};
+        const size_t remaining = ZSTD_compressStream2(
+            static_cast<ZSTD_CCtx *>(context), &out, &input,
+            end ? ZSTD_e_end : ZSTD_e_continue);
+        check(remaining, "Compression");
+        if (!output.write(buffer.data(), out.pos))
+            throw std::runtime_error("Compression: Failed to write");
+        if (end ? remaining == 0 : input.pos == input.size)
+            break;
+    }
+    cpu_ns += thread_cpu_ns() - start;
+#else
+    (void)data, (void)size, (void)end;
+    unavailable();
+#endif
+}
+
+void decompress_stream(std::istream &input, std::ostream &output) {
+#ifdef BACKUP_HAVE_ZSTD
+    std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(
+        ZSTD_createDCtx(), &ZSTD_freeDCtx);
+    if (!context)
+        throw std::runtime_error("Compression: Out of memory");
+    std::string in(ZSTD_DStreamInSize(), '\0');
+    std::string out(ZSTD_DStreamOutSize(), '\0');
+    size_t last = 0;
+    bool empty = true;
+    while (true) {
+        input.read(in.data(), in.size());
+        const size_t read = input.gcount();
+        if (read == 0)
+            break;
+        empty = false;
+        ZSTD_inBuffer chunk{in.data(), read, 0};
+        while (chunk.pos < chunk.size) {
+            ZSTD_outBuffer buffer{out.data(), out.size(), 0};
+            last = ZSTD_decompressStream(context.get(), &buffer, &chunk);
+            check(last, "Decompression");
+            if (!output.write(out.data(), buffer.pos))
+                throw std::runtime_error("Compression: Failed to write");
+        }
+    }
+    if (input.bad())
+        throw std::runtime_error("Compression: Failed to read");
+    // A complete frame leaves nothing pending.
+    if (empty || last != 0)
+        throw std::runtime_error("Compression: Truncated stream");
+#else
+    (void)input, (void)output;
+    unavailable();
+#endif
+}
+
+std::optional<ull> frame_content_size(const fs::path &path) {
+#ifdef BACKUP_HAVE_ZSTD
+    std::ifstream input(path, std::ios::binary);
+    char header[FRAME_HEADER_MAX_SIZE];
+    input.read(header, sizeof(header));
+    const ull size = ZSTD_getFrameContentSize(header, input.gcount());
+    if (size == ZSTD_CONTENTSIZE_ERROR)
+        return std::nullopt;
+    if (size != ZSTD_CONTENTSIZE_UNKNOWN)
+        return size;
+    // Streamed frames record their size in the trailing skippable frame.
+    unsigned char frame[SIZE_FRAME_SIZE];
+    input.clear();
+    if (!input.seekg(-static_cast<std::streamoff>(sizeof(frame)),
+                     std::ios::end) ||
+        !input.read(reinterpret_cast<char *>(frame), sizeof(frame)) ||
+        load_le(frame, 4) != SIZE_FRAME_MAGIC ||
+        load_le(frame + 4, 4) != SIZE_FRAME_PAYLOAD)
+        return std::nullopt;
+    return load_le(frame + 8, 8);
+#else
+    (void)path;
+    return std::nullopt;
+#endif
+}
+
+void CompressionStats::add(ull size, ull stored, bool compressed,
+                           ull cpu_ns) {
+    ++(compressed ? compressed_objects : raw_objects);
+    this->size += size, this->stored += stored, this->cpu_ns += cpu_ns;
+}
+
+std::string CompressionStats::summary() const {
+    const double ratio =
+        stored ? static_cast<double>(size) / stored : 1.0;
+    return std::format("{} objects compressed, {} stored raw, {:.2f} MB -> "
+                       "{:.2f} MB (ratio {:.2f}), {:.2f} s CPU",
+                       compressed_objects.load(), raw_objects.load(),
+                       size / (1024.0 * 1024), stored / (1024.0 * 1024), ratio,
+                       cpu_ns / 1e9);
+}
+} // namespace compression
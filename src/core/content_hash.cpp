@@ -0,0 +1,197 @@
+/// @file content_hash.cpp
+/// @brief content_hash.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <cstdint>
+#include <stdexcept>
+
+#include <openssl/evp.h>
+
+#include "content_hash.hpp"
+
+namespace contenthash {
+namespace {
+const EVP_MD *evp_md(HashAlgorithm algorithm) {
+    switch (algorithm) {
+    case HashAlgorithm::MD5:
+        return EVP_md5();
+    case HashAlgorithm::SHA256:
+        return EVP_sha256();
+    case HashAlgorithm::BLAKE2B:
+        return EVP_blake2b512();
+    }
+    return nullptr;
+}
+
+constexpr char DIGITS[] = "0123456789ABCDEF";
+
+/// @return The value of a hex digit, or -1.
+int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20; // lower case
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+#if defined(__GNUC__)
+// Sixteen bytes at a time with GCC vector extensions, which compile to SSE2
+// on x86-64 and to NEON on ARM.
+#define CONTENT_HASH_VECTOR_HEX
+typedef unsigned char Bytes __attribute__((vector_size(16)));
+
+Bytes load(const void *p) {
+    Bytes v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+Bytes digit_chars(Bytes value) {
+    return value + '0' + ((Bytes)(value > 9) & ('A' - '0' - 10));
+}
+
+/// @brief Encodes 16 bytes as 32 hex digits.
+void encode16(const unsigned char *in, char *out) {
+    const Bytes v = load(in);
+    const Bytes high = digit_chars(v >> 4), low = digit_chars(v & 0xF);
+    const Bytes first = __builtin_shufflevector(
+        high, low, 0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+    const Bytes second = __builtin_shufflevector(
+        high, low, 8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+    std::memcpy(out, &first, sizeof(first));
+    std::memcpy(out + 16, &second, sizeof(second));
+}
+
+/// @brief Decodes 32 hex digits into 16 bytes.
+/// @return false if any character is not a hex digit.
+bool decode16(const char *in, unsigned char *out) {
+    Bytes valid = ~Bytes{};
+    auto values = [&](Bytes c) {
+        const Bytes digit = c - '0', letter = (c | 0x20) - 'a';
+        const Bytes is_digit = (Bytes)(digit < 10);
+        const Bytes is_letter = (Bytes)(letter < 6);
+        valid &= is_digit | is_letter;
+        return (digit & is_digit) | ((letter + 10) & is_letter);
+    };
+    const Bytes a = values(load(in)), b = values(load(in + 16));
+    const Bytes high = __builtin_shufflevector(
+        a, b, 0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const Bytes low = __builtin_shufflevector(
+        a, b, 1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+    uint64_t check[2];
+    std::memcpy(check, &valid, sizeof(check));
+    if ((check[0] & check[1]) != ~uint64_t(0))
+        return false;
+    const Bytes bytes = high << 4 | low;
+    std::memcpy(out, &bytes, sizeof(bytes));
+    return true;
+}
+#endif
+} // namespace
+
+Digest::Digest(const void *data, size_t size) {
+    if (size > MAX_SIZE)
+        throw std::length_error("Digest: Too long");
+    std::memcpy(bytes.data(), data, size);
+    size_ = static_cast<unsigned char>(size);
+}
+
+Hasher::Hasher(HashAlgorithm algorithm) : context(EVP_MD_CTX_new()) {
+    if (context == nullptr)
+        throw std::runtime_error("Hasher: Failed to create context");
+    if (EVP_DigestInit_ex(context, evp_md(algorithm), nullptr) != 1) {
+        EVP_MD_CTX_free(context);
+        throw std::runtime_error("Hasher: Failed to initialize");
+    }
+}
+
+Hasher::~Hasher() { EVP_MD_CTX_free(context); }
+
+void Hasher::update(const void *data, size_t size) {
+    EVP_DigestUpdate(context, data, size);
+}
+
+Digest Hasher::final() {
+    static_assert(EVP_MAX_MD_SIZE <= Digest::MAX_SIZE);
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length;
+    if (EVP_DigestFinal_ex(context, digest, &length) != 1)
+        throw std::runtime_error("Hasher: Failed to finalize");
+    return Digest(digest, length);
+}
+
+size_t digest_size(HashAlgorithm algorithm) {
+    return EVP_MD_size(evp_md(algorithm));
+}
+
+const char *algorithm_name(HashAlgorithm algorithm) {
+    switch (algorithm) {
+    case HashAlgorithm::MD5:
+        return "md5";
+    case HashAlgorithm::SHA256:
+        return "sha256";
+    case HashAlgorithm::BLAKE2B:
+        return "blake2b";
+    }
+    return "unknown";
+}
+
+bool parse_algorithm(const std::string &name, HashAlgorithm &algorithm) {
+    for (auto candidate :
+         {HashAlgorithm::MD5, HashAlgorithm::SHA256, HashAlgorithm::BLAKE2B})
+        if (name == algorithm_name(candidate)) {
+            algorithm = candidate;
+            return true;
+        }
+    return false;
+}
+
+std::string to_hex(std::string_view bytes) {
+    std::string hex(bytes.size() * 2, '\0');
+    const auto *in = reinterpret_cast<const unsigned char *>(bytes.data());
+    size_t i = 0;
+#ifdef CONTENT_HASH_VECTOR_HEX
+    for (; i + 16 <= bytes.size(); i += 16)
+        encode16(in + i, hex.data() + 2 * i);
+#endif
+    for (; i < bytes.size(); ++i)
+        hex[2 * i] = DIGITS[in[i] >> 4], hex[2 * i + 1] = DIGITS[in[i] & 0xF];
+    return hex;
+}
+
+bool from_hex(std::string_view hex, Digest &digest) {
+    if (hex.size() % 2 != 0 || hex.size() / 2 > Digest::MAX_SIZE)
+        return false;
+    unsigned char bytes[Digest::MAX_SIZE];
+    const size_t size = hex.size() / 2;
+    size_t i = 0;
+#ifdef CONTENT_HASH_VECTOR_HEX
+    for (; i + 16 <= size; i += 16)
+        if (!decode16(hex.data() + 2 * i, bytes + i))
+            return false;
+#endif
+    for (; i < size; ++i) {
+        const int high = hex_value(hex[2 * i]), low = hex_value(hex[2 * i + 1]);
+        if (high < 0 || low < 0)
+            return false;
+        bytes[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+    digest = Digest(bytes, size);
+    return true;
+}
+
+std::string object_name(HashAlgorithm algorithm, const Digest &digest,
+                        bool tree) {
+    const std::string hex = to_hex(digest);
+    if (tree)
+        return std::string(algorithm_name(algorithm)) + "-tree-" + hex;
+    if (algorithm == HashAlgorithm::MD5)
+        return hex;
+    return std::string(algorithm_name(algorithm)) + "-" + hex;
+}
+} // namespace contenthash
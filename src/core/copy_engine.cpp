@@ -0,0 +1,258 @@
+/// @file copy_engine.cpp
+/// @brief copy_engine.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+
+#include "copy_engine.hpp"
+
+namespace copyengine {
+namespace {
+#ifndef _WIN32
+/// Largest amount handed to the kernel per call, so that a huge file does
+/// not block the thread in one uninterruptible call.
+constexpr size_t KERNEL_COPY_CHUNK = size_t(1) << 30;
+
+/// Buffer of the last resort copy.
+constexpr size_t BUFFER_SIZE = size_t(1) << 20;
+
+/// @brief The source and the new target, removed again unless committed.
+class CopyFiles {
+  public:
+    CopyFiles(const fs::path &from, const fs::path &to) : to(to) {
+        in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+            fail("open");
+        if (fstat(in, &st) != 0)
+            fail("stat");
+        out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                   st.st_mode & 07777);
+        if (out < 0)
+            fail("create");
+        created = true;
+    }
+    ~CopyFiles() {
+        if (in >= 0)
+            close(in);
+        if (out >= 0)
+            close(out);
+        if (created && !committed)
+            unlink(to.c_str());
+    }
+    CopyFiles(const CopyFiles &) = delete;
+    CopyFiles &operator=(const CopyFiles &) = delete;
+
+    void commit() {
+        const int fd = std::exchange(out, -1);
+        if (close(fd) != 0)
+            fail("close");
+        committed = true;
+    }
+
+    [[noreturn]] void fail(const char *what) {
+        throw std::runtime_error(std::format("CopyFile: Failed to {} file: {}",
+                                             what, std::strerror(errno)));
+    }
+
+    int in = -1, out = -1;
+    struct stat st;
+
+  private:
+    fs::path to;
+    bool created = false, committed = false;
+};
+
+/// @brief Errors meaning "this method cannot be used here", as opposed to
+/// a real read or write failure.
+bool unsupported(int error) {
+    return error == ENOSYS || error == EOPNOTSUPP || error == ENOTTY ||
+           error == EXDEV || error == EINVAL || error == EPERM ||
+           error == EBADF || error == ETXTBSY;
+}
+
+#ifdef __linux__
+bool try_reflink(CopyFiles &files) {
+    if (ioctl(files.out, FICLONE, files.in) == 0)
+        return true;
+    if (!unsupported(errno))
+        files.fail("clone");
+    return false;
+}
+
+/// @return Whether the method took the copy to the end; `offset` is where
+/// it stopped otherwise.
+bool try_copy_file_range(CopyFiles &files, off_t &offset) {
+    while (true) {
+        off_t in_offset = offset, out_offset = offset;
+        const ssize_t n = copy_file_range(files.in, &in_offset, files.out,
+                                          &out_offset, KERNEL_COPY_CHUNK, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && unsupported(errno))
+            return false;
+        if (n < 0)
+            files.fail("copy");
+        // Some filesystems report nothing copied instead of an error.
+        if (n == 0)
+            return offset >= files.st.st_size;
+        offset += n;
+    }
+}
+
+bool try_sendfile(CopyFiles &files, off_t &offset) {
+    if (lseek(files.out, offset, SEEK_SET) < 0)
+        files.fail("seek");
+    while (true) {
+        off_t in_offset = offset;
+        const ssize_t n =
+            sendfile(files.out, files.in, &in_offset, KERNEL_COPY_CHUNK);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && unsupported(errno))
+            return false;
+        if (n < 0)
+            files.fail("copy");
+        if (n == 0)
+            return offset >= files.st.st_size;
+        offset += n;
+    }
+}
+#endif
+
+void copy_buffered(CopyFiles &files, off_t offset) {
+    thread_local std::vector<char> buffer(BUFFER_SIZE);
+    while (true) {
+        const ssize_t n = pread(files.in, buffer.data(), buffer.size(), offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            files.fail("read");
+        if (n == 0)
+            return;
+        for (ssize_t written = 0; written < n;) {
+            const ssize_t m = pwrite(files.out, buffer.data() + written,
+                                     n - written, offset + written);
+            if (m < 0 && errno == EINTR)
+                continue;
+            if (m < 0)
+                files.fail("write");
+            written += m;
+        }
+        offset += n;
+    }
+}
+#endif
+} // namespace
+
+const char *copy_method_name(CopyMethod method) {
+    switch (method) {
+    case CopyMethod::REFLINK:
+        return "reflink";
+    case CopyMethod::COPY_FILE_RANGE:
+        return "copy_file_range";
+    case CopyMethod::SENDFILE:
+        return "sendfile";
+    case CopyMethod::BUFFERED:
+        return "buffered";
+    }
+    return "unknown";
+}
+
+CopyMethod copy_file(const fs::path &from, const fs::path &to) {
+#ifndef _WIN32
+    CopyFiles files(from, to);
+    CopyMethod method = CopyMethod::BUFFERED;
+    off_t offset = 0;
+#ifdef __linux__
+    if (try_reflink(files))
+        method = CopyMethod::REFLINK;
+    else if (try_copy_file_range(files, offset))
+        method = CopyMethod::COPY_FILE_RANGE;
+    else if (try_sendfile(files, offset))
+        method = CopyMethod::SENDFILE;
+    else
+#endif
+        copy_buffered(files, offset);
+    files.commit();
+    return method;
+#else
+    fs::copy_file(from, to);
+    return CopyMethod::BUFFERED;
+#endif
+}
+
+bool supports_reflink(const fs::path &directory) {
+#ifdef __linux__
+    const fs::path from = directory / ".reflink-probe";
+    const fs::path to = directory / ".reflink-probe.clone";
+    bool supported = false;
+    const int in = open(from.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0600);
+    if (in >= 0) {
+        const char byte = 0;
+        const int out =
+            open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (out >= 0) {
+            supported = write(in, &byte, 1) == 1 &&
+                        ioctl(out, FICLONE, in) == 0;
+            close(out);
+        }
+        close(in);
+    }
+    unlink(to.c_str());
+    unlink(from.c_str());
+    return supported;
+#else
+    (void)directory;
+    return false;
+#endif
+}
+
+void CopyStats::add(CopyMethod method, ull size) {
+    files[static_cast<size_t>(method)]++;
+    bytes[static_cast<size_t>(method)] += size;
+}
+
+ull CopyStats::get_files(CopyMethod method) const {
+    return files[static_cast<size_t>(method)];
+}
+
+ull CopyStats::get_bytes(CopyMethod method) const {
+    return bytes[static_cast<size_t>(method)];
+}
+
+std::string CopyStats::summary() const {
+    std::string result;
+    for (size_t i = 0; i < COPY_METHOD_COUNT; ++i) {
+        if (files[i] == 0)
+            continue;
+        if (!result.empty())
+            result += ", ";
+        result += std::format("{} {} files ({:.2f} MB)",
+                              copy_method_name(static_cast<CopyMethod>(i)),
+                              files[i].load(), bytes[i] / (1024.0 * 1024));
+    }
+    return result;
+}
+} // namespace copyengine
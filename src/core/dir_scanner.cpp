@@ -0,0 +1,571 @@
+/// @file dir_scanner.cpp
+/// @brief dir_scanner.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <chrono>
+#include <format>
+#include <system_error>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include "metadata_engine.hpp"
+#endif
+
+#include "config.hpp"
+#include "dir_scanner.hpp"
+#include "print.hpp"
+#include "str_encode.hpp"
+
+namespace scanner {
+
+DirectoryScanner::DirectoryScanner(int thread_num, bool use_io_uring)
+    : thread_num(std::max(thread_num, 1)), use_io_uring(use_io_uring),
+      previous_snapshot(nullptr), current_snapshot(nullptr),
+      trust_file_stats(false),
+      exclude_engine(
+          std::make_unique<exclude::ExcludeEngine>(config::EXCLUDE_PATTERNS)),
+      open_directory_fds(0), pending(0), queued(0), idle_workers(0),
+      directories(0), entries(0), files(0), stat_calls(0),
+      reused_directories(0) {
+    for (int i = 0; i < this->thread_num; ++i)
+        queues.emplace_back(std::make_unique<WorkerQueue>());
+}
+
+DirectoryScanner::~DirectoryScanner() = default;
+
+void DirectoryScanner::set_snapshots(const snapshot::DirectorySnapshot *previous,
+                                     snapshot::DirectorySnapshot *current,
+                                     bool trust_file_stats) {
+    previous_snapshot = previous;
+    current_snapshot = current;
+    this->trust_file_stats = trust_file_stats;
+}
+
+void DirectoryScanner::push(int id, PendingDirectory directory) {
+    pending.fetch_add(1, std::memory_order_relaxed);
+    // Counted first, so `queued` never falls below the directories queued.
+    queued.fetch_add(1);
+    {
+        std::lock_guard lock(queues[id]->mutex);
+        queues[id]->directories.push_back(std::move(directory));
+    }
+    wake_idle(false);
+}
+
+void DirectoryScanner::wake_idle(bool all) {
+    // An idle worker counts itself before checking for work, both under
+    // `idle_mutex`: either it sees the new state or it is counted here, and
+    // taking the mutex then makes sure it is already waiting.
+    if (idle_workers.load() == 0)
+        return;
+    { std::lock_guard lock(idle_mutex); }
+    if (all)
+        idle_cv.notify_all();
+    else
+        idle_cv.notify_one();
+}
+
+bool DirectoryScanner::pop_or_steal(int id, PendingDirectory &directory) {
+    {
+        auto &own = *queues[id];
+        std::lock_guard lock(own.mutex);
+        if (!own.directories.empty()) {
+            directory = std::move(own.directories.back());
+            own.directories.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    for (int i = 1; i < thread_num; ++i) {
+        auto &victim = *queues[(id + i) % thread_num];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.directories.empty()) {
+            directory = std::move(victim.directories.front());
+            victim.directories.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifndef _WIN32
+struct DirectoryScanner::WorkerState {
+    std::unique_ptr<metadata::MetadataEngine> engine;
+    std::vector<char> names; /// 当前目录中文件和子目录的名称，以'\0'分隔
+    std::vector<size_t> file_offsets, subdirectory_offsets;
+    std::vector<size_t> file_children; /// 各文件在快照记录子项中的下标
+    std::vector<size_t> kept_files;    /// 未被排除的文件在file_offsets中的下标
+    /// 未被排除的子目录的名称偏移及其匹配状态
+    std::vector<std::pair<size_t, std::shared_ptr<const exclude::MatchState>>>
+        kept_subdirectories;
+    std::vector<size_t> stat_files; /// 各statx请求对应的文件下标
+    std::vector<metadata::StatRequest> stat_requests;
+    std::vector<metadata::OpenRequest> open_requests;
+    /// 本线程记录的目录，遍历结束后合并到新快照
+    std::vector<std::pair<std::u8string, snapshot::DirectoryRecord>> records;
+};
+
+unsigned char entry_type(int directory_fd, const char *name,
+                         unsigned char type, ull &stat_calls) {
+    // d_type comes for free with getdents; only a few filesystems leave it
+    // unset and need an extra lstat.
+    if (type != DT_UNKNOWN)
+        return type;
+    struct stat st;
+    ++stat_calls;
+    if (fstatat(directory_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return DT_UNKNOWN;
+    return IFTODT(st.st_mode);
+}
+
+namespace {
+constexpr long long NS_PER_SECOND = 1000000000;
+
+/// Reads the entries of `dir` into `state.names`, sorting them into files and
+/// subdirectories.
+/// @return 0, or the errno of a failed readdir; the entries read before the
+/// failure are kept.
+template <typename State>
+int read_entries(DIR *dir, State &state, scanner::ull &local_entries,
+                 scanner::ull &local_stat_calls) {
+    // Collect the names first: readdir reuses its buffer, and the batched
+    // engine needs all requests of this directory at once.
+    while (true) {
+        // readdir returns nullptr both at the end and on error; only errno
+        // tells them apart, and fstatat below may have left it set.
+        errno = 0;
+        const dirent *entry = readdir(dir);
+        if (entry == nullptr)
+            return errno;
+        const char *name = entry->d_name;
+        if (name[0] == '.' &&
+            (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        ++local_entries;
+
+        const unsigned char type =
+            entry_type(dirfd(dir), name, entry->d_type, local_stat_calls);
+        if (type == DT_DIR)
+            state.subdirectory_offsets.push_back(state.names.size());
+        else if (type == DT_REG || type == DT_LNK)
+            state.file_offsets.push_back(state.names.size());
+        else
+            continue;
+        state.names.insert(state.names.end(), name, name + strlen(name) + 1);
+    }
+}
+} // namespace
+
+void DirectoryScanner::list_directory(int id,
+                                      const PendingDirectory &pending_directory,
+                                      const DirectoryCallback &on_directory,
+                                      const FileCallback &on_file) {
+    const fs::path &directory = pending_directory.path;
+    directories.fetch_add(1, std::memory_order_relaxed);
+    on_directory(id, pending_directory.id);
+
+    int dir_fd = pending_directory.fd;
+    if (dir_fd >= 0)
+        open_directory_fds.fetch_sub(1, std::memory_order_relaxed);
+    else
+        dir_fd = open(directory.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    auto report_open_error = [&] {
+        print::log(print::ERROR,
+                   std::format("[ERROR] Scanner: cannot open directory {}: {}",
+                               strencode::to_console_format(
+                                   directory.u8string()),
+                               std::generic_category().message(errno)));
+    };
+    if (dir_fd < 0) {
+        report_open_error();
+        return;
+    }
+    WorkerState &state = *worker_states[id];
+    state.names.clear();
+    state.file_offsets.clear();
+    state.subdirectory_offsets.clear();
+    state.file_children.clear();
+    ull local_entries = 0, local_files = 0, local_stat_calls = 0;
+
+    // With a snapshot, stat the directory itself: unchanged mtime and ctime
+    // mean the set of children is unchanged and readdir can be skipped.
+    snapshot::DirectoryRecord record;
+    const snapshot::DirectoryRecord *previous = nullptr;
+    ull directory_device = 0;
+    if (previous_snapshot != nullptr || current_snapshot != nullptr) {
+        struct statx stx;
+        ++local_stat_calls;
+        if (statx(dir_fd, "", AT_EMPTY_PATH, STATX_MTIME | STATX_CTIME, &stx) ==
+            0) {
+            directory_device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            record.mtime_sec = stx.stx_mtime.tv_sec;
+            record.mtime_nsec = stx.stx_mtime.tv_nsec;
+            record.ctime_sec = stx.stx_ctime.tv_sec;
+            record.ctime_nsec = stx.stx_ctime.tv_nsec;
+            if (previous_snapshot != nullptr) {
+                previous = previous_snapshot->find(directory.u8string());
+                if (previous != nullptr &&
+                    !previous_snapshot->is_unchanged(*previous, record))
+                    previous = nullptr;
+            }
+        }
+    }
+
+    // The child list, recorded before any exclusion so that the snapshot stays
+    // valid when the rules change.
+    DIR *dir = nullptr;
+    bool complete = true;
+    if (previous != nullptr) {
+        reused_directories.fetch_add(1, std::memory_order_relaxed);
+        state.names.assign(previous->names.begin(), previous->names.end());
+        for (size_t i = 0; i < previous->children.size(); ++i) {
+            const auto &child = previous->children[i];
+            if (child.kind == snapshot::ChildKind::DIRECTORY) {
+                state.subdirectory_offsets.push_back(child.name_offset);
+            } else {
+                state.file_offsets.push_back(child.name_offset);
+                state.file_children.push_back(i);
+            }
+        }
+        local_entries += previous->children.size();
+        if (current_snapshot != nullptr)
+            record.children = previous->children;
+    } else {
+        dir = fdopendir(dir_fd);
+        if (dir == nullptr) {
+            report_open_error();
+            close(dir_fd);
+            return;
+        }
+        if (const int error =
+                read_entries(dir, state, local_entries, local_stat_calls)) {
+            print::log(print::ERROR,
+                       std::format("[ERROR] Scanner: cannot read directory "
+                                   "{}: {}",
+                                   strencode::to_console_format(
+                                       directory.u8string()),
+                                   std::generic_category().message(error)));
+            // An incomplete child list must not be reused by the next run.
+            complete = false;
+        }
+        for (size_t i = 0; i < state.file_offsets.size(); ++i)
+            state.file_children.push_back(i);
+        if (current_snapshot != nullptr) {
+            for (size_t offset : state.file_offsets)
+                record.children.push_back({static_cast<uint32_t>(offset),
+                                           snapshot::ChildKind::OTHER, 0, 0, 0,
+                                           1});
+            for (size_t offset : state.subdirectory_offsets)
+                record.children.push_back({static_cast<uint32_t>(offset),
+                                           snapshot::ChildKind::DIRECTORY, 0,
+                                           0, 0, 1});
+        }
+    }
+    if (current_snapshot != nullptr)
+        record.names.assign(state.names.begin(), state.names.end());
+
+    // Rules of an ignore file in this directory apply to its children.
+    auto exclude_state = pending_directory.exclude_state;
+    for (size_t offset : state.file_offsets) {
+        if (config::IGNORE_FILE_NAME == state.names.data() + offset) {
+            exclude_state = exclude_engine->with_ignore_file(
+                exclude_state, directory / config::IGNORE_FILE_NAME);
+            break;
+        }
+    }
+    state.kept_files.clear();
+    for (size_t i = 0; i < state.file_offsets.size(); ++i)
+        if (!exclude_engine->is_excluded(
+                exclude_state, state.names.data() + state.file_offsets[i],
+                false, nullptr))
+            state.kept_files.push_back(i);
+    state.kept_subdirectories.clear();
+    for (size_t offset : state.subdirectory_offsets) {
+        const char *name = state.names.data() + offset;
+        std::shared_ptr<const exclude::MatchState> child_state;
+        if (exclude_engine->is_excluded(exclude_state, name, true,
+                                        &child_state)) {
+            print::log(print::RESET,
+                       "[INFO] skipped: " + strencode::to_console_format(
+                                                (directory / name).u8string()));
+            continue;
+        }
+        state.kept_subdirectories.emplace_back(offset, std::move(child_state));
+    }
+
+    // Fast incremental mode trusts the recorded metadata of files in an
+    // unchanged directory; every other file gets one statx. Symlinks are
+    // followed, so a link to a regular file is backed up by content while a
+    // link to a directory is skipped.
+    state.stat_files.clear();
+    for (size_t i : state.kept_files) {
+        if (previous != nullptr && trust_file_stats) {
+            const auto &child = previous->children[state.file_children[i]];
+            if (child.kind == snapshot::ChildKind::FILE) {
+                ++local_files;
+                fileinfo::FileInfo file_info(
+                    pathstore::arena().append(
+                        pending_directory.id, reinterpret_cast<const char8_t *>(
+                                                  previous->name_of(child))),
+                    static_cast<time_t>(child.modified_time), child.file_size);
+                file_info.set_times(
+                    child.modified_time * NS_PER_SECOND + child.modified_nsec,
+                    child.change_time * NS_PER_SECOND + child.change_nsec);
+                file_info.set_identity(directory_device, child.inode,
+                                       child.link_count);
+                on_file(id, std::move(file_info));
+                continue;
+            }
+        }
+        state.stat_files.push_back(i);
+    }
+    state.stat_requests.resize(state.stat_files.size());
+    for (size_t j = 0; j < state.stat_files.size(); ++j) {
+        auto &request = state.stat_requests[j];
+        request.name =
+            state.names.data() + state.file_offsets[state.stat_files[j]];
+        request.flags = AT_STATX_SYNC_AS_STAT;
+        request.mask = STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_CTIME |
+                       STATX_INO | STATX_NLINK;
+    }
+    state.engine->statx_batch(dir_fd, state.stat_requests);
+    local_stat_calls += state.stat_requests.size();
+    for (size_t j = 0; j < state.stat_requests.size(); ++j) {
+        const auto &request = state.stat_requests[j];
+        const bool regular =
+            request.result == 0 && S_ISREG(request.stx.stx_mode);
+        if (current_snapshot != nullptr)
+            record.children[state.file_children[state.stat_files[j]]] = {
+                static_cast<uint32_t>(request.name - state.names.data()),
+                regular ? snapshot::ChildKind::FILE : snapshot::ChildKind::OTHER,
+                request.stx.stx_mtime.tv_sec, request.stx.stx_size,
+                request.stx.stx_ino, request.stx.stx_nlink,
+                request.stx.stx_mtime.tv_nsec, request.stx.stx_ctime.tv_sec,
+                request.stx.stx_ctime.tv_nsec};
+        if (request.result != 0) {
+            print::log(print::ERROR,
+                       std::format("[ERROR] Scanner: cannot stat {}: {}",
+                                   strencode::to_console_format(
+                                       (directory / request.name).u8string()),
+                                   std::generic_category().message(
+                                       -request.result)));
+            continue;
+        }
+        if (!regular)
+            continue;
+        ++local_files;
+        fileinfo::FileInfo file_info(
+            pathstore::arena().append(
+                pending_directory.id,
+                reinterpret_cast<const char8_t *>(request.name)),
+            static_cast<time_t>(request.stx.stx_mtime.tv_sec),
+            request.stx.stx_size);
+        file_info.set_times(
+            request.stx.stx_mtime.tv_sec * NS_PER_SECOND +
+                request.stx.stx_mtime.tv_nsec,
+            request.stx.stx_ctime.tv_sec * NS_PER_SECOND +
+                request.stx.stx_ctime.tv_nsec);
+        file_info.set_identity(
+            makedev(request.stx.stx_dev_major, request.stx.stx_dev_minor),
+            request.stx.stx_ino, request.stx.stx_nlink);
+        on_file(id, std::move(file_info));
+    }
+    if (current_snapshot != nullptr && complete)
+        state.records.emplace_back(directory.u8string(), std::move(record));
+
+    // Open as many subdirectories as the descriptor budget allows; the others
+    // are opened by path when they are listed.
+    const int wanted = static_cast<int>(state.kept_subdirectories.size());
+    int budget = open_directory_fds.load(std::memory_order_relaxed);
+    int reserved = 0;
+    do {
+        reserved = std::clamp(config::SCANNER_MAX_OPEN_DIRECTORIES - budget, 0,
+                              wanted);
+    } while (reserved > 0 && !open_directory_fds.compare_exchange_weak(
+                                 budget, budget + reserved,
+                                 std::memory_order_relaxed));
+    state.open_requests.resize(reserved);
+    for (int i = 0; i < reserved; ++i)
+        state.open_requests[i] = {
+            state.names.data() + state.kept_subdirectories[i].first,
+            O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC, -1};
+    state.engine->openat_batch(dir_fd, state.open_requests);
+
+    for (int i = 0; i < wanted; ++i) {
+        auto &[offset, child_state] = state.kept_subdirectories[i];
+        const char *name = state.names.data() + offset;
+        int fd = i < reserved ? state.open_requests[i].fd : -1;
+        if (i < reserved && fd < 0)
+            open_directory_fds.fetch_sub(1, std::memory_order_relaxed);
+        push(id, {directory / name,
+                  pathstore::arena().append(
+                      pending_directory.id,
+                      reinterpret_cast<const char8_t *>(name)),
+                  std::max(fd, -1), std::move(child_state)});
+    }
+    if (dir != nullptr)
+        closedir(dir);
+    else
+        close(dir_fd);
+
+    entries.fetch_add(local_entries, std::memory_order_relaxed);
+    files.fetch_add(local_files, std::memory_order_relaxed);
+    stat_calls.fetch_add(local_stat_calls, std::memory_order_relaxed);
+}
+#else
+struct DirectoryScanner::WorkerState {};
+
+void DirectoryScanner::list_directory(int id,
+                                      const PendingDirectory &pending_directory,
+                                      const DirectoryCallback &on_directory,
+                                      const FileCallback &on_file) {
+    const fs::path &directory = pending_directory.path;
+    directories.fetch_add(1, std::memory_order_relaxed);
+    on_directory(id, pending_directory.id);
+
+    ull local_entries = 0, local_files = 0;
+    try {
+        auto exclude_state = pending_directory.exclude_state;
+        if (fs::exists(directory / config::IGNORE_FILE_NAME))
+            exclude_state = exclude_engine->with_ignore_file(
+                exclude_state, directory / config::IGNORE_FILE_NAME);
+        for (const auto &entry : fs::directory_iterator(directory)) {
+            ++local_entries;
+            std::error_code ec;
+            auto name = entry.path().filename().u8string();
+            const bool is_directory =
+                entry.is_directory(ec) && !entry.is_symlink(ec);
+            std::shared_ptr<const exclude::MatchState> child_state;
+            if (exclude_engine->is_excluded(
+                    exclude_state,
+                    std::string_view(reinterpret_cast<const char *>(name.data()),
+                                     name.size()),
+                    is_directory, &child_state)) {
+                if (is_directory)
+                    print::log(print::RESET,
+                               "[INFO] skipped: " +
+                                   strencode::to_console_format(
+                                       entry.path().u8string()));
+                continue;
+            }
+            if (is_directory) {
+                push(id, {entry.path(),
+                          pathstore::arena().append(pending_directory.id, name),
+                          -1, std::move(child_state)});
+            } else if (entry.is_regular_file(ec)) {
+                ++local_files;
+                const auto modified_time = entry.last_write_time();
+                fileinfo::FileInfo file_info(
+                    pathstore::arena().append(pending_directory.id, name),
+                    fileinfo::file_time_type2time_t(modified_time),
+                    entry.file_size());
+                file_info.set_times(fileinfo::file_time_type2ns(modified_time),
+                                    0);
+                on_file(id, std::move(file_info));
+            }
+        }
+    } catch (const fs::filesystem_error &e) {
+        print::log(print::ERROR, std::string("[ERROR] ") + e.what());
+    }
+    entries.fetch_add(local_entries, std::memory_order_relaxed);
+    files.fetch_add(local_files, std::memory_order_relaxed);
+}
+#endif
+
+void DirectoryScanner::worker_loop(int id,
+                                   const DirectoryCallback &on_directory,
+                                   const FileCallback &on_file) {
+    PendingDirectory directory;
+    while (true) {
+        if (pop_or_steal(id, directory)) {
+            list_directory(id, directory, on_directory, on_file);
+            // Children are pushed before this decrement, so `pending` can only
+            // reach zero once the whole tree has been listed.
+            if (pending.fetch_sub(1) == 1)
+                wake_idle(true);
+        } else if (pending.load(std::memory_order_acquire) == 0) {
+            return;
+        } else {
+            // Nothing to take, but others are still listing and may push.
+            std::unique_lock lock(idle_mutex);
+            idle_workers.fetch_add(1);
+            idle_cv.wait(lock, [&] {
+                return queued.load() > 0 || pending.load() == 0;
+            });
+            idle_workers.fetch_sub(1);
+        }
+    }
+}
+
+void DirectoryScanner::scan(const std::vector<fs::path> &roots,
+                            const DirectoryCallback &on_directory,
+                            const FileCallback &on_file) {
+    auto start = std::chrono::steady_clock::now();
+    directories = 0, entries = 0, files = 0, stat_calls = 0;
+    reused_directories = 0;
+    if (current_snapshot != nullptr)
+        current_snapshot->set_created_time(
+            std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count());
+
+    worker_states.clear();
+    for (int i = 0; i < thread_num; ++i) {
+        worker_states.emplace_back(std::make_unique<WorkerState>());
+#ifndef _WIN32
+        worker_states.back()->engine = metadata::create_engine(
+            use_io_uring ? metadata::EngineType::IO_URING
+                         : metadata::EngineType::SYNC,
+            config::IO_URING_QUEUE_DEPTH);
+#endif
+    }
+
+    // Spread the roots over the workers so that every worker starts busy when
+    // there are several of them.
+    for (size_t i = 0; i < roots.size(); ++i)
+        push(static_cast<int>(i % thread_num),
+             {roots[i], pathstore::arena().intern(roots[i]), -1,
+              exclude_engine->root_state()});
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < thread_num; ++i)
+        workers.emplace_back(
+            [&, i] { worker_loop(i, on_directory, on_file); });
+    worker_loop(0, on_directory, on_file);
+    for (auto &worker : workers)
+        worker.join();
+
+    stats.directories = directories;
+    stats.entries = entries;
+    stats.files = files;
+    stats.stat_calls = stat_calls;
+    stats.reused_directories = reused_directories;
+#ifndef _WIN32
+    if (current_snapshot != nullptr)
+        for (auto &state : worker_states)
+            for (auto &[path, record] : state->records)
+                current_snapshot->insert(std::move(path), std::move(record));
+    stats.engine = worker_states[0]->engine->name();
+#else
+    stats.engine = "std::filesystem";
+#endif
+    stats.seconds = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+}
+
+} // namespace scanner
@@ -0,0 +1,161 @@
+/// @file dir_snapshot.cpp
+/// @brief dir_snapshot.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <fstream>
+
+#include "dir_snapshot.hpp"
+
+namespace snapshot {
+namespace {
+constexpr char MAGIC[4] = {'B', 'S', 'D', 'S'};
+constexpr uint32_t FORMAT_VERSION = 4;
+
+template <typename T> void write_value(std::ofstream &os, const T &value) {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T> bool read_value(std::ifstream &is, T &value) {
+    return static_cast<bool>(
+        is.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+template <typename String>
+void write_string(std::ofstream &os, const String &str) {
+    write_value(os, static_cast<uint64_t>(str.size()));
+    os.write(reinterpret_cast<const char *>(str.data()), str.size());
+}
+
+template <typename String> bool read_string(std::ifstream &is, String &str) {
+    uint64_t size;
+    if (!read_value(is, size))
+        return false;
+    str.resize(size);
+    return static_cast<bool>(
+        is.read(reinterpret_cast<char *>(str.data()), size));
+}
+} // namespace
+
+bool DirectorySnapshot::load(const fs::path &file) {
+    records.clear();
+    std::ifstream is(file, std::ios::binary);
+    if (!is)
+        return false;
+
+    char magic[sizeof(MAGIC)];
+    uint32_t version;
+    uint64_t count;
+    if (!is.read(magic, sizeof(magic)) ||
+        !std::equal(magic, magic + sizeof(magic), MAGIC) ||
+        !read_value(is, version) || version != FORMAT_VERSION ||
+        !read_value(is, created_time) || !read_value(is, count))
+        return false;
+
+    records.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        std::u8string path;
+        DirectoryRecord record;
+        uint64_t child_count;
+        if (!read_string(is, path) || !read_value(is, record.mtime_sec) ||
+            !read_value(is, record.mtime_nsec) ||
+            !read_value(is, record.ctime_sec) ||
+            !read_value(is, record.ctime_nsec) ||
+            !read_string(is, record.names) || !read_value(is, child_count)) {
+            records.clear();
+            return false;
+        }
+        record.children.resize(child_count);
+        for (auto &child : record.children) {
+            if (!read_value(is, child.name_offset) ||
+                !read_value(is, child.kind) ||
+                !read_value(is, child.modified_time) ||
+                !read_value(is, child.file_size) ||
+                !read_value(is, child.inode) ||
+                !read_value(is, child.link_count) ||
+                !read_value(is, child.modified_nsec) ||
+                !read_value(is, child.change_time) ||
+                !read_value(is, child.change_nsec) ||
+                child.name_offset >= record.names.size()) {
+                records.clear();
+                return false;
+            }
+        }
+        records.emplace(std::move(path), std::move(record));
+    }
+    return true;
+}
+
+bool DirectorySnapshot::save(const fs::path &file) const {
+    std::ofstream os(file, std::ios::binary);
+    if (!os)
+        return false;
+    os.write(MAGIC, sizeof(MAGIC));
+    write_value(os, FORMAT_VERSION);
+    write_value(os, created_time);
+    write_value(os, static_cast<uint64_t>(records.size()));
+    for (const auto &[path, record] : records) {
+        write_string(os, path);
+        write_value(os, record.mtime_sec);
+        write_value(os, record.mtime_nsec);
+        write_value(os, record.ctime_sec);
+        write_value(os, record.ctime_nsec);
+        write_string(os, record.names);
+        write_value(os, static_cast<uint64_t>(record.children.size()));
+        for (const auto &child : record.children) {
+            write_value(os, child.name_offset);
+            write_value(os, child.kind);
+            write_value(os, child.modified_time);
+            write_value(os, child.file_size);
+            write_value(os, child.inode);
+            write_value(os, child.link_count);
+            write_value(os, child.modified_nsec);
+            write_value(os, child.change_time);
+            write_value(os, child.change_nsec);
+        }
+    }
+    return static_cast<bool>(os);
+}
+
+const DirectoryRecord *
+DirectorySnapshot::find(const std::u8string &path) const {
+    auto it = records.find(path);
+    return it == records.end() ? nullptr : &it->second;
+}
+
+bool DirectorySnapshot::is_unchanged(const DirectoryRecord &record,
+                                     const DirectoryRecord &current) const {
+    // A directory modified in the same second the previous scan started may
+    // have changed again after it was listed without its mtime moving on
+    // filesystems with coarse timestamps.
+    return record.mtime_sec == current.mtime_sec &&
+           record.mtime_nsec == current.mtime_nsec &&
+           record.ctime_sec == current.ctime_sec &&
+           record.ctime_nsec == current.ctime_nsec &&
+           current.mtime_sec < created_time && current.ctime_sec < created_time;
+}
+
+void DirectorySnapshot::insert(std::u8string path, DirectoryRecord record) {
+    records.insert_or_assign(std::move(path), std::move(record));
+}
+
+void DirectorySnapshot::merge_outside(const DirectorySnapshot &previous,
+                                      const std::vector<fs::path> &roots) {
+    auto is_under_roots = [&](const fs::path &path) {
+        for (const auto &root : roots) {
+            auto [root_end, _] = std::mismatch(root.begin(), root.end(),
+                                               path.begin(), path.end());
+            if (root_end == root.end())
+                return true;
+        }
+        return false;
+    };
+    for (const auto &[path, record] : previous.records)
+        if (!records.contains(path) && !is_under_roots(fs::path(path)))
+            records.emplace(path, record);
+}
+} // namespace snapshot
@@ -0,0 +1,345 @@
+/// @file exclude.cpp
+/// @brief exclude.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <bitset>
+#include <format>
+#include <fstream>
+
+#include "config.hpp"
+#include "exclude.hpp"
+#include "print.hpp"
+#include "str_encode.hpp"
+
+namespace exclude {
+namespace {
+/// 通配符的一个token：接受的字节集合，或`*`。
+struct Token {
+    std::bitset<256> chars;
+    bool star = false;
+};
+
+/// Splits a glob into tokens, collapsing runs of `*`.
+std::vector<Token> parse_glob(std::string_view glob) {
+    std::vector<Token> tokens;
+    for (size_t i = 0; i < glob.size(); ++i) {
+        Token token;
+        const unsigned char c = glob[i];
+        if (c == '*') {
+            if (!tokens.empty() && tokens.back().star)
+                continue;
+            token.star = true;
+        } else if (c == '?') {
+            token.chars.set();
+        } else if (c == '[' && glob.find(']', i + 2) != std::string_view::npos) {
+            size_t j = i + 1;
+            const bool negated = glob[j] == '!' || glob[j] == '^';
+            if (negated)
+                ++j;
+            // A ']' right after the opening bracket is a literal member.
+            size_t first = j;
+            for (; j < glob.size() && (glob[j] != ']' || j == first); ++j) {
+                unsigned char low = glob[j], high = low;
+                if (j + 2 < glob.size() && glob[j + 1] == '-' &&
+                    glob[j + 2] != ']') {
+                    high = glob[j + 2];
+                    j += 2;
+                }
+                for (unsigned ch = low; ch <= high; ++ch)
+                    token.chars.set(ch);
+            }
+            if (negated)
+                token.chars.flip();
+            i = j;
+        } else if (c == '\\' && i + 1 < glob.size()) {
+            token.chars.set(static_cast<unsigned char>(glob[++i]));
+        } else {
+            token.chars.set(c);
+        }
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+/// Shifts a multi-word bit set left by one bit.
+void shift_left(std::vector<uint64_t> &bits) {
+    uint64_t carry = 0;
+    for (auto &word : bits) {
+        uint64_t next = word >> 63;
+        word = (word << 1) | carry;
+        carry = next;
+    }
+}
+
+bool test_bit(const std::vector<uint64_t> &bits, size_t i) {
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+void set_bit(std::vector<uint64_t> &bits, size_t i) {
+    bits[i / 64] |= uint64_t(1) << (i % 64);
+}
+
+/// Escapes the glob metacharacters of a literal name.
+std::string escape(std::string_view name) {
+    std::string escaped;
+    for (char c : name) {
+        if (c == '*' || c == '?' || c == '[' || c == '\\' || c == '!' ||
+            c == '#')
+            escaped.push_back('\\');
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+} // namespace
+
+RuleSet::RuleSet(const std::vector<std::string> &lines, std::string source)
+    : source(std::move(source)) {
+    std::vector<std::vector<Token>> globs;
+    for (std::string line : lines) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        // Trailing spaces are ignored unless escaped.
+        while (!line.empty() && line.back() == ' ' &&
+               !(line.size() > 1 && line[line.size() - 2] == '\\'))
+            line.pop_back();
+
+        Rule rule;
+        rule.pattern = line;
+        if (line[0] == '!') {
+            rule.negated = true;
+            line.erase(0, 1);
+        } else if (line.starts_with("\\!") || line.starts_with("\\#")) {
+            line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.directory_only = true;
+            line.pop_back();
+        }
+        // A slash anywhere but at the end anchors the pattern to the directory
+        // of its source; otherwise it matches a name at any depth.
+        const bool anchored = line.find('/') != std::string::npos;
+        if (!anchored)
+            rule.components.push_back(DOUBLE_STAR);
+        size_t begin = 0;
+        while (begin <= line.size()) {
+            size_t end = std::min(line.find('/', begin), line.size());
+            std::string_view component(line.data() + begin, end - begin);
+            begin = end + 1;
+            if (component.empty())
+                continue;
+            if (component == "**") {
+                if (rule.components.empty() ||
+                    rule.components.back() != DOUBLE_STAR)
+                    rule.components.push_back(DOUBLE_STAR);
+            } else {
+                rule.components.push_back(static_cast<uint32_t>(globs.size()));
+                globs.push_back(parse_glob(component));
+            }
+        }
+        if (rule.components.empty())
+            continue;
+        rules.push_back(std::move(rule));
+    }
+
+    // Lay the globs out side by side in one state vector.
+    for (const auto &tokens : globs)
+        state_count += tokens.size() + 1;
+    const size_t words = (state_count + 63) / 64;
+    char_masks.assign(256 * words, 0);
+    star_mask.assign(words, 0);
+    start_mask.assign(words, 0);
+    size_t state = 0;
+    for (const auto &tokens : globs) {
+        set_bit(start_mask, state);
+        for (const auto &token : tokens) {
+            if (token.star) {
+                set_bit(star_mask, state);
+            } else {
+                for (unsigned c = 0; c < 256; ++c)
+                    if (token.chars.test(c))
+                        char_masks[c * words + state / 64] |= uint64_t(1)
+                                                              << (state % 64);
+            }
+            ++state;
+        }
+        accept_states.push_back(static_cast<uint32_t>(state++));
+    }
+}
+
+std::shared_ptr<RuleSet> RuleSet::load(const fs::path &file) {
+    std::ifstream is(file);
+    if (!is)
+        return nullptr;
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(is, line);)
+        lines.push_back(std::move(line));
+    auto rule_set = std::make_shared<RuleSet>(
+        lines, strencode::to_console_format(file.u8string()));
+    return rule_set->size() ? rule_set : nullptr;
+}
+
+void RuleSet::match(std::string_view name,
+                    std::vector<uint64_t> &matched) const {
+    const size_t words = start_mask.size();
+    thread_local std::vector<uint64_t> active, moved;
+    active = start_mask;
+    moved.resize(words);
+
+    // A `*` state may also be skipped without consuming anything.
+    auto close_stars = [&] {
+        for (size_t w = 0; w < words; ++w)
+            moved[w] = active[w] & star_mask[w];
+        shift_left(moved);
+        for (size_t w = 0; w < words; ++w)
+            active[w] |= moved[w];
+    };
+    close_stars();
+    for (unsigned char c : name) {
+        const uint64_t *mask = char_masks.data() + c * words;
+        bool any = false;
+        for (size_t w = 0; w < words; ++w)
+            moved[w] = active[w] & mask[w];
+        shift_left(moved);
+        for (size_t w = 0; w < words; ++w) {
+            active[w] = moved[w] | (active[w] & star_mask[w]);
+            any |= active[w] != 0;
+        }
+        if (!any)
+            break;
+        close_stars();
+    }
+
+    matched.assign((accept_states.size() + 63) / 64, 0);
+    for (size_t glob = 0; glob < accept_states.size(); ++glob)
+        if (test_bit(active, accept_states[glob]))
+            set_bit(matched, glob);
+}
+
+MatchState::Group
+ExcludeEngine::start_group(std::shared_ptr<const RuleSet> set) {
+    MatchState::Group group{std::move(set), {}};
+    for (uint32_t rule = 0; rule < group.rule_set->rules.size(); ++rule) {
+        group.active.push_back({rule, 0});
+        // A leading `**` may match no component at all.
+        if (group.rule_set->rules[rule].components[0] == RuleSet::DOUBLE_STAR &&
+            group.rule_set->rules[rule].components.size() > 1)
+            group.active.push_back({rule, 1});
+    }
+    return group;
+}
+
+ExcludeEngine::ExcludeEngine(const std::vector<std::string> &patterns) {
+    std::vector<std::string> builtin;
+    for (const auto &path : config::IGNORED_PATH)
+        if (path != "." && path != "..") {
+            auto name = path.u8string();
+            builtin.push_back(escape(std::string(name.begin(), name.end())));
+        }
+
+    auto state = std::make_shared<MatchState>();
+    for (auto set : {std::make_shared<const RuleSet>(builtin, "builtin"),
+                     std::make_shared<const RuleSet>(patterns, "--exclude")}) {
+        if (set->size() == 0)
+            continue;
+        rule_sets.push_back(set);
+        state->groups.push_back(start_group(set));
+    }
+    root = state;
+}
+
+bool ExcludeEngine::is_excluded(
+    const std::shared_ptr<const MatchState> &state, std::string_view name,
+    bool is_directory, std::shared_ptr<const MatchState> *child_state) const {
+    thread_local std::vector<uint64_t> matched;
+    // Only directories that may be listed need the state of the next level.
+    const bool track = is_directory && child_state != nullptr;
+    auto child = track ? std::make_shared<MatchState>() : nullptr;
+    const RuleSet::Rule *winner = nullptr;
+
+    for (const auto &group : state->groups) {
+        const RuleSet &set = *group.rule_set;
+        set.match(name, matched);
+        MatchState::Group child_group{group.rule_set, {}};
+        auto advance = [&](uint32_t rule, uint32_t component) {
+            if (!track)
+                return;
+            const auto &components = set.rules[rule].components;
+            for (; component < components.size(); ++component) {
+                MatchState::Active next{rule, component};
+                if (std::find(child_group.active.begin(),
+                              child_group.active.end(),
+                              next) == child_group.active.end())
+                    child_group.active.push_back(next);
+                // `**` may also match no component; keep going past it.
+                if (components[component] != RuleSet::DOUBLE_STAR ||
+                    component + 1 == components.size())
+                    break;
+            }
+        };
+
+        const RuleSet::Rule *group_winner = nullptr;
+        uint32_t group_winner_index = 0;
+        for (const auto &[rule_index, component] : group.active) {
+            const auto &rule = set.rules[rule_index];
+            const uint32_t glob = rule.components[component];
+            const bool last = component + 1 == rule.components.size();
+            bool matches;
+            if (glob == RuleSet::DOUBLE_STAR) {
+                matches = last;
+                advance(rule_index, component);
+            } else {
+                matches = test_bit(matched, glob) && last;
+                if (test_bit(matched, glob) && !last)
+                    advance(rule_index, component + 1);
+            }
+            if (matches && (!rule.directory_only || is_directory) &&
+                (group_winner == nullptr || rule_index > group_winner_index))
+                group_winner = &rule, group_winner_index = rule_index;
+        }
+        if (group_winner != nullptr)
+            winner = group_winner;
+        if (track && !child_group.active.empty())
+            child->groups.push_back(std::move(child_group));
+    }
+
+    if (winner != nullptr)
+        winner->hits.fetch_add(1, std::memory_order_relaxed);
+    const bool excluded = winner != nullptr && !winner->negated;
+    if (!excluded && track)
+        *child_state = child->groups == state->groups ? state : child;
+    return excluded;
+}
+
+std::shared_ptr<const MatchState>
+ExcludeEngine::with_ignore_file(const std::shared_ptr<const MatchState> &state,
+                                const fs::path &file) {
+    auto set = RuleSet::load(file);
+    if (set == nullptr)
+        return state;
+    {
+        std::lock_guard lock(mutex);
+        rule_sets.push_back(set);
+    }
+    auto next = std::make_shared<MatchState>(*state);
+    next->groups.push_back(start_group(set));
+    return next;
+}
+
+void ExcludeEngine::report() const {
+    std::lock_guard lock(mutex);
+    for (const auto &set : rule_sets)
+        for (size_t i = 0; i < set->size(); ++i)
+            print::log(print::RESET,
+                       std::format("[INFO] Exclude: {} hits: {} ({})",
+                                   set->get_hits(i), set->get_pattern(i),
+                                   set->get_source()),
+                       false);
+}
+} // namespace exclude
@@ -0,0 +1,45 @@
+/// @file extent.cpp
+/// @brief extent.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include "extent.hpp"
+
+#ifndef _WIN32
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace extent {
+
+PhysicalKey physical_key(const fs::path &path, ull inode) {
+    PhysicalKey key{true, inode};
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd < 0) // O_NOATIME is refused for files owned by other users
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return key;
+
+    // Room for the header plus a single extent: only the first one matters.
+    alignas(fiemap) char buffer[sizeof(fiemap) + sizeof(fiemap_extent)];
+    std::memset(buffer, 0, sizeof(buffer));
+    auto *map = reinterpret_cast<fiemap *>(buffer);
+    map->fm_start = 0;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+    if (ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0 &&
+        !(map->fm_extents[0].fe_flags & FIEMAP_EXTENT_UNKNOWN))
+        key = {false, map->fm_extents[0].fe_physical};
+    close(fd);
+#endif
+    return key;
+}
+} // namespace extent
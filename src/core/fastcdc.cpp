@@ -0,0 +1,164 @@
+/// @file fastcdc.cpp
+/// @brief fastcdc.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+#include "fastcdc.hpp"
+
+namespace fastcdc {
+namespace {
+using ull = unsigned long long;
+
+/// @brief A fixed pseudo-random value per byte, so that the cut points and
+/// with them the chunk digests stay the same across runs and builds.
+constexpr std::array<ull, 256> make_gear_table() {
+    std::array<ull, 256> table{};
+    ull state = 0x4241434b55505359; // splitmix64
+    for (auto &value : table) {
+        ull z = state += 0x9e3779b97f4a7c15;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}
+
+constexpr std::array<ull, 256> GEAR = make_gear_table();
+
+/// @brief A mask of the top `bits` bits, which depend on the whole window;
+/// the low bits only see the last few bytes.
+constexpr ull top_bits(int bits) { return ~0ull << (64 - bits); }
+
+/// Independent hash chains scanned together, each over its own segment.
+constexpr size_t LANES = 4;
+
+/// The length of each lane's segment per round: long enough to hide the
+/// warm-up of the window, short enough that little is scanned past a cut.
+constexpr size_t LANE_SIZE = 1 << 14;
+
+/// @brief Scans `LANES` consecutive segments of `LANE_SIZE` bytes at once.
+/// @return The first position relative to `data` whose hash matches, or
+/// `LANES * LANE_SIZE`.
+size_t scan_lanes(const unsigned char *data, ull mask) {
+    const unsigned char *const l0 = data, *const l1 = data + LANE_SIZE,
+                               *const l2 = data + 2 * LANE_SIZE,
+                               *const l3 = data + 3 * LANE_SIZE;
+    ull h0 = 0, h1 = 0, h2 = 0, h3 = 0;
+    for (ptrdiff_t k = -static_cast<ptrdiff_t>(WINDOW_SIZE - 1); k < 0; ++k) {
+        h0 = (h0 << 1) + GEAR[l0[k]];
+        h1 = (h1 << 1) + GEAR[l1[k]];
+        h2 = (h2 << 1) + GEAR[l2[k]];
+        h3 = (h3 << 1) + GEAR[l3[k]];
+    }
+    size_t found[LANES] = {LANE_SIZE, LANE_SIZE, LANE_SIZE, LANE_SIZE};
+    for (size_t k = 0; k < LANE_SIZE; ++k) {
+        h0 = (h0 << 1) + GEAR[l0[k]];
+        h1 = (h1 << 1) + GEAR[l1[k]];
+        h2 = (h2 << 1) + GEAR[l2[k]];
+        h3 = (h3 << 1) + GEAR[l3[k]];
+        // Rarely taken, so the branches cost next to nothing.
+        if ((h0 & mask) && (h1 & mask) && (h2 & mask) && (h3 & mask))
+            continue;
+        const ull hashes[LANES] = {h0, h1, h2, h3};
+        for (size_t j = 0; j < LANES; ++j)
+            if ((hashes[j] & mask) == 0 && found[j] == LANE_SIZE)
+                found[j] = k;
+        // The first lane decides; later lanes only matter if it has none.
+        if (found[0] != LANE_SIZE)
+            break;
+    }
+    for (size_t j = 0; j < LANES; ++j)
+        if (found[j] != LANE_SIZE)
+            return j * LANE_SIZE + found[j];
+    return LANES * LANE_SIZE;
+}
+} // namespace
+
+size_t scan_scalar(const unsigned char *data, size_t begin, size_t end,
+                   ull mask) {
+    if (begin >= end)
+        return end;
+    ull hash = 0;
+    for (size_t i = begin - (WINDOW_SIZE - 1); i < begin; ++i)
+        hash = (hash << 1) + GEAR[data[i]];
+    for (size_t i = begin; i < end; ++i) {
+        hash = (hash << 1) + GEAR[data[i]];
+        if ((hash & mask) == 0)
+            return i;
+    }
+    return end;
+}
+
+size_t scan(const unsigned char *data, size_t begin, size_t end, ull mask) {
+    // The chains are independent, so the CPU overlaps their shift-and-add
+    // latency; each lane starts with the window before its first position,
+    // so its hashes equal the sequential ones.
+    size_t i = begin;
+    for (; i < end && end - i >= LANES * LANE_SIZE; i += LANES * LANE_SIZE) {
+        const size_t found = scan_lanes(data + i, mask);
+        if (found != LANES * LANE_SIZE)
+            return i + found;
+    }
+    return scan_scalar(data, i, end, mask);
+}
+
+size_t cut(const unsigned char *data, size_t size, const Params &params) {
+    if (size <= params.min_size)
+        return size;
+    // Normalized chunking: one bit more than the average below it, one bit
+    // less above it.
+    const int bits = std::countr_zero(params.average_size);
+    const size_t limit = std::min(size, params.max_size);
+    // A cut at position `i` ends the chunk after it.
+    const size_t normal = std::min(params.average_size - 1, limit);
+    size_t i = scan(data, params.min_size - 1, normal, top_bits(bits + 1));
+    if (i < normal)
+        return i + 1;
+    i = scan(data, normal, limit, top_bits(bits - 1));
+    return i < limit ? i + 1 : limit;
+}
+
+Chunker::Chunker(const Params &params) : params(params) {
+    if (params.min_size < WINDOW_SIZE ||
+        params.min_size > params.average_size ||
+        params.average_size > params.max_size ||
+        !std::has_single_bit(params.average_size))
+        throw std::invalid_argument("Chunker: Invalid chunk sizes");
+}
+
+void Chunker::update(const char *data, size_t size,
+                     const Callback &on_chunk) {
+    buffer.append(data, size);
+    // Waiting for two maximal chunks moves each byte at most once when the
+    // rest is shifted to the front.
+    if (buffer.size() - start >= 2 * params.max_size)
+        emit(false, on_chunk);
+}
+
+void Chunker::finish(const Callback &on_chunk) {
+    emit(true, on_chunk);
+    buffer.clear();
+    start = 0;
+}
+
+void Chunker::emit(bool end, const Callback &on_chunk) {
+    // With fewer than `max_size` bytes the cut may depend on data to come.
+    while (buffer.size() - start >= (end ? 1 : params.max_size)) {
+        const size_t size = cut(
+            reinterpret_cast<const unsigned char *>(buffer.data()) + start,
+            buffer.size() - start, params);
+        on_chunk(std::string_view(buffer).substr(start, size));
+        start += size;
+    }
+    buffer.erase(0, start);
+    start = 0;
+}
+} // namespace fastcdc
@@ -12,6 +12,10 @@
 #include <format>
 #include <sstream>
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
 #include "file_info.hpp"
 #include "nlohmann/json.hpp"
 #include "print.hpp"
@@ -23,23 +27,86 @@ time_t file_time_type2time_t(fs::file_time_type ftime) {
     return std::chrono::system_clock::to_time_t(systemTimePoint);
 }
 
+long long file_time_type2ns(fs::file_time_type ftime) {
+    auto systemTimePoint =
+        std::chrono::clock_cast<std::chrono::system_clock>(ftime);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               systemTimePoint.time_since_epoch())
+        .count();
+}
+
 void from_json(const json &j, FileInfo &f) {
     std::string path;
-    j.at("path").get_to(path), f.path = path;
-    j.at("modified").get_to(f.modified_time);
+    j.at("path").get_to(path);
+    f.path_id = pathstore::arena().intern(
+        fs::path(std::u8string(path.begin(), path.end())));
+    // Manifests before nanosecond timestamps only have "modified" seconds.
+    time_t modified_time;
+    j.at("modified").get_to(modified_time);
+    f.modified_time_ns =
+        j.value("mtime_ns", modified_time * FileInfo::NS_PER_SECOND);
+    f.change_time_ns = j.value("ctime_ns", 0ll);
+    f.device = j.value("dev", ull(0));
+    f.inode = j.value("inode", ull(0));
     j.at("size").get_to(f.file_size);
-    j.at("md5").get_to(f.md5_value);
+    // Entries without an algorithm were written by MD5-only versions.
+    f.hash_algorithm = config::HashAlgorithm::MD5;
+    f.tree_chunk_size = j.value("tree", ull(0));
+    if (j.contains("algorithm")) {
+        std::string algorithm;
+        j.at("algorithm").get_to(algorithm);
+        if (!contenthash::parse_algorithm(algorithm, f.hash_algorithm))
+            throw std::runtime_error("FileInfo: Unknown hash algorithm: " +
+                                     algorithm);
+    }
+    const auto &hex =
+        j.at(j.contains("algorithm") ? "hash" : "md5").get_ref<const string &>();
+    if (!contenthash::from_hex(hex, f.hash_value))
+        throw std::runtime_error("FileInfo: Invalid hash value: " + hex);
+    f.chunks.clear();
+    if (j.contains("chunks")) {
+        for (const auto &chunk : j.at("chunks")) {
+            const auto &chunk_hex = chunk.get_ref<const string &>();
+            if (!contenthash::from_hex(chunk_hex, f.chunks.emplace_back()))
+                throw std::runtime_error("FileInfo: Invalid chunk hash: " +
+                                         chunk_hex);
+        }
+    }
 }
 void to_json(json &j, const FileInfo &f) {
-    std::u8string p = f.path.u8string();
+    std::u8string p = f.get_path().u8string();
     j = json{{"path", string(p.begin(), p.end())},
-             {"modified", f.modified_time},
-             {"size", f.file_size},
-             {"md5", f.md5_value}};
+             {"modified", f.get_modified_time()},
+             {"size", f.file_size}};
+    // Whole-second times stay in the old format.
+    if (f.modified_time_ns !=
+        f.get_modified_time() * FileInfo::NS_PER_SECOND)
+        j["mtime_ns"] = f.modified_time_ns;
+    if (f.change_time_ns != 0)
+        j["ctime_ns"] = f.change_time_ns;
+    if (f.inode != 0)
+        j["dev"] = f.device, j["inode"] = f.inode;
+    if (f.tree_chunk_size != 0)
+        j["tree"] = f.tree_chunk_size;
+    if (f.hash_algorithm == config::HashAlgorithm::MD5 &&
+        f.tree_chunk_size == 0) {
+        j["md5"] = contenthash::to_hex(f.hash_value);
+    } else {
+        j["algorithm"] = contenthash::algorithm_name(f.hash_algorithm);
+        j["hash"] = contenthash::to_hex(f.hash_value);
+    }
+    if (!f.chunks.empty()) {
+        json chunks = json::array();
+        for (const auto &chunk : f.chunks)
+            chunks.push_back(contenthash::to_hex(chunk));
+        j["chunks"] = std::move(chunks);
+    }
 }
 
 FileInfo::FileInfo(const fs::path &path)
-    : path(path), modified_time(0), file_size(0), md5_value("") {
+    : path_id(pathstore::arena().intern(path)), modified_time_ns(0),
+      change_time_ns(0), file_size(0), device(0), inode(0), link_count(1),
+      hash_algorithm(config::HashAlgorithm::MD5), tree_chunk_size(0) {
     if (!std::filesystem::exists(path)) {
         print::log(print::ERROR, "[ERROR] FileInfo: File does not exist");
         return;
@@ -51,13 +118,46 @@ FileInfo::FileInfo(const fs::path &path)
     auto _modified_time =
         std::filesystem::last_write_time(path, ec);
     if (!ec) {
-        modified_time = file_time_type2time_t(_modified_time);
+        modified_time_ns = file_time_type2ns(_modified_time);
     } else {
         std::cerr << "[ERROR] FileInfo: Failed to retrieve modification time: "
                   << ec.message() << std::endl;
     }
 
     file_size = std::filesystem::file_size(path);
+#ifndef _WIN32
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) {
+        modified_time_ns =
+            st.st_mtim.tv_sec * NS_PER_SECOND + st.st_mtim.tv_nsec;
+        change_time_ns = st.st_ctim.tv_sec * NS_PER_SECOND + st.st_ctim.tv_nsec;
+        device = st.st_dev, inode = st.st_ino, link_count = st.st_nlink;
+    }
+#endif
+}
+
+bool metadata_matches(const FileInfo &file) {
+    const fs::path path = file.get_path();
+#ifndef _WIN32
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+        return false;
+    const long long ns_per_second = 1000000000;
+    return ull(st.st_size) == file.get_file_size() &&
+           st.st_mtim.tv_sec * ns_per_second + st.st_mtim.tv_nsec ==
+               file.get_modified_time_ns() &&
+           (file.get_change_time_ns() == 0 ||
+            st.st_ctim.tv_sec * ns_per_second + st.st_ctim.tv_nsec ==
+                file.get_change_time_ns()) &&
+           (file.get_inode() == 0 || (ull(st.st_dev) == file.get_device() &&
+                                      ull(st.st_ino) == file.get_inode()));
+#else
+    std::error_code ec_size, ec_time;
+    const auto size = fs::file_size(path, ec_size);
+    const auto time = fs::last_write_time(path, ec_time);
+    return !ec_size && !ec_time && size == file.get_file_size() &&
+           file_time_type2ns(time) == file.get_modified_time_ns();
+#endif
 }
 
 } // namespace fileinfo
\ No newline at end of file
@@ -6,159 +6,433 @@
 // Licensed under the MIT License. See LICENSE file in the root directory for
 // details.
 
-#include <array>
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
-#include <iomanip>
+#include <iterator>
 #include <mutex>
-#include <sstream>
+#include <optional>
 #include <string>
-#include <unordered_map>
-
-#include <openssl/evp.h>
+#include <unordered_set>
 
+#include "content_hash.hpp"
+#include "fastcdc.hpp"
 #include "file_info_md5.hpp"
+#include "hash_store.hpp"
+#include "md5_multi.hpp"
+#include "read_engine.hpp"
+#include "siphash.hpp"
+#include "str_encode.hpp"
+#include "tree_hash.hpp"
 
 namespace fileinfo {
-constexpr int MD5_DIGEST_BYTE_LEN = 16;
-fs::path PATH_MD5_CACHE;
-std::unordered_map<ull, std::array<unsigned char, MD5_DIGEST_BYTE_LEN>>
-    cached_md5;
-std::mutex cached_md5_mutex;
-
-/// @brief Converts a binary digest to a hexadecimal string.
-/// @param[in] digest The binary digest array.
-/// @param[in] len The length of the digest.
-/// @return A hexadecimal encoded string representation of the digest.
-string hex_encode(const unsigned char digest[EVP_MAX_MD_SIZE],
-                  unsigned int len) {
-    std::stringstream ss;
-    ss << std::hex << std::uppercase;
-    for (unsigned int i = 0; i < len; ++i) {
-        ss << std::setw(2) << std::setfill('0')
-           << (static_cast<unsigned int>(digest[i]) & 0xFF);
-    }
-    return ss.str();
-}
+/// Cached hashes of `config::HASH_ALGORITHM`: each value is the identity
+/// of the file followed by the binary digest, see `CacheEntry`.
+hashstore::HashStore cached_md5;
 
-/// @brief Combines a value into the hash seed.
-/// @details This function is used to combine different parts of an object's
-/// data (e.g., path, modified time, size) into a single hash value for use in
-/// unordered_map hashing.
-/// @param[in,out] seed The seed value that will be combined with the hash of
-/// the given value.
-/// @param[in] value The value to be combined into the hash seed.
-template <typename T> inline void hash_combine(size_t &seed, const T &value) {
-    seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-}
+/// SipHash key of the cache keys. It is fixed so that keys stay the same
+/// across runs and builds.
+constexpr ull CACHE_KEY_K0 = 0x4261636b75705379ull;
+constexpr ull CACHE_KEY_K1 = 0x7374656d43616368ull;
 
-/// @brief Hashing function for FileInfo objects.
-/// @details This function is used as a hasher in unordered_map for FileInfo
-/// objects based on their path, modified time, and size.
-/// @param[in] f The FileInfo object to be hashed.
-/// @return A hash value calculated from the file's path, modified time, and
-/// size(not related to file content).
-ull FileInfo_hash(const FileInfo &f) {
-    size_t seed = 0;
-    hash_combine(seed, f.get_path());
-    hash_combine(seed, f.get_modified_time());
-    hash_combine(seed, f.get_file_size());
-    return seed;
-}
+/// Chunk lists of chunked files, one file per cache key, see
+/// `load_chunk_list`. Empty until `init`.
+fs::path chunk_lists;
+const char CHUNK_LIST_MAGIC[4] = {'B', 'S', 'C', 'L'};
+/// Names of the chunk lists loaded or saved in this run; the others are
+/// removed by `update_cached_hash`, see `prune_chunk_lists`.
+std::unordered_set<string> used_chunk_lists;
+std::mutex used_chunk_lists_mutex;
+
+/// @brief The metadata a cached hash is valid for.
+struct CacheIdentity {
+    ull device;
+    ull inode;
+    ull size;
+    long long mtime_ns;
+    long long ctime_ns;
+};
+static_assert(sizeof(CacheIdentity) == 40);
+
+/// @brief Where a file's hash lives in the cache.
+/// @details The key is a 128-bit SipHash of the path and the tree chunk
+/// size, so it is stable across standard library versions. The metadata is
+/// stored in front of the digest and compared on every hit rather than
+/// hashed into the key: a hit is only taken when the whole identity matches,
+/// and a changed file replaces its entry instead of leaving a stale one.
+struct CacheEntry {
+    hashcache::Key key;
+    string identity;
+
+    CacheEntry(const FileInfo &file, ull tree_chunk_size = 0) {
+        const auto path = file.get_path().generic_u8string();
+        string message(reinterpret_cast<const char *>(path.data()),
+                       path.size());
+        message.append(reinterpret_cast<const char *>(&tree_chunk_size),
+                       sizeof(tree_chunk_size));
+        key = siphash::hash128(CACHE_KEY_K0, CACHE_KEY_K1, message);
+
+        const CacheIdentity fields{file.get_device(), file.get_inode(),
+                                   file.get_file_size(),
+                                   file.get_modified_time_ns(),
+                                   file.get_change_time_ns()};
+        identity.assign(reinterpret_cast<const char *>(&fields),
+                        sizeof(fields));
+    }
+
+    /// @brief Extracts the digest of a cached value whose identity matches.
+    bool matches(const string &value, contenthash::Digest &digest) const {
+        if (value.compare(0, identity.size(), identity) != 0)
+            return false;
+        digest = contenthash::Digest(
+            std::string_view(value).substr(identity.size()));
+        return true;
+    }
+};
 
 void init() {
-    PATH_MD5_CACHE = config::PATH_MD5_CACHE / (env::UUID + ".bin");
+    // One cache per algorithm; MD5 has no suffix, as before.
+    const auto algorithm = config::HASH_ALGORITHM;
+    string stem = env::UUID;
+    if (algorithm != config::HashAlgorithm::MD5)
+        stem += std::string(".") + contenthash::algorithm_name(algorithm);
     if (!fs::exists(config::PATH_MD5_CACHE))
         fs::create_directories(config::PATH_MD5_CACHE);
-    std::ifstream ifs(PATH_MD5_CACHE, std::ios::binary);
-    if (ifs) {
-        ull hash;
-        unsigned char md5[MD5_DIGEST_BYTE_LEN];
-        while (ifs.read(reinterpret_cast<char *>(&hash), sizeof(hash))) {
-            ifs.read(reinterpret_cast<char *>(md5), MD5_DIGEST_BYTE_LEN);
-            cached_md5[hash] = std::array<unsigned char, MD5_DIGEST_BYTE_LEN>();
-            std::copy(md5, md5 + MD5_DIGEST_BYTE_LEN, cached_md5[hash].begin());
-        }
+    // Keys of the flat `.bin` file of earlier versions came from std::hash
+    // and cannot be carried over.
+    std::error_code ec;
+    fs::remove(config::PATH_MD5_CACHE / (stem + ".bin"), ec);
+    chunk_lists = config::PATH_MD5_CACHE / (stem + ".chunks");
+    cached_md5.open(config::PATH_MD5_CACHE / (stem + ".tbl"),
+                    sizeof(CacheIdentity) + contenthash::digest_size(algorithm));
+}
+/// @brief Removes the chunk lists this run neither loaded nor saved.
+/// @details A list belongs to one path and one version of the file, and a
+/// changed file gets its list rewritten under the same name; lists of files
+/// that were deleted or are no longer chunked would otherwise stay forever.
+/// A run that used no chunk list leaves them alone, as do temporary files,
+/// which may belong to a concurrent run.
+void prune_chunk_lists() {
+    std::lock_guard lock(used_chunk_lists_mutex);
+    if (chunk_lists.empty() || used_chunk_lists.empty())
+        return;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(chunk_lists, ec)) {
+        const fs::path &list = entry.path();
+        if (list.extension() != ".tmp" &&
+            !used_chunk_lists.contains(list.filename().string()))
+            fs::remove(list, ec);
     }
+    used_chunk_lists.clear();
 }
-void update_cached_md5() {
-    std::ofstream cache_ouput_stream(PATH_MD5_CACHE, std::ios::binary);
-
-    if (cache_ouput_stream) {
-        for (const auto &[hash, md5] : cached_md5) {
-            cache_ouput_stream.write(reinterpret_cast<const char *>(&hash),
-                                     sizeof(hash));
-            cache_ouput_stream.write(reinterpret_cast<const char *>(md5.data()),
-                                     md5.size());
-        }
+
+void update_cached_hash() {
+    try {
+        cached_md5.close();
+        prune_chunk_lists();
+    } catch (const std::exception &e) {
+        print::log(print::WARN,
+                   std::string("[WARN] Failed to update the hash cache: ") +
+                       e.what());
     }
 }
 
-void calculate_md5_value(FileInfo &file) {
-    unsigned char digest[EVP_MAX_MD_SIZE]; // MD5 输出的缓冲区
-    unsigned int digest_length;
+/// @brief Looks up the cache and fills in the cached value.
+/// @return Whether the file can be skipped: a hit is trusted unless
+/// `config::VERIFY_CACHED_HASH` asks to recompute and compare, see
+/// `store_result`.
+bool use_cached(FileInfo &file, const CacheEntry &entry,
+                ull tree_chunk_size = 0) {
+    if (!config::SHOULD_CHECK_CACHED_MD5)
+        return false;
+    string value;
+    contenthash::Digest digest;
+    if (!cached_md5.find(entry.key, value) || !entry.matches(value, digest))
+        return false;
+    file.set_hash_value(config::HASH_ALGORITHM, digest, tree_chunk_size);
+    return !config::VERIFY_CACHED_HASH;
+}
 
-    ull hash = FileInfo_hash(file);
-    if (config::SHOULD_CHECK_CACHED_MD5) {
-        std::lock_guard lock(cached_md5_mutex);
-
-        if (cached_md5.contains(hash)) {
-            file.md5_value =
-                hex_encode(cached_md5[hash].data(), MD5_DIGEST_BYTE_LEN);
-#ifdef RELEASE_MODE
-            return;
-#endif
+/// @brief Records a freshly computed digest in the file and the cache.
+void store_result(FileInfo &file, const CacheEntry &entry,
+                  const contenthash::Digest &digest, ull tree_chunk_size = 0) {
+    if (config::VERIFY_CACHED_HASH) {
+        string value;
+        contenthash::Digest cached;
+        if (config::SHOULD_CHECK_CACHED_MD5 && !file.get_hash_value().empty() &&
+            cached_md5.find(entry.key, value) && entry.matches(value, cached)) {
+            if (cached != digest) {
+                throw std::runtime_error("CalculateHash: Hash value mismatch");
+            }
         }
     }
+    file.set_hash_value(config::HASH_ALGORITHM, digest, tree_chunk_size);
+    cached_md5.insert(entry.key, entry.identity + string(digest.view()));
+}
 
-    EVP_MD_CTX *mdctx = EVP_MD_CTX_new();
-    if (!mdctx) {
-        throw std::runtime_error("CalculateMD5: Failed to create MD5 context");
-    }
+/// @brief Hashes a large file chunk by chunk on several threads, see
+/// tree_hash.hpp.
+void calculate_tree_hash_value(FileInfo &file) {
+    const ull chunk_size = TREE_HASH_CHUNK_SIZE;
+    // Tree roots differ from whole-file digests, so they are cached apart.
+    const CacheEntry entry(file, chunk_size);
+    if (use_cached(file, entry, chunk_size))
+        return;
 
-    auto ctx_deleter = [](EVP_MD_CTX *ctx) { EVP_MD_CTX_free(ctx); };
-    std::unique_ptr<EVP_MD_CTX, decltype(ctx_deleter)> ctx_guard(mdctx,
-                                                                 ctx_deleter);
+    auto tree = treehash::hash_file(file.get_path(), config::HASH_ALGORITHM,
+                                    chunk_size, std::max(config::THREAD_NUM, 1));
+    store_result(file, entry, tree.root, chunk_size);
+}
+
+/// @brief The chunk list file of a cache entry.
+fs::path chunk_list_path(const CacheEntry &entry) {
+    return chunk_lists /
+           contenthash::to_hex(std::string_view(
+               reinterpret_cast<const char *>(&entry.key), sizeof(entry.key)));
+}
 
-    if (EVP_DigestInit_ex(mdctx, EVP_md5(), NULL) != 1) {
-        throw std::runtime_error("CalculateMD5: Failed to initialize MD5");
+/// @brief Keeps the chunk list of a cache entry from being pruned.
+void use_chunk_list(const CacheEntry &entry) {
+    std::lock_guard lock(used_chunk_lists_mutex);
+    used_chunk_lists.insert(chunk_list_path(entry).filename().string());
+}
+
+/// @brief Loads the digest and the chunks of a chunked file hashed earlier.
+/// @details The list is the magic, the identity of the file, the digest and
+/// the chunk digests; it is only used when the identity still matches.
+bool load_chunk_list(const CacheEntry &entry, contenthash::Digest &digest,
+                     std::vector<contenthash::Digest> &chunks) {
+    if (chunk_lists.empty())
+        return false;
+    std::ifstream input(chunk_list_path(entry), std::ios::binary);
+    if (!input)
+        return false;
+    const string data((std::istreambuf_iterator<char>(input)),
+                      std::istreambuf_iterator<char>());
+    const size_t digest_size = contenthash::digest_size(config::HASH_ALGORITHM);
+    const size_t header = sizeof(CHUNK_LIST_MAGIC) + entry.identity.size();
+    if (data.size() < header + 2 * digest_size ||
+        (data.size() - header) % digest_size != 0 ||
+        data.compare(0, sizeof(CHUNK_LIST_MAGIC), CHUNK_LIST_MAGIC,
+                     sizeof(CHUNK_LIST_MAGIC)) != 0 ||
+        data.compare(sizeof(CHUNK_LIST_MAGIC), entry.identity.size(),
+                     entry.identity) != 0)
+        return false;
+    digest = contenthash::Digest(data.data() + header, digest_size);
+    chunks.clear();
+    for (size_t position = header + digest_size; position < data.size();
+         position += digest_size)
+        chunks.emplace_back(data.data() + position, digest_size);
+    use_chunk_list(entry);
+    return true;
+}
+
+/// @brief Saves the chunk list of a chunked file. Failures are only logged:
+/// the file is read again next time.
+void save_chunk_list(const FileInfo &file, const CacheEntry &entry,
+                     const std::vector<contenthash::Digest> &chunks) {
+    if (chunk_lists.empty())
+        return;
+    string data(CHUNK_LIST_MAGIC, sizeof(CHUNK_LIST_MAGIC));
+    data += entry.identity;
+    data += file.get_hash_value().view();
+    for (const auto &chunk : chunks)
+        data += chunk.view();
+
+    // Write to a temporary file first so a crash never leaves a torn list.
+    const fs::path list = chunk_list_path(entry);
+    fs::path temporary = list;
+    temporary += ".tmp";
+    std::error_code ec;
+    fs::create_directories(chunk_lists, ec);
+    bool written;
+    {
+        std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+        written = static_cast<bool>(output.write(data.data(), data.size()));
     }
+    if (written)
+        fs::rename(temporary, list, ec);
+    if (written && !ec) {
+        use_chunk_list(entry);
+    } else {
+        fs::remove(temporary, ec);
+        print::log(print::WARN,
+                   "[WARN] Failed to save the chunk list of " +
+                       strencode::to_console_format(
+                           file.get_path().u8string()));
+    }
+}
 
-    std::ifstream fs(fs::path(file.path), std::ifstream::binary);
-    if (!fs) {
-        throw std::runtime_error("CalculateMD5: Failed to open file");
+/// @brief Hashes a large file and stores it as content-defined chunks, each
+/// under the object name of its own digest, see fastcdc.hpp.
+/// @details The chunk list is kept next to the hash cache: an unchanged file
+/// whose chunks are all in the store is not read again. Otherwise only the
+/// chunks the store does not have yet are written.
+void calculate_chunked_hash_value(FileInfo &file,
+                                  objectstore::ObjectStore &store,
+                                  HashResult &result) {
+    const CacheEntry entry(file);
+    std::vector<contenthash::Digest> chunks;
+    if (config::SHOULD_CHECK_CACHED_MD5) {
+        contenthash::Digest digest;
+        if (load_chunk_list(entry, digest, chunks) &&
+            std::all_of(chunks.begin(), chunks.end(), [&](const auto &chunk) {
+                return store.contains(contenthash::object_name(
+                    config::HASH_ALGORITHM, chunk));
+            })) {
+            file.set_hash_value(config::HASH_ALGORITHM, digest);
+            if (!config::VERIFY_CACHED_HASH) {
+                file.set_chunks(std::move(chunks));
+                result.stored = true;
+                return;
+            }
+        }
+        chunks.clear();
     }
 
-    // Read and update hash
-    char buffer[READ_FILE_BUFFER_SIZE];
-    while (fs.read(buffer, sizeof(buffer))) {
-        EVP_DigestUpdate(mdctx, buffer, fs.gcount());
+    contenthash::Hasher hasher(config::HASH_ALGORITHM);
+    fastcdc::Chunker chunker;
+    auto on_chunk = [&](std::string_view chunk) {
+        contenthash::Hasher chunk_hasher(config::HASH_ALGORITHM);
+        chunk_hasher.update(chunk.data(), chunk.size());
+        chunks.push_back(chunk_hasher.final());
+        // Only chunks actually written count; an existing one, or one a
+        // concurrent writer published first, does not.
+        if (store.store(contenthash::object_name(config::HASH_ALGORITHM,
+                                                 chunks.back()),
+                        chunk))
+            result.new_chunks++, result.new_chunk_bytes += chunk.size();
+    };
+    readengine::read_file(file.get_path(), config::READ_ENGINE,
+                          [&](const char *data, size_t size) {
+                              hasher.update(data, size);
+                              chunker.update(data, size, on_chunk);
+                          });
+    chunker.finish(on_chunk);
+    store_result(file, entry, hasher.final());
+    save_chunk_list(file, entry, chunks);
+    file.set_chunks(std::move(chunks));
+    result.stored = true;
+}
+
+/// @brief `calculate_hash_value` with the details of the result.
+void calculate_hash_value(FileInfo &file, objectstore::ObjectStore *store,
+                          HashResult &result) {
+    if (store != nullptr && config::CHUNKED_STORAGE &&
+        file.get_file_size() >= CHUNKED_MIN_SIZE) {
+        calculate_chunked_hash_value(file, *store, result);
+        return;
     }
-    if (fs.gcount() > 0) {
-        EVP_DigestUpdate(mdctx, buffer, fs.gcount());
+    if (config::TREE_HASH && file.get_file_size() >= TREE_HASH_MIN_SIZE) {
+        calculate_tree_hash_value(file);
+        return;
     }
+    const CacheEntry entry(file);
+    if (use_cached(file, entry))
+        return;
+
+    contenthash::Hasher hasher(config::HASH_ALGORITHM);
+    // Small objects go to a pack and are kept in memory until named; larger
+    // ones stream into a temporary object, unless the copier can reflink
+    // them or copy them in the kernel.
+    const bool pack =
+        store != nullptr && store->should_pack(file.get_file_size());
+    string content;
+    std::optional<objectstore::ObjectStore::Writer> object;
+    if (store != nullptr && !pack && !store->prefers_import(file.get_device()))
+        object.emplace(*store, file.get_file_size());
+    // Read once: hash and, when storing, write the same bytes.
+    readengine::read_file(file.get_path(), config::READ_ENGINE,
+                          [&](const char *data, size_t size) {
+                              hasher.update(data, size);
+                              if (pack)
+                                  content.append(data, size);
+                              else if (object)
+                                  object->write(data, size);
+                          });
+    store_result(file, entry, hasher.final());
+    if (pack)
+        store->store(file.get_object_name(), content);
+    else if (object)
+        object->publish(file.get_object_name());
+    result.stored = pack || object.has_value();
+}
 
-    if (EVP_DigestFinal_ex(mdctx, digest, &digest_length) != 1) {
-        throw std::runtime_error("CalculateMD5: Failed to finalize MD5");
+bool calculate_hash_value(FileInfo &file, objectstore::ObjectStore *store) {
+    HashResult result;
+    calculate_hash_value(file, store, result);
+    return result.stored;
+}
+
+std::vector<HashResult> calculate_hash_values(std::span<FileInfo> files,
+                                              objectstore::ObjectStore *store) {
+    std::vector<HashResult> results(files.size());
+    auto calculate_one = [&](size_t i) {
+        try {
+            calculate_hash_value(files[i], store, results[i]);
+        } catch (...) {
+            results[i].error = std::current_exception();
+        }
+    };
+
+    // Small MD5 files are read whole and hashed LANES at a time; the rest
+    // take the streaming path.
+    std::vector<size_t> small;
+    std::vector<std::optional<CacheEntry>> entries(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (config::HASH_ALGORITHM != config::HashAlgorithm::MD5 ||
+            files[i].get_file_size() > SMALL_FILE_SIZE) {
+            calculate_one(i);
+            continue;
+        }
+        entries[i].emplace(files[i]);
+        if (!use_cached(files[i], *entries[i]))
+            small.push_back(i);
     }
+    // Lanes run in lockstep, so neighbours of similar size waste the least.
+    std::sort(small.begin(), small.end(), [&](size_t a, size_t b) {
+        return files[a].get_file_size() < files[b].get_file_size();
+    });
 
-    // Convert digest to hex string
-    assert(digest_length == MD5_DIGEST_BYTE_LEN);
-    string calc_res = hex_encode(digest, digest_length);
-#ifdef DEBUG_MODE
-    {
-        std::lock_guard lock(cached_md5_mutex);
-        if (config::SHOULD_CHECK_CACHED_MD5 && file.md5_value != "") {
-            if (hex_encode(cached_md5[hash].data(), MD5_DIGEST_BYTE_LEN) !=
-                calc_res) {
-                throw std::runtime_error("CalculateMD5: MD5 value mismatch");
+    thread_local std::vector<string> contents;
+    contents.resize(md5multi::LANES);
+    for (size_t begin = 0; begin < small.size(); begin += md5multi::LANES) {
+        std::vector<size_t> group;
+        std::vector<std::string_view> messages;
+        for (size_t k = begin;
+             k < std::min(begin + md5multi::LANES, small.size()); ++k) {
+            const size_t i = small[k];
+            string &content = contents[group.size()];
+            content.clear();
+            try {
+                readengine::read_file(files[i].get_path(), config::READ_ENGINE,
+                                      [&](const char *data, size_t size) {
+                                          content.append(data, size);
+                                      });
+            } catch (...) {
+                results[i].error = std::current_exception();
+                continue;
+            }
+            group.push_back(i);
+            messages.push_back(content);
+        }
+        std::vector<md5multi::Digest> digests(group.size());
+        md5multi::md5(messages, digests);
+        for (size_t l = 0; l < group.size(); ++l) {
+            const size_t i = group[l];
+            try {
+                store_result(files[i], *entries[i],
+                             contenthash::Digest(digests[l].data(),
+                                                 digests[l].size()));
+                if (store != nullptr) {
+                    store->store(files[i].get_object_name(), contents[l]);
+                    results[i].stored = true;
+                }
+            } catch (...) {
+                results[i].error = std::current_exception();
             }
         }
     }
-#endif
-    file.md5_value = calc_res;
-    std::lock_guard lock(cached_md5_mutex);
-    cached_md5[hash] = std::array<unsigned char, MD5_DIGEST_BYTE_LEN>();
-    std::copy(digest, digest + MD5_DIGEST_BYTE_LEN, cached_md5[hash].begin());
+    return results;
 }
-} // namespace fileinfo
\ No newline at end of file
+} // namespace fileinfo
@@ -0,0 +1,79 @@
+/// @file hard_links.cpp
+/// @brief hard_links.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include "hard_links.hpp"
+
+namespace hardlinks {
+
+bool HardLinkGroups::join(fileinfo::FileInfo &file) {
+    if (file.get_link_count() <= 1)
+        return true;
+    std::unique_lock lock(mutex);
+    auto [it, inserted] =
+        groups.try_emplace({file.get_device(), file.get_inode()});
+    auto &group = it->second;
+    ++group.seen;
+    if (inserted)
+        return true;
+    saved_reads++, saved_bytes += file.get_file_size();
+    if (!group.finished) {
+        group.waiting.push_back(std::move(file));
+        return false;
+    }
+    fileinfo::FileInfo follower = std::move(file);
+    follower.set_hash_value(group.algorithm, group.hash, group.tree_chunk_size);
+    follower.set_chunks(group.chunks);
+    const bool hashed = group.hashed;
+    if (group.seen >= follower.get_link_count())
+        groups.erase(it);
+    lock.unlock();
+    release(std::move(follower), hashed);
+    return false;
+}
+
+void HardLinkGroups::finish(const fileinfo::FileInfo &leader, bool hashed) {
+    if (leader.get_link_count() <= 1)
+        return;
+    std::vector<fileinfo::FileInfo> waiting;
+    {
+        std::lock_guard lock(mutex);
+        auto it = groups.find({leader.get_device(), leader.get_inode()});
+        auto &group = it->second;
+        waiting.swap(group.waiting);
+        // After `close` no other link can arrive, so nothing needs the result.
+        if (closed || group.seen >= leader.get_link_count()) {
+            groups.erase(it);
+        } else {
+            group.finished = true, group.hashed = hashed;
+            group.algorithm = leader.get_hash_algorithm();
+            group.hash = leader.get_hash_value();
+            group.tree_chunk_size = leader.get_tree_chunk_size();
+            group.chunks = leader.get_chunks();
+        }
+    }
+    for (auto &file : waiting) {
+        file.set_hash_value(leader.get_hash_algorithm(),
+                            leader.get_hash_value(),
+                            leader.get_tree_chunk_size());
+        file.set_chunks(leader.get_chunks());
+        release(std::move(file), hashed);
+    }
+}
+
+void HardLinkGroups::close() {
+    std::lock_guard lock(mutex);
+    closed = true;
+    // Groups still waiting for their leader are released by `finish`.
+    std::erase_if(groups, [](const auto &entry) { return entry.second.finished; });
+}
+
+size_t HardLinkGroups::size() const {
+    std::lock_guard lock(mutex);
+    return groups.size();
+}
+} // namespace hardlinks
@@ -0,0 +1,121 @@
+/// @file hash_cache.cpp
+/// @brief hash_cache.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include "hash_cache.hpp"
+
+namespace hashcache {
+namespace {
+constexpr size_t INITIAL_SLOTS = 64;
+constexpr Key EMPTY{};
+} // namespace
+
+HashCache::HashCache(size_t value_size) : value_size(value_size) {}
+
+void HashCache::reset(size_t value_size) {
+    for (auto &shard : shards) {
+        std::unique_lock lock(shard.mutex);
+        shard.keys.clear(), shard.values.clear();
+        shard.used = 0, shard.has_zero = false, shard.zero_value.clear();
+    }
+    this->value_size = value_size;
+}
+
+HashCache::Shard &HashCache::shard_of(const Key &key) const {
+    // The top bits pick the shard; probe() uses the low bits.
+    return shards[mix(key) >> 58 & (SHARDS - 1)];
+}
+
+size_t HashCache::probe(const Shard &shard, const Key &key) const {
+    const size_t mask = shard.keys.size() - 1;
+    size_t slot = mix(key) & mask;
+    while (shard.keys[slot] != EMPTY && shard.keys[slot] != key)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+bool HashCache::find(const Key &key, std::string &value) const {
+    const Shard &shard = shard_of(key);
+    std::shared_lock lock(shard.mutex);
+    if (key == EMPTY) {
+        if (shard.has_zero)
+            value = shard.zero_value;
+        return shard.has_zero;
+    }
+    if (shard.keys.empty())
+        return false;
+    const size_t slot = probe(shard, key);
+    if (shard.keys[slot] == EMPTY)
+        return false;
+    value.assign(reinterpret_cast<const char *>(shard.values.data()) +
+                     slot * value_size,
+                 value_size);
+    return true;
+}
+
+void HashCache::insert(const Key &key, std::string_view value) {
+    if (value.size() != value_size)
+        return;
+    Shard &shard = shard_of(key);
+    std::unique_lock lock(shard.mutex);
+    if (key == EMPTY) {
+        shard.has_zero = true, shard.zero_value = value;
+        return;
+    }
+    // Keep the load factor at or below 1/2 so probe sequences stay short.
+    if ((shard.used + 1) * 2 > shard.keys.size())
+        grow(shard);
+    const size_t slot = probe(shard, key);
+    if (shard.keys[slot] == EMPTY)
+        shard.keys[slot] = key, shard.used++;
+    std::memcpy(shard.values.data() + slot * value_size, value.data(),
+                value_size);
+}
+
+void HashCache::grow(Shard &shard) {
+    std::vector<Key> keys(std::max(shard.keys.size() * 2, INITIAL_SLOTS));
+    std::vector<unsigned char> values(keys.size() * value_size);
+    keys.swap(shard.keys), values.swap(shard.values);
+    for (size_t old_slot = 0; old_slot < keys.size(); ++old_slot) {
+        if (keys[old_slot] == EMPTY)
+            continue;
+        const size_t slot = probe(shard, keys[old_slot]);
+        shard.keys[slot] = keys[old_slot];
+        std::memcpy(shard.values.data() + slot * value_size,
+                    values.data() + old_slot * value_size, value_size);
+    }
+}
+
+size_t HashCache::size() const {
+    size_t total = 0;
+    for (const auto &shard : shards) {
+        std::shared_lock lock(shard.mutex);
+        total += shard.used + shard.has_zero;
+    }
+    return total;
+}
+
+void HashCache::for_each(
+    const std::function<void(const Key &, std::string_view)> &visit) const {
+    for (const auto &shard : shards) {
+        std::shared_lock lock(shard.mutex);
+        if (shard.has_zero)
+            visit(EMPTY, shard.zero_value);
+        for (size_t slot = 0; slot < shard.keys.size(); ++slot)
+            if (shard.keys[slot] != EMPTY)
+                visit(shard.keys[slot],
+                      std::string_view(reinterpret_cast<const char *>(
+                                           shard.values.data()) +
+                                           slot * value_size,
+                                       value_size));
+    }
+}
+} // namespace hashcache
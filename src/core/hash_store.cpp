@@ -0,0 +1,418 @@
+/// @file hash_store.cpp
+/// @brief hash_store.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+#include "hash_store.hpp"
+#include "mapped_file.hpp"
+
+namespace hashstore {
+using mappedfile::MappedFile;
+
+namespace {
+// Both files use host byte order.
+const char TABLE_MAGIC[4] = {'B', 'S', 'H', 'T'};
+const char JOURNAL_MAGIC[4] = {'B', 'S', 'H', 'J'};
+constexpr uint32_t FORMAT_VERSION = 2;
+
+// Table header: magic, version, value size, slot count, entry count and
+// whether the all-zero key is present; the value of that key follows at
+// offset 64 since the all-zero key marks empty slots. Slots start at the
+// next multiple of 64.
+constexpr size_t ZERO_VALUE_OFFSET = 64;
+constexpr ull MIN_SLOTS = 64;
+constexpr size_t KEY_SIZE = 16;
+constexpr Key EMPTY{};
+
+size_t table_header_size(size_t value_size) {
+    return ZERO_VALUE_OFFSET + (value_size + 63) / 64 * 64;
+}
+
+// Journal header: magic, version and value size. Each record is the key,
+// the value and a check value, so a torn tail is detected and dropped.
+constexpr size_t JOURNAL_HEADER_SIZE = 16;
+
+using Visit = std::function<void(const Key &, std::string_view)>;
+
+ull load64(const unsigned char *p) {
+    ull value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+void store64(unsigned char *p, ull value) {
+    std::memcpy(p, &value, sizeof(value));
+}
+
+Key load_key(const unsigned char *p) { return {load64(p), load64(p + 8)}; }
+
+void store_key(unsigned char *p, const Key &key) {
+    store64(p, key.low), store64(p + 8, key.high);
+}
+
+ull record_check(const Key &key, std::string_view value) {
+    ull check = 0xcbf29ce484222325ull; // FNV-1a over the value
+    for (unsigned char byte : value)
+        check = (check ^ byte) * 0x100000001b3ull;
+    return hashcache::mix(hashcache::mix(key) ^ check);
+}
+
+std::string journal_header(size_t value_size) {
+    std::string header(JOURNAL_HEADER_SIZE, '\0');
+    std::memcpy(header.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    std::memcpy(header.data() + 4, &FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    store64(reinterpret_cast<unsigned char *>(header.data()) + 8, value_size);
+    return header;
+}
+
+void append_record(std::string &out, const Key &key, std::string_view value) {
+    unsigned char key_bytes[KEY_SIZE];
+    store_key(key_bytes, key);
+    out.append(reinterpret_cast<const char *>(key_bytes), KEY_SIZE);
+    out.append(value);
+    const ull check = record_check(key, value);
+    out.append(reinterpret_cast<const char *>(&check), sizeof(check));
+}
+
+size_t record_size(size_t value_size) {
+    return KEY_SIZE + value_size + sizeof(ull);
+}
+
+/// @brief Replays a journal.
+/// @param records [out] Number of records read.
+/// @return Length of the valid prefix: a torn or corrupt tail is ignored,
+/// and a journal of another version or value size is invalid as a whole.
+ull replay(const fs::path &path, size_t value_size, const Visit &visit,
+           size_t &records) {
+    records = 0;
+    std::ifstream input(path, std::ios::binary);
+    if (!input)
+        return 0;
+
+    char header[JOURNAL_HEADER_SIZE];
+    if (!input.read(header, sizeof(header)))
+        return 0;
+    uint32_t version;
+    std::memcpy(&version, header + 4, sizeof(version));
+    if (std::memcmp(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        version != FORMAT_VERSION ||
+        load64(reinterpret_cast<unsigned char *>(header) + 8) != value_size)
+        return 0;
+    ull valid = JOURNAL_HEADER_SIZE;
+
+    // Read in large blocks rather than one read per record.
+    const size_t size = record_size(value_size);
+    std::vector<char> buffer(size * 4096);
+    size_t filled = 0;
+    while (true) {
+        input.read(buffer.data() + filled, buffer.size() - filled);
+        filled += input.gcount();
+        size_t used = 0;
+        for (; filled - used >= size; used += size) {
+            const auto *record =
+                reinterpret_cast<const unsigned char *>(buffer.data() + used);
+            const Key key = load_key(record);
+            std::string_view value(buffer.data() + used + KEY_SIZE,
+                                   value_size);
+            if (load64(record + KEY_SIZE + value_size) !=
+                record_check(key, value))
+                return valid;
+            visit(key, value);
+            valid += size, records++;
+        }
+        std::memmove(buffer.data(), buffer.data() + used, filled - used);
+        filled -= used;
+        if (!input)
+            return valid;
+    }
+}
+
+/// @brief Number of records a journal can hold at most.
+ull record_capacity(const fs::path &path, size_t value_size) {
+    std::error_code ec;
+    const ull size = fs::file_size(path, ec);
+    return ec ? 0 : size / record_size(value_size);
+}
+
+/// @brief Returns the slot holding `key`, or the empty slot it would take.
+ull probe(const unsigned char *slots, size_t stride, ull mask, const Key &key) {
+    ull slot = hashcache::mix(key) & mask;
+    while (true) {
+        const Key stored = load_key(slots + slot * stride);
+        if (stored == EMPTY || stored == key)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+}
+
+} // namespace
+
+/// @brief The table file, queried in place.
+class Table {
+  public:
+    /// @return nullptr if the file is missing or not a table of `value_size`.
+    static std::unique_ptr<Table> load(const fs::path &path,
+                                       size_t value_size) {
+        auto table = std::unique_ptr<Table>(new Table(value_size));
+        if (!table->file.open_read(path) ||
+            table->file.size() < table->header_size)
+            return nullptr;
+        const unsigned char *header = table->file.data();
+        uint32_t version;
+        std::memcpy(&version, header + 4, sizeof(version));
+        table->slots = load64(header + 16);
+        const size_t body = table->file.size() - table->header_size;
+        if (std::memcmp(header, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0 ||
+            version != FORMAT_VERSION || load64(header + 8) != value_size ||
+            !std::has_single_bit(table->slots) ||
+            body / table->stride != table->slots || body % table->stride != 0)
+            return nullptr;
+        return table;
+    }
+
+    bool find(const Key &key, std::string &value) const {
+        const unsigned char *header = file.data();
+        if (key == EMPTY) {
+            if (load64(header + 32) == 0)
+                return false;
+            value.assign(
+                reinterpret_cast<const char *>(header + ZERO_VALUE_OFFSET),
+                value_size);
+            return true;
+        }
+        const unsigned char *base = header + header_size;
+        const unsigned char *entry =
+            base + probe(base, stride, slots - 1, key) * stride;
+        if (load_key(entry) == EMPTY)
+            return false;
+        value.assign(reinterpret_cast<const char *>(entry + KEY_SIZE),
+                     value_size);
+        return true;
+    }
+
+    ull entries() const { return load64(file.data() + 24); }
+
+    void for_each(const Visit &visit) const {
+        const unsigned char *header = file.data();
+        if (load64(header + 32) != 0)
+            visit(EMPTY, std::string_view(reinterpret_cast<const char *>(
+                                              header + ZERO_VALUE_OFFSET),
+                                          value_size));
+        const unsigned char *base = header + header_size;
+        for (ull slot = 0; slot < slots; ++slot) {
+            const unsigned char *entry = base + slot * stride;
+            if (const Key key = load_key(entry); key != EMPTY)
+                visit(key, std::string_view(reinterpret_cast<const char *>(
+                                                entry + KEY_SIZE),
+                                            value_size));
+        }
+    }
+
+  private:
+    explicit Table(size_t value_size)
+        : value_size(value_size), stride(KEY_SIZE + value_size),
+          header_size(table_header_size(value_size)) {}
+
+    MappedFile file;
+    size_t value_size;
+    size_t stride;
+    size_t header_size;
+    ull slots = 0;
+};
+
+HashStore::HashStore(size_t value_size)
+    : value_size(value_size), recent(value_size) {}
+
+HashStore::~HashStore() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+void HashStore::open(const fs::path &table_path, size_t value_size) {
+    close();
+    this->value_size = value_size;
+    recent.reset(value_size);
+    table = Table::load(table_path, value_size);
+
+    fs::path journal_path = table_path, old_path = table_path;
+    journal_path += ".journal", old_path += ".journal.old";
+    const Visit remember = [&](const Key &key, std::string_view value) {
+        recent.insert(key, value);
+    };
+    std::error_code ec;
+
+    // A journal left over by an interrupted merge is merged again.
+    std::vector<fs::path> merge;
+    size_t old_records = 0;
+    ull old_valid = 0;
+    if (fs::exists(old_path, ec)) {
+        old_valid = replay(old_path, value_size, remember, old_records);
+        merge.push_back(old_path);
+    }
+    size_t records;
+    ull valid = replay(journal_path, value_size, remember, records);
+
+    const ull table_entries = table ? table->entries() : 0;
+    const bool should_compact =
+        !merge.empty() ||
+        old_records + records >=
+            std::max<ull>(HASH_JOURNAL_COMPACT_MIN_ENTRIES, table_entries / 16);
+    if (should_compact && records > 0) {
+        // Hand the journal over to the merge and start a fresh one.
+        if (old_valid == 0) {
+            fs::resize_file(journal_path, valid, ec);
+            fs::rename(journal_path, old_path, ec);
+            if (merge.empty())
+                merge.push_back(old_path);
+        } else {
+            std::ifstream input(journal_path, std::ios::binary);
+            std::string data(valid - JOURNAL_HEADER_SIZE, '\0');
+            input.seekg(JOURNAL_HEADER_SIZE);
+            input.read(data.data(), data.size());
+            fs::resize_file(old_path, old_valid, ec);
+            std::ofstream output(old_path, std::ios::binary | std::ios::app);
+            output.write(data.data(), data.size());
+            if (output.flush())
+                fs::remove(journal_path, ec);
+        }
+        valid = 0;
+    } else if (valid > 0) {
+        fs::resize_file(journal_path, valid, ec); // drop a torn tail
+    }
+
+    journal.open(journal_path,
+                 std::ios::binary | (valid > 0 ? std::ios::app
+                                               : std::ios::trunc));
+    if (!journal)
+        throw std::runtime_error("HashStore: Failed to open " +
+                                 journal_path.string());
+    if (valid == 0) {
+        journal << journal_header(value_size);
+        journal.flush();
+    }
+
+    if (should_compact)
+        compactor = std::thread([this, table_path, value_size, merge] {
+            try {
+                compact(table_path, value_size, merge);
+                std::error_code ec;
+                for (const auto &path : merge)
+                    fs::remove(path, ec);
+            } catch (...) {
+                compact_error = std::current_exception();
+            }
+        });
+}
+
+bool HashStore::find(const Key &key, std::string &value) const {
+    return recent.find(key, value) || (table && table->find(key, value));
+}
+
+void HashStore::insert(const Key &key, std::string_view value) {
+    if (value.size() != value_size)
+        return;
+    std::string existing;
+    if (find(key, existing) && existing == value)
+        return;
+    recent.insert(key, value);
+    if (!journal.is_open())
+        return;
+    std::lock_guard lock(journal_mutex);
+    append_record(pending, key, value);
+    if (++pending_entries >= HASH_JOURNAL_FLUSH_ENTRIES)
+        write_pending();
+}
+
+void HashStore::write_pending() {
+    journal.write(pending.data(), pending.size());
+    journal.flush();
+    pending.clear(), pending_entries = 0;
+}
+
+void HashStore::checkpoint() {
+    std::lock_guard lock(journal_mutex);
+    if (journal.is_open() && pending_entries > 0)
+        write_pending();
+}
+
+void HashStore::close() {
+    checkpoint();
+    const bool journal_ok = !journal.is_open() || journal.good();
+    journal.close();
+    if (compactor.joinable())
+        compactor.join();
+    table.reset();
+    auto error = std::exchange(compact_error, nullptr);
+    if (error)
+        std::rethrow_exception(error);
+    if (!journal_ok)
+        throw std::runtime_error("HashStore: Failed to write the journal");
+}
+
+size_t HashStore::size() const {
+    return recent.size() + (table ? table->entries() : 0);
+}
+
+void HashStore::compact(const fs::path &table_path, size_t value_size,
+                        const std::vector<fs::path> &journals) {
+    const auto old_table = Table::load(table_path, value_size);
+    ull capacity = old_table ? old_table->entries() : 0;
+    for (const auto &path : journals)
+        capacity += record_capacity(path, value_size);
+    const ull slots = std::bit_ceil(std::max(capacity * 2, MIN_SLOTS));
+    const size_t stride = KEY_SIZE + value_size;
+    const size_t header_size = table_header_size(value_size);
+
+    fs::path temporary = table_path;
+    temporary += ".tmp";
+    MappedFile output;
+    output.create(temporary, header_size + slots * stride);
+    unsigned char *header = output.data();
+    unsigned char *base = header + header_size;
+    ull entries = 0;
+    const Visit put = [&](const Key &key, std::string_view value) {
+        if (key == EMPTY) {
+            entries += load64(header + 32) == 0;
+            store64(header + 32, 1);
+            std::memcpy(header + ZERO_VALUE_OFFSET, value.data(), value_size);
+            return;
+        }
+        unsigned char *entry =
+            base + probe(base, stride, slots - 1, key) * stride;
+        if (load_key(entry) == EMPTY)
+            store_key(entry, key), entries++;
+        std::memcpy(entry + KEY_SIZE, value.data(), value_size);
+    };
+    if (old_table)
+        old_table->for_each(put);
+    size_t records;
+    for (const auto &path : journals)
+        replay(path, value_size, put, records);
+
+    std::memcpy(header, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+    std::memcpy(header + 4, &FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    store64(header + 8, value_size);
+    store64(header + 16, slots);
+    store64(header + 24, entries);
+    output.commit();
+
+    std::error_code ec;
+    fs::rename(temporary, table_path, ec);
+    if (ec)
+        throw std::runtime_error("HashStore: Failed to replace " +
+                                 table_path.string() + ": " + ec.message());
+}
+} // namespace hashstore
@@ -0,0 +1,109 @@
+/// @file mapped_file.cpp
+/// @brief mapped_file.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+
+namespace mappedfile {
+bool MappedFile::open_read(const fs::path &path, bool random) {
+    unmap();
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+    if (ok) {
+        void *address = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ok = address != MAP_FAILED;
+        if (ok) {
+            data_ = static_cast<unsigned char *>(address);
+            size_ = st.st_size;
+            if (random)
+                madvise(address, size_, MADV_RANDOM);
+        }
+    }
+    ::close(fd);
+    return ok;
+#else
+    (void)random;
+    std::ifstream input(path, std::ios::binary);
+    if (!input)
+        return false;
+    buffer.assign(std::istreambuf_iterator<char>(input),
+                  std::istreambuf_iterator<char>());
+    data_ = reinterpret_cast<unsigned char *>(buffer.data());
+    size_ = buffer.size();
+    return size_ > 0;
+#endif
+}
+
+void MappedFile::create(const fs::path &path, size_t size) {
+    unmap();
+    this->path = path;
+#ifndef _WIN32
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0)
+        throw std::runtime_error(std::format("MappedFile: Failed to create {}: {}",
+                                             path.string(),
+                                             std::strerror(errno)));
+    void *address =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED)
+        throw std::runtime_error(std::format("MappedFile: Failed to map {}: {}",
+                                             path.string(),
+                                             std::strerror(errno)));
+    data_ = static_cast<unsigned char *>(address);
+#else
+    buffer.assign(size, '\0');
+    data_ = reinterpret_cast<unsigned char *>(buffer.data());
+#endif
+    size_ = size;
+}
+
+void MappedFile::commit() {
+#ifndef _WIN32
+    if (msync(data_, size_, MS_SYNC) != 0 || fsync(fd) != 0)
+        throw std::runtime_error(std::format("MappedFile: Failed to write {}: {}",
+                                             path.string(),
+                                             std::strerror(errno)));
+#else
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output.write(buffer.data(), buffer.size()) || !output.flush())
+        throw std::runtime_error("MappedFile: Failed to write " +
+                                 path.string());
+#endif
+    unmap();
+}
+
+void MappedFile::unmap() {
+#ifndef _WIN32
+    if (data_ != nullptr)
+        munmap(data_, size_);
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+#else
+    buffer.clear();
+#endif
+    data_ = nullptr, size_ = 0;
+}
+} // namespace mappedfile
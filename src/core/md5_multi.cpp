@@ -0,0 +1,155 @@
+/// @file md5_multi.cpp
+/// @brief md5_multi.hpp的实现，使用GCC的向量扩展。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "md5_multi.hpp"
+
+// One clone per instruction set, picked by the dynamic loader (ifunc).
+#if defined(__linux__) && defined(__x86_64__)
+#define MD5_MULTI_TARGETS                                                      \
+    __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define MD5_MULTI_TARGETS
+#endif
+
+namespace md5multi {
+namespace {
+typedef uint32_t Vector
+    __attribute__((vector_size(sizeof(uint32_t) * LANES)));
+
+constexpr size_t BLOCK_SIZE = 64;
+
+constexpr uint32_t K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+
+constexpr int S[4][4] = {
+    {7, 12, 17, 22}, {5, 9, 14, 20}, {4, 11, 16, 23}, {6, 10, 15, 21}};
+
+constexpr uint32_t INITIAL_STATE[4] = {0x67452301, 0xefcdab89, 0x98badcfe,
+                                       0x10325476};
+
+inline uint32_t load_le32(const unsigned char *p) {
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 |
+           uint32_t(p[3]) << 24;
+}
+
+/// @brief 一条消息按块读取的视图：完整的块直接取自消息，末尾一至两块为补齐后的副本。
+struct Lane {
+    const unsigned char *data = nullptr;
+    size_t full_blocks = 0; /// 直接取自消息的块数
+    size_t blocks = 0;      /// 总块数
+    unsigned char tail[2 * BLOCK_SIZE];
+
+    void init(std::string_view message) {
+        data = reinterpret_cast<const unsigned char *>(message.data());
+        full_blocks = message.size() / BLOCK_SIZE;
+        const size_t rest = message.size() % BLOCK_SIZE;
+        const size_t tail_blocks = rest + 1 + 8 <= BLOCK_SIZE ? 1 : 2;
+        blocks = full_blocks + tail_blocks;
+
+        std::memset(tail, 0, sizeof(tail));
+        std::memcpy(tail, data + full_blocks * BLOCK_SIZE, rest);
+        tail[rest] = 0x80;
+        const uint64_t bits = uint64_t(message.size()) * 8;
+        unsigned char *length = tail + tail_blocks * BLOCK_SIZE - 8;
+        for (int i = 0; i < 8; ++i)
+            length[i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+
+    /// @return 第`index`块，越界时返回nullptr。
+    const unsigned char *block(size_t index) const {
+        if (index < full_blocks)
+            return data + index * BLOCK_SIZE;
+        if (index < blocks)
+            return tail + (index - full_blocks) * BLOCK_SIZE;
+        return nullptr;
+    }
+};
+
+/// @brief 对所有通道各压缩一个块；`active`为0的通道保持原状态。
+/// @param words 按[字][通道]转置后的块。
+/// @details 向量只经指针传递：各克隆版本传递向量参数的ABI不同。
+MD5_MULTI_TARGETS
+void compress(Vector state[4], const uint32_t (*words)[LANES],
+              const Vector *active) {
+    Vector w[16];
+    for (int i = 0; i < 16; ++i)
+        std::memcpy(&w[i], words[i], sizeof(Vector));
+
+    Vector a = state[0], b = state[1], c = state[2], d = state[3];
+    auto step = [&](Vector f, int i, int g) {
+        Vector x = a + f + K[i] + w[g];
+        const int n = S[i / 16][i % 4];
+        a = d, d = c, c = b, b = b + ((x << n) | (x >> (32 - n)));
+    };
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i)
+        step((b & c) | (~b & d), i, i);
+#pragma GCC unroll 16
+    for (int i = 16; i < 32; ++i)
+        step((d & b) | (~d & c), i, (5 * i + 1) % 16);
+#pragma GCC unroll 16
+    for (int i = 32; i < 48; ++i)
+        step(b ^ c ^ d, i, (3 * i + 5) % 16);
+#pragma GCC unroll 16
+    for (int i = 48; i < 64; ++i)
+        step(c ^ (b | ~d), i, (7 * i) % 16);
+    state[0] += a & *active, state[1] += b & *active;
+    state[2] += c & *active, state[3] += d & *active;
+}
+} // namespace
+
+void md5(std::span<const std::string_view> messages,
+         std::span<Digest> digests) {
+    const size_t count = std::min(messages.size(), LANES);
+    Lane lanes[LANES];
+    size_t max_blocks = 0;
+    for (size_t l = 0; l < count; ++l) {
+        lanes[l].init(messages[l]);
+        max_blocks = std::max(max_blocks, lanes[l].blocks);
+    }
+
+    Vector state[4];
+    for (int i = 0; i < 4; ++i)
+        for (size_t l = 0; l < LANES; ++l)
+            state[i][l] = INITIAL_STATE[i];
+
+    alignas(sizeof(Vector)) uint32_t words[16][LANES] = {};
+    for (size_t index = 0; index < max_blocks; ++index) {
+        Vector active;
+        for (size_t l = 0; l < LANES; ++l) {
+            const unsigned char *block =
+                l < count ? lanes[l].block(index) : nullptr;
+            active[l] = block != nullptr ? ~0u : 0u;
+            if (block != nullptr)
+                for (int i = 0; i < 16; ++i)
+                    words[i][l] = load_le32(block + 4 * i);
+        }
+        compress(state, words, &active);
+    }
+
+    for (size_t l = 0; l < count; ++l)
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                digests[l][4 * i + j] =
+                    static_cast<unsigned char>(state[i][l] >> (8 * j));
+}
+} // namespace md5multi
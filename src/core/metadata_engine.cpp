@@ -0,0 +1,271 @@
+/// @file metadata_engine.cpp
+/// @brief metadata_engine.hpp的实现。
+///
+/// 不依赖liburing，直接通过系统调用建立和使用io_uring。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#include "metadata_engine.hpp"
+
+namespace metadata {
+namespace {
+
+/// @brief 逐个调用系统调用的同步引擎。
+class SyncEngine : public MetadataEngine {
+  public:
+    void statx_batch(int dir_fd, std::span<StatRequest> requests) override {
+        for (auto &request : requests)
+            request.result = statx(dir_fd, request.name, request.flags,
+                                   request.mask, &request.stx) == 0
+                                 ? 0
+                                 : -errno;
+    }
+    void openat_batch(int dir_fd, std::span<OpenRequest> requests) override {
+        for (auto &request : requests) {
+            request.fd = openat(dir_fd, request.name, request.flags);
+            if (request.fd < 0)
+                request.fd = -errno;
+        }
+    }
+    const char *name() const override { return "sync"; }
+};
+
+/// @brief 最小的io_uring封装：映射提交队列和完成队列，批量提交并等待全部完成。
+class IoUring {
+  public:
+    IoUring() : ring_fd(-1) {}
+    ~IoUring() {
+        if (sqes != nullptr)
+            munmap(sqes, sqes_size);
+        if (cq_ptr != nullptr && cq_ptr != sq_ptr)
+            munmap(cq_ptr, cq_size);
+        if (sq_ptr != nullptr)
+            munmap(sq_ptr, sq_size);
+        if (ring_fd >= 0)
+            close(ring_fd);
+    }
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    /// @brief 建立队列。
+    /// @return 失败时返回false（内核不支持、被禁止或资源不足）。
+    bool init(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0)
+            return false;
+
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+            sq_size = cq_size = std::max(sq_size, cq_size);
+
+        sq_ptr = map(sq_size, IORING_OFF_SQ_RING);
+        if (sq_ptr == nullptr)
+            return false;
+        cq_ptr = single_mmap ? sq_ptr : map(cq_size, IORING_OFF_CQ_RING);
+        if (cq_ptr == nullptr)
+            return false;
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(map(sqes_size, IORING_OFF_SQES));
+        if (sqes == nullptr)
+            return false;
+
+        auto *sq = static_cast<char *>(sq_ptr);
+        auto *cq = static_cast<char *>(cq_ptr);
+        sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        capacity = params.sq_entries;
+        return true;
+    }
+
+    /// @brief 一次最多提交的请求数。
+    unsigned get_capacity() const { return capacity; }
+
+    /// @brief 获取下一个提交项并清零；调用者保证未超过容量。
+    io_uring_sqe *next_sqe() {
+        unsigned tail = *sq_tail + pending;
+        unsigned index = tail & sq_mask;
+        sq_array[index] = index;
+        ++pending;
+        std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+        return &sqes[index];
+    }
+
+    /// @brief 提交所有提交项，等待已提交的全部完成，对每个完成项调用`on_complete`。
+    /// @details io_uring_enter失败时，内核尚未取走的提交项被丢弃，不调用
+    /// `on_complete`；已取走的仍等到完成才返回，因此返回后内核不再写入请求的
+    /// 缓冲区，迟到的完成项也不会被下一批误认。
+    /// @return 0；io_uring_enter失败时为第一次失败的-errno。
+    template <typename F> int submit_and_wait(F &&on_complete) {
+        const unsigned first =
+            std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire);
+        const unsigned to_submit = pending;
+        std::atomic_ref<unsigned>(*sq_tail).store(*sq_tail + to_submit,
+                                                  std::memory_order_release);
+        pending = 0;
+
+        int error = 0;
+        unsigned completed = 0;
+        while (true) {
+            const unsigned submitted =
+                std::atomic_ref<unsigned>(*sq_head).load(
+                    std::memory_order_acquire) -
+                first;
+            if (error != 0 && submitted < to_submit)
+                std::atomic_ref<unsigned>(*sq_tail).store(
+                    first + submitted, std::memory_order_release);
+            const unsigned expected = error != 0 ? submitted : to_submit;
+            if (completed >= expected)
+                break;
+
+            int ret = static_cast<int>(syscall(
+                __NR_io_uring_enter, ring_fd,
+                error != 0 ? 0 : to_submit - submitted, expected - completed,
+                IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (ret < 0 && errno != EINTR) {
+                if (error == 0)
+                    error = -errno;
+                else
+                    // Completions are still posted while we cannot wait for
+                    // them; poll until the submitted ones are all back.
+                    std::this_thread::yield();
+            }
+
+            unsigned head = *cq_head;
+            unsigned tail =
+                std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+            for (; head != tail; ++head, ++completed) {
+                const io_uring_cqe &cqe = cqes[head & cq_mask];
+                on_complete(cqe.user_data, cqe.res);
+            }
+            std::atomic_ref<unsigned>(*cq_head).store(head,
+                                                      std::memory_order_release);
+        }
+        return error;
+    }
+
+  private:
+    void *map(size_t size, off_t offset) {
+        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    int ring_fd;
+    void *sq_ptr = nullptr, *cq_ptr = nullptr;
+    size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+    io_uring_sqe *sqes = nullptr;
+    io_uring_cqe *cqes = nullptr;
+    unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_array = nullptr;
+    unsigned *cq_head = nullptr, *cq_tail = nullptr;
+    unsigned sq_mask = 0, cq_mask = 0, capacity = 0;
+    unsigned pending = 0; /// 已填写但尚未提交的提交项数量
+};
+
+/// @brief 基于io_uring的批量引擎。
+class UringEngine : public MetadataEngine {
+  public:
+    bool init(unsigned queue_depth) { return ring.init(queue_depth); }
+
+    void statx_batch(int dir_fd, std::span<StatRequest> requests) override {
+        for (size_t begin = 0; begin < requests.size();
+             begin += ring.get_capacity()) {
+            auto chunk = requests.subspan(
+                begin, std::min<size_t>(ring.get_capacity(),
+                                        requests.size() - begin));
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                io_uring_sqe *sqe = ring.next_sqe();
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = dir_fd;
+                sqe->addr = reinterpret_cast<__u64>(chunk[i].name);
+                sqe->len = chunk[i].mask;
+                sqe->off = reinterpret_cast<__u64>(&chunk[i].stx);
+                sqe->statx_flags = static_cast<__u32>(chunk[i].flags);
+                sqe->user_data = i;
+                chunk[i].result = -EINVAL;
+            }
+            ring.submit_and_wait([&](__u64 index, int res) {
+                chunk[index].result = res;
+            });
+            // Kernels older than 5.6 reject the opcode itself, and requests
+            // dropped by a failed submission never complete; fall back to
+            // plain syscalls for anything the ring could not do.
+            for (auto &request : chunk)
+                if (request.result == -EINVAL)
+                    fallback.statx_batch(dir_fd, {&request, 1});
+        }
+    }
+
+    void openat_batch(int dir_fd, std::span<OpenRequest> requests) override {
+        for (size_t begin = 0; begin < requests.size();
+             begin += ring.get_capacity()) {
+            auto chunk = requests.subspan(
+                begin, std::min<size_t>(ring.get_capacity(),
+                                        requests.size() - begin));
+            for (size_t i = 0; i < chunk.size(); ++i) {
+                io_uring_sqe *sqe = ring.next_sqe();
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = dir_fd;
+                sqe->addr = reinterpret_cast<__u64>(chunk[i].name);
+                sqe->open_flags = static_cast<__u32>(chunk[i].flags);
+                sqe->user_data = i;
+                chunk[i].fd = -EINVAL;
+            }
+            // Only the requests the ring did not open are retried, so no
+            // descriptor is opened twice.
+            ring.submit_and_wait(
+                [&](__u64 index, int res) { chunk[index].fd = res; });
+            for (auto &request : chunk)
+                if (request.fd == -EINVAL)
+                    fallback.openat_batch(dir_fd, {&request, 1});
+        }
+    }
+
+    const char *name() const override { return "io_uring"; }
+
+  private:
+    IoUring ring;
+    SyncEngine fallback;
+};
+} // namespace
+
+std::unique_ptr<MetadataEngine> create_engine(EngineType type,
+                                              unsigned queue_depth) {
+    if (type == EngineType::IO_URING) {
+        auto engine = std::make_unique<UringEngine>();
+        if (engine->init(queue_depth))
+            return engine;
+    }
+    return std::make_unique<SyncEngine>();
+}
+
+bool io_uring_available() {
+    UringEngine engine;
+    return engine.init(1);
+}
+} // namespace metadata
+
+#endif
@@ -0,0 +1,157 @@
+/// @file object_index.cpp
+/// @brief object_index.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#include "mapped_file.hpp"
+#include "object_index.hpp"
+
+namespace objectindex {
+namespace {
+// Host byte order: magic, version, entry count; then entries of key, size
+// and flags.
+const char INDEX_MAGIC[4] = {'B', 'S', 'L', 'I'};
+constexpr uint32_t FORMAT_VERSION = 1;
+constexpr size_t HEADER_SIZE = 16;
+constexpr size_t ENTRY_SIZE = 32;
+
+constexpr ull FLAG_COMPRESSED = 1;
+constexpr ull FLAG_FLAT = 2;
+
+constexpr size_t BITS_PER_KEY = 10;
+constexpr unsigned HASH_COUNT = 7;
+/// The filter is never smaller than this many keys.
+constexpr size_t MIN_CAPACITY = 1 << 16;
+
+ull load_u64(const unsigned char *p) {
+    ull value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+void store_u64(unsigned char *p, ull value) {
+    std::memcpy(p, &value, sizeof(value));
+}
+} // namespace
+
+BloomFilter::BloomFilter(size_t capacity)
+    : capacity(std::max(capacity, MIN_CAPACITY)),
+      bits((this->capacity * BITS_PER_KEY + 63) / 64) {}
+
+// The two halves of the SipHash key are independent, so the probes are
+// derived from them by double hashing.
+void BloomFilter::add(const Key &key) {
+    const ull size = bits.size() * 64;
+    for (unsigned i = 0; i < HASH_COUNT; ++i) {
+        const ull bit = (key.high + i * (key.low | 1)) % size;
+        bits[bit / 64] |= 1ull << (bit % 64);
+    }
+}
+
+bool BloomFilter::may_contain(const Key &key) const {
+    const ull size = bits.size() * 64;
+    for (unsigned i = 0; i < HASH_COUNT; ++i) {
+        const ull bit = (key.high + i * (key.low | 1)) % size;
+        if ((bits[bit / 64] & (1ull << (bit % 64))) == 0)
+            return false;
+    }
+    return true;
+}
+
+bool ObjectIndex::load(const fs::path &path) {
+    std::unique_lock lock(mutex);
+    entries.clear();
+    filter = BloomFilter();
+    mappedfile::MappedFile file;
+    if (!file.open_read(path, false) || file.size() < HEADER_SIZE)
+        return false;
+    const unsigned char *data = file.data();
+    uint32_t version;
+    std::memcpy(&version, data + 4, sizeof(version));
+    const ull count = load_u64(data + 8);
+    if (std::memcmp(data, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        version != FORMAT_VERSION ||
+        file.size() != HEADER_SIZE + count * ENTRY_SIZE)
+        return false;
+
+    entries.reserve(count);
+    filter = BloomFilter(2 * count);
+    for (const unsigned char *p = data + HEADER_SIZE;
+         p < data + file.size(); p += ENTRY_SIZE) {
+        const Key key{.low = load_u64(p + 8), .high = load_u64(p)};
+        const ull flags = load_u64(p + 24);
+        entries[key] = {load_u64(p + 16), (flags & FLAG_COMPRESSED) != 0,
+                        (flags & FLAG_FLAT) != 0};
+        filter.add(key);
+    }
+    return true;
+}
+
+void ObjectIndex::save(const fs::path &path) const {
+    std::shared_lock lock(mutex);
+    const fs::path temporary = fs::path(path) += ".tmp";
+    mappedfile::MappedFile output;
+    output.create(temporary, HEADER_SIZE + entries.size() * ENTRY_SIZE);
+    unsigned char *data = output.data();
+    std::memcpy(data, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    std::memcpy(data + 4, &FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    store_u64(data + 8, entries.size());
+    unsigned char *p = data + HEADER_SIZE;
+    for (const auto &[key, entry] : entries) {
+        store_u64(p, key.high);
+        store_u64(p + 8, key.low);
+        store_u64(p + 16, entry.size);
+        store_u64(p + 24, (entry.compressed ? FLAG_COMPRESSED : 0) |
+                              (entry.flat ? FLAG_FLAT : 0));
+        p += ENTRY_SIZE;
+    }
+    output.commit();
+    fs::rename(temporary, path);
+}
+
+void ObjectIndex::insert(std::string_view name, const Entry &entry) {
+    const Key key = packstore::object_key(name);
+    std::unique_lock lock(mutex);
+    entries[key] = entry;
+    if (entries.size() > filter.get_capacity())
+        grow_filter();
+    else
+        filter.add(key);
+}
+
+void ObjectIndex::erase(std::string_view name) {
+    const Key key = packstore::object_key(name);
+    std::unique_lock lock(mutex);
+    // The filter keeps the key; the map answers for it.
+    entries.erase(key);
+}
+
+std::optional<Entry> ObjectIndex::find(std::string_view name) const {
+    const Key key = packstore::object_key(name);
+    std::shared_lock lock(mutex);
+    if (!filter.may_contain(key))
+        return std::nullopt;
+    auto it = entries.find(key);
+    if (it == entries.end())
+        return std::nullopt;
+    return it->second;
+}
+
+size_t ObjectIndex::size() const {
+    std::shared_lock lock(mutex);
+    return entries.size();
+}
+
+void ObjectIndex::grow_filter() {
+    filter = BloomFilter(2 * entries.size());
+    for (const auto &[key, entry] : entries)
+        filter.add(key);
+}
+} // namespace objectindex
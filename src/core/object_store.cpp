@@ -0,0 +1,493 @@
+/// @file object_store.cpp
+/// @brief object_store.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <format>
+#include <random>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "config.hpp"
+#include "object_store.hpp"
+#include "read_engine.hpp"
+
+namespace objectstore {
+namespace {
+/// Two levels of 256 subdirectories.
+constexpr size_t FANOUT_DIRECTORIES = 1 << 16;
+
+/// @brief The subdirectory number of an object: the top two bytes of its key.
+size_t fanout_of(const std::string &name) {
+    return packstore::object_key(name).high >> 48;
+}
+
+/// @brief Whether `name` is a subdirectory of the fan-out layout.
+bool is_fanout_name(const std::string &name) {
+    return name.size() == 2 &&
+           std::isxdigit(static_cast<unsigned char>(name[0])) &&
+           std::isxdigit(static_cast<unsigned char>(name[1]));
+}
+
+/// @brief Files at the top of the copies directory that are not objects.
+bool is_reserved(const std::string &name) {
+    return name.empty() || name[0] == '.' || name == LAYOUT_FILE ||
+           name.starts_with(objectindex::OBJECT_INDEX_FILE);
+}
+
+/// @brief Splits the compression suffix off a file name.
+/// @return Whether the object is compressed.
+bool strip_suffix(std::string &name) {
+    const std::string_view suffix = compression::COMPRESSED_SUFFIX;
+    if (!name.ends_with(suffix))
+        return false;
+    name.resize(name.size() - suffix.size());
+    return true;
+}
+
+constexpr std::string_view LOCK_SUFFIX = ".lock";
+
+#ifndef _WIN32
+/// @brief Opens `path` and takes an exclusive lock on it.
+/// @return The descriptor, or -1 if the file is locked by another run (or
+/// cannot be opened).
+int try_lock(const fs::path &path) {
+    while (true) {
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return -1;
+        if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        // Another run may have removed the file between open and flock.
+        struct stat locked, current;
+        if (::fstat(fd, &locked) == 0 && ::stat(path.c_str(), &current) == 0 &&
+            locked.st_dev == current.st_dev && locked.st_ino == current.st_ino)
+            return fd;
+        ::close(fd);
+    }
+}
+#endif
+} // namespace
+
+ObjectStore::ObjectStore(const fs::path &directory)
+    : directory(directory),
+      prepared(new std::atomic<bool>[FANOUT_DIRECTORIES]()) {}
+
+ObjectStore::~ObjectStore() { release_partial(); }
+
+void ObjectStore::open(bool writable) {
+    this->writable = writable;
+    packs.open(directory / PACKS_DIRECTORY, writable);
+    if (writable) {
+        fs::create_directories(directory);
+        if (!fs::exists(directory / LAYOUT_FILE))
+            migrate();
+        acquire_partial();
+        reflink = copyengine::supports_reflink(partial);
+#ifndef _WIN32
+        struct stat st;
+        if (::stat(directory.c_str(), &st) == 0)
+            device = st.st_dev;
+#endif
+    }
+    const fs::path index = directory / objectindex::OBJECT_INDEX_FILE;
+    index_rebuilt = migrated > 0 || !loose.load(index);
+    if (index_rebuilt)
+        rebuild_index();
+    // Written back by `close`: a run that does not get there leaves no index,
+    // and the next one scans the directory again.
+    if (writable) {
+        std::error_code ec;
+        fs::remove(index, ec);
+    }
+}
+
+void ObjectStore::close() {
+    packs.close();
+    if (writable) {
+        loose.save(directory / objectindex::OBJECT_INDEX_FILE);
+        writable = false;
+    }
+    release_partial();
+}
+
+void ObjectStore::acquire_partial() {
+    const fs::path root = directory / fileinfo::PARTIAL_OBJECTS_DIRECTORY;
+    fs::create_directories(root);
+    // Only directories whose lock is free belong to runs that have ended;
+    // those of concurrent backups are left alone.
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(root, ec)) {
+        const fs::path path = entry.path();
+        if (path.filename().string().ends_with(LOCK_SUFFIX))
+            continue;
+#ifndef _WIN32
+        fs::path lock = path;
+        lock += LOCK_SUFFIX;
+        const int fd = try_lock(lock);
+        if (fd < 0)
+            continue;
+        fs::remove_all(path, ec);
+        fs::remove(lock, ec);
+        ::close(fd);
+#else
+        // Without flock, a directory in use cannot be told apart; only loose
+        // files of earlier versions are removed.
+        if (!entry.is_directory())
+            fs::remove(path, ec);
+#endif
+    }
+
+    const std::string run =
+        std::format("{:08x}{:08x}", std::random_device{}(),
+                    std::random_device{}());
+    partial = root / run;
+#ifndef _WIN32
+    fs::path lock = partial;
+    lock += LOCK_SUFFIX;
+    partial_lock = try_lock(lock);
+    if (partial_lock < 0)
+        throw std::runtime_error(
+            "ObjectStore: Failed to lock the temporary object directory");
+#endif
+    fs::create_directories(partial);
+}
+
+void ObjectStore::release_partial() {
+    if (partial.empty())
+        return;
+    std::error_code ec;
+    fs::remove_all(partial, ec);
+#ifndef _WIN32
+    fs::path lock = partial;
+    lock += LOCK_SUFFIX;
+    fs::remove(lock, ec);
+    ::close(partial_lock);
+    partial_lock = -1;
+#endif
+    partial.clear();
+}
+
+fs::path ObjectStore::object_path(const std::string &name) const {
+    const size_t fanout = fanout_of(name);
+    return directory / std::format("{:02x}", fanout >> 8) /
+           std::format("{:02x}", fanout & 0xff) / name;
+}
+
+fs::path ObjectStore::entry_path(const std::string &name,
+                                 const objectindex::Entry &entry) const {
+    if (entry.flat)
+        return directory / (entry.compressed
+                                ? name + compression::COMPRESSED_SUFFIX
+                                : name);
+    return entry.compressed ? compressed_path(name) : object_path(name);
+}
+
+void ObjectStore::prepare_directory(const std::string &name) {
+    auto &done = prepared[fanout_of(name)];
+    if (done.load(std::memory_order_relaxed))
+        return;
+    fs::create_directories(object_path(name).parent_path());
+    done = true;
+}
+
+void ObjectStore::migrate() {
+    // Listed first: the loop adds the fan-out directories.
+    std::vector<std::string> names;
+    for (const auto &entry : fs::directory_iterator(directory)) {
+        std::string name = entry.path().filename().string();
+        if (entry.is_regular_file() && !is_reserved(name))
+            names.push_back(std::move(name));
+    }
+    for (auto name : names) {
+        const fs::path from = directory / name;
+        const bool compressed = strip_suffix(name);
+        prepare_directory(name);
+        fs::rename(from,
+                   compressed ? compressed_path(name) : object_path(name));
+        ++migrated;
+    }
+    std::ofstream layout(directory / LAYOUT_FILE);
+    if (!(layout << "fanout 2\n"))
+        throw std::runtime_error("ObjectStore: Failed to write the layout");
+}
+
+void ObjectStore::rebuild_index() {
+    auto add = [&](const fs::directory_entry &entry, bool flat) {
+        std::string name = entry.path().filename().string();
+        if (!entry.is_regular_file() || is_reserved(name))
+            return;
+        objectindex::Entry object;
+        object.flat = flat;
+        object.compressed = strip_suffix(name);
+        if (object.compressed) {
+            // Compressed objects record their size, see compression.hpp.
+            const auto size = compression::frame_content_size(entry.path());
+            if (!size)
+                return;
+            object.size = *size;
+        } else {
+            object.size = entry.file_size();
+        }
+        loose.insert(name, object);
+    };
+    std::error_code ec;
+    for (const auto &first : fs::directory_iterator(directory, ec)) {
+        const std::string name = first.path().filename().string();
+        if (!first.is_directory()) {
+            add(first, true);
+            continue;
+        }
+        if (!is_fanout_name(name))
+            continue;
+        for (const auto &second : fs::directory_iterator(first.path()))
+            if (second.is_directory() &&
+                is_fanout_name(second.path().filename().string()))
+                for (const auto &object : fs::directory_iterator(second.path()))
+                    add(object, false);
+    }
+}
+
+std::optional<ull> ObjectStore::object_size(const std::string &name) const {
+    if (auto location = packs.find(name))
+        return location->size;
+    if (auto entry = loose.find(name))
+        return entry->size;
+    return std::nullopt;
+}
+
+bool ObjectStore::store(const std::string &name, std::string_view content) {
+    if (!should_pack(content.size())) {
+        if (contains(name))
+            return false;
+        Writer writer(*this, content.size());
+        writer.write(content.data(), content.size());
+        return writer.publish(name);
+    }
+    if (compression_level <= 0)
+        return packs.add(name, content);
+    if (packs.find(name))
+        return false;
+    const ull start = compression::thread_cpu_ns();
+    std::string compressed;
+    const bool compress =
+        compression::worth_compressing(content) &&
+        compression::compress(content, compression_level, compressed);
+    const std::string_view stored = compress ? compressed : content;
+    const ull cpu_ns = compression::thread_cpu_ns() - start;
+    if (!packs.add(name, stored, content.size()))
+        return false;
+    compression_stats.add(content.size(), stored.size(), compress, cpu_ns);
+    return true;
+}
+
+std::optional<copyengine::CopyMethod>
+ObjectStore::import(const fs::path &source, const std::string &name) {
+    if (contains(name) || adopt(name))
+        return std::nullopt;
+    if (compression_level <= 0) {
+        // Copied under a temporary name like `Writer`, so that a crash or a
+        // failed copy never leaves a truncated object under its final name.
+        const fs::path temporary = temporary_path();
+        const auto method = copyengine::copy_file(source, temporary);
+        const ull size = fs::file_size(temporary);
+        prepare_directory(name);
+        fs::rename(temporary, object_path(name));
+        loose.insert(name, {size, false, false});
+        remember_import(name);
+        return method;
+    }
+    Writer writer(*this, fs::file_size(source));
+    readengine::read_file(source, config::READ_ENGINE,
+                          [&](const char *data, size_t size) {
+                              writer.write(data, size);
+                          });
+    if (!writer.publish(name))
+        return std::nullopt;
+    remember_import(name);
+    return copyengine::CopyMethod::BUFFERED;
+}
+
+bool ObjectStore::adopt(const std::string &name) {
+    // Only asked for objects missing from the index, which are mostly new.
+    std::error_code ec;
+    if (const ull size = fs::file_size(object_path(name), ec); !ec) {
+        loose.insert(name, {size, false, false});
+        return true;
+    }
+    const fs::path compressed = compressed_path(name);
+    if (!fs::exists(compressed, ec))
+        return false;
+    const auto size = compression::frame_content_size(compressed);
+    if (!size)
+        return false;
+    loose.insert(name, {*size, true, false});
+    return true;
+}
+
+fs::path ObjectStore::temporary_path() {
+    // The directory belongs to this run, so a counter keeps names unique.
+    if (partial.empty())
+        throw std::runtime_error("ObjectStore: Not opened for writing");
+    static std::atomic<ull> next_id = 0;
+    return partial / std::to_string(next_id++);
+}
+
+void ObjectStore::remember_import(const std::string &name) {
+    std::lock_guard lock(imported_mutex);
+    imported.insert(packstore::object_key(name));
+}
+
+bool ObjectStore::discard(const std::string &name) {
+    {
+        // Objects that existed before this run may be referenced by earlier
+        // manifests, whatever this run saw of the source.
+        std::lock_guard lock(imported_mutex);
+        if (imported.erase(packstore::object_key(name)) == 0)
+            return false;
+    }
+    auto entry = loose.find(name);
+    if (!entry)
+        return false;
+    std::error_code ec;
+    fs::remove(entry_path(name, *entry), ec);
+    loose.erase(name);
+    return true;
+}
+
+copyengine::CopyMethod ObjectStore::extract(const std::string &name,
+                                            const fs::path &target) const {
+    if (!packs.find(name))
+        if (auto entry = loose.find(name); entry && !entry->compressed)
+            return copyengine::copy_file(entry_path(name, *entry), target);
+    extract_chunks({name}, target);
+    return copyengine::CopyMethod::BUFFERED;
+}
+
+void ObjectStore::extract_chunks(const std::vector<std::string> &names,
+                                 const fs::path &target) const {
+    for (const auto &name : names)
+        if (!contains(name))
+            throw std::runtime_error(
+                std::format("ObjectStore: Object {} not found", name));
+    if (fs::exists(target))
+        throw std::runtime_error(
+            std::format("ObjectStore: {} already exists", target.string()));
+
+    std::ofstream output(target, std::ios::binary);
+    try {
+        for (const auto &name : names)
+            write_object(name, output);
+        if (!output.flush())
+            throw std::runtime_error("Failed to write");
+    } catch (const std::exception &e) {
+        output.close();
+        std::error_code ec;
+        fs::remove(target, ec);
+        throw std::runtime_error(std::format("ObjectStore: {}: {}",
+                                             target.string(), e.what()));
+    }
+}
+
+void ObjectStore::write_object(const std::string &name,
+                               std::ostream &output) const {
+    if (auto location = packs.find(name)) {
+        std::string content = packs.read(*location);
+        if (location->stored_size < location->size)
+            content = compression::decompress(content, location->size);
+        if (!output.write(content.data(), content.size()))
+            throw std::runtime_error("Failed to write");
+        return;
+    }
+    const auto entry = loose.find(name);
+    if (!entry)
+        throw std::runtime_error("Object " + name + " not found");
+    std::ifstream input(entry_path(name, *entry), std::ios::binary);
+    if (!input)
+        throw std::runtime_error("Failed to open object " + name);
+    if (entry->compressed) {
+        compression::decompress_stream(input, output);
+    } else if (input.peek() != std::ifstream::traits_type::eof() &&
+               !(output << input.rdbuf())) {
+        throw std::runtime_error("Failed to copy object " + name);
+    }
+}
+
+ObjectStore::Writer::Writer(ObjectStore &store, ull expected_size)
+    : store(store), expected_size(expected_size),
+      path(store.temporary_path()) {
+    output.open(path, std::ios::binary | std::ios::trunc);
+    if (!output)
+        throw std::runtime_error("ObjectStore: Failed to create temporary object");
+}
+
+ObjectStore::Writer::~Writer() {
+    if (!published) {
+        compressor.reset();
+        output.close();
+        std::error_code ec;
+        fs::remove(path, ec);
+    }
+}
+
+void ObjectStore::Writer::write(const char *data, size_t size) {
+    if (!decided) {
+        decided = true;
+        if (store.compression_level > 0) {
+            // Judged by the first block: media and archives stay raw.
+            const ull start = compression::thread_cpu_ns();
+            if (compression::worth_compressing(std::string_view(
+                    data, std::min(size, compression::SAMPLE_SIZE))))
+                compressor.emplace(output, store.compression_level,
+                                   expected_size, store.compression_threads);
+            cpu_ns = compression::thread_cpu_ns() - start;
+        }
+    }
+    if (compressor)
+        compressor->write(data, size);
+    else if (!output.write(data, size))
+        throw std::runtime_error("ObjectStore: Failed to write temporary object");
+    written += size;
+}
+
+bool ObjectStore::Writer::publish(const std::string &name) {
+    if (compressor)
+        compressor->finish();
+    // The file may have changed size since it was scanned; record what was
+    // actually written.
+    const ull size = compressor ? compressor->get_size() : written;
+    const ull stored = output.tellp();
+    output.close();
+    if (!output)
+        throw std::runtime_error("ObjectStore: Failed to write temporary object");
+    if (store.contains(name)) {
+        fs::remove(path);
+        published = true;
+        return false;
+    }
+    store.prepare_directory(name);
+    fs::rename(path, compressor ? store.compressed_path(name)
+                                : store.object_path(name));
+    store.loose.insert(name, {size, compressor.has_value(), false});
+    if (store.compression_level > 0)
+        store.compression_stats.add(
+            size, stored, compressor.has_value(),
+            cpu_ns + (compressor ? compressor->get_cpu_ns() : 0));
+    published = true;
+    return true;
+}
+} // namespace objectstore
@@ -0,0 +1,879 @@
+/// @file pack_store.cpp
+/// @brief pack_store.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+#include "pack_store.hpp"
+#include "siphash.hpp"
+
+namespace packstore {
+namespace {
+// Both files use host byte order.
+const char PACK_MAGIC[4] = {'B', 'S', 'P', 'K'};
+const char INDEX_MAGIC[4] = {'B', 'S', 'P', 'I'};
+constexpr uint32_t FORMAT_VERSION = 2;
+
+// Pack: magic, version, reserved; then records of name size (u32), original
+// size (u32), stored size (u64), name and stored content.
+constexpr size_t PACK_HEADER_SIZE = 16;
+constexpr size_t RECORD_HEADER_SIZE = 16;
+// Size of a reserved object whose record is still being written.
+constexpr ull WRITING = ~0ull;
+// Object names are short; anything longer marks a torn or foreign record.
+constexpr uint32_t MAX_NAME_SIZE = 1024;
+
+// Index: magic, version, entry count; the fanout table; then the entries.
+constexpr size_t INDEX_HEADER_SIZE = 16;
+constexpr size_t FANOUT_SIZE = 256;
+constexpr size_t INDEX_ENTRY_SIZE = 32;
+constexpr size_t INDEX_ENTRIES_OFFSET =
+    INDEX_HEADER_SIZE + FANOUT_SIZE * sizeof(ull);
+
+// Multi-pack index: magic, version, pack count, reserved, entry count; the
+// fanout table; the entries (key, offset, pack, original and stored size);
+// then the file names of the packs, each ending in a NUL.
+const char MULTI_INDEX_MAGIC[4] = {'B', 'S', 'P', 'M'};
+constexpr uint32_t MULTI_INDEX_VERSION = 1;
+constexpr size_t MULTI_INDEX_HEADER_SIZE = 24;
+constexpr size_t MULTI_INDEX_ENTRY_SIZE = 40;
+constexpr size_t MULTI_INDEX_ENTRIES_OFFSET =
+    MULTI_INDEX_HEADER_SIZE + FANOUT_SIZE * sizeof(ull);
+
+/// SipHash key of the object keys, fixed so that indexes stay valid across
+/// runs and builds.
+constexpr ull OBJECT_KEY_K0 = 0x4261636b75705061ull;
+constexpr ull OBJECT_KEY_K1 = 0x636b496e64657821ull;
+
+ull load_u64(const unsigned char *p) {
+    ull value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+void store_u64(unsigned char *p, ull value) {
+    std::memcpy(p, &value, sizeof(value));
+}
+
+/// @brief Orders keys the way the index stores them; the fanout table is
+/// keyed on the top byte of `high`.
+bool key_less(const Key &a, const Key &b) {
+    return a.high != b.high ? a.high < b.high : a.low < b.low;
+}
+unsigned top_byte(const Key &key) { return key.high >> 56; }
+
+fs::path index_path(const fs::path &pack) {
+    return fs::path(pack).replace_extension(".idx");
+}
+
+/// Held while the multi-pack index is written, so that concurrent runs do
+/// not write the same temporary file or remove each other's.
+constexpr std::string_view MULTI_INDEX_LOCK_SUFFIX = ".lock";
+
+#ifndef _WIN32
+/// @brief An exclusive `flock` on a file, released when destroyed.
+/// @details A run holds the lock of each pack it appends to until the index
+/// is written, so that other runs do not take the pack for one left by an
+/// interrupted run.
+class FileLock {
+  public:
+    FileLock() = default;
+    /// @param fd An open descriptor of the file, owned from now on.
+    /// @param wait Whether to wait for the lock instead of failing at once.
+    FileLock(int fd, bool wait) : fd(fd) {
+        if (fd >= 0 && ::flock(fd, LOCK_EX | (wait ? 0 : LOCK_NB)) != 0) {
+            ::close(fd);
+            this->fd = -1;
+        }
+    }
+    ~FileLock() {
+        if (fd >= 0)
+            ::close(fd);
+    }
+    FileLock(FileLock &&other) noexcept : fd(std::exchange(other.fd, -1)) {}
+    FileLock &operator=(FileLock &&other) noexcept {
+        std::swap(fd, other.fd);
+        return *this;
+    }
+
+    bool held() const { return fd >= 0; }
+
+  private:
+    int fd = -1;
+};
+
+/// @return The lock of `path`, not held if another run holds it.
+FileLock try_lock(const fs::path &path, bool create = false) {
+    return FileLock(
+        ::open(path.c_str(), (create ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC,
+               0644),
+        false);
+}
+
+/// @brief Waits for the lock of `path`, creating the file if needed.
+FileLock wait_lock(const fs::path &path) {
+    return FileLock(::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644),
+                    true);
+}
+#else
+// Without flock, a pack in use cannot be told apart: every pack without an
+// index is taken for one of an interrupted run.
+struct FileLock {
+    bool held() const { return true; }
+};
+FileLock try_lock(const fs::path &, bool = false) { return {}; }
+FileLock wait_lock(const fs::path &) { return {}; }
+#endif
+
+/// @brief One object of a pack, as the index records it.
+struct IndexEntry {
+    Key key;
+    ull offset;
+    uint32_t size;
+    uint32_t stored_size;
+    uint32_t pack = 0; /// Only in the multi-pack index.
+};
+
+bool entry_less(const IndexEntry &a, const IndexEntry &b) {
+    return key_less(a.key, b.key);
+}
+
+/// @brief Looks up a key in a sorted table of fixed-size entries that begin
+/// with the key: the fanout table bounds the range, a binary search finds
+/// the entry.
+/// @return The entry, or nullptr.
+const unsigned char *search(const unsigned char *fanout,
+                            const unsigned char *entries, size_t entry_size,
+                            const Key &key) {
+    auto count = [&](unsigned byte) {
+        return load_u64(fanout + byte * sizeof(ull));
+    };
+    const unsigned byte = top_byte(key);
+    ull low = byte == 0 ? 0 : count(byte - 1);
+    ull high = count(byte);
+    while (low < high) {
+        const ull middle = low + (high - low) / 2;
+        const unsigned char *entry = entries + middle * entry_size;
+        const Key stored{load_u64(entry + 8), load_u64(entry)};
+        if (stored == key)
+            return entry;
+        if (key_less(stored, key))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return nullptr;
+}
+
+/// @brief Fills the fanout table of sorted entries.
+void write_fanout(unsigned char *fanout,
+                  const std::vector<IndexEntry> &entries) {
+    size_t next = 0;
+    for (unsigned byte = 0; byte < FANOUT_SIZE; ++byte) {
+        while (next < entries.size() && top_byte(entries[next].key) <= byte)
+            ++next;
+        store_u64(fanout + byte * sizeof(ull), next);
+    }
+}
+
+/// @brief Flushes a file to disk before its index is published.
+void sync_file(const fs::path &path) {
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    const bool ok = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0)
+        ::close(fd);
+    if (!ok)
+        throw std::runtime_error(std::format("PackStore: Failed to sync {}: {}",
+                                             path.string(),
+                                             std::strerror(errno)));
+#else
+    (void)path;
+#endif
+}
+
+/// @brief Writes the sorted index of a pack and moves it into place.
+void write_index(const fs::path &pack, std::vector<IndexEntry> entries) {
+    std::sort(entries.begin(), entries.end(), entry_less);
+    const fs::path path = index_path(pack);
+    const fs::path temporary = fs::path(path) += ".tmp";
+    mappedfile::MappedFile output;
+    output.create(temporary,
+                  INDEX_ENTRIES_OFFSET + entries.size() * INDEX_ENTRY_SIZE);
+    unsigned char *data = output.data();
+    std::memcpy(data, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    std::memcpy(data + 4, &FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    store_u64(data + 8, entries.size());
+
+    write_fanout(data + INDEX_HEADER_SIZE, entries);
+    unsigned char *entry = data + INDEX_ENTRIES_OFFSET;
+    for (const auto &e : entries) {
+        store_u64(entry, e.key.high);
+        store_u64(entry + 8, e.key.low);
+        store_u64(entry + 16, e.offset);
+        std::memcpy(entry + 24, &e.size, sizeof(e.size));
+        std::memcpy(entry + 28, &e.stored_size, sizeof(e.stored_size));
+        entry += INDEX_ENTRY_SIZE;
+    }
+    output.commit();
+    fs::rename(temporary, path);
+}
+
+/// @brief Reads the complete records of a pack whose index is missing.
+/// @return The end of the last complete record, or 0 if `path` is not a
+/// pack.
+ull scan_pack(const fs::path &path, std::vector<IndexEntry> &entries) {
+    std::ifstream input(path, std::ios::binary);
+    char header[PACK_HEADER_SIZE];
+    if (!input.read(header, sizeof(header)) ||
+        std::memcmp(header, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0)
+        return 0;
+    uint32_t version;
+    std::memcpy(&version, header + 4, sizeof(version));
+    if (version != FORMAT_VERSION)
+        return 0;
+
+    std::error_code ec;
+    const ull file_size = fs::file_size(path, ec);
+    ull end = PACK_HEADER_SIZE;
+    std::string name;
+    while (true) {
+        unsigned char record[RECORD_HEADER_SIZE];
+        if (!input.read(reinterpret_cast<char *>(record), sizeof(record)))
+            break;
+        uint32_t name_size, size;
+        std::memcpy(&name_size, record, sizeof(name_size));
+        std::memcpy(&size, record + 4, sizeof(size));
+        const ull stored_size = load_u64(record + 8);
+        const ull content_offset = end + RECORD_HEADER_SIZE + name_size;
+        if (name_size == 0 || name_size > MAX_NAME_SIZE ||
+            size > PACK_OBJECT_MAX_SIZE || stored_size > size ||
+            content_offset + stored_size > file_size)
+            break;
+        name.resize(name_size);
+        if (!input.read(name.data(), name_size) ||
+            !input.seekg(stored_size, std::ios::cur))
+            break;
+        entries.push_back({object_key(name), content_offset, size,
+                           static_cast<uint32_t>(stored_size)});
+        end = content_offset + stored_size;
+    }
+    return end;
+}
+} // namespace
+
+Key object_key(std::string_view name) {
+    return siphash::hash128(OBJECT_KEY_K0, OBJECT_KEY_K1, name);
+}
+
+/// @brief A pack file opened for reading, with its index once written.
+class Pack {
+  public:
+    explicit Pack(const fs::path &path) : path(path) {
+#ifndef _WIN32
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error(
+                std::format("PackStore: Failed to open {}: {}", path.string(),
+                            std::strerror(errno)));
+#endif
+    }
+    ~Pack() {
+#ifndef _WIN32
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    }
+    Pack(const Pack &) = delete;
+    Pack &operator=(const Pack &) = delete;
+
+    /// @brief Maps the index of the pack.
+    /// @return false if it is missing or malformed.
+    bool load_index() {
+        if (!index.open_read(index_path(path)) ||
+            index.size() < INDEX_ENTRIES_OFFSET)
+            return false;
+        const unsigned char *data = index.data();
+        uint32_t version;
+        std::memcpy(&version, data + 4, sizeof(version));
+        const ull entries = load_u64(data + 8);
+        if (std::memcmp(data, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+            version != FORMAT_VERSION ||
+            index.size() != INDEX_ENTRIES_OFFSET + entries * INDEX_ENTRY_SIZE ||
+            fanout(FANOUT_SIZE - 1) != entries)
+            return false;
+        count = entries;
+        return true;
+    }
+
+    /// @brief Looks up a key.
+    std::optional<Location> find(const Key &key, uint32_t id) const {
+        const unsigned char *entry =
+            search(index.data() + INDEX_HEADER_SIZE,
+                   index.data() + INDEX_ENTRIES_OFFSET, INDEX_ENTRY_SIZE, key);
+        if (entry == nullptr)
+            return std::nullopt;
+        return to_location(entry, id);
+    }
+
+    /// @brief Appends all entries of the index to `entries`.
+    void entries(uint32_t id, std::vector<IndexEntry> &entries) const {
+        const unsigned char *entry = index.data() + INDEX_ENTRIES_OFFSET;
+        for (size_t i = 0; i < count; ++i, entry += INDEX_ENTRY_SIZE) {
+            const Location location = to_location(entry, id);
+            entries.push_back({{load_u64(entry + 8), load_u64(entry)},
+                               location.offset,
+                               static_cast<uint32_t>(location.size),
+                               static_cast<uint32_t>(location.stored_size),
+                               id});
+        }
+    }
+
+    std::string read(ull offset, ull size) const {
+        std::string content(size, '\0');
+#ifndef _WIN32
+        ull done = 0;
+        while (done < size) {
+            const ssize_t n =
+                pread(fd, content.data() + done, size - done, offset + done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                throw std::runtime_error(
+                    std::format("PackStore: Failed to read {}", path.string()));
+            done += n;
+        }
+#else
+        std::ifstream input(path, std::ios::binary);
+        if (!input.seekg(offset) || !input.read(content.data(), size))
+            throw std::runtime_error(
+                std::format("PackStore: Failed to read {}", path.string()));
+#endif
+        return content;
+    }
+
+    size_t size() const { return count; }
+
+    fs::path path;
+
+  private:
+    ull fanout(unsigned byte) const {
+        return load_u64(index.data() + INDEX_HEADER_SIZE + byte * sizeof(ull));
+    }
+
+    static Location to_location(const unsigned char *entry, uint32_t id) {
+        const ull offset = load_u64(entry + 16);
+        uint32_t size, stored_size;
+        std::memcpy(&size, entry + 24, sizeof(size));
+        std::memcpy(&stored_size, entry + 28, sizeof(stored_size));
+        return Location{id, offset, size, stored_size};
+    }
+
+    mappedfile::MappedFile index;
+    size_t count = 0;
+#ifndef _WIN32
+    int fd = -1;
+#endif
+};
+
+/// @brief The merged index of many packs, so that finding an object takes a
+/// single binary search however many packs there are.
+class MultiPackIndex {
+  public:
+    /// @brief Maps the index.
+    /// @return false if it is missing or malformed.
+    bool load(const fs::path &path) {
+        if (!index.open_read(path) || index.size() < MULTI_INDEX_ENTRIES_OFFSET)
+            return false;
+        const unsigned char *data = index.data();
+        uint32_t version, packs;
+        std::memcpy(&version, data + 4, sizeof(version));
+        std::memcpy(&packs, data + 8, sizeof(packs));
+        count = load_u64(data + 16);
+        const ull names_offset =
+            MULTI_INDEX_ENTRIES_OFFSET + count * MULTI_INDEX_ENTRY_SIZE;
+        if (std::memcmp(data, MULTI_INDEX_MAGIC, sizeof(MULTI_INDEX_MAGIC)) !=
+                0 ||
+            version != MULTI_INDEX_VERSION || names_offset > index.size() ||
+            load_u64(data + MULTI_INDEX_HEADER_SIZE +
+                     (FANOUT_SIZE - 1) * sizeof(ull)) != count)
+            return false;
+        std::string_view names(reinterpret_cast<const char *>(data) +
+                                   names_offset,
+                               index.size() - names_offset);
+        pack_names.clear();
+        while (!names.empty()) {
+            const size_t end = names.find('\0');
+            if (end == std::string_view::npos)
+                return false;
+            pack_names.emplace_back(names.substr(0, end));
+            names.remove_prefix(end + 1);
+        }
+        return pack_names.size() == packs;
+    }
+
+    /// @brief Looks up a key; the pack number is the position of the pack
+    /// in `get_pack_names`.
+    std::optional<Location> find(const Key &key) const {
+        const unsigned char *entry =
+            search(index.data() + MULTI_INDEX_HEADER_SIZE,
+                   index.data() + MULTI_INDEX_ENTRIES_OFFSET,
+                   MULTI_INDEX_ENTRY_SIZE, key);
+        if (entry == nullptr)
+            return std::nullopt;
+        return to_location(entry);
+    }
+
+    /// @brief Appends all entries, which are sorted, to `entries`.
+    void entries(std::vector<IndexEntry> &entries) const {
+        const unsigned char *entry = index.data() + MULTI_INDEX_ENTRIES_OFFSET;
+        for (size_t i = 0; i < count; ++i, entry += MULTI_INDEX_ENTRY_SIZE) {
+            const Location location = to_location(entry);
+            entries.push_back({{load_u64(entry + 8), load_u64(entry)},
+                               location.offset,
+                               static_cast<uint32_t>(location.size),
+                               static_cast<uint32_t>(location.stored_size),
+                               location.pack});
+        }
+    }
+
+    const std::vector<std::string> &get_pack_names() const {
+        return pack_names;
+    }
+    size_t size() const { return count; }
+
+    /// @brief Writes the index of sorted `entries`, whose pack numbers are
+    /// positions in `pack_names`, and moves it into place.
+    static void write(const fs::path &path,
+                      const std::vector<IndexEntry> &entries,
+                      const std::vector<std::string> &pack_names) {
+        size_t names_size = 0;
+        for (const auto &name : pack_names)
+            names_size += name.size() + 1;
+        const fs::path temporary = fs::path(path) += ".tmp";
+        mappedfile::MappedFile output;
+        output.create(temporary, MULTI_INDEX_ENTRIES_OFFSET +
+                                     entries.size() * MULTI_INDEX_ENTRY_SIZE +
+                                     names_size);
+        unsigned char *data = output.data();
+        const uint32_t packs = pack_names.size(), reserved = 0;
+        std::memcpy(data, MULTI_INDEX_MAGIC, sizeof(MULTI_INDEX_MAGIC));
+        std::memcpy(data + 4, &MULTI_INDEX_VERSION, sizeof(MULTI_INDEX_VERSION));
+        std::memcpy(data + 8, &packs, sizeof(packs));
+        std::memcpy(data + 12, &reserved, sizeof(reserved));
+        store_u64(data + 16, entries.size());
+        write_fanout(data + MULTI_INDEX_HEADER_SIZE, entries);
+        unsigned char *entry = data + MULTI_INDEX_ENTRIES_OFFSET;
+        for (const auto &e : entries) {
+            store_u64(entry, e.key.high);
+            store_u64(entry + 8, e.key.low);
+            store_u64(entry + 16, e.offset);
+            std::memcpy(entry + 24, &e.pack, sizeof(e.pack));
+            std::memcpy(entry + 28, &e.size, sizeof(e.size));
+            std::memcpy(entry + 32, &e.stored_size, sizeof(e.stored_size));
+            std::memcpy(entry + 36, &reserved, sizeof(reserved));
+            entry += MULTI_INDEX_ENTRY_SIZE;
+        }
+        for (const auto &name : pack_names) {
+            std::memcpy(entry, name.data(), name.size());
+            entry[name.size()] = '\0';
+            entry += name.size() + 1;
+        }
+        output.commit();
+        fs::rename(temporary, path);
+    }
+
+  private:
+    static Location to_location(const unsigned char *entry) {
+        uint32_t pack, size, stored_size;
+        std::memcpy(&pack, entry + 24, sizeof(pack));
+        std::memcpy(&size, entry + 28, sizeof(size));
+        std::memcpy(&stored_size, entry + 32, sizeof(stored_size));
+        return Location{pack, load_u64(entry + 16), size, stored_size};
+    }
+
+    mappedfile::MappedFile index;
+    size_t count = 0;
+    std::vector<std::string> pack_names;
+};
+
+/// @brief Appends to one pack; owned by a single thread at a time.
+class PackWriter {
+  public:
+    uint32_t pack = 0;
+    fs::path path;
+    FileLock lock; /// Held until the index is written.
+    std::ofstream output;
+    ull offset = 0;
+    std::vector<IndexEntry> entries;
+    /// A write failed: the pack ends in a torn record and takes no more.
+    bool failed = false;
+    bool finished = false;
+};
+
+PackStore::PackStore() = default;
+
+PackStore::~PackStore() {
+    try {
+        close();
+    } catch (...) {
+        // The packs stay without index and are recovered on the next open.
+    }
+}
+
+void PackStore::open(const fs::path &directory, bool writable) {
+    this->directory = directory;
+    this->writable = writable;
+    std::error_code ec;
+    if (!fs::is_directory(directory, ec))
+        return;
+    std::vector<fs::path> paths, temporaries;
+    for (const auto &entry : fs::directory_iterator(directory, ec)) {
+        const fs::path &path = entry.path();
+        if (path.extension() == ".pack")
+            paths.push_back(path);
+        else if (writable && path.extension() == ".tmp")
+            temporaries.push_back(path);
+    }
+    std::sort(paths.begin(), paths.end());
+
+    // The packs the multi-pack index covers come first, numbered as in the
+    // index; it is ignored if any of them is gone.
+    auto multi = std::make_unique<MultiPackIndex>();
+    if (multi->load(directory / MULTI_INDEX_FILE)) {
+        std::vector<std::unique_ptr<Pack>> packs;
+        for (const auto &name : multi->get_pack_names()) {
+            const fs::path path = directory / name;
+            if (!std::binary_search(paths.begin(), paths.end(), path))
+                break;
+            packs.push_back(std::make_unique<Pack>(path));
+        }
+        if (packs.size() == multi->get_pack_names().size()) {
+            indexed = std::move(packs);
+            covered = indexed.size();
+            indexed_objects = multi->size();
+            multi_index = std::move(multi);
+        }
+    }
+
+    std::unordered_set<std::string> covered_names;
+    if (multi_index)
+        covered_names.insert(multi_index->get_pack_names().begin(),
+                             multi_index->get_pack_names().end());
+    for (const auto &path : paths) {
+        if (covered_names.contains(path.filename().string()))
+            continue;
+        auto pack = std::make_unique<Pack>(path);
+        if (!pack->load_index()) {
+            if (!writable)
+                continue;
+            // A concurrent run holds the lock of the packs it appends to;
+            // those are left alone.
+            const FileLock lock = try_lock(path);
+            if (!lock.held())
+                continue;
+            // Left by an interrupted run: index the complete records and cut
+            // off the torn one.
+            std::vector<IndexEntry> entries;
+            const ull end = scan_pack(path, entries);
+            if (end == 0)
+                continue;
+            if (end < fs::file_size(path))
+                fs::resize_file(path, end);
+            write_index(path, std::move(entries));
+            if (!pack->load_index())
+                continue;
+        }
+        indexed_objects += pack->size();
+        indexed.push_back(std::move(pack));
+    }
+
+    // Temporary indexes of interrupted runs; those of concurrent runs are
+    // under a lock.
+    for (const auto &path : temporaries) {
+        const fs::path target = fs::path(path).replace_extension();
+        bool stale;
+        if (target.filename() == MULTI_INDEX_FILE) {
+            fs::path lock = target;
+            lock += MULTI_INDEX_LOCK_SUFFIX;
+            stale = try_lock(lock, true).held();
+        } else {
+            const fs::path pack = fs::path(target).replace_extension(".pack");
+            stale = !fs::exists(pack, ec) || try_lock(pack).held();
+        }
+        if (stale)
+            fs::remove(path, ec);
+    }
+}
+
+std::optional<Location> PackStore::find_indexed(const Key &key) const {
+    if (multi_index)
+        if (auto location = multi_index->find(key))
+            return location;
+    // Packs of runs that did not write the multi-pack index.
+    for (uint32_t i = covered; i < indexed.size(); ++i)
+        if (auto location = indexed[i]->find(key, i))
+            return location;
+    return std::nullopt;
+}
+
+std::optional<Location> PackStore::find(std::string_view name) const {
+    const Key key = object_key(name);
+    if (auto location = find_indexed(key))
+        return location;
+    std::lock_guard lock(mutex);
+    auto it = pending.find(key);
+    if (it == pending.end() || it->second.size == WRITING)
+        return std::nullopt;
+    return it->second;
+}
+
+std::string PackStore::read(const Location &location) const {
+    const Pack *pack;
+    if (location.pack < indexed.size()) {
+        pack = indexed[location.pack].get();
+    } else {
+        std::lock_guard lock(mutex);
+        const size_t i = location.pack - indexed.size();
+        if (i >= written.size())
+            throw std::runtime_error("PackStore: Invalid location");
+        pack = written[i].get();
+    }
+    return pack->read(location.offset, location.stored_size);
+}
+
+bool PackStore::add(std::string_view name, std::string_view content,
+                    ull size) {
+    if (size > PACK_OBJECT_MAX_SIZE || content.size() > size)
+        throw std::invalid_argument("PackStore: Invalid object size");
+    const Key key = object_key(name);
+    if (find_indexed(key))
+        return false;
+
+    PackWriter *writer = nullptr;
+    {
+        std::unique_lock lock(mutex);
+        if (closed)
+            throw std::logic_error("PackStore: Already closed");
+        // Another thread may be writing the same object; wait for it so that
+        // the object can be found once this returns.
+        auto it = pending.find(key);
+        while (it != pending.end() && it->second.size == WRITING) {
+            written_cv.wait(lock);
+            it = pending.find(key);
+        }
+        if (it != pending.end())
+            return false;
+        pending.emplace(key, Location{0, 0, WRITING, 0});
+        if (!idle.empty()) {
+            writer = idle.back();
+            idle.pop_back();
+        }
+    }
+    if (writer == nullptr) {
+        try {
+            writer = create_writer();
+        } catch (...) {
+            {
+                std::lock_guard lock(mutex);
+                pending.erase(key);
+            }
+            written_cv.notify_all();
+            throw;
+        }
+    }
+
+    const ull record = writer->offset;
+    const ull content_offset = record + RECORD_HEADER_SIZE + name.size();
+    unsigned char header[RECORD_HEADER_SIZE] = {};
+    const uint32_t name_size = name.size(), original_size = size;
+    std::memcpy(header, &name_size, sizeof(name_size));
+    std::memcpy(header + 4, &original_size, sizeof(original_size));
+    store_u64(header + 8, content.size());
+    // Flushed per object: a found object must be readable right away.
+    writer->output.write(reinterpret_cast<const char *>(header), sizeof(header))
+        .write(name.data(), name.size())
+        .write(content.data(), content.size())
+        .flush();
+    const bool ok = static_cast<bool>(writer->output);
+
+    bool full = false;
+    {
+        std::lock_guard lock(mutex);
+        if (ok) {
+            writer->offset = content_offset + content.size();
+            writer->entries.push_back({key, content_offset, original_size,
+                                       static_cast<uint32_t>(content.size())});
+            pending[key] =
+                Location{writer->pack, content_offset, size, content.size()};
+            full = writer->offset >= PACK_FILE_MAX_SIZE;
+        } else {
+            writer->failed = true;
+            pending.erase(key);
+        }
+        if (ok && !full)
+            idle.push_back(writer);
+    }
+    written_cv.notify_all();
+    if (!ok || full)
+        finish(*writer);
+    if (!ok)
+        throw std::runtime_error(
+            std::format("PackStore: Failed to write {}", writer->path.string()));
+    return true;
+}
+
+PackWriter *PackStore::create_writer() {
+    // Unique across the threads and across runs sharing the directory.
+    static const unsigned process_tag = std::random_device{}();
+    static std::atomic<ull> next_id = 0;
+    // The file is created without the lock; other threads keep appending to
+    // their own packs meanwhile.
+    fs::create_directories(directory);
+    auto writer = std::make_unique<PackWriter>();
+    auto next_path = [&] {
+        return directory /
+               std::format("pack-{:08x}-{:04}.pack", process_tag, next_id++);
+    };
+#ifndef _WIN32
+    // Locked before the header is written: a run that opens the directory
+    // meanwhile sees either an empty file or a locked pack.
+    int fd;
+    do {
+        writer->path = next_path();
+        fd = ::open(writer->path.c_str(),
+                    O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    } while (fd < 0 && errno == EEXIST);
+    writer->lock = FileLock(fd, true);
+    if (!writer->lock.held())
+        throw std::runtime_error(std::format("PackStore: Failed to create {}",
+                                             writer->path.string()));
+#else
+    do {
+        writer->path = next_path();
+    } while (fs::exists(writer->path));
+#endif
+    writer->output.open(writer->path, std::ios::binary | std::ios::trunc);
+    unsigned char header[PACK_HEADER_SIZE] = {};
+    std::memcpy(header, PACK_MAGIC, sizeof(PACK_MAGIC));
+    std::memcpy(header + 4, &FORMAT_VERSION, sizeof(FORMAT_VERSION));
+    if (!writer->output.write(reinterpret_cast<const char *>(header),
+                              sizeof(header)))
+        throw std::runtime_error(std::format("PackStore: Failed to create {}",
+                                             writer->path.string()));
+    writer->offset = PACK_HEADER_SIZE;
+    auto pack = std::make_unique<Pack>(writer->path);
+
+    std::lock_guard lock(mutex);
+    writer->pack = indexed.size() + written.size();
+    written.push_back(std::move(pack));
+    writers.push_back(std::move(writer));
+    return writers.back().get();
+}
+
+void PackStore::finish(PackWriter &writer) {
+    if (writer.finished)
+        return;
+    writer.finished = true;
+    writer.output.close();
+    if (writer.entries.empty()) {
+        std::error_code ec;
+        fs::remove(writer.path, ec);
+    } else {
+        sync_file(writer.path);
+        write_index(writer.path, writer.entries);
+    }
+    writer.lock = FileLock();
+}
+
+void PackStore::close() {
+    std::vector<PackWriter *> open_writers;
+    {
+        std::lock_guard lock(mutex);
+        if (closed)
+            return;
+        closed = true;
+        for (const auto &writer : writers)
+            open_writers.push_back(writer.get());
+        idle.clear();
+    }
+    std::exception_ptr error;
+    for (PackWriter *writer : open_writers) {
+        try {
+            finish(*writer);
+        } catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+    if (writable && (!writers.empty() || covered < indexed.size()))
+        write_multi_index();
+}
+
+void PackStore::write_multi_index() {
+    // The covered packs keep their numbers and their entries are already
+    // sorted; the others are sorted and merged in.
+    std::vector<std::string> names;
+    std::vector<IndexEntry> entries;
+    if (multi_index) {
+        names = multi_index->get_pack_names();
+        entries.reserve(indexed_objects + pending.size());
+        multi_index->entries(entries);
+    }
+    const size_t merged = entries.size();
+    for (size_t i = covered; i < indexed.size(); ++i) {
+        const uint32_t id = names.size();
+        names.push_back(indexed[i]->path.filename().string());
+        indexed[i]->entries(id, entries);
+    }
+    for (const auto &writer : writers) {
+        if (writer->entries.empty())
+            continue;
+        const uint32_t id = names.size();
+        names.push_back(writer->path.filename().string());
+        for (auto entry : writer->entries) {
+            entry.pack = id;
+            entries.push_back(entry);
+        }
+    }
+    std::sort(entries.begin() + merged, entries.end(), entry_less);
+    std::inplace_merge(entries.begin(), entries.begin() + merged,
+                       entries.end(), entry_less);
+    fs::path lock_path = directory / MULTI_INDEX_FILE;
+    lock_path += MULTI_INDEX_LOCK_SUFFIX;
+    const FileLock lock = wait_lock(lock_path);
+    MultiPackIndex::write(directory / MULTI_INDEX_FILE, entries, names);
+}
+
+size_t PackStore::size() const {
+    std::lock_guard lock(mutex);
+    return indexed_objects + pending.size();
+}
+
+size_t PackStore::pack_count() const {
+    std::lock_guard lock(mutex);
+    return indexed.size() + written.size();
+}
+} // namespace packstore
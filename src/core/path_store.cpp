@@ -0,0 +1,154 @@
+/// @file path_store.cpp
+/// @brief path_store.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <cstring>
+#include <stdexcept>
+
+#include "path_store.hpp"
+
+namespace pathstore {
+
+PathArena::PathArena()
+    : node_blocks(new std::atomic<Node *>[MAX_NODE_BLOCKS]()), node_count(0) {}
+
+PathArena::~PathArena() {
+    for (size_t i = 0; i < MAX_NODE_BLOCKS; ++i)
+        delete[] node_blocks[i].load(std::memory_order_relaxed);
+}
+
+const char8_t *PathArena::store_name(Shard &shard, std::u8string_view name) {
+    if (name.empty())
+        return u8"";
+    auto &blocks = shard.name_blocks;
+    if (name.size() > NAME_BLOCK_SIZE / 4) {
+        // Unusually long names get a block of their own so that they do not
+        // waste the rest of the shared block.
+        blocks.emplace_back(std::make_unique<char8_t[]>(name.size()));
+        std::memcpy(blocks.back().get(), name.data(), name.size());
+        auto *stored = blocks.back().get();
+        // Keep the shared block as the last one.
+        if (blocks.size() > 1)
+            std::swap(blocks.back(), blocks[blocks.size() - 2]);
+        return stored;
+    }
+    if (shard.name_block_used + name.size() > NAME_BLOCK_SIZE) {
+        blocks.emplace_back(std::make_unique<char8_t[]>(NAME_BLOCK_SIZE));
+        shard.name_block_used = 0;
+    }
+    char8_t *stored = blocks.back().get() + shard.name_block_used;
+    std::memcpy(stored, name.data(), name.size());
+    shard.name_block_used += name.size();
+    return stored;
+}
+
+PathId PathArena::append_locked(Shard &shard, PathId parent,
+                                std::u8string_view name) {
+    const size_t index = node_count.fetch_add(1, std::memory_order_relaxed);
+    if (index >= MAX_NODE_BLOCKS * NODE_BLOCK_SIZE - 1)
+        throw std::runtime_error("PathArena: too many paths");
+    const PathId id = static_cast<PathId>(index);
+
+    // Whoever needs a block first installs it; a thread that loses the race
+    // frees its own.
+    auto &slot = node_blocks[id >> NODE_BLOCK_BITS];
+    Node *block = slot.load(std::memory_order_acquire);
+    if (block == nullptr) {
+        Node *fresh = new Node[NODE_BLOCK_SIZE];
+        if (slot.compare_exchange_strong(block, fresh,
+                                         std::memory_order_acq_rel))
+            block = fresh;
+        else
+            delete[] fresh;
+    }
+    block[id & (NODE_BLOCK_SIZE - 1)] =
+        Node{store_name(shard, name), static_cast<uint32_t>(name.size()),
+             parent};
+    return id;
+}
+
+PathArena::Shard &PathArena::thread_shard() {
+    static std::atomic<size_t> next_thread = 0;
+    // Threads take the shards in turn, so up to SHARD_COUNT threads never
+    // share one.
+    thread_local const size_t index = next_thread++ % SHARD_COUNT;
+    return shards[index];
+}
+
+PathId PathArena::append(PathId parent, std::u8string_view name) {
+    Shard &shard = thread_shard();
+    std::lock_guard lock(shard.mutex);
+    return append_locked(shard, parent, name);
+}
+
+PathId PathArena::intern(const fs::path &path) {
+    PathId id = INVALID_PATH_ID;
+    for (const auto &component : path) {
+        std::u8string name = component.u8string();
+        if (name.empty())
+            continue;
+        const std::pair<PathId, std::u8string_view> key{id, name};
+        Shard &shard = shards[ChildHash()(key) % SHARD_COUNT];
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.children.find(key);
+        if (it != shard.children.end()) {
+            id = it->second;
+            continue;
+        }
+        PathId child = append_locked(shard, id, name);
+        shard.children.emplace(std::make_pair(id, get_name(child)), child);
+        id = child;
+    }
+    return id;
+}
+
+fs::path PathArena::get_path(PathId id) const {
+    if (id == INVALID_PATH_ID)
+        return {};
+
+    // Collect the components from the leaf up, then join them root first.
+    const Node *components[256];
+    std::vector<const Node *> deep_components;
+    size_t depth = 0, length = 0;
+    for (PathId cur = id; cur != INVALID_PATH_ID; cur = node(cur).parent) {
+        const Node *n = &node(cur);
+        if (depth < std::size(components))
+            components[depth] = n;
+        else
+            deep_components.push_back(n);
+        ++depth, length += n->length + 1;
+    }
+    auto component_at = [&](size_t i) {
+        return i < std::size(components)
+                   ? components[i]
+                   : deep_components[i - std::size(components)];
+    };
+
+    auto is_separator = [](char8_t c) { return c == u8'/' || c == u8'\\'; };
+    std::u8string result;
+    result.reserve(length);
+    for (size_t i = depth; i-- > 0;) {
+        const Node *n = component_at(i);
+        if (!result.empty() && !is_separator(result.back()) &&
+            !is_separator(n->name[0]))
+            result.push_back(
+                static_cast<char8_t>(fs::path::preferred_separator));
+        result.append(n->name, n->length);
+    }
+    return fs::path(std::move(result));
+}
+
+size_t PathArena::size() const {
+    return node_count.load(std::memory_order_acquire);
+}
+
+PathArena &arena() {
+    static PathArena instance;
+    return instance;
+}
+
+} // namespace pathstore
@@ -0,0 +1,225 @@
+/// @file read_engine.cpp
+/// @brief read_engine.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "read_engine.hpp"
+
+namespace readengine {
+namespace {
+
+void read_stream(const fs::path &path, const Consumer &consume) {
+    std::ifstream fs(path, std::ifstream::binary);
+    if (!fs)
+        throw std::runtime_error("ReadFile: Failed to open file");
+    char buffer[fileinfo::READ_FILE_BUFFER_SIZE];
+    while (fs.read(buffer, sizeof(buffer)))
+        consume(buffer, fs.gcount());
+    if (fs.gcount() > 0)
+        consume(buffer, fs.gcount());
+    if (fs.bad())
+        throw std::runtime_error("ReadFile: Failed to read file");
+}
+
+#ifndef _WIN32
+/// @brief 按线程复用的对齐缓冲区，只增不减（上限为`READ_BUFFER_MAX_SIZE`）。
+class AlignedBuffer {
+  public:
+    AlignedBuffer() : data(nullptr), capacity(0) {}
+    ~AlignedBuffer() { std::free(data); }
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+    /// @brief 取得至少`size`字节的缓冲区，`size`须为对齐的整数倍。
+    char *get(size_t size) {
+        if (size > capacity) {
+            std::free(data);
+            data = static_cast<char *>(
+                std::aligned_alloc(fileinfo::DIRECT_IO_ALIGNMENT, size));
+            capacity = size;
+            if (data == nullptr) {
+                capacity = 0;
+                throw std::bad_alloc();
+            }
+        }
+        return data;
+    }
+
+  private:
+    char *data;
+    size_t capacity;
+};
+
+/// @brief 与文件描述符绑定的RAII封装。
+class FileDescriptor {
+  public:
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    ~FileDescriptor() {
+        if (fd >= 0)
+            close(fd);
+    }
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+    operator int() const { return fd; }
+
+  private:
+    int fd;
+};
+
+/// Buffers grow with the file so small files are read with a single call.
+size_t buffer_size(off_t file_size) {
+    size_t size =
+        std::bit_ceil(static_cast<size_t>(std::max<off_t>(file_size, 1)));
+    return std::clamp(size, fileinfo::READ_BUFFER_MIN_SIZE,
+                      fileinfo::READ_BUFFER_MAX_SIZE);
+}
+
+[[noreturn]] void throw_errno(const char *what) {
+    throw std::runtime_error(
+        std::format("ReadFile: Failed to {} file: {}", what,
+                    std::strerror(errno)));
+}
+
+void read_descriptor(int fd, off_t file_size, bool direct,
+                     const Consumer &consume) {
+    thread_local AlignedBuffer buffer;
+    const size_t size = buffer_size(file_size);
+    char *data = buffer.get(size);
+    off_t offset = 0;
+    while (true) {
+        ssize_t n = pread(fd, data, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EINVAL && direct) {
+            // Some filesystems accept O_DIRECT at open time but not on read.
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+            continue;
+        }
+        if (n < 0)
+            throw_errno("read");
+        // Only 0 means end of file: NFS, FUSE and signals can cut a read
+        // short anywhere. An unaligned offset after a short O_DIRECT read
+        // fails with EINVAL and continues without O_DIRECT above.
+        if (n == 0)
+            break;
+        consume(data, n);
+        offset += n;
+    }
+}
+
+void read_pread(const fs::path &path, bool direct, const Consumer &consume) {
+    int fd = -1;
+    if (direct) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+        if (fd < 0 && errno == EINVAL) // e.g. tmpfs
+            direct = false;
+    }
+    if (!direct)
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw_errno("open");
+    FileDescriptor guard(fd);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        throw_errno("stat");
+    if (!direct)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    read_descriptor(fd, st.st_size, direct, consume);
+}
+
+void read_mmap(const fs::path &path, const Consumer &consume) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw_errno("open");
+    FileDescriptor guard(fd);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        throw_errno("stat");
+    if (st.st_size == 0)
+        return;
+    const size_t length = st.st_size;
+    void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) // e.g. special files: fall back to reading
+        return read_descriptor(fd, st.st_size, false, consume);
+    madvise(address, length, MADV_SEQUENTIAL);
+
+    // Hand the mapping over in pieces so pages are touched in order.
+    const char *data = static_cast<const char *>(address);
+    try {
+        for (size_t offset = 0; offset < length;
+             offset += fileinfo::READ_BUFFER_MAX_SIZE)
+            consume(data + offset, std::min(fileinfo::READ_BUFFER_MAX_SIZE,
+                                            length - offset));
+    } catch (...) {
+        munmap(address, length);
+        throw;
+    }
+    munmap(address, length);
+}
+#endif
+} // namespace
+
+void read_file(const fs::path &path, config::ReadEngine engine,
+               const Consumer &consume) {
+#ifndef _WIN32
+    switch (engine) {
+    case config::ReadEngine::PREAD:
+        return read_pread(path, false, consume);
+    case config::ReadEngine::DIRECT:
+        return read_pread(path, true, consume);
+    case config::ReadEngine::MMAP:
+        return read_mmap(path, consume);
+    case config::ReadEngine::STREAM:
+        break;
+    }
+#endif
+    read_stream(path, consume);
+}
+
+bool parse_read_engine(const std::string &name, config::ReadEngine &engine) {
+    for (auto candidate :
+         {config::ReadEngine::STREAM, config::ReadEngine::PREAD,
+          config::ReadEngine::DIRECT, config::ReadEngine::MMAP})
+        if (name == read_engine_name(candidate)) {
+            engine = candidate;
+            return true;
+        }
+    return false;
+}
+
+const char *read_engine_name(config::ReadEngine engine) {
+    switch (engine) {
+    case config::ReadEngine::STREAM:
+        return "stream";
+    case config::ReadEngine::PREAD:
+        return "pread";
+    case config::ReadEngine::DIRECT:
+        return "direct";
+    case config::ReadEngine::MMAP:
+        return "mmap";
+    }
+    return "unknown";
+}
+} // namespace readengine
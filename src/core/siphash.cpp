@@ -0,0 +1,59 @@
+/// @file siphash.cpp
+/// @brief siphash.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <bit>
+
+#include "siphash.hpp"
+
+namespace siphash {
+namespace {
+struct State {
+    ull v0, v1, v2, v3;
+
+    void round() {
+        v0 += v1, v1 = std::rotl(v1, 13), v1 ^= v0, v0 = std::rotl(v0, 32);
+        v2 += v3, v3 = std::rotl(v3, 16), v3 ^= v2;
+        v0 += v3, v3 = std::rotl(v3, 21), v3 ^= v0;
+        v2 += v1, v1 = std::rotl(v1, 17), v1 ^= v2, v2 = std::rotl(v2, 32);
+    }
+
+    void absorb(ull m) {
+        v3 ^= m;
+        round(), round();
+        v0 ^= m;
+    }
+};
+
+ull load_le64(const unsigned char *p, size_t size) {
+    ull value = 0;
+    for (size_t i = 0; i < size; ++i)
+        value |= ull(p[i]) << (8 * i);
+    return value;
+}
+} // namespace
+
+hashcache::Key hash128(ull k0, ull k1, std::string_view data) {
+    State s{k0 ^ 0x736f6d6570736575ull, k1 ^ 0x646f72616e646f6dull ^ 0xee,
+            k0 ^ 0x6c7967656e657261ull, k1 ^ 0x7465646279746573ull};
+    const auto *p = reinterpret_cast<const unsigned char *>(data.data());
+    const size_t blocks = data.size() / 8;
+    for (size_t i = 0; i < blocks; ++i)
+        s.absorb(load_le64(p + 8 * i, 8));
+    s.absorb(load_le64(p + 8 * blocks, data.size() % 8) |
+             ull(data.size()) << 56);
+
+    s.v2 ^= 0xee;
+    s.round(), s.round(), s.round(), s.round();
+    hashcache::Key key;
+    key.low = s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+    s.v1 ^= 0xdd;
+    s.round(), s.round(), s.round(), s.round();
+    key.high = s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+    return key;
+}
+} // namespace siphash
@@ -8,6 +8,11 @@
 
 #include <filesystem>
 #include <iostream>
+#include <optional>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 
 #include "print.hpp"
 #include "str_encode.hpp"
@@ -53,29 +58,49 @@ ThreadPool::~ThreadPool() {
     }
 }
 
-FilesCopier::FilesCopier(const bool &overwrite_existing)
-    : total_size(0), finished_size(0), total_num(0), finished_num(0),
-      stop(false), if_show_progress_bar(false),
-      overwrite_existing(overwrite_existing), worker(nullptr) {
-    worker = new std::thread([this] {
-        while (true) {
-            Task *task = nullptr;
-            {
-                std::unique_lock<std::mutex> lock(queue_mutex);
-                condition.wait(lock, [this] { return stop || !tasks.empty(); });
-                if (stop && tasks.empty()) {
-                    return;
-                }
+void DeviceLimiter::acquire(ull device) {
+    if (limit <= 0)
+        return;
+    std::unique_lock lock(mutex);
+    released.wait(lock, [&] { return active[device] < limit; });
+    ++active[device];
+}
 
-                task = new Task(tasks.front());
-                tasks.pop();
-            }
-            if (task != nullptr) {
-                copy_func(*task);
-                delete task;
-            }
-        }
-    });
+void DeviceLimiter::release(ull device) {
+    if (limit <= 0)
+        return;
+    {
+        std::lock_guard lock(mutex);
+        --active[device];
+    }
+    released.notify_all();
+}
+
+namespace {
+/// @return The device holding `path` or, if it does not exist yet, its
+/// nearest existing ancestor; 0 if unknown.
+ull device_of(const fs::path &path) {
+#ifndef _WIN32
+    struct stat st;
+    for (fs::path p = path; !p.empty(); p = p.parent_path()) {
+        if (::stat(p.c_str(), &st) == 0)
+            return st.st_dev;
+        if (p == p.parent_path())
+            break;
+    }
+#endif
+    return 0;
+}
+} // namespace
+
+FilesCopier::FilesCopier(const bool &overwrite_existing,
+                         size_t max_queued_tasks, int workers, int per_device)
+    : max_queued_tasks(max_queued_tasks), stop(false),
+      if_show_progress_bar(false), overwrite_existing(overwrite_existing),
+      total_size(0), finished_size(0), total_num(0), finished_num(0),
+      source_limiter(per_device), target_limiter(per_device) {
+    for (int i = 0; i < std::max(workers, 1); ++i)
+        this->workers.emplace_back([this] { work(); });
 }
 FilesCopier::~FilesCopier() {
     {
@@ -84,41 +109,135 @@ FilesCopier::~FilesCopier() {
     }
     condition.notify_all();
 
-    worker->join();
+    for (auto &worker : workers)
+        worker.join();
+
+    if (const auto summary = copy_stats.summary(); !summary.empty())
+        print::log(print::INFO, "[INFO] FilesCopier: " + summary);
 }
-void FilesCopier::enqueue(fs::path from, fs::path to, ull file_size) {
+void FilesCopier::work() {
+    while (true) {
+        std::optional<Task> task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            condition.wait(lock, [this] { return stop || !tasks.empty(); });
+            if (stop && tasks.empty()) {
+                return;
+            }
+
+            task.emplace(std::move(tasks.front()));
+            tasks.pop();
+            // Another worker is writing the same target: leave the task to it.
+            // It still counts against `max_queued_tasks` until it runs.
+            auto [it, inserted] = in_flight.try_emplace(task->to);
+            if (!inserted) {
+                it->second.push_back(std::move(*task));
+                ++deferred;
+                continue;
+            }
+        }
+        this->not_full.notify_one();
+
+        run(*task);
+        while (true) {
+            std::vector<Task> waiting;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                auto it = in_flight.find(task->to);
+                waiting.swap(it->second);
+                if (waiting.empty()) {
+                    in_flight.erase(it);
+                    break;
+                }
+                deferred -= waiting.size();
+            }
+            this->not_full.notify_all();
+            for (const auto &next : waiting)
+                run(next);
+        }
+    }
+}
+void FilesCopier::run(const Task &task) {
+    bool success;
+    if (source_limiter.enabled()) {
+        auto &arena = pathstore::arena();
+        const ull source = device_of(arena.get_path(task.from));
+        const ull target = device_of(arena.get_path(task.to).parent_path());
+        // Always source before target, so no two workers wait on each other.
+        DeviceLimiter::Guard reading(source_limiter, source);
+        DeviceLimiter::Guard writing(target_limiter, target);
+        success = copy_func(task);
+    } else {
+        success = copy_func(task);
+    }
+    if (task.on_finished)
+        task.on_finished(success);
+}
+void FilesCopier::enqueue(pathstore::PathId from, pathstore::PathId to,
+                          ull file_size,
+                          FinishedCallback on_finished) {
+    enqueue(from, to, file_size, nullptr, std::move(on_finished));
+}
+void FilesCopier::enqueue(pathstore::PathId from, pathstore::PathId to,
+                          ull file_size, Producer produce,
+                          FinishedCallback on_finished) {
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
-        tasks.emplace(from, to, file_size);
+        if (max_queued_tasks)
+            not_full.wait(lock,
+                          [this] {
+                              return tasks.size() + deferred < max_queued_tasks;
+                          });
+        tasks.emplace(from, to, file_size, std::move(produce),
+                      std::move(on_finished));
         total_num++, total_size += file_size;
     }
     condition.notify_one();
 }
-void FilesCopier::copy_func(const Task &task) {
+bool FilesCopier::copy_func(const Task &task) {
+    const fs::path from = pathstore::arena().get_path(task.from);
+    const fs::path to = pathstore::arena().get_path(task.to);
     try {
-        if (fs::exists(task.to) && overwrite_existing)
-            fs::remove(task.to);
-        if (!fs::exists(task.to))
-            fs::copy_file(task.from, task.to);
-        finished_num++, finished_size += task.file_size;
-        if (if_show_progress_bar)
+        std::optional<copyengine::CopyMethod> method;
+        if (task.produce) {
+            // The producer knows whether the target exists (e.g. from the
+            // object index) and saves the stat.
+            method = task.produce(to);
+        } else {
+            bool exists = fs::exists(to);
+            if (exists && overwrite_existing) {
+                fs::remove(to);
+                exists = false;
+            }
+            if (!exists)
+                method = copyengine::copy_file(from, to);
+        }
+        if (method)
+            copy_stats.add(*method, task.file_size);
+        const int num = ++finished_num;
+        const ull size = finished_size += task.file_size;
+        if (if_show_progress_bar) {
+            std::lock_guard lock(progress_mutex);
             print::progress_bar::print_double_progress_bar(
-                static_cast<double>(finished_num) / total_num,
-                static_cast<double>(finished_size) / total_size);
+                static_cast<double>(num) / total_num,
+                static_cast<double>(size) / total_size);
+        }
+        return true;
     } catch (const std::exception &e) {
         print::log(
             print::ERROR,
             std::format("[ERROR] FilesCopier: {} to {}, : {}.",
-                        strencode::to_console_format(task.from.u8string()),
-                        strencode::to_console_format(task.to.u8string()),
+                        strencode::to_console_format(from.u8string()),
+                        strencode::to_console_format(to.u8string()),
                         e.what()));
+        return false;
     }
 }
 void FilesCopier::show_progress_bar() {
     print::cprintln(print::INFO,
                     std::format("  Copying {}{}{} files, size: {}{:.2f}{} MB.",
                                 print::progress_bar::DOUBLE_PROGRESS_COLOR1,
-                                total_num, print::INFO,
+                                total_num.load(), print::INFO,
                                 print::progress_bar::DOUBLE_PROGRESS_COLOR2,
                                 total_size / (1024.0 * 1024), print::INFO));
     if_show_progress_bar = true;
@@ -0,0 +1,254 @@
+/// @file tree_hash.cpp
+/// @brief tree_hash.hpp的实现。
+//
+// This file is part of BackupSystem - a C++ project.
+//
+// Licensed under the MIT License. See LICENSE file in the root directory for
+// details.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "content_hash.hpp"
+#include "tree_hash.hpp"
+
+namespace treehash {
+namespace {
+/// Read buffer per thread; chunks are streamed through it.
+constexpr size_t BUFFER_SIZE = 1 << 22;
+
+void append_le64(std::string &out, ull value) {
+    for (int i = 0; i < 8; ++i)
+        out.push_back(static_cast<char>(value >> (8 * i)));
+}
+
+/// @brief 读取文件中的一段，同一线程内复用文件句柄。
+class ChunkReader {
+  public:
+    explicit ChunkReader(const fs::path &path) {
+#ifndef _WIN32
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error(std::format(
+                "TreeHash: Failed to open file: {}", std::strerror(errno)));
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+        stream.open(path, std::ios::binary);
+        if (!stream)
+            throw std::runtime_error("TreeHash: Failed to open file");
+#endif
+        buffer.resize(BUFFER_SIZE);
+    }
+    ~ChunkReader() {
+#ifndef _WIN32
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+    ChunkReader(const ChunkReader &) = delete;
+    ChunkReader &operator=(const ChunkReader &) = delete;
+
+    /// @brief 计算从`offset`起至多`length`字节的哈希值。
+    contenthash::Digest hash(config::HashAlgorithm algorithm, ull offset,
+                             ull length) {
+        contenthash::Hasher hasher(algorithm);
+        while (length > 0) {
+            const size_t want = std::min<ull>(length, buffer.size());
+#ifndef _WIN32
+            ssize_t n = pread(fd, buffer.data(), want, offset);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw std::runtime_error(std::format(
+                    "TreeHash: Failed to read file: {}", std::strerror(errno)));
+#else
+            stream.clear();
+            stream.seekg(offset);
+            stream.read(buffer.data(), want);
+            std::streamsize n = stream.gcount();
+#endif
+            if (n == 0) // the file shrank: hash what is there
+                break;
+            hasher.update(buffer.data(), n);
+            offset += n, length -= n;
+        }
+        return hasher.final();
+    }
+
+  private:
+#ifndef _WIN32
+    int fd = -1;
+#else
+    std::ifstream stream;
+#endif
+    std::vector<char> buffer;
+};
+
+/// @brief The chunks of one file, shared by its caller and any helpers.
+struct Job {
+    Job(const fs::path &path, config::HashAlgorithm algorithm, ull chunk_size,
+        std::vector<contenthash::Digest> &chunks)
+        : path(path), algorithm(algorithm), chunk_size(chunk_size),
+          chunks(chunks) {}
+
+    /// @brief Hashes chunks until none are left. Chunks are handed out in
+    /// order, so the threads sweep the file together.
+    void work() {
+        try {
+            ChunkReader reader(path);
+            for (size_t i = next_chunk++; i < chunks.size(); i = next_chunk++)
+                chunks[i] = reader.hash(algorithm, i * chunk_size, chunk_size);
+        } catch (...) {
+            std::lock_guard lock(error_mutex);
+            if (!error)
+                error = std::current_exception();
+            next_chunk = chunks.size();
+        }
+    }
+
+    bool has_work() const { return next_chunk < chunks.size(); }
+
+    const fs::path &path;
+    const config::HashAlgorithm algorithm;
+    const ull chunk_size;
+    std::vector<contenthash::Digest> &chunks;
+    std::atomic<size_t> next_chunk = 0;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    int helpers = 0; /// Helpers working on the job, under the pool's mutex.
+};
+
+/// @brief Helper threads shared by every file being hashed.
+/// @details The callers are hash workers already, so each call adding its
+/// own threads would multiply the thread count by the number of large
+/// files hashed at once. The pool is sized by the largest request instead,
+/// and its helpers join whichever file still has chunks left.
+class HelperPool {
+  public:
+    static HelperPool &instance() {
+        static HelperPool pool;
+        return pool;
+    }
+
+    ~HelperPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        job_cv.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    /// @brief Grows the pool to at least `helpers` threads.
+    void start(int helpers) {
+        std::lock_guard lock(mutex);
+        while (static_cast<int>(threads.size()) < helpers)
+            threads.emplace_back([this] { run(); });
+    }
+
+    void post(Job &job) {
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(&job);
+        }
+        job_cv.notify_all();
+    }
+
+    /// @brief Removes a job once its caller ran out of chunks, waiting for
+    /// the helpers still hashing its last chunks.
+    void withdraw(Job &job) {
+        std::unique_lock lock(mutex);
+        jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+        done_cv.wait(lock, [&] { return job.helpers == 0; });
+    }
+
+  private:
+    void run() {
+        std::unique_lock lock(mutex);
+        while (true) {
+            Job *job = nullptr;
+            job_cv.wait(lock, [&] {
+                if (stopping)
+                    return true;
+                for (Job *candidate : jobs)
+                    if (candidate->has_work()) {
+                        job = candidate;
+                        return true;
+                    }
+                return false;
+            });
+            if (job == nullptr)
+                return;
+            ++job->helpers;
+            lock.unlock();
+            job->work();
+            lock.lock();
+            --job->helpers;
+            done_cv.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable job_cv, done_cv;
+    std::vector<Job *> jobs;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
+} // namespace
+
+Tree hash_file(const fs::path &path, config::HashAlgorithm algorithm,
+               ull chunk_size, int threads) {
+    const ull file_size = fs::file_size(path);
+    Tree tree;
+    tree.algorithm = algorithm, tree.chunk_size = chunk_size;
+    const size_t chunk_count =
+        std::max<ull>((file_size + chunk_size - 1) / chunk_size, 1);
+    tree.chunks.resize(chunk_count);
+
+    Job job(path, algorithm, chunk_size, tree.chunks);
+    const int helpers =
+        static_cast<int>(std::min<size_t>(std::max(threads, 1), chunk_count)) -
+        1;
+    if (helpers > 0) {
+        auto &pool = HelperPool::instance();
+        pool.start(helpers);
+        pool.post(job);
+        job.work();
+        pool.withdraw(job);
+    } else {
+        job.work();
+    }
+    if (job.error)
+        std::rethrow_exception(job.error);
+
+    tree.root = combine(algorithm, chunk_size, tree.chunks);
+    return tree;
+}
+
+contenthash::Digest combine(config::HashAlgorithm algorithm, ull chunk_size,
+                            const std::vector<contenthash::Digest> &chunks) {
+    std::string prefix;
+    append_le64(prefix, chunk_size);
+    contenthash::Hasher hasher(algorithm);
+    hasher.update(prefix.data(), prefix.size());
+    for (const auto &chunk : chunks)
+        hasher.update(chunk.data(), chunk.size());
+    return hasher.final();
+}
+
+} // namespace treehash
@@ -0,0 +1,90 @@
+/// @file bench_fastcdc.cpp
+/// @brief 比较多通道与单通道gear扫描的分块吞吐量（MB/s），并给出修改一处后
+/// 需要重新保存的数据量
+///
+/// 用法：bench_fastcdc [数据大小(MiB)]
+/// 数据为内存中的随机字节。不注册为测试用例。
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "fastcdc.hpp"
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/// @brief The chunk lengths, scanning with `scan`.
+template <typename Scan>
+std::vector<size_t> chunk_lengths(const std::string &content, Scan scan) {
+    const auto *data = reinterpret_cast<const unsigned char *>(content.data());
+    const fastcdc::Params params;
+    const int bits = std::countr_zero(params.average_size);
+    std::vector<size_t> lengths;
+    for (size_t offset = 0; offset < content.size();) {
+        const unsigned char *chunk = data + offset;
+        const size_t size = std::min(content.size() - offset, params.max_size);
+        size_t length = size;
+        if (size > params.min_size) {
+            const size_t normal = std::min(params.average_size - 1, size);
+            size_t i = scan(chunk, params.min_size - 1, normal,
+                            ~0ull << (64 - bits - 1));
+            if (i == normal)
+                i = scan(chunk, normal, size, ~0ull << (64 - bits + 1));
+            length = i < size ? i + 1 : size;
+        }
+        lengths.push_back(length);
+        offset += length;
+    }
+    return lengths;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    const size_t size = (argc > 1 ? std::stoul(argv[1]) : 256) << 20;
+    std::string content(size, '\0');
+    std::mt19937_64 random(42);
+    for (auto &c : content)
+        c = static_cast<char>(random());
+    const double megabytes = double(size) / (1024 * 1024);
+
+    auto start = clock_type::now();
+    const auto scalar = chunk_lengths(content, fastcdc::scan_scalar);
+    const double scalar_seconds = seconds_since(start);
+    start = clock_type::now();
+    const auto lanes = chunk_lengths(content, fastcdc::scan);
+    const double lanes_seconds = seconds_since(start);
+
+    std::printf("%.0f MiB, %zu chunks, same cut points: %s\n", megabytes,
+                lanes.size(), scalar == lanes ? "yes" : "NO");
+    std::printf("scalar   %10.1f MB/s\n", megabytes / scalar_seconds);
+    std::printf("lanes    %10.1f MB/s\n", megabytes / lanes_seconds);
+
+    // Insert a few bytes in the middle and count the bytes of new chunks.
+    auto chunks_of = [](const std::string &data) {
+        std::set<std::string> chunks;
+        fastcdc::Chunker chunker;
+        auto on_chunk = [&](std::string_view c) { chunks.emplace(c); };
+        chunker.update(data.data(), data.size(), on_chunk);
+        chunker.finish(on_chunk);
+        return chunks;
+    };
+    std::string modified = content;
+    modified.insert(size / 2, "inserted");
+    const auto before = chunks_of(content);
+    size_t new_bytes = 0;
+    for (const auto &chunk : chunks_of(modified))
+        new_bytes += before.contains(chunk) ? 0 : chunk.size();
+    std::printf("after inserting 8 bytes: %.2f MB of new chunks\n",
+                new_bytes / (1024.0 * 1024));
+    return 0;
+}
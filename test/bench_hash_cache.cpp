@@ -0,0 +1,89 @@
+/// @file bench_hash_cache.cpp
+/// @brief 比较分片缓存与“一把互斥锁 + unordered_map”在不同线程数下的吞吐量
+///
+/// 用法：bench_hash_cache [项数] [每线程操作数] [最大线程数]
+/// 每个线程99%查找已有的项、1%插入新项，报告每秒百万次操作（Mops/s）。不注册
+/// 为测试用例。
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "hash_cache.hpp"
+
+namespace {
+typedef unsigned long long ull;
+
+/// 原先的实现：全局互斥锁保护的unordered_map。
+class MutexCache {
+  public:
+    bool find(const hashcache::Key &key, std::string &digest) {
+        std::lock_guard lock(mutex);
+        auto it = map.find(key.low);
+        if (it == map.end())
+            return false;
+        digest.assign(reinterpret_cast<const char *>(it->second.data()), 16);
+        return true;
+    }
+    void insert(const hashcache::Key &key, std::string_view digest) {
+        std::lock_guard lock(mutex);
+        std::copy(digest.begin(), digest.end(), map[key.low].begin());
+    }
+
+  private:
+    std::mutex mutex;
+    std::unordered_map<ull, std::array<unsigned char, 16>> map;
+};
+
+hashcache::Key key_of(ull i) { return {(i + 1) * 0x9e3779b97f4a7c15ull, i}; }
+
+template <typename Cache>
+double run(Cache &cache, int threads, ull entries, ull operations) {
+    const std::string digest(16, 'x');
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back([&, t] {
+            std::string found;
+            ull state = t * 0x2545f4914f6cdd1dull + 1;
+            for (ull i = 0; i < operations; ++i) {
+                state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+                if (state % 100 == 0)
+                    cache.insert(key_of(entries + state % entries), digest);
+                else
+                    cache.find(key_of(state % entries), found);
+            }
+        });
+    for (auto &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return threads * operations / seconds / 1e6;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    ull entries = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    ull operations = argc > 2 ? std::stoull(argv[2]) : 1000000;
+    int max_threads = argc > 3 ? std::stoi(argv[3]) : 32;
+
+    const std::string digest(16, 'x');
+    std::printf("%8s %14s %14s\n", "threads", "mutex Mops/s", "sharded Mops/s");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        MutexCache mutex_cache;
+        hashcache::HashCache sharded_cache(16);
+        for (ull i = 0; i < entries; ++i)
+            mutex_cache.insert(key_of(i), digest),
+                sharded_cache.insert(key_of(i), digest);
+        std::printf("%8d %14.2f %14.2f\n", threads,
+                    run(mutex_cache, threads, entries, operations),
+                    run(sharded_cache, threads, entries, operations));
+    }
+    return 0;
+}
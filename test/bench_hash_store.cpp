@@ -0,0 +1,93 @@
+/// @file bench_hash_store.cpp
+/// @brief 比较启动时读入整个旧版缓存文件与映射表文件的耗时
+///
+/// 用法：bench_hash_store [项数] [目录]
+/// 生成一个旧版本格式（64位键）的缓存文件与同样项数的表文件，分别报告载入（旧方式：逐项
+/// 读入`unordered_map`）与打开（`HashStore::open`）以及随后10万次查找的耗时。
+/// 不注册为测试用例。
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include "hash_store.hpp"
+
+namespace fs = std::filesystem;
+typedef unsigned long long ull;
+
+namespace {
+ull key_of(ull i) { return (i + 1) * 0x9e3779b97f4a7c15ull; }
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    const ull count = argc > 1 ? std::stoull(argv[1]) : 5000000;
+    const fs::path directory =
+        argc > 2 ? fs::path(argv[2])
+                 : fs::temp_directory_path() / "bench_hash_store";
+    fs::remove_all(directory);
+    fs::create_directories(directory);
+    const fs::path legacy = directory / "cache.bin";
+    const fs::path table = directory / "cache.tbl";
+
+    const std::string digest(16, 'x');
+    {
+        std::ofstream output(legacy, std::ios::binary);
+        for (ull i = 0; i < count; ++i) {
+            const ull key = key_of(i);
+            output.write(reinterpret_cast<const char *>(&key), sizeof(key));
+            output << digest;
+        }
+    }
+    {
+        hashstore::HashStore store;
+        store.open(table, 16);
+        for (ull i = 0; i < count; ++i)
+            store.insert({key_of(i), i}, digest);
+        store.close();
+    }
+    fs::path journal = table;
+    journal += ".journal";
+    hashstore::HashStore::compact(table, 16, {journal});
+    fs::remove(journal);
+
+    auto start = std::chrono::steady_clock::now();
+    std::unordered_map<ull, std::string> map;
+    {
+        std::ifstream input(legacy, std::ios::binary);
+        ull key;
+        std::string value(16, '\0');
+        while (input.read(reinterpret_cast<char *>(&key), sizeof(key)) &&
+               input.read(value.data(), value.size()))
+            map[key] = value;
+    }
+    const double load_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    hashstore::HashStore store;
+    store.open(table, 16);
+    const double open_seconds = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    std::string found;
+    ull hits = 0;
+    for (ull i = 0; i < 100000; ++i)
+        hits += store.find({key_of(i * 7919 % count), i * 7919 % count}, found);
+    const double find_seconds = seconds_since(start);
+
+    std::printf("%llu entries\n", count);
+    std::printf("legacy load:  %8.3f s\n", load_seconds);
+    std::printf("table open:   %8.3f s\n", open_seconds);
+    std::printf("100k lookups: %8.3f s (%llu hits)\n", find_seconds, hits);
+    store.close();
+    fs::remove_all(directory);
+    return 0;
+}
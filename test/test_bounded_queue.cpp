@@ -0,0 +1,132 @@
+/// @file test_bounded_queue.cpp
+/// @brief 测试有界阻塞队列：满时阻塞、关闭时唤醒等待者、不阻塞地出队
+
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+
+using namespace std::chrono_literals;
+
+// 测试元素按入队顺序取出，关闭后取空时返回空
+TEST(BoundedQueueTest, FifoUntilClosed) {
+    BoundedQueue<std::unique_ptr<int>> queue(4);
+    for (int i = 0; i < 3; ++i)
+        EXPECT_TRUE(queue.push(std::make_unique<int>(i)));
+    queue.close();
+    EXPECT_FALSE(queue.push(std::make_unique<int>(3)));
+    for (int i = 0; i < 3; ++i) {
+        auto value = queue.pop();
+        ASSERT_TRUE(value);
+        EXPECT_EQ(**value, i);
+    }
+    EXPECT_FALSE(queue.pop());
+}
+
+// 测试队列满时`push`阻塞，取出一个元素后继续
+TEST(BoundedQueueTest, PushBlocksWhenFull) {
+    BoundedQueue<int> queue(2);
+    queue.push(1);
+    queue.push(2);
+    std::atomic<bool> pushed = false;
+    std::thread producer([&] {
+        queue.push(3);
+        pushed = true;
+    });
+    std::this_thread::sleep_for(100ms);
+    EXPECT_FALSE(pushed);
+    EXPECT_EQ(queue.pop(), 1);
+    producer.join();
+    EXPECT_TRUE(pushed);
+    EXPECT_EQ(queue.pop(), 2);
+    EXPECT_EQ(queue.pop(), 3);
+}
+
+// 测试队列空时`pop`阻塞，直到有元素入队
+TEST(BoundedQueueTest, PopBlocksWhenEmpty) {
+    BoundedQueue<int> queue(2);
+    std::atomic<bool> popped = false;
+    std::thread consumer([&] {
+        EXPECT_EQ(queue.pop(), 7);
+        popped = true;
+    });
+    std::this_thread::sleep_for(100ms);
+    EXPECT_FALSE(popped);
+    queue.push(7);
+    consumer.join();
+    EXPECT_TRUE(popped);
+}
+
+// 测试`close`唤醒等待的消费者与生产者
+TEST(BoundedQueueTest, CloseWakesWaiters) {
+    BoundedQueue<int> empty(1);
+    std::vector<std::thread> consumers;
+    std::atomic<int> woken = 0;
+    for (int i = 0; i < 3; ++i)
+        consumers.emplace_back([&] {
+            EXPECT_FALSE(empty.pop());
+            woken++;
+        });
+
+    BoundedQueue<int> full(1);
+    full.push(0);
+    std::thread producer([&] {
+        EXPECT_FALSE(full.push(1));
+        woken++;
+    });
+
+    std::this_thread::sleep_for(100ms);
+    EXPECT_EQ(woken, 0);
+    empty.close();
+    full.close();
+    for (auto &consumer : consumers)
+        consumer.join();
+    producer.join();
+    EXPECT_EQ(woken, 4);
+    // 关闭前入队的元素仍可取出
+    EXPECT_EQ(full.pop(), 0);
+    EXPECT_FALSE(full.pop());
+}
+
+// 测试`try_pop`不阻塞，并为等待的生产者腾出空位
+TEST(BoundedQueueTest, TryPop) {
+    BoundedQueue<int> queue(1);
+    EXPECT_FALSE(queue.try_pop());
+    queue.push(1);
+    std::thread producer([&] { queue.push(2); });
+    EXPECT_EQ(queue.try_pop(), 1);
+    producer.join();
+    EXPECT_EQ(queue.try_pop(), 2);
+    EXPECT_FALSE(queue.try_pop());
+    queue.close();
+    EXPECT_FALSE(queue.try_pop());
+}
+
+// 测试多个生产者与消费者：每个元素恰好取出一次
+TEST(BoundedQueueTest, ManyProducersAndConsumers) {
+    constexpr int PRODUCERS = 4, CONSUMERS = 4, ITEMS = 10000;
+    BoundedQueue<int> queue(16);
+    std::vector<std::atomic<int>> seen(PRODUCERS * ITEMS);
+    std::vector<std::thread> producers, consumers;
+    for (int p = 0; p < PRODUCERS; ++p)
+        producers.emplace_back([&, p] {
+            for (int i = 0; i < ITEMS; ++i)
+                queue.push(p * ITEMS + i);
+        });
+    for (int c = 0; c < CONSUMERS; ++c)
+        consumers.emplace_back([&] {
+            while (auto value = queue.pop())
+                seen[*value]++;
+        });
+    for (auto &producer : producers)
+        producer.join();
+    queue.close();
+    for (auto &consumer : consumers)
+        consumer.join();
+    for (size_t i = 0; i < seen.size(); ++i)
+        ASSERT_EQ(seen[i], 1) << i;
+}
@@ -0,0 +1,123 @@
+/// @file test_compression.cpp
+/// @brief 测试压缩前的采样判断，以及整块、流式的压缩与解压
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "compression.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+std::string text(size_t size) {
+    std::string content;
+    for (int line = 0; content.size() < size; ++line)
+        content += "line " + std::to_string(line) + ": the quick brown fox\n";
+    content.resize(size);
+    return content;
+}
+
+std::string random_bytes(size_t size) {
+    std::mt19937_64 random(42);
+    std::string content(size, '\0');
+    for (auto &c : content)
+        c = static_cast<char>(random());
+    return content;
+}
+} // namespace
+
+// 测试字节熵与是否值得压缩的判断
+TEST(CompressionTest, WorthCompressing) {
+    EXPECT_DOUBLE_EQ(compression::entropy(std::string(100, 'a')), 0.0);
+    EXPECT_GT(compression::entropy(random_bytes(1 << 16)), 7.9);
+
+    EXPECT_TRUE(compression::worth_compressing(text(5000)));
+    EXPECT_FALSE(compression::worth_compressing(random_bytes(5000)));
+    EXPECT_FALSE(compression::worth_compressing(""));
+    // 已压缩格式的魔数，即使其余内容可压缩
+    EXPECT_FALSE(compression::worth_compressing("\x1f\x8b" + text(5000)));
+    EXPECT_FALSE(compression::worth_compressing("\x89PNG" + text(5000)));
+    EXPECT_FALSE(compression::worth_compressing("1234ftypisom" + text(5000)));
+    EXPECT_TRUE(compression::worth_compressing("ftyp" + text(5000)));
+}
+
+// 测试整块压缩与解压；未编译zstd时按原样保存
+TEST(CompressionTest, BlockRoundTrip) {
+    const std::string content = text(50000);
+    std::string compressed;
+    if (!compression::available()) {
+        EXPECT_FALSE(compression::compress(content, 3, compressed));
+        EXPECT_THROW(compression::decompress(content, content.size()),
+                     std::runtime_error);
+        return;
+    }
+    ASSERT_TRUE(compression::compress(content, 3, compressed));
+    EXPECT_LT(compressed.size(), content.size() / 4);
+    EXPECT_EQ(compression::decompress(compressed, content.size()), content);
+    EXPECT_THROW(compression::decompress(compressed, content.size() + 1),
+                 std::runtime_error);
+    EXPECT_THROW(compression::decompress(compressed.substr(1), content.size()),
+                 std::runtime_error);
+
+    // 不可压缩的内容压缩后不更小
+    EXPECT_FALSE(compression::compress(random_bytes(5000), 3, compressed));
+}
+
+// 测试流式压缩、帧头中的原始大小与流式解压
+TEST(CompressionTest, StreamRoundTrip) {
+    if (!compression::available())
+        GTEST_SKIP() << "built without zstd";
+    const std::string content = text(3 << 20);
+    const fs::path path = fs::temp_directory_path() / "test_compression.zst";
+    {
+        std::ofstream output(path, std::ios::binary);
+        compression::Compressor compressor(output, 3, content.size(), 2);
+        for (size_t offset = 0; offset < content.size(); offset += 100000)
+            compressor.write(content.data() + offset,
+                             std::min<size_t>(100000, content.size() - offset));
+        compressor.finish();
+    }
+    EXPECT_LT(fs::file_size(path), content.size() / 4);
+    EXPECT_EQ(compression::frame_content_size(path), content.size());
+
+    std::ifstream input(path, std::ios::binary);
+    std::ostringstream output;
+    compression::decompress_stream(input, output);
+    EXPECT_EQ(output.str(), content);
+
+    // 截断的流：末尾没有记录原始大小的帧
+    fs::resize_file(path, fs::file_size(path) / 2);
+    EXPECT_FALSE(compression::frame_content_size(path));
+    std::ifstream truncated(path, std::ios::binary);
+    std::ostringstream discarded;
+    EXPECT_THROW(compression::decompress_stream(truncated, discarded),
+                 std::runtime_error);
+    fs::remove(path);
+
+    // 写入的字节数与预计的大小不符（读取时文件仍在变化）
+    {
+        std::ofstream output(path, std::ios::binary);
+        compression::Compressor compressor(output, 3, 10, 1);
+        compressor.write("12345", 5);
+        compressor.finish();
+        EXPECT_EQ(compressor.get_size(), 5u);
+    }
+    EXPECT_EQ(compression::frame_content_size(path), 5u);
+    fs::remove(path);
+}
+
+// 测试压缩统计
+TEST(CompressionTest, Stats) {
+    compression::CompressionStats stats;
+    stats.add(4 << 20, 1 << 20, true, 500000000);
+    stats.add(1 << 20, 1 << 20, false, 1000);
+    EXPECT_EQ(stats.get_objects(true), 1u);
+    EXPECT_EQ(stats.get_objects(false), 1u);
+    EXPECT_EQ(stats.summary(),
+              "1 objects compressed, 1 stored raw, 5.00 MB -> 2.00 MB "
+              "(ratio 2.50), 0.50 s CPU");
+}
@@ -0,0 +1,144 @@
+/// @file test_content_hash.cpp
+/// @brief 测试各哈希算法与清单中算法的记录
+
+#include <cctype>
+#include <format>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "content_hash.hpp"
+#include "file_info.hpp"
+
+using config::HashAlgorithm;
+using nlohmann::json;
+
+namespace {
+std::string hex_of(HashAlgorithm algorithm, const std::string &data) {
+    contenthash::Hasher hasher(algorithm);
+    hasher.update(data.data(), data.size());
+    return contenthash::to_hex(hasher.final());
+}
+
+contenthash::Digest from_hex(const std::string &hex) {
+    contenthash::Digest digest;
+    EXPECT_TRUE(contenthash::from_hex(hex, digest));
+    return digest;
+}
+} // namespace
+
+// 测试已知的哈希值
+TEST(ContentHashTest, KnownDigests) {
+    EXPECT_EQ(hex_of(HashAlgorithm::MD5, "abc"),
+              "900150983CD24FB0D6963F7D28E17F72");
+    EXPECT_EQ(hex_of(HashAlgorithm::SHA256, "abc"),
+              "BA7816BF8F01CFEA414140DE5DAE2223"
+              "B00361A396177A9CB410FF61F20015AD");
+    EXPECT_EQ(hex_of(HashAlgorithm::BLAKE2B, "abc"),
+              "BA80A53F981C4D0D6A2797B69F12F6E94C212F14685AC4B74B12BB6FDBFFA2D1"
+              "7D87C5392AAB792DC252D5DE4533CC9518D38AA8DBF1925AB92386EDD4009923");
+    EXPECT_EQ(contenthash::digest_size(HashAlgorithm::SHA256), 32u);
+}
+
+// 测试十六进制的转换：向量部分与逐字节部分结果一致，非法输入被拒绝
+TEST(ContentHashTest, HexRoundTrip) {
+    std::string bytes;
+    for (size_t i = 0; i < contenthash::Digest::MAX_SIZE; ++i)
+        bytes.push_back(static_cast<char>(i * 37 + 11));
+    for (size_t size = 0; size <= bytes.size(); ++size) {
+        const std::string_view part(bytes.data(), size);
+        std::string expected;
+        for (unsigned char byte : part)
+            expected += std::format("{:02X}", byte);
+        ASSERT_EQ(contenthash::to_hex(part), expected);
+
+        contenthash::Digest digest;
+        ASSERT_TRUE(contenthash::from_hex(expected, digest));
+        EXPECT_EQ(digest.view(), part);
+        std::string lower = expected;
+        for (auto &c : lower)
+            c = static_cast<char>(std::tolower(c));
+        ASSERT_TRUE(contenthash::from_hex(lower, digest));
+        EXPECT_EQ(digest.view(), part);
+    }
+
+    contenthash::Digest digest = from_hex("AB");
+    std::string hex = contenthash::to_hex(bytes.substr(0, 32));
+    for (size_t position : {0ul, 17ul, 40ul, 63ul}) {
+        for (char bad : {'G', 'g', '/', ':', '@', '`', ' '}) {
+            std::string corrupt = hex;
+            corrupt[position] = bad;
+            EXPECT_FALSE(contenthash::from_hex(corrupt, digest));
+        }
+    }
+    EXPECT_FALSE(contenthash::from_hex("ABC", digest));
+    EXPECT_FALSE(contenthash::from_hex(std::string(130, 'A'), digest));
+    EXPECT_EQ(digest, from_hex("ab"));
+    EXPECT_NE(digest, from_hex("AB00"));
+}
+
+// 测试副本名：MD5不带前缀，保持旧仓库可读
+TEST(ContentHashTest, ObjectNames) {
+    EXPECT_EQ(contenthash::object_name(HashAlgorithm::MD5, from_hex("AB")),
+              "AB");
+    EXPECT_EQ(contenthash::object_name(HashAlgorithm::SHA256, from_hex("AB")),
+              "sha256-AB");
+    HashAlgorithm algorithm = HashAlgorithm::MD5;
+    EXPECT_TRUE(contenthash::parse_algorithm("blake2b", algorithm));
+    EXPECT_EQ(algorithm, HashAlgorithm::BLAKE2B);
+    EXPECT_FALSE(contenthash::parse_algorithm("crc32", algorithm));
+}
+
+// 测试清单项：旧格式按MD5读取，其余算法记录算法名
+TEST(ContentHashTest, ManifestEntries) {
+    json old_entry = {{"path", "/data/a.txt"},
+                      {"modified", 1},
+                      {"size", 3},
+                      {"md5", "900150983CD24FB0D6963F7D28E17F72"}};
+    auto file = old_entry.get<fileinfo::FileInfo>();
+    EXPECT_EQ(file.get_hash_algorithm(), HashAlgorithm::MD5);
+    EXPECT_EQ(file.get_object_name(), "900150983CD24FB0D6963F7D28E17F72");
+    EXPECT_EQ(json(file), old_entry);
+
+    file.set_hash_value(HashAlgorithm::SHA256, from_hex("BA78"));
+    json new_entry = file;
+    EXPECT_EQ(new_entry["algorithm"], "sha256");
+    EXPECT_FALSE(new_entry.contains("md5"));
+    auto loaded = new_entry.get<fileinfo::FileInfo>();
+    EXPECT_EQ(loaded.get_hash_algorithm(), HashAlgorithm::SHA256);
+    EXPECT_EQ(loaded.get_object_name(), "sha256-BA78");
+    EXPECT_TRUE(loaded.get_chunks().empty());
+    EXPECT_FALSE(new_entry.contains("chunks"));
+
+    // 分块保存的文件记录各块的哈希值
+    file.set_chunks({from_hex("0102"), from_hex("0304")});
+    json chunked_entry = file;
+    EXPECT_EQ(chunked_entry["chunks"], json({"0102", "0304"}));
+    EXPECT_EQ(chunked_entry.get<fileinfo::FileInfo>().get_chunk_object_names(),
+              (std::vector<std::string>{"sha256-0102", "sha256-0304"}));
+    chunked_entry["chunks"] = {"010"};
+    EXPECT_THROW(chunked_entry.get<fileinfo::FileInfo>(), std::runtime_error);
+
+    new_entry["hash"] = "BA7";
+    EXPECT_THROW(new_entry.get<fileinfo::FileInfo>(), std::runtime_error);
+    new_entry["algorithm"] = "crc32";
+    EXPECT_THROW(new_entry.get<fileinfo::FileInfo>(), std::runtime_error);
+}
+
+// 测试清单项保存纳秒精度的时间与设备号、inode号
+TEST(ContentHashTest, ManifestTimestamps) {
+    json entry = {{"path", "/data/b.txt"},
+                  {"modified", -2},
+                  {"mtime_ns", -1500000000},
+                  {"ctime_ns", 1700000000123456789},
+                  {"size", 3},
+                  {"dev", 2049},
+                  {"inode", 77},
+                  {"md5", "900150983CD24FB0D6963F7D28E17F72"}};
+    auto file = entry.get<fileinfo::FileInfo>();
+    EXPECT_EQ(file.get_modified_time(), -2);
+    EXPECT_EQ(file.get_modified_time_ns(), -1500000000);
+    EXPECT_EQ(file.get_change_time_ns(), 1700000000123456789);
+    EXPECT_EQ(file.get_device(), 2049u);
+    EXPECT_EQ(file.get_inode(), 77u);
+    EXPECT_EQ(json(file), entry);
+}
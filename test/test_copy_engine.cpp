@@ -0,0 +1,87 @@
+/// @file test_copy_engine.cpp
+/// @brief 测试文件复制的各种方式与失败时的清理
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "copy_engine.hpp"
+
+namespace fs = std::filesystem;
+using copyengine::CopyMethod;
+
+namespace {
+class CopyEngineTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        fs::remove_all(directory);
+        fs::create_directories(directory);
+    }
+    void TearDown() override { fs::remove_all(directory); }
+
+    std::string read(const fs::path &path) {
+        std::ifstream input(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(input), {});
+    }
+
+    fs::path directory = fs::temp_directory_path() / "test_copy_engine";
+};
+} // namespace
+
+// 测试各种大小的文件复制后内容与权限不变
+TEST_F(CopyEngineTest, CopiesContentAndPermissions) {
+    for (size_t size :
+         {size_t(0), size_t(1), size_t(4096), size_t(3 << 20) + 7}) {
+        std::string content(size, '\0');
+        for (size_t i = 0; i < size; ++i)
+            content[i] = static_cast<char>(i * 131 + (i >> 12));
+        const fs::path from = directory / ("from" + std::to_string(size));
+        const fs::path to = directory / ("to" + std::to_string(size));
+        std::ofstream(from, std::ios::binary) << content;
+        fs::permissions(from, fs::perms::owner_read | fs::perms::owner_write |
+                                  fs::perms::group_read);
+
+        const CopyMethod method = copyengine::copy_file(from, to);
+        EXPECT_EQ(read(to), content) << copyengine::copy_method_name(method);
+        EXPECT_EQ(fs::status(to).permissions(), fs::status(from).permissions());
+    }
+}
+
+// 测试目标已存在或源文件不存在时抛出异常，且不留下目标文件
+TEST_F(CopyEngineTest, Failures) {
+    const fs::path from = directory / "from", to = directory / "to";
+    std::ofstream(from) << "new";
+    std::ofstream(to) << "old";
+    EXPECT_THROW(copyengine::copy_file(from, to), std::runtime_error);
+    EXPECT_EQ(read(to), "old");
+
+    EXPECT_THROW(copyengine::copy_file(directory / "missing", directory / "x"),
+                 std::runtime_error);
+    EXPECT_FALSE(fs::exists(directory / "x"));
+}
+
+// 测试探测reflink不留下文件，支持时复制使用reflink
+TEST_F(CopyEngineTest, ReflinkProbe) {
+    const bool supported = copyengine::supports_reflink(directory);
+    EXPECT_TRUE(fs::is_empty(directory));
+    if (!supported)
+        GTEST_SKIP() << "filesystem without reflink";
+    std::ofstream(directory / "from", std::ios::binary)
+        << std::string(1 << 16, 'r');
+    EXPECT_EQ(copyengine::copy_file(directory / "from", directory / "to"),
+              CopyMethod::REFLINK);
+}
+
+// 测试按复制方式的统计
+TEST(CopyStatsTest, Summary) {
+    copyengine::CopyStats stats;
+    EXPECT_EQ(stats.summary(), "");
+    stats.add(CopyMethod::REFLINK, 1024 * 1024);
+    stats.add(CopyMethod::REFLINK, 1024 * 1024);
+    stats.add(CopyMethod::BUFFERED, 0);
+    EXPECT_EQ(stats.get_files(CopyMethod::REFLINK), 2u);
+    EXPECT_EQ(stats.get_bytes(CopyMethod::REFLINK), 2u * 1024 * 1024);
+    EXPECT_EQ(stats.summary(),
+              "reflink 2 files (2.00 MB), buffered 1 files (0.00 MB)");
+}
@@ -0,0 +1,139 @@
+/// @file test_dir_scanner.cpp
+/// @brief 测试多线程目录遍历：空闲线程等待任务，遍历结束时全部退出；
+/// 文件信息来自遍历时的`statx`，`d_type`未知时改用`fstatat`
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "dir_scanner.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+class DirectoryScannerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        fs::remove_all(root);
+        // 一条深的链与许多浅的目录：线程经常无事可做，需要等待后被唤醒
+        fs::path deep = root / "deep";
+        for (int d = 0; d < 200; ++d) {
+            deep /= "d" + std::to_string(d);
+            fs::create_directories(deep);
+            std::ofstream(deep / "f") << d;
+        }
+        for (int d = 0; d < DIRECTORIES; ++d) {
+            const fs::path dir = root / ("w" + std::to_string(d));
+            fs::create_directories(dir);
+            for (int f = 0; f < FILES; ++f)
+                std::ofstream(dir / ("f" + std::to_string(f))) << f;
+        }
+    }
+    void TearDown() override { fs::remove_all(root); }
+
+    static constexpr int DIRECTORIES = 100, FILES = 10;
+    fs::path root = fs::temp_directory_path() / "test_dir_scanner";
+};
+} // namespace
+
+// 测试多个线程遍历得到全部目录与文件，多次遍历结果相同
+TEST_F(DirectoryScannerTest, ScansWholeTree) {
+    for (int threads : {1, 4, 16}) {
+        for (int round = 0; round < 5; ++round) {
+            scanner::DirectoryScanner directory_scanner(threads, false);
+            std::atomic<int> directories = 0, files = 0;
+            directory_scanner.scan(
+                {root}, [&](int, pathstore::PathId) { directories++; },
+                [&](int, fileinfo::FileInfo &&) { files++; });
+            // 根、deep、链上的目录与浅的目录
+            EXPECT_EQ(directories, 2 + 200 + DIRECTORIES);
+            EXPECT_EQ(files, 200 + DIRECTORIES * FILES);
+            EXPECT_EQ(directory_scanner.get_stats().files,
+                      static_cast<unsigned long long>(files));
+        }
+    }
+}
+
+#ifndef _WIN32
+// 测试遍历得到的文件信息与`stat`一致：大小、纳秒精度的修改时间与ctime、inode号
+TEST_F(DirectoryScannerTest, FileInfoMatchesStat) {
+    constexpr long long NS_PER_SECOND = 1000000000;
+    const fs::path sized = root / "sized";
+    std::ofstream(sized) << std::string(12345, 'x');
+    // 非整秒的修改时间，确认纳秒部分没有丢失
+    const timespec times[2] = {{1700000000, 123456789},
+                               {1700000000, 987654321}};
+    ASSERT_EQ(utimensat(AT_FDCWD, sized.c_str(), times, 0), 0);
+
+    scanner::DirectoryScanner directory_scanner(4, false);
+    std::mutex mutex;
+    std::map<fs::path, fileinfo::FileInfo> scanned;
+    directory_scanner.scan({root}, [](int, pathstore::PathId) {},
+                           [&](int, fileinfo::FileInfo &&file) {
+                               std::lock_guard lock(mutex);
+                               scanned.emplace(file.get_path(),
+                                               std::move(file));
+                           });
+    ASSERT_EQ(scanned.size(), 200u + DIRECTORIES * FILES + 1);
+    for (const auto &path :
+         {sized, root / "w7" / "f3", root / "deep" / "d0" / "f"}) {
+        auto it = scanned.find(path);
+        ASSERT_NE(it, scanned.end()) << path;
+        const auto &file = it->second;
+        struct stat st;
+        ASSERT_EQ(stat(path.c_str(), &st), 0);
+        EXPECT_EQ(file.get_file_size(),
+                  static_cast<unsigned long long>(st.st_size));
+        EXPECT_EQ(file.get_modified_time(), st.st_mtim.tv_sec);
+        EXPECT_EQ(file.get_modified_time_ns(),
+                  st.st_mtim.tv_sec * NS_PER_SECOND + st.st_mtim.tv_nsec);
+        EXPECT_EQ(file.get_change_time_ns(),
+                  st.st_ctim.tv_sec * NS_PER_SECOND + st.st_ctim.tv_nsec);
+        EXPECT_EQ(file.get_device(),
+                  static_cast<unsigned long long>(st.st_dev));
+        EXPECT_EQ(file.get_inode(), static_cast<unsigned long long>(st.st_ino));
+        EXPECT_EQ(file.get_link_count(), st.st_nlink);
+    }
+    EXPECT_EQ(scanned.at(sized).get_file_size(), 12345u);
+    EXPECT_EQ(scanned.at(sized).get_modified_time_ns(),
+              1700000000 * NS_PER_SECOND + 987654321);
+}
+
+// 测试`d_type`为`DT_UNKNOWN`时改用`fstatat`判断类型，已知类型不再获取元数据
+TEST_F(DirectoryScannerTest, UnknownEntryTypeFallsBackToStat) {
+    const fs::path dir = root / "w0";
+    fs::create_symlink("f0", dir / "link");
+    fs::create_directory(dir / "sub");
+    const int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    ASSERT_GE(dir_fd, 0);
+
+    scanner::ull stat_calls = 0;
+    EXPECT_EQ(scanner::entry_type(dir_fd, "f0", DT_UNKNOWN, stat_calls),
+              DT_REG);
+    EXPECT_EQ(scanner::entry_type(dir_fd, "sub", DT_UNKNOWN, stat_calls),
+              DT_DIR);
+    // 不跟随符号链接
+    EXPECT_EQ(scanner::entry_type(dir_fd, "link", DT_UNKNOWN, stat_calls),
+              DT_LNK);
+    EXPECT_EQ(scanner::entry_type(dir_fd, "missing", DT_UNKNOWN, stat_calls),
+              DT_UNKNOWN);
+    EXPECT_EQ(stat_calls, 4u);
+
+    EXPECT_EQ(scanner::entry_type(dir_fd, "f0", DT_REG, stat_calls), DT_REG);
+    EXPECT_EQ(scanner::entry_type(dir_fd, "missing", DT_DIR, stat_calls),
+              DT_DIR);
+    EXPECT_EQ(stat_calls, 4u);
+    close(dir_fd);
+}
+#endif
@@ -0,0 +1,86 @@
+/// @file test_dir_snapshot.cpp
+/// @brief 测试目录快照的保存、载入与复用判断
+
+#include <filesystem>
+#include <gtest/gtest.h>
+
+#include "dir_snapshot.hpp"
+
+namespace fs = std::filesystem;
+using snapshot::ChildKind;
+using snapshot::DirectoryRecord;
+using snapshot::DirectorySnapshot;
+
+namespace {
+DirectoryRecord make_record(int64_t mtime, int64_t ctime) {
+    DirectoryRecord record;
+    record.mtime_sec = mtime, record.mtime_nsec = 5;
+    record.ctime_sec = ctime, record.ctime_nsec = 7;
+    record.names = std::string("sub\0a.txt\0", 10);
+    record.children = {{0, ChildKind::DIRECTORY, 0, 0, 0, 1},
+                       {4, ChildKind::FILE, 1234, 42, 99, 2}};
+    return record;
+}
+} // namespace
+
+// 测试保存后载入得到相同的记录
+TEST(DirectorySnapshotTest, SaveLoadRoundTrip) {
+    fs::path file = fs::temp_directory_path() / "test_dir_snapshot.bin";
+    DirectorySnapshot saved;
+    saved.set_created_time(1000);
+    saved.insert(u8"/data/project", make_record(100, 200));
+    ASSERT_TRUE(saved.save(file));
+
+    DirectorySnapshot loaded;
+    ASSERT_TRUE(loaded.load(file));
+    EXPECT_EQ(loaded.get_created_time(), 1000);
+    ASSERT_EQ(loaded.size(), 1u);
+    const DirectoryRecord *record = loaded.find(u8"/data/project");
+    ASSERT_NE(record, nullptr);
+    EXPECT_EQ(record->names, make_record(100, 200).names);
+    ASSERT_EQ(record->children.size(), 2u);
+    EXPECT_STREQ(record->name_of(record->children[1]), "a.txt");
+    EXPECT_EQ(record->children[1].kind, ChildKind::FILE);
+    EXPECT_EQ(record->children[1].modified_time, 1234);
+    EXPECT_EQ(record->children[1].file_size, 42u);
+    EXPECT_EQ(record->children[1].inode, 99u);
+    EXPECT_EQ(record->children[1].link_count, 2u);
+    EXPECT_EQ(loaded.find(u8"/data"), nullptr);
+
+    // 截断的文件被拒绝
+    fs::resize_file(file, fs::file_size(file) - 3);
+    EXPECT_FALSE(loaded.load(file));
+    EXPECT_EQ(loaded.size(), 0u);
+    fs::remove(file);
+}
+
+// 测试只有时间戳一致且早于上次遍历开始时间的目录才被复用
+TEST(DirectorySnapshotTest, UnchangedDirectory) {
+    DirectorySnapshot previous;
+    previous.set_created_time(1000);
+    DirectoryRecord record = make_record(100, 200);
+    EXPECT_TRUE(previous.is_unchanged(record, make_record(100, 200)));
+    EXPECT_FALSE(previous.is_unchanged(record, make_record(101, 200)));
+    EXPECT_FALSE(previous.is_unchanged(record, make_record(100, 201)));
+
+    // 在上次遍历开始的同一秒内被修改的目录不可信
+    DirectoryRecord racy = make_record(1000, 1000);
+    EXPECT_FALSE(previous.is_unchanged(racy, make_record(1000, 1000)));
+}
+
+// 测试合并时只保留根目录之外的旧记录
+TEST(DirectorySnapshotTest, MergeOutsideRoots) {
+    DirectorySnapshot previous, current;
+    previous.insert(u8"/data/a", make_record(1, 1));
+    previous.insert(u8"/data/a/deleted", make_record(1, 1));
+    previous.insert(u8"/data/ab", make_record(1, 1));
+    previous.insert(u8"/other", make_record(1, 1));
+    current.insert(u8"/data/a", make_record(2, 2));
+    current.merge_outside(previous, {fs::path("/data/a")});
+
+    EXPECT_EQ(current.size(), 3u);
+    EXPECT_EQ(current.find(u8"/data/a")->mtime_sec, 2);
+    EXPECT_EQ(current.find(u8"/data/a/deleted"), nullptr);
+    EXPECT_NE(current.find(u8"/data/ab"), nullptr);
+    EXPECT_NE(current.find(u8"/other"), nullptr);
+}
@@ -0,0 +1,96 @@
+/// @file test_exclude.cpp
+/// @brief 测试排除规则引擎的gitignore语义
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "exclude.hpp"
+
+namespace fs = std::filesystem;
+using exclude::ExcludeEngine;
+using exclude::MatchState;
+using State = std::shared_ptr<const MatchState>;
+
+namespace {
+/// 逐级判断相对路径，最后一个分量的类型由`is_directory`给出。
+bool excluded(const ExcludeEngine &engine, State state,
+              const std::string &relative_path, bool is_directory) {
+    std::vector<std::string> components;
+    for (const auto &component : fs::path(relative_path))
+        components.push_back(component.string());
+    for (size_t i = 0; i < components.size(); ++i) {
+        const bool last = i + 1 == components.size();
+        State child;
+        if (engine.is_excluded(state, components[i], !last || is_directory,
+                               &child))
+            return true;
+        state = child;
+    }
+    return false;
+}
+} // namespace
+
+// 测试不含`/`的模式匹配任意深度的名称
+TEST(ExcludeTest, BasenamePatterns) {
+    ExcludeEngine engine({"*.o", "node_modules/", "cache?", "[Tt]emp"});
+    auto root = engine.root_state();
+    EXPECT_TRUE(excluded(engine, root, "main.o", false));
+    EXPECT_TRUE(excluded(engine, root, "src/lib/util.o", false));
+    EXPECT_FALSE(excluded(engine, root, "src/main.cpp", false));
+    EXPECT_FALSE(excluded(engine, root, "main.o.txt", false));
+    EXPECT_TRUE(excluded(engine, root, "web/node_modules", true));
+    EXPECT_FALSE(excluded(engine, root, "web/node_modules", false));
+    EXPECT_TRUE(excluded(engine, root, "cache1", true));
+    EXPECT_FALSE(excluded(engine, root, "cache12", true));
+    EXPECT_TRUE(excluded(engine, root, "a/Temp", false));
+    EXPECT_TRUE(excluded(engine, root, "a/temp", false));
+    EXPECT_FALSE(excluded(engine, root, "a/xtemp", false));
+}
+
+// 测试锚定的模式和`**`
+TEST(ExcludeTest, AnchoredPatterns) {
+    ExcludeEngine engine({"/build", "docs/*.pdf", "logs/**/*.log", "out/**"});
+    auto root = engine.root_state();
+    EXPECT_TRUE(excluded(engine, root, "build", true));
+    EXPECT_FALSE(excluded(engine, root, "src/build", true));
+    EXPECT_TRUE(excluded(engine, root, "docs/manual.pdf", false));
+    EXPECT_FALSE(excluded(engine, root, "docs/old/manual.pdf", false));
+    EXPECT_FALSE(excluded(engine, root, "a/docs/manual.pdf", false));
+    EXPECT_TRUE(excluded(engine, root, "logs/a.log", false));
+    EXPECT_TRUE(excluded(engine, root, "logs/2024/01/a.log", false));
+    EXPECT_FALSE(excluded(engine, root, "logs/a.txt", false));
+    EXPECT_FALSE(excluded(engine, root, "out", true));
+    EXPECT_TRUE(excluded(engine, root, "out/a", false));
+}
+
+// 测试后出现的规则优先，`!`重新包含
+TEST(ExcludeTest, Negation) {
+    ExcludeEngine engine({"*.log", "!keep.log", "# comment", ""});
+    auto root = engine.root_state();
+    EXPECT_TRUE(excluded(engine, root, "a.log", false));
+    EXPECT_TRUE(excluded(engine, root, "x/b.log", false));
+    EXPECT_FALSE(excluded(engine, root, "x/keep.log", false));
+}
+
+// 测试目录中的规则文件只作用于该目录之下，且优先于命令行规则
+TEST(ExcludeTest, IgnoreFile) {
+    fs::path dir = fs::temp_directory_path() / "test_exclude_dir";
+    fs::create_directories(dir);
+    std::ofstream(dir / ".backupignore") << "!important.tmp\n/generated/\n";
+
+    ExcludeEngine engine({"*.tmp"});
+    auto root = engine.root_state();
+    auto state = engine.with_ignore_file(root, dir / ".backupignore");
+    EXPECT_NE(state, root);
+    EXPECT_TRUE(excluded(engine, state, "a.tmp", false));
+    EXPECT_FALSE(excluded(engine, state, "sub/important.tmp", false));
+    EXPECT_TRUE(excluded(engine, state, "generated", true));
+    EXPECT_FALSE(excluded(engine, state, "sub/generated", true));
+    EXPECT_FALSE(excluded(engine, root, "generated", true));
+
+    EXPECT_EQ(engine.with_ignore_file(root, dir / "missing"), root);
+    fs::remove_all(dir);
+}
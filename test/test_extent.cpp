@@ -0,0 +1,41 @@
+/// @file test_extent.cpp
+/// @brief 测试按物理位置排序所用的键
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "extent.hpp"
+
+namespace fs = std::filesystem;
+using extent::PhysicalKey;
+
+// 测试取得物理偏移的文件排在只能按inode号排序的文件之前
+TEST(ExtentTest, KeyOrder) {
+    EXPECT_LT((PhysicalKey{false, 1u << 30}), (PhysicalKey{true, 1}));
+    EXPECT_LT((PhysicalKey{false, 1}), (PhysicalKey{false, 2}));
+    EXPECT_LT((PhysicalKey{true, 1}), (PhysicalKey{true, 2}));
+}
+
+// 测试无法查询时退回inode号
+TEST(ExtentTest, FallbackToInode) {
+    PhysicalKey key = extent::physical_key(
+        fs::temp_directory_path() / "test_extent_missing", 1234);
+    EXPECT_TRUE(key.approximate);
+    EXPECT_EQ(key.position, 1234u);
+
+    // 有数据的文件：物理偏移或inode号之一
+    fs::path file = fs::temp_directory_path() / "test_extent_file";
+    std::ofstream(file) << std::string(1 << 16, 'x');
+    key = extent::physical_key(file, 99);
+    if (key.approximate) {
+        EXPECT_EQ(key.position, 99u);
+    } else {
+        // 物理偏移与传入的inode号无关，重复查询结果相同
+        const PhysicalKey again = extent::physical_key(file, 100);
+        EXPECT_FALSE(again.approximate);
+        EXPECT_EQ(again.position, key.position);
+    }
+    fs::remove(file);
+}
@@ -0,0 +1,96 @@
+/// @file test_fastcdc.cpp
+/// @brief 测试内容定义分块：多通道扫描与单通道扫描一致、块长度的范围、
+/// 流式写入与一次写入的结果相同，以及插入数据后只有附近的块改变
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "fastcdc.hpp"
+
+namespace {
+std::string random_bytes(size_t size, unsigned seed = 42) {
+    std::mt19937_64 random(seed);
+    std::string content(size, '\0');
+    for (auto &c : content)
+        c = static_cast<char>(random());
+    return content;
+}
+
+std::vector<std::string> chunk(const std::string &content, size_t block) {
+    fastcdc::Chunker chunker;
+    std::vector<std::string> chunks;
+    auto on_chunk = [&](std::string_view chunk) { chunks.emplace_back(chunk); };
+    for (size_t offset = 0; offset < content.size(); offset += block)
+        chunker.update(content.data() + offset,
+                       std::min(block, content.size() - offset), on_chunk);
+    chunker.finish(on_chunk);
+    return chunks;
+}
+} // namespace
+
+// 测试多通道扫描在各种范围与掩码下与单通道扫描的结果相同
+TEST(FastCdcTest, ScanMatchesScalar) {
+    const std::string content = random_bytes(1 << 20);
+    const auto *data = reinterpret_cast<const unsigned char *>(content.data());
+    for (int bits : {4, 10, 16, 21, 40})
+        for (size_t begin : {63, 100, 5000})
+            for (size_t end : {begin, begin + 1000, begin + 70000,
+                               begin + 200000, content.size()}) {
+                const unsigned long long mask = ~0ull << (64 - bits);
+                EXPECT_EQ(fastcdc::scan(data, begin, end, mask),
+                          fastcdc::scan_scalar(data, begin, end, mask))
+                    << bits << " " << begin << " " << end;
+            }
+}
+
+// 测试块长度在最小与最大长度之间，拼接后与原数据相同，且与写入的分段方式无关
+TEST(FastCdcTest, ChunkBounds) {
+    const std::string content = random_bytes(24 << 20);
+    const auto chunks = chunk(content, 1 << 20);
+    std::string joined;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (i + 1 < chunks.size()) {
+            EXPECT_GE(chunks[i].size(), fastcdc::MIN_CHUNK_SIZE);
+            EXPECT_LE(chunks[i].size(), fastcdc::MAX_CHUNK_SIZE);
+        }
+        joined += chunks[i];
+    }
+    EXPECT_EQ(joined, content);
+    // 归一化分块使块长度集中在平均长度附近
+    EXPECT_GT(chunks.size(), content.size() / (2 * fastcdc::AVERAGE_CHUNK_SIZE));
+    EXPECT_LT(chunks.size(), 2 * content.size() / fastcdc::AVERAGE_CHUNK_SIZE);
+
+    EXPECT_EQ(chunk(content, 12345), chunks);
+    EXPECT_EQ(chunk(content, content.size()), chunks);
+
+    // 不足最小长度的数据为一块，空数据没有块
+    EXPECT_EQ(chunk("short", 2), std::vector<std::string>{"short"});
+    EXPECT_TRUE(chunk("", 1).empty());
+}
+
+// 测试在中间插入数据后，只有插入处附近的块改变
+TEST(FastCdcTest, InsertionKeepsOtherChunks) {
+    const std::string original = random_bytes(32 << 20);
+    std::string modified = original;
+    modified.insert(modified.size() / 2, random_bytes(1000, 7));
+
+    const auto before = chunk(original, 1 << 20);
+    const auto after = chunk(modified, 1 << 20);
+    const std::set<std::string> known(before.begin(), before.end());
+    size_t changed = 0;
+    for (const auto &c : after)
+        changed += !known.contains(c);
+    EXPECT_GE(changed, 1u);
+    EXPECT_LE(changed, 2u);
+}
+
+// 测试无效的块长度参数
+TEST(FastCdcTest, InvalidParams) {
+    EXPECT_THROW(fastcdc::Chunker({16, 1024, 4096}), std::invalid_argument);
+    EXPECT_THROW(fastcdc::Chunker({256, 1000, 4096}), std::invalid_argument);
+    EXPECT_THROW(fastcdc::Chunker({2048, 1024, 4096}), std::invalid_argument);
+    EXPECT_NO_THROW(fastcdc::Chunker({64, 64, 64}));
+}
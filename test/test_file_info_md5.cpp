@@ -6,6 +6,7 @@
 #include <filesystem>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <random>
 #include <regex>
 #include <vector>
 
@@ -94,8 +95,9 @@ class MD5ComprehensiveTest : public ::testing::Test {
 // 测试空文件 MD5
 TEST_F(FileInfoMD5Test, EmptyFile) {
     fileinfo::FileInfo file(u8"test_files/empty.txt");
-    fileinfo::calculate_md5_value(file);
-    EXPECT_EQ(file.get_md5_value(), "D41D8CD98F00B204E9800998ECF8427E");
+    fileinfo::calculate_hash_value(file);
+    EXPECT_EQ(contenthash::to_hex(file.get_hash_value()),
+              "D41D8CD98F00B204E9800998ECF8427E");
 }
 
 // 测试文件内容变化检测
@@ -103,10 +105,10 @@ TEST_F(FileInfoMD5Test, ContentChangeDetection) {
     fileinfo::FileInfo file1(u8"test_files/test1.bin");
     fileinfo::FileInfo file2(u8"test_files/test2.bin");
 
-    fileinfo::calculate_md5_value(file1);
-    fileinfo::calculate_md5_value(file2);
+    fileinfo::calculate_hash_value(file1);
+    fileinfo::calculate_hash_value(file2);
 
-    EXPECT_NE(file1.get_md5_value(), file2.get_md5_value());
+    EXPECT_NE(file1.get_hash_value(), file2.get_hash_value());
 }
 
 // 测试缓存功能
@@ -115,10 +117,142 @@ TEST_F(FileInfoMD5Test, CacheFunctionality) {
 
     fileinfo::FileInfo file(u8"test_files/test1.bin");
     fileinfo::FileInfo file2(u8"test_files/test1.bin");
-    fileinfo::calculate_md5_value(file);  // 首次计算
-    fileinfo::calculate_md5_value(file2); // 第二次应从缓存读取
+    fileinfo::calculate_hash_value(file);  // 首次计算
+    fileinfo::calculate_hash_value(file2); // 第二次应从缓存读取
 
-    EXPECT_EQ(file.get_md5_value(), file2.get_md5_value());
+    EXPECT_EQ(file.get_hash_value(), file2.get_hash_value());
+}
+
+// 命中缓存时不再读取文件
+TEST_F(FileInfoMD5Test, CacheHitSkipsRead) {
+    config::SHOULD_CHECK_CACHED_MD5 = true;
+    fileinfo::init();
+
+    fileinfo::FileInfo file(u8"test_files/test2.bin");
+    fileinfo::FileInfo scanned(u8"test_files/test2.bin");
+    fileinfo::calculate_hash_value(file);
+    // 元数据取自扫描时，内容在此之后改变：命中缓存则得到旧的哈希值。
+    std::vector<char> data(1024 * 1024, 0xCC);
+    std::ofstream("test_files/test2.bin", std::ios::binary)
+        .write(data.data(), data.size());
+    fileinfo::calculate_hash_value(scanned);
+    EXPECT_EQ(file.get_hash_value(), scanned.get_hash_value());
+
+    config::VERIFY_CACHED_HASH = true;
+    EXPECT_THROW(fileinfo::calculate_hash_value(scanned), std::runtime_error);
+    config::VERIFY_CACHED_HASH = false;
+    fileinfo::update_cached_hash();
+    fs::remove_all(config::PATH_MD5_CACHE);
+}
+
+// 分块保存的文件未变化且各块都在时不再读取，已有的块不计入新写入的块
+TEST_F(FileInfoMD5Test, ChunkedCacheHitSkipsRead) {
+    config::SHOULD_CHECK_CACHED_MD5 = true;
+    config::CHUNKED_STORAGE = true;
+    fileinfo::init();
+    objectstore::ObjectStore objects("test_files/objects");
+    objects.open();
+
+    std::string data(fileinfo::CHUNKED_MIN_SIZE, '\0');
+    std::mt19937_64 random(42);
+    for (auto &byte : data)
+        byte = static_cast<char>(random());
+    std::ofstream("test_files/large.bin", std::ios::binary)
+        .write(data.data(), data.size());
+    std::ofstream("test_files/copy.bin", std::ios::binary)
+        .write(data.data(), data.size());
+
+    std::vector<fileinfo::FileInfo> files{
+        fileinfo::FileInfo(u8"test_files/large.bin")};
+    const auto first = fileinfo::calculate_hash_values(files, &objects);
+    ASSERT_FALSE(first[0].error);
+    EXPECT_GT(first[0].new_chunks, 0u);
+    EXPECT_EQ(first[0].new_chunks, files[0].get_chunks().size());
+
+    // 内容相同的另一个文件：各块已存在，不算新写入
+    std::vector<fileinfo::FileInfo> copies{
+        fileinfo::FileInfo(u8"test_files/copy.bin"),
+        fileinfo::FileInfo(u8"test_files/large.bin")};
+    // 元数据取自扫描时，内容在此之后改变：命中块列表则得到旧的结果
+    data[0] ^= 1;
+    std::ofstream("test_files/large.bin", std::ios::binary)
+        .write(data.data(), data.size());
+    const auto second = fileinfo::calculate_hash_values(copies, &objects);
+    ASSERT_FALSE(second[0].error);
+    ASSERT_FALSE(second[1].error);
+    EXPECT_EQ(second[0].new_chunks, 0u);
+    EXPECT_EQ(second[1].new_chunks, 0u);
+    EXPECT_TRUE(second[1].stored);
+    EXPECT_EQ(copies[1].get_hash_value(), files[0].get_hash_value());
+    EXPECT_EQ(copies[1].get_chunks(), files[0].get_chunks());
+
+    objects.close();
+    config::CHUNKED_STORAGE = false;
+    fileinfo::update_cached_hash();
+    fs::remove_all(config::PATH_MD5_CACHE);
+}
+
+// 关闭缓存时删除本次未用到的块列表（如已删除的文件的），本次没有用到块列表时都保留
+TEST_F(FileInfoMD5Test, UnusedChunkListsPruned) {
+    config::SHOULD_CHECK_CACHED_MD5 = true;
+    config::CHUNKED_STORAGE = true;
+    objectstore::ObjectStore objects("test_files/objects");
+    objects.open();
+    std::string data(fileinfo::CHUNKED_MIN_SIZE, '\0');
+    std::mt19937_64 random(7);
+    for (auto &byte : data)
+        byte = static_cast<char>(random());
+    std::ofstream("test_files/old.bin", std::ios::binary)
+        .write(data.data(), data.size());
+    data[0] ^= 1;
+    std::ofstream("test_files/new.bin", std::ios::binary)
+        .write(data.data(), data.size());
+
+    auto lists = [] {
+        std::vector<fs::path> found;
+        for (const auto &cache : fs::directory_iterator(config::PATH_MD5_CACHE))
+            if (cache.is_directory()) // `<stem>.chunks`
+                for (const auto &list : fs::directory_iterator(cache.path()))
+                    found.push_back(list.path());
+        std::sort(found.begin(), found.end());
+        return found;
+    };
+    auto backup = [&](const char8_t *path) {
+        fileinfo::init();
+        std::vector<fileinfo::FileInfo> files;
+        if (path != nullptr)
+            files.emplace_back(path);
+        for (const auto &result :
+             fileinfo::calculate_hash_values(files, &objects))
+            EXPECT_FALSE(result.error);
+        fileinfo::update_cached_hash();
+    };
+
+    backup(u8"test_files/old.bin");
+    const auto old_lists = lists();
+    ASSERT_EQ(old_lists.size(), 1u);
+    // 其他运行尚未改名的临时文件
+    fs::path temporary = old_lists[0];
+    temporary += ".tmp";
+    std::ofstream(temporary) << "partial";
+
+    backup(nullptr);
+    EXPECT_EQ(lists().size(), 2u);
+
+    fs::remove("test_files/old.bin");
+    backup(u8"test_files/new.bin");
+    const auto new_lists = lists();
+    ASSERT_EQ(new_lists.size(), 2u);
+    EXPECT_FALSE(fs::exists(old_lists[0]));
+    EXPECT_TRUE(fs::exists(temporary));
+
+    // 块列表命中时同样保留
+    backup(u8"test_files/new.bin");
+    EXPECT_EQ(lists(), new_lists);
+
+    objects.close();
+    config::CHUNKED_STORAGE = false;
+    fs::remove_all(config::PATH_MD5_CACHE);
 }
 
 // 测试多线程安全
@@ -132,7 +266,7 @@ TEST_F(FileInfoMD5Test, ThreadSafety) {
         threads.emplace_back([]() {
             fileinfo::FileInfo file(u8"test_files/test1.bin");
             for (int j = 0; j < 100; ++j) {
-                fileinfo::calculate_md5_value(file);
+                fileinfo::calculate_hash_value(file);
             }
         });
     }
@@ -148,7 +282,7 @@ TEST_F(FileInfoMD5Test, ThreadSafety) {
 // 测试异常处理
 TEST_F(FileInfoMD5Test, InvalidFileHandling) {
     fileinfo::FileInfo file(u8"non_existent_file.txt");
-    EXPECT_THROW(fileinfo::calculate_md5_value(file), std::runtime_error);
+    EXPECT_THROW(fileinfo::calculate_hash_value(file), std::runtime_error);
 }
 
 // <--------------MD5ComprehensiveTest-------------->
@@ -180,8 +314,8 @@ TEST_F(MD5ComprehensiveTest, BoundarySizes) {
 
         // 计算自定义 MD5
         fileinfo::FileInfo file(filename);
-        fileinfo::calculate_md5_value(file);
-        std::string custom_md5 = file.get_md5_value();
+        fileinfo::calculate_hash_value(file);
+        std::string custom_md5 = contenthash::to_hex(file.get_hash_value());
 
         // 转换为大写比较（系统工具输出为小写）
         std::transform(custom_md5.begin(), custom_md5.end(), custom_md5.begin(),
@@ -206,8 +340,8 @@ TEST_F(MD5ComprehensiveTest, SmallSizes) {
         ASSERT_FALSE(system_md5.empty()) << "Test " << size << " failed";
 
         fileinfo::FileInfo file{fs::path(filename).u8string()};
-        fileinfo::calculate_md5_value(file);
-        std::string custom_md5 = file.get_md5_value();
+        fileinfo::calculate_hash_value(file);
+        std::string custom_md5 = contenthash::to_hex(file.get_hash_value());
         std::transform(custom_md5.begin(), custom_md5.end(), custom_md5.begin(),
                        ::toupper);
         std::transform(system_md5.begin(), system_md5.end(), system_md5.begin(),
@@ -231,8 +365,8 @@ TEST_F(MD5ComprehensiveTest, RandomSizes) {
         ASSERT_FALSE(system_md5.empty()) << "Test " << i << " failed";
 
         fileinfo::FileInfo file{fs::path(filename).u8string()};
-        fileinfo::calculate_md5_value(file);
-        std::string custom_md5 = file.get_md5_value();
+        fileinfo::calculate_hash_value(file);
+        std::string custom_md5 = contenthash::to_hex(file.get_hash_value());
         std::transform(custom_md5.begin(), custom_md5.end(), custom_md5.begin(),
                        ::toupper);
         std::transform(system_md5.begin(), system_md5.end(), system_md5.begin(),
@@ -256,8 +390,8 @@ TEST_F(MD5ComprehensiveTest, SpecialFilenames) {
         ASSERT_FALSE(system_md5.empty()) << "Failed for filename: " << name;
 
         fileinfo::FileInfo file{fs::path(name).u8string()};
-        fileinfo::calculate_md5_value(file);
-        std::string custom_md5 = file.get_md5_value();
+        fileinfo::calculate_hash_value(file);
+        std::string custom_md5 = contenthash::to_hex(file.get_hash_value());
         std::transform(custom_md5.begin(), custom_md5.end(), custom_md5.begin(),
                        ::toupper);
         std::transform(system_md5.begin(), system_md5.end(), system_md5.begin(),
@@ -0,0 +1,185 @@
+/// @file test_files_copier.cpp
+/// @brief 测试多线程文件复制、同一目标的任务与设备并发限制
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+class FilesCopierTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        fs::remove_all(directory);
+        fs::create_directories(directory / "from");
+        fs::create_directories(directory / "to");
+    }
+    void TearDown() override { fs::remove_all(directory); }
+
+    pathstore::PathId write(const std::string &name,
+                            const std::string &content) {
+        const fs::path path = directory / "from" / name;
+        std::ofstream(path, std::ios::binary) << content;
+        return pathstore::arena().intern(path);
+    }
+    pathstore::PathId target(const std::string &name) {
+        return pathstore::arena().intern(directory / "to" / name);
+    }
+    std::string read(const std::string &name) {
+        std::ifstream input(directory / "to" / name, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(input), {});
+    }
+
+    fs::path directory = fs::temp_directory_path() / "test_files_copier";
+};
+} // namespace
+
+// 测试多个工作线程复制全部文件，每个任务的回调恰好调用一次
+TEST_F(FilesCopierTest, CopiesWithSeveralWorkers) {
+    constexpr int FILES = 200;
+    std::atomic<int> finished = 0, succeeded = 0;
+    {
+        FilesCopier copier(false, 16, 4);
+        for (int i = 0; i < FILES; ++i) {
+            const std::string name = std::to_string(i);
+            copier.enqueue(write(name, std::string(i * 31, 'a' + i % 26)),
+                           target(name), i * 31, [&](bool success) {
+                               finished++;
+                               succeeded += success;
+                           });
+        }
+    }
+    EXPECT_EQ(finished, FILES);
+    EXPECT_EQ(succeeded, FILES);
+    for (int i = 0; i < FILES; ++i)
+        ASSERT_EQ(read(std::to_string(i)), std::string(i * 31, 'a' + i % 26));
+}
+
+// 测试目标相同的任务依次执行：后到的任务发现目标已存在并跳过
+TEST_F(FilesCopierTest, SameTargetIsCopiedOnce) {
+    const std::string content(1 << 20, 'x');
+    std::vector<pathstore::PathId> sources;
+    for (int i = 0; i < 8; ++i)
+        sources.push_back(write("same" + std::to_string(i), content));
+    std::atomic<int> succeeded = 0;
+    {
+        FilesCopier copier(false, 0, 8);
+        for (auto source : sources)
+            copier.enqueue(source, target("object"), content.size(),
+                           [&](bool success) { succeeded += success; });
+    }
+    EXPECT_EQ(succeeded, 8);
+    EXPECT_EQ(read("object"), content);
+}
+
+// 测试等待同一目标的任务计入队列上限：目标正在复制时`enqueue`阻塞
+TEST_F(FilesCopierTest, WaitingTasksCountAgainstLimit) {
+    constexpr int TASKS = 20, LIMIT = 4;
+    const auto source = write("source", "data");
+    std::atomic<bool> release = false;
+    std::atomic<int> enqueued = 0, finished = 0;
+    {
+        FilesCopier copier(false, LIMIT, 2);
+        std::thread producer([&] {
+            for (int i = 0; i < TASKS; ++i) {
+                copier.enqueue(
+                    source, target("object"), 4,
+                    [&](const fs::path &to)
+                        -> std::optional<copyengine::CopyMethod> {
+                        while (!release)
+                            std::this_thread::yield();
+                        if (fs::exists(to))
+                            return std::nullopt;
+                        fs::copy_file(directory / "from" / "source", to);
+                        return copyengine::CopyMethod::BUFFERED;
+                    },
+                    [&](bool) { finished++; });
+                enqueued++;
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        // 第一个任务在复制中，其余的最多等待`LIMIT`个。
+        EXPECT_LE(enqueued, LIMIT + 1);
+        release = true;
+        producer.join();
+    }
+    EXPECT_EQ(enqueued, TASKS);
+    EXPECT_EQ(finished, TASKS);
+    EXPECT_EQ(read("object"), "data");
+}
+
+// 测试由`produce`写出的任务不检查、不覆盖目标，是否已存在由`produce`判断
+TEST_F(FilesCopierTest, ProducerDecidesExistence) {
+    std::ofstream(directory / "to" / "object") << "stored";
+    std::atomic<int> produced = 0;
+    std::atomic<bool> succeeded = false;
+    {
+        FilesCopier copier(true, 0, 1);
+        copier.enqueue(
+            write("source", "new"), target("object"), 3,
+            [&](const fs::path &) -> std::optional<copyengine::CopyMethod> {
+                produced++;
+                return std::nullopt;
+            },
+            [&](bool success) { succeeded = success; });
+        copier.enqueue(
+            write("source2", "data"), target("missing"), 4,
+            [&](const fs::path &to) -> std::optional<copyengine::CopyMethod> {
+                produced++;
+                std::ofstream(to) << "data";
+                return copyengine::CopyMethod::BUFFERED;
+            });
+    }
+    EXPECT_EQ(produced, 2);
+    EXPECT_TRUE(succeeded);
+    EXPECT_EQ(read("object"), "stored");
+    EXPECT_EQ(read("missing"), "data");
+}
+
+// 测试设备并发限制下仍能完成，且覆盖已有文件
+TEST_F(FilesCopierTest, PerDeviceLimit) {
+    std::ofstream(directory / "to" / "old") << "old content";
+    {
+        FilesCopier copier(true, 0, 4, 1);
+        copier.enqueue(write("old", "new"), target("old"), 3);
+        for (int i = 0; i < 20; ++i)
+            copier.enqueue(write("f" + std::to_string(i), "data"),
+                           target("f" + std::to_string(i)), 4);
+    }
+    EXPECT_EQ(read("old"), "new");
+    for (int i = 0; i < 20; ++i)
+        EXPECT_EQ(read("f" + std::to_string(i)), "data");
+}
+
+// 测试设备限制器：同一设备上的并发数不超过上限，不同设备互不影响
+TEST(DeviceLimiterTest, LimitsEachDevice) {
+    DeviceLimiter limiter(2);
+    std::atomic<int> active[2] = {0, 0}, peak[2] = {0, 0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i)
+        threads.emplace_back([&, device = i % 2] {
+            for (int round = 0; round < 50; ++round) {
+                DeviceLimiter::Guard guard(limiter, device);
+                const int now = ++active[device];
+                int seen = peak[device];
+                while (now > seen &&
+                       !peak[device].compare_exchange_weak(seen, now))
+                    ;
+                std::this_thread::yield();
+                --active[device];
+            }
+        });
+    for (auto &thread : threads)
+        thread.join();
+    EXPECT_LE(peak[0], 2);
+    EXPECT_LE(peak[1], 2);
+}
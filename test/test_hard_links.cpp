@@ -0,0 +1,91 @@
+/// @file test_hard_links.cpp
+/// @brief 测试硬链接分组：等待领头者、放行，以及链接不全时的释放
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "hard_links.hpp"
+
+namespace {
+/// @brief 一个硬链接路径：设备1上的`inode`，共`links`个链接。
+fileinfo::FileInfo link(const std::string &name, hardlinks::ull inode,
+                        unsigned links) {
+    fileinfo::FileInfo file(pathstore::arena().intern("/links/" + name), 0,
+                            100);
+    file.set_identity(1, inode, links);
+    return file;
+}
+
+class HardLinkGroupsTest : public ::testing::Test {
+  protected:
+    hardlinks::HardLinkGroups groups{
+        [this](fileinfo::FileInfo &&file, bool hashed) {
+            released.push_back(std::move(file));
+            released_hashed.push_back(hashed);
+        }};
+    std::vector<fileinfo::FileInfo> released;
+    std::vector<bool> released_hashed;
+    contenthash::Digest digest{"\x01\x02\x03\x04"};
+};
+} // namespace
+
+// 测试链接都在范围内：后到的路径等待领头者，完成后放行并删除分组
+TEST_F(HardLinkGroupsTest, AllLinksSeen) {
+    auto leader = link("a", 10, 3), second = link("b", 10, 3),
+         third = link("c", 10, 3);
+    ASSERT_TRUE(groups.join(leader));
+    EXPECT_FALSE(groups.join(second));
+    EXPECT_TRUE(released.empty());
+
+    leader.set_hash_value(config::HashAlgorithm::MD5, digest);
+    groups.finish(leader, true);
+    ASSERT_EQ(released.size(), 1u);
+    EXPECT_EQ(released[0].get_hash_value(), digest);
+    EXPECT_TRUE(released_hashed[0]);
+    EXPECT_EQ(groups.size(), 1u);
+
+    // 领头者完成后到达的路径立即放行，最后一个链接删除分组
+    EXPECT_FALSE(groups.join(third));
+    ASSERT_EQ(released.size(), 2u);
+    EXPECT_EQ(released[1].get_hash_value(), digest);
+    EXPECT_EQ(groups.size(), 0u);
+    EXPECT_EQ(groups.get_saved_reads(), 2u);
+    EXPECT_EQ(groups.get_saved_bytes(), 200u);
+}
+
+// 测试链接不全在范围内：`close`释放领头者已完成的分组
+TEST_F(HardLinkGroupsTest, PartialGroupReleasedOnClose) {
+    auto leader = link("a", 20, 3), second = link("b", 20, 3);
+    ASSERT_TRUE(groups.join(leader));
+    EXPECT_FALSE(groups.join(second));
+    groups.finish(leader, true);
+    ASSERT_EQ(released.size(), 1u);
+    EXPECT_EQ(groups.size(), 1u);
+
+    groups.close();
+    EXPECT_EQ(groups.size(), 0u);
+}
+
+// 测试`close`时领头者尚未完成：分组保留，完成时放行等待的路径并删除
+TEST_F(HardLinkGroupsTest, PartialGroupFinishedAfterClose) {
+    auto leader = link("a", 30, 4), second = link("b", 30, 4);
+    ASSERT_TRUE(groups.join(leader));
+    EXPECT_FALSE(groups.join(second));
+    groups.close();
+    EXPECT_EQ(groups.size(), 1u);
+
+    groups.finish(leader, false);
+    ASSERT_EQ(released.size(), 1u);
+    EXPECT_FALSE(released_hashed[0]);
+    EXPECT_EQ(groups.size(), 0u);
+}
+
+// 测试只有一个链接的文件不登记
+TEST_F(HardLinkGroupsTest, SingleLinkNotTracked) {
+    auto file = link("single", 40, 1);
+    EXPECT_TRUE(groups.join(file));
+    groups.finish(file, true);
+    EXPECT_EQ(groups.size(), 0u);
+    EXPECT_TRUE(released.empty());
+}
@@ -0,0 +1,86 @@
+/// @file test_hash_cache.cpp
+/// @brief 测试分片哈希值缓存的查找、覆盖、扩容与并发访问
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hash_cache.hpp"
+
+using hashcache::HashCache;
+using hashcache::Key;
+
+namespace {
+Key make_key(unsigned long long value) { return {value, value * 3}; }
+
+std::string digest_for(unsigned long long key) {
+    std::string digest(16, '\0');
+    for (int i = 0; i < 16; ++i)
+        digest[i] = static_cast<char>(key >> (i % 8 * 8));
+    return digest;
+}
+} // namespace
+
+// 测试插入、覆盖与全0的键
+TEST(HashCacheTest, InsertAndFind) {
+    HashCache cache(16);
+    std::string digest;
+    EXPECT_FALSE(cache.find(make_key(42), digest));
+    cache.insert(make_key(42), digest_for(42));
+    cache.insert(make_key(0), digest_for(7));
+    ASSERT_TRUE(cache.find(make_key(42), digest));
+    EXPECT_EQ(digest, digest_for(42));
+    ASSERT_TRUE(cache.find(make_key(0), digest));
+    EXPECT_EQ(digest, digest_for(7));
+
+    cache.insert(make_key(42), digest_for(43));
+    ASSERT_TRUE(cache.find(make_key(42), digest));
+    EXPECT_EQ(digest, digest_for(43));
+    EXPECT_EQ(cache.size(), 2u);
+
+    // 长度不符的哈希值被忽略
+    cache.insert(make_key(5), "short");
+    EXPECT_FALSE(cache.find(make_key(5), digest));
+
+    cache.reset(32);
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_FALSE(cache.find(make_key(42), digest));
+}
+
+// 测试扩容后所有项仍可找到，遍历得到每一项
+TEST(HashCacheTest, GrowAndVisit) {
+    HashCache cache(16);
+    constexpr unsigned long long COUNT = 100000;
+    for (unsigned long long key = 1; key <= COUNT; ++key)
+        cache.insert(make_key(key * 0x9e3779b97f4a7c15ull), digest_for(key));
+    EXPECT_EQ(cache.size(), COUNT);
+    std::string digest;
+    for (unsigned long long key = 1; key <= COUNT; ++key) {
+        ASSERT_TRUE(cache.find(make_key(key * 0x9e3779b97f4a7c15ull), digest));
+        ASSERT_EQ(digest, digest_for(key));
+    }
+    size_t visited = 0;
+    cache.for_each([&](const Key &, std::string_view) { ++visited; });
+    EXPECT_EQ(visited, COUNT);
+}
+
+// 测试多线程同时插入与查找
+TEST(HashCacheTest, Concurrent) {
+    HashCache cache(16);
+    constexpr int THREADS = 8;
+    constexpr unsigned long long PER_THREAD = 20000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t)
+        threads.emplace_back([&, t] {
+            std::string digest;
+            for (unsigned long long i = 1; i <= PER_THREAD; ++i) {
+                unsigned long long key = t * PER_THREAD + i;
+                cache.insert(make_key(key), digest_for(key));
+                EXPECT_TRUE(cache.find(make_key(key), digest));
+            }
+        });
+    for (auto &thread : threads)
+        thread.join();
+    EXPECT_EQ(cache.size(), THREADS * PER_THREAD);
+}
@@ -0,0 +1,162 @@
+/// @file test_hash_store.cpp
+/// @brief 测试持久化哈希值缓存的日志回放、合并与格式检查
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "hash_store.hpp"
+
+namespace fs = std::filesystem;
+using hashstore::HashStore;
+using hashstore::Key;
+
+namespace {
+Key make_key(unsigned long long value) { return {value, ~value}; }
+
+std::string digest_for(unsigned long long key) {
+    std::string digest(16, '\0');
+    for (int i = 0; i < 16; ++i)
+        digest[i] = static_cast<char>(key >> (i % 8 * 8) ^ i);
+    return digest;
+}
+
+class HashStoreTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        fs::remove_all(directory);
+        fs::create_directories(directory);
+    }
+    void TearDown() override { fs::remove_all(directory); }
+
+    fs::path path(const char *suffix) const {
+        return directory / (std::string("cache") + suffix);
+    }
+
+    fs::path directory = fs::temp_directory_path() / "test_hash_store";
+    fs::path table = path(".tbl");
+};
+} // namespace
+
+// 测试新增的项经日志保存，重新打开后仍可找到
+TEST_F(HashStoreTest, JournalSurvivesReopen) {
+    {
+        HashStore store;
+        store.open(table, 16);
+        for (unsigned long long key = 0; key < 100; ++key)
+            store.insert(make_key(key), digest_for(key));
+        store.insert(make_key(7), digest_for(700));
+        store.close();
+    }
+    EXPECT_TRUE(fs::exists(path(".tbl.journal")));
+    EXPECT_FALSE(fs::exists(table)); // too short to merge yet
+
+    HashStore store;
+    store.open(table, 16);
+    std::string digest;
+    for (unsigned long long key = 0; key < 100; ++key) {
+        ASSERT_TRUE(store.find(make_key(key), digest));
+        EXPECT_EQ(digest, key == 7 ? digest_for(700) : digest_for(key));
+    }
+    EXPECT_FALSE(store.find(make_key(100), digest));
+}
+
+// 测试日志末尾不完整的记录被丢弃，之后追加的项不受影响
+TEST_F(HashStoreTest, TornJournalTail) {
+    {
+        HashStore store;
+        store.open(table, 16);
+        store.insert(make_key(1), digest_for(1));
+        store.insert(make_key(2), digest_for(2));
+        store.close();
+    }
+    fs::resize_file(path(".tbl.journal"),
+                    fs::file_size(path(".tbl.journal")) - 5);
+    {
+        HashStore store;
+        store.open(table, 16);
+        store.insert(make_key(3), digest_for(3));
+        store.close();
+    }
+    HashStore store;
+    store.open(table, 16);
+    std::string digest;
+    EXPECT_TRUE(store.find(make_key(1), digest));
+    EXPECT_FALSE(store.find(make_key(2), digest));
+    ASSERT_TRUE(store.find(make_key(3), digest));
+    EXPECT_EQ(digest, digest_for(3));
+}
+
+// 测试日志足够长时在后台合并为表文件，合并后从表中查找
+TEST_F(HashStoreTest, CompactsLongJournal) {
+    const unsigned long long count =
+        hashstore::HASH_JOURNAL_COMPACT_MIN_ENTRIES + 10;
+    {
+        HashStore store;
+        store.open(table, 16);
+        for (unsigned long long key = 1; key <= count; ++key)
+            store.insert(make_key(key), digest_for(key));
+        store.close();
+    }
+    {
+        HashStore store;
+        store.open(table, 16); // starts the merge
+        store.insert(make_key(count + 1), digest_for(count + 1));
+        store.close();
+    }
+    EXPECT_TRUE(fs::exists(table));
+    EXPECT_FALSE(fs::exists(path(".tbl.journal.old")));
+
+    HashStore store;
+    store.open(table, 16);
+    EXPECT_EQ(store.size(), count + 1);
+    std::string digest;
+    for (unsigned long long key = 1; key <= count + 1; ++key) {
+        ASSERT_TRUE(store.find(make_key(key), digest));
+        ASSERT_EQ(digest, digest_for(key));
+    }
+}
+
+// 测试旧格式（64位键）的日志被丢弃并重新开始
+TEST_F(HashStoreTest, DiscardsOldFormat) {
+    {
+        std::ofstream journal(path(".tbl.journal"), std::ios::binary);
+        const unsigned int version = 1;
+        const unsigned long long digest_size = 16;
+        journal << "BSHJ";
+        journal.write(reinterpret_cast<const char *>(&version), 4);
+        journal.write(reinterpret_cast<const char *>(&digest_size), 8);
+        journal << std::string(32, 'z');
+    }
+    {
+        HashStore store;
+        store.open(table, 16);
+        EXPECT_EQ(store.size(), 0u);
+        store.insert(make_key(1), digest_for(1));
+        store.close();
+    }
+    HashStore store;
+    store.open(table, 16);
+    std::string digest;
+    ASSERT_TRUE(store.find(make_key(1), digest));
+    EXPECT_EQ(digest, digest_for(1));
+}
+
+// 测试值的长度不同的缓存文件被忽略
+TEST_F(HashStoreTest, IgnoresOtherDigestSize) {
+    HashStore::compact(table, 16, {});
+    {
+        HashStore store;
+        store.open(table, 16);
+        store.insert(make_key(5), digest_for(5));
+        store.close();
+    }
+    HashStore store;
+    store.open(table, 32);
+    std::string digest;
+    EXPECT_FALSE(store.find(make_key(5), digest));
+    store.insert(make_key(5), std::string(32, 'a'));
+    ASSERT_TRUE(store.find(make_key(5), digest));
+    EXPECT_EQ(digest, std::string(32, 'a'));
+}
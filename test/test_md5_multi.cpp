@@ -0,0 +1,56 @@
+/// @file test_md5_multi.cpp
+/// @brief 测试多缓冲区MD5与OpenSSL的结果一致
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include <openssl/evp.h>
+
+#include "md5_multi.hpp"
+
+using md5multi::Digest;
+
+namespace {
+Digest evp_md5(const std::string &message) {
+    Digest digest;
+    unsigned int length;
+    EVP_Digest(message.data(), message.size(), digest.data(), &length,
+               EVP_md5(), nullptr);
+    return digest;
+}
+
+std::string make_message(size_t size, unsigned seed) {
+    std::string message(size, '\0');
+    for (size_t i = 0; i < size; ++i)
+        message[i] = static_cast<char>(seed * 7 + i * 13 + (i >> 8));
+    return message;
+}
+
+void check(const std::vector<std::string> &messages) {
+    std::vector<std::string_view> views(messages.begin(), messages.end());
+    std::vector<Digest> digests(messages.size());
+    md5multi::md5(views, digests);
+    for (size_t i = 0; i < messages.size(); ++i)
+        EXPECT_EQ(digests[i], evp_md5(messages[i]))
+            << "size " << messages[i].size();
+}
+} // namespace
+
+// 测试补齐边界附近的长度，各通道长度各不相同
+TEST(Md5MultiTest, PaddingBoundaries) {
+    std::vector<size_t> sizes = {0,  1,   55,  56,  57,  63,  64,  65,
+                                 119, 120, 127, 128, 129, 1000, 4096, 65536};
+    std::vector<std::string> messages;
+    for (size_t i = 0; i < sizes.size(); ++i)
+        messages.push_back(make_message(sizes[i], i));
+    ASSERT_EQ(messages.size(), md5multi::LANES);
+    check(messages);
+}
+
+// 测试不足`LANES`条消息
+TEST(Md5MultiTest, PartialBatch) {
+    check({});
+    check({"abc"});
+    check({make_message(300, 1), make_message(70000, 2), ""});
+}
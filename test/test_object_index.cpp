@@ -0,0 +1,159 @@
+/// @file test_object_index.cpp
+/// @brief 测试Bloom过滤器、对象索引的保存与载入，以及副本目录的两级子目录迁移
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "object_index.hpp"
+#include "object_store.hpp"
+#include "pack_store.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+class ObjectIndexTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        fs::remove_all(directory);
+        fs::create_directories(directory);
+    }
+    void TearDown() override { fs::remove_all(directory); }
+
+    /// 大于pack对象上限的内容，保存为单独的文件。
+    static std::string content_of(int i) {
+        std::string content(packstore::PACK_OBJECT_MAX_SIZE + 1 + i, '\0');
+        for (size_t j = 0; j < content.size(); ++j)
+            content[j] = static_cast<char>(i * 131 + j * 7);
+        return content;
+    }
+    static std::string read(const fs::path &path) {
+        std::ifstream input(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(input), {});
+    }
+    static void write(const fs::path &path, const std::string &content) {
+        std::ofstream output(path, std::ios::binary);
+        output << content;
+    }
+
+    fs::path directory = fs::temp_directory_path() / "test_object_index";
+};
+} // namespace
+
+// 测试Bloom过滤器没有漏判，误判率约为1%
+TEST_F(ObjectIndexTest, BloomFilter) {
+    const int count = 100000;
+    objectindex::BloomFilter filter(count);
+    auto key = [](const std::string &prefix, int i) {
+        return packstore::object_key(prefix + std::to_string(i));
+    };
+    for (int i = 0; i < count; ++i)
+        filter.add(key("present", i));
+    for (int i = 0; i < count; ++i)
+        EXPECT_TRUE(filter.may_contain(key("present", i)));
+    int false_positives = 0;
+    for (int i = 0; i < count; ++i)
+        false_positives += filter.may_contain(key("absent", i));
+    EXPECT_LT(false_positives, count / 50);
+}
+
+// 测试索引的插入、查找、删除，以及保存后载入
+TEST_F(ObjectIndexTest, InsertFindSaveLoad) {
+    const fs::path path = directory / objectindex::OBJECT_INDEX_FILE;
+    {
+        objectindex::ObjectIndex index;
+        EXPECT_FALSE(index.load(path));
+        // More than the minimal filter capacity, so that it grows.
+        for (int i = 0; i < 70000; ++i)
+            index.insert("object" + std::to_string(i),
+                         {static_cast<unsigned long long>(i), i % 2 == 0,
+                          i % 3 == 0});
+        index.erase("object5");
+        EXPECT_EQ(index.size(), 69999u);
+        EXPECT_FALSE(index.find("object5"));
+        EXPECT_FALSE(index.find("missing"));
+        index.save(path);
+    }
+    objectindex::ObjectIndex index;
+    ASSERT_TRUE(index.load(path));
+    EXPECT_EQ(index.size(), 69999u);
+    EXPECT_FALSE(index.find("object5"));
+    for (int i : {0, 1, 3, 42, 69999}) {
+        auto entry = index.find("object" + std::to_string(i));
+        ASSERT_TRUE(entry) << i;
+        EXPECT_EQ(entry->size, static_cast<unsigned long long>(i));
+        EXPECT_EQ(entry->compressed, i % 2 == 0);
+        EXPECT_EQ(entry->flat, i % 3 == 0);
+    }
+
+    // A truncated file is rejected.
+    fs::resize_file(path, fs::file_size(path) - 1);
+    EXPECT_FALSE(index.load(path));
+    EXPECT_EQ(index.size(), 0u);
+}
+
+// 测试平铺的旧副本目录：只读打开时按原位置读取，可写打开时迁移到两级子目录
+TEST_F(ObjectIndexTest, MigrateFlatLayout) {
+    for (int i = 0; i < 20; ++i)
+        write(directory / ("object" + std::to_string(i)), content_of(i));
+    {
+        objectstore::ObjectStore objects(directory);
+        objects.open(false);
+        EXPECT_EQ(objects.get_migrated(), 0u);
+        EXPECT_EQ(objects.loose_object_count(), 20u);
+        EXPECT_EQ(objects.object_size("object3"), content_of(3).size());
+        EXPECT_TRUE(fs::exists(directory / "object3"));
+        EXPECT_FALSE(fs::exists(directory / objectstore::LAYOUT_FILE));
+        objects.close();
+    }
+    {
+        objectstore::ObjectStore objects(directory);
+        objects.open();
+        EXPECT_EQ(objects.get_migrated(), 20u);
+        EXPECT_TRUE(objects.is_index_rebuilt());
+        EXPECT_TRUE(fs::exists(directory / objectstore::LAYOUT_FILE));
+        EXPECT_FALSE(fs::exists(directory / "object3"));
+        EXPECT_EQ(read(objects.object_path("object3")), content_of(3));
+        // `ab/cd/object3`
+        const fs::path path = objects.object_path("object3");
+        EXPECT_EQ(path.parent_path().parent_path().parent_path(), directory);
+        const fs::path target = directory / "restored";
+        objects.extract("object7", target);
+        EXPECT_EQ(read(target), content_of(7));
+        objects.close();
+    }
+    // The saved index is used on the next run.
+    objectstore::ObjectStore objects(directory);
+    objects.open();
+    EXPECT_EQ(objects.get_migrated(), 0u);
+    EXPECT_FALSE(objects.is_index_rebuilt());
+    EXPECT_EQ(objects.loose_object_count(), 20u);
+    EXPECT_EQ(objects.object_size("object19"), content_of(19).size());
+    objects.close();
+}
+
+// 测试未正常关闭时索引文件缺失，下次打开时扫描重建
+TEST_F(ObjectIndexTest, RebuildAfterUncleanExit) {
+    {
+        objectstore::ObjectStore objects(directory);
+        objects.open();
+        EXPECT_TRUE(objects.store("first", content_of(1)));
+        objects.close();
+    }
+    {
+        objectstore::ObjectStore objects(directory);
+        objects.open();
+        EXPECT_FALSE(objects.is_index_rebuilt());
+        EXPECT_TRUE(objects.store("second", content_of(2)));
+        // No close(): the index of this run is lost.
+        EXPECT_FALSE(fs::exists(directory / objectindex::OBJECT_INDEX_FILE));
+    }
+    objectstore::ObjectStore objects(directory);
+    objects.open();
+    EXPECT_TRUE(objects.is_index_rebuilt());
+    EXPECT_EQ(objects.object_size("first"), content_of(1).size());
+    EXPECT_EQ(objects.object_size("second"), content_of(2).size());
+    EXPECT_FALSE(objects.contains("third"));
+    objects.close();
+}
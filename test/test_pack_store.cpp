@@ -0,0 +1,393 @@
+/// @file test_pack_store.cpp
+/// @brief 测试pack文件的追加、索引查找、中途退出后的恢复，以及对象存储
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.hpp"
+#include "object_store.hpp"
+#include "pack_store.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+class PackStoreTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        fs::remove_all(directory);
+        fs::create_directories(directory);
+    }
+    void TearDown() override { fs::remove_all(directory); }
+
+    static std::string content_of(int i) {
+        std::string content(i * 37 % 5000, '\0');
+        for (size_t j = 0; j < content.size(); ++j)
+            content[j] = static_cast<char>(i * 131 + j);
+        return content;
+    }
+    static std::string read(const fs::path &path) {
+        std::ifstream input(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(input), {});
+    }
+    size_t count_files(const std::string &extension) const {
+        size_t count = 0;
+        for (const auto &entry : fs::directory_iterator(directory))
+            count += entry.path().extension() == extension;
+        return count;
+    }
+
+    fs::path directory = fs::temp_directory_path() / "test_pack_store";
+};
+} // namespace
+
+// 测试追加的对象可以立即读出，关闭后通过索引读出；同名对象只写入一次
+TEST_F(PackStoreTest, AddFindAndReopen) {
+    {
+        packstore::PackStore packs;
+        packs.open(directory);
+        for (int i = 0; i < 500; ++i)
+            EXPECT_TRUE(packs.add("object" + std::to_string(i), content_of(i)));
+        EXPECT_FALSE(packs.add("object7", content_of(7)));
+        EXPECT_FALSE(packs.find("missing"));
+        auto location = packs.find("object42");
+        ASSERT_TRUE(location);
+        EXPECT_EQ(packs.read(*location), content_of(42));
+        EXPECT_EQ(packs.size(), 500u);
+        packs.close();
+        EXPECT_THROW(packs.add("late", "x"), std::logic_error);
+    }
+    EXPECT_EQ(count_files(".pack"), 1u);
+    EXPECT_EQ(count_files(".idx"), 1u);
+
+    packstore::PackStore packs;
+    packs.open(directory, false);
+    EXPECT_EQ(packs.size(), 500u);
+    for (int i = 0; i < 500; ++i) {
+        auto location = packs.find("object" + std::to_string(i));
+        ASSERT_TRUE(location) << i;
+        EXPECT_EQ(location->size, content_of(i).size());
+        EXPECT_EQ(packs.read(*location), content_of(i));
+    }
+    EXPECT_FALSE(packs.find("missing"));
+}
+
+// 测试多个线程同时追加：每个线程得到自己的pack，同名对象只写入一次
+TEST_F(PackStoreTest, ConcurrentWriters) {
+    packstore::PackStore packs;
+    packs.open(directory);
+    std::vector<std::thread> threads;
+    std::atomic<int> added = 0;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; ++i)
+                added += packs.add("object" + std::to_string(i), content_of(i));
+        });
+    for (auto &thread : threads)
+        thread.join();
+    EXPECT_EQ(added, 1000);
+    EXPECT_EQ(packs.size(), 1000u);
+    EXPECT_GE(packs.pack_count(), 1u);
+    packs.close();
+
+    packstore::PackStore reopened;
+    reopened.open(directory, false);
+    for (int i = 0; i < 1000; ++i) {
+        auto location = reopened.find("object" + std::to_string(i));
+        ASSERT_TRUE(location) << i;
+        EXPECT_EQ(reopened.read(*location), content_of(i));
+    }
+}
+
+// 测试没有索引的pack（中途退出）：只读时被忽略，可写时重建索引并截去不完整的记录
+TEST_F(PackStoreTest, RecoversPackWithoutIndex) {
+    {
+        packstore::PackStore packs;
+        packs.open(directory);
+        for (int i = 0; i < 20; ++i)
+            packs.add("object" + std::to_string(i), content_of(i));
+        packs.close();
+    }
+    // 中途退出的运行既没有写出pack的索引，也没有写出多pack索引
+    fs::remove(directory / packstore::MULTI_INDEX_FILE);
+    fs::path pack;
+    for (const auto &entry : fs::directory_iterator(directory))
+        if (entry.path().extension() == ".idx")
+            fs::remove(entry.path());
+        else
+            pack = entry.path();
+    const auto complete_size = fs::file_size(pack);
+    std::ofstream(pack, std::ios::binary | std::ios::app) << "torn record";
+
+    {
+        packstore::PackStore packs;
+        packs.open(directory, false);
+        EXPECT_EQ(packs.size(), 0u);
+        EXPECT_FALSE(packs.find("object3"));
+    }
+    packstore::PackStore packs;
+    packs.open(directory);
+    EXPECT_EQ(packs.size(), 20u);
+    EXPECT_EQ(fs::file_size(pack), complete_size);
+    EXPECT_EQ(count_files(".idx"), 1u);
+    for (int i = 0; i < 20; ++i) {
+        auto location = packs.find("object" + std::to_string(i));
+        ASSERT_TRUE(location) << i;
+        EXPECT_EQ(packs.read(*location), content_of(i));
+    }
+}
+
+// 测试同时进行的运行正在追加的pack（没有索引但持有锁）及其临时文件不被修复或删除
+TEST_F(PackStoreTest, PackOfConcurrentRun) {
+    packstore::PackStore running;
+    running.open(directory);
+    for (int i = 0; i < 20; ++i)
+        running.add("object" + std::to_string(i), content_of(i));
+    fs::path pack;
+    for (const auto &entry : fs::directory_iterator(directory))
+        pack = entry.path();
+    const auto size = fs::file_size(pack);
+    const fs::path temporary = fs::path(pack).replace_extension(".idx.tmp");
+    std::ofstream(temporary) << "being written";
+    std::ofstream(directory / "pack-gone.idx.tmp") << "left over";
+    {
+        packstore::PackStore other;
+        other.open(directory);
+        EXPECT_EQ(other.size(), 0u);
+        EXPECT_EQ(fs::file_size(pack), size);
+        EXPECT_TRUE(fs::exists(temporary));
+        EXPECT_FALSE(fs::exists(directory / "pack-gone.idx.tmp"));
+        EXPECT_TRUE(other.add("other", content_of(1000)));
+        other.close();
+    }
+    EXPECT_EQ(count_files(".idx"), 1u);
+    running.close();
+    EXPECT_FALSE(fs::exists(temporary));
+
+    packstore::PackStore packs;
+    packs.open(directory, false);
+    EXPECT_EQ(packs.size(), 21u);
+    for (int i = 0; i < 20; ++i) {
+        auto location = packs.find("object" + std::to_string(i));
+        ASSERT_TRUE(location) << i;
+        EXPECT_EQ(packs.read(*location), content_of(i));
+    }
+}
+
+// 测试多次运行写入的pack由多pack索引覆盖；未覆盖的pack仍可找到，下次关闭时并入
+TEST_F(PackStoreTest, MultiPackIndex) {
+    for (int run = 0; run < 3; ++run) {
+        packstore::PackStore packs;
+        packs.open(directory);
+        for (int i = run * 100; i < run * 100 + 100; ++i)
+            EXPECT_TRUE(packs.add("object" + std::to_string(i), content_of(i)));
+        packs.close();
+    }
+    EXPECT_EQ(count_files(".pack"), 3u);
+    EXPECT_TRUE(fs::exists(directory / packstore::MULTI_INDEX_FILE));
+
+    // 一次没有写出多pack索引的运行
+    fs::copy_file(directory / packstore::MULTI_INDEX_FILE,
+                  directory / "saved-index");
+    {
+        packstore::PackStore packs;
+        packs.open(directory);
+        EXPECT_FALSE(packs.add("object42", content_of(42)));
+        EXPECT_TRUE(packs.add("object300", content_of(300)));
+        packs.close();
+    }
+    fs::rename(directory / "saved-index",
+               directory / packstore::MULTI_INDEX_FILE);
+
+    auto check = [&] {
+        packstore::PackStore packs;
+        packs.open(directory, false);
+        EXPECT_EQ(packs.size(), 301u);
+        EXPECT_EQ(packs.pack_count(), 4u);
+        for (int i = 0; i <= 300; ++i) {
+            auto location = packs.find("object" + std::to_string(i));
+            ASSERT_TRUE(location) << i;
+            EXPECT_EQ(packs.read(*location), content_of(i));
+        }
+        EXPECT_FALSE(packs.find("missing"));
+    };
+    check();
+    {
+        packstore::PackStore packs;
+        packs.open(directory);
+        packs.close();
+    }
+    check();
+}
+
+// 测试对象存储：小对象写入pack，大对象为单独的文件，均可按名称取出
+TEST_F(PackStoreTest, ObjectStore) {
+    const std::string small = content_of(3);
+    const std::string large(packstore::PACK_OBJECT_MAX_SIZE + 1, 'L');
+    {
+        objectstore::ObjectStore objects(directory);
+        objects.open();
+        EXPECT_TRUE(objects.store("small", small));
+        EXPECT_TRUE(objects.store("large", large));
+        EXPECT_FALSE(objects.store("small", small));
+        EXPECT_FALSE(fs::exists(objects.object_path("small")));
+        EXPECT_EQ(read(objects.object_path("large")), large);
+        EXPECT_EQ(objects.object_size("small"), small.size());
+        objects.close();
+    }
+    objectstore::ObjectStore objects(directory);
+    objects.open(false);
+    EXPECT_EQ(objects.object_size("large"), large.size());
+    EXPECT_FALSE(objects.contains("missing"));
+
+    objects.extract("small", directory / "small.out");
+    objects.extract("large", directory / "large.out");
+    EXPECT_EQ(read(directory / "small.out"), small);
+    EXPECT_EQ(read(directory / "large.out"), large);
+    EXPECT_ANY_THROW(objects.extract("small", directory / "small.out"));
+    EXPECT_ANY_THROW(objects.extract("missing", directory / "missing.out"));
+
+    // 分块保存的文件由各块依次拼接而成
+    objects.extract_chunks({"small", "large", "small"}, directory / "joined.out");
+    EXPECT_EQ(read(directory / "joined.out"), small + large + small);
+    EXPECT_ANY_THROW(
+        objects.extract_chunks({"small", "missing"}, directory / "partial.out"));
+    EXPECT_FALSE(fs::exists(directory / "partial.out"));
+
+    // 已存在的对象可能被之前的清单引用，不会被删除
+    EXPECT_FALSE(objects.discard("large"));
+    EXPECT_FALSE(objects.discard("small"));
+    EXPECT_TRUE(objects.contains("large"));
+    EXPECT_TRUE(objects.contains("small"));
+}
+
+// 测试只有本次运行由`import`复制的单独对象可被删除
+TEST_F(PackStoreTest, DiscardOnlyImported) {
+    const std::string large(200000, 'l'), other(200000, 'o');
+    const fs::path source = directory / "source";
+    std::ofstream(source, std::ios::binary) << large;
+    objectstore::ObjectStore objects(directory / "copies");
+    objects.open();
+    objects.import(source, "imported");
+    EXPECT_TRUE(objects.store("stored", other));
+    EXPECT_FALSE(objects.discard("stored"));
+    EXPECT_TRUE(objects.contains("stored"));
+    EXPECT_TRUE(objects.discard("imported"));
+    EXPECT_FALSE(objects.contains("imported"));
+    EXPECT_FALSE(fs::exists(objects.object_path("imported")));
+    EXPECT_FALSE(objects.discard("imported"));
+
+    // 索引中没有、但已在副本目录中的对象加入索引，不再复制，也不会被删除
+    const fs::path present = objects.object_path("present");
+    fs::create_directories(present.parent_path());
+    std::ofstream(present, std::ios::binary) << "present";
+    EXPECT_FALSE(objects.import(source, "present"));
+    EXPECT_EQ(objects.object_size("present"), 7u);
+    EXPECT_EQ(read(present), "present");
+    EXPECT_FALSE(objects.discard("present"));
+
+    // 复制失败时不在副本名下留下文件
+    EXPECT_ANY_THROW(objects.import(directory / "missing", "missing"));
+    EXPECT_FALSE(objects.contains("missing"));
+    EXPECT_FALSE(fs::exists(objects.object_path("missing")));
+    objects.close();
+}
+
+// 测试压缩的对象：单独的对象为`.zst`文件，pack中的对象记录原始长度，取出时解压；
+// 不值得压缩的对象按原样保存
+TEST_F(PackStoreTest, CompressedObjects) {
+    if (!compression::available())
+        GTEST_SKIP() << "built without zstd";
+    std::string small, large;
+    while (small.size() < 4000)
+        small += "small text " + std::to_string(small.size()) + "\n";
+    while (large.size() < (1 << 20))
+        large += "large text " + std::to_string(large.size()) + "\n";
+    const std::string media = "\x89PNG" + small;
+    {
+        objectstore::ObjectStore objects(directory);
+        objects.open();
+        objects.set_compression(3, 2);
+        EXPECT_TRUE(objects.store("small", small));
+        EXPECT_TRUE(objects.store("media", media));
+        fs::path source = directory / "source";
+        std::ofstream(source, std::ios::binary) << large;
+        objects.import(source, "large");
+        EXPECT_FALSE(fs::exists(objects.object_path("large")));
+        EXPECT_LT(fs::file_size(objects.object_path("large") += ".zst"),
+                  large.size() / 4);
+
+        const auto &stats = objects.get_compression_stats();
+        EXPECT_EQ(stats.get_objects(true), 2u);
+        EXPECT_EQ(stats.get_objects(false), 1u);
+        EXPECT_EQ(stats.get_size(), small.size() + media.size() + large.size());
+        EXPECT_LT(stats.get_stored(), stats.get_size() / 2);
+        objects.close();
+    }
+    objectstore::ObjectStore objects(directory);
+    objects.open(false);
+    EXPECT_EQ(objects.object_size("small"), small.size());
+    EXPECT_EQ(objects.object_size("large"), large.size());
+    for (const auto &[name, content] :
+         {std::pair{"small", small}, {"media", media}, {"large", large}}) {
+        objects.extract(name, directory / (std::string(name) + ".out"));
+        EXPECT_EQ(read(directory / (std::string(name) + ".out")), content)
+            << name;
+    }
+    EXPECT_FALSE(objects.discard("large"));
+    EXPECT_TRUE(objects.contains("large"));
+}
+
+// 测试读取时大小已变化的文件按实际写入的内容压缩保存，重建索引时大小不变
+TEST_F(PackStoreTest, CompressedObjectChangedSize) {
+    if (!compression::available())
+        GTEST_SKIP() << "built without zstd";
+    std::string log;
+    while (log.size() < (1 << 18))
+        log += "log line " + std::to_string(log.size()) + "\n";
+    {
+        objectstore::ObjectStore objects(directory);
+        objects.open();
+        objects.set_compression(3, 2);
+        objectstore::ObjectStore::Writer writer(objects, log.size() / 2);
+        writer.write(log.data(), log.size());
+        writer.publish("log");
+        EXPECT_EQ(objects.object_size("log"), log.size());
+        // 不写出索引，下次打开时扫描重建
+    }
+    objectstore::ObjectStore objects(directory);
+    objects.open(false);
+    EXPECT_TRUE(objects.is_index_rebuilt());
+    EXPECT_EQ(objects.object_size("log"), log.size());
+    objects.extract("log", directory / "log.out");
+    EXPECT_EQ(read(directory / "log.out"), log);
+}
+
+// 测试打开时只删除已结束的运行留下的临时文件，同时进行的运行的临时文件保留
+TEST_F(PackStoreTest, PartialObjectsOfOtherRuns) {
+    const fs::path partial = directory / fileinfo::PARTIAL_OBJECTS_DIRECTORY;
+    fs::create_directories(partial / "ended");
+    std::ofstream(partial / "ended" / "0") << "left over";
+    std::ofstream(partial / "flat") << "left over";
+
+    const std::string content(1 << 17, 'p');
+    objectstore::ObjectStore running(directory);
+    running.open();
+    EXPECT_FALSE(fs::exists(partial / "ended"));
+    EXPECT_FALSE(fs::exists(partial / "flat"));
+    objectstore::ObjectStore::Writer writer(running, content.size());
+    writer.write(content.data(), content.size());
+    {
+        objectstore::ObjectStore other(directory);
+        other.open();
+        other.close();
+    }
+    EXPECT_TRUE(writer.publish("object"));
+    EXPECT_EQ(running.object_size("object"), content.size());
+    running.close();
+    EXPECT_TRUE(fs::is_empty(partial));
+}
@@ -0,0 +1,95 @@
+/// @file test_path_store.cpp
+/// @brief 测试 PathArena 的路径驻留与重建
+
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+#include "path_store.hpp"
+
+namespace fs = std::filesystem;
+using pathstore::PathArena;
+using pathstore::PathId;
+
+// 测试绝对路径、相对路径的往返
+TEST(PathStoreTest, InternRoundTrip) {
+    PathArena arena;
+    for (fs::path path : {fs::path("/tmp/a/b.txt"), fs::path("rel/dir/file"),
+                          fs::path("./backup_copies/ABC"), fs::path("/")}) {
+        EXPECT_EQ(arena.get_path(arena.intern(path)), path);
+    }
+    EXPECT_EQ(arena.intern(fs::path()), pathstore::INVALID_PATH_ID);
+    EXPECT_EQ(arena.get_path(pathstore::INVALID_PATH_ID), fs::path());
+}
+
+// 测试相同前缀共享节点
+TEST(PathStoreTest, SharedPrefixes) {
+    PathArena arena;
+    PathId a = arena.intern("/data/project/a.txt");
+    size_t size = arena.size();
+    PathId b = arena.intern("/data/project/b.txt");
+    EXPECT_EQ(arena.size(), size + 1);
+    EXPECT_EQ(arena.get_parent(a), arena.get_parent(b));
+    EXPECT_EQ(arena.intern("/data/project/a.txt"), a);
+    EXPECT_EQ(arena.get_name(b), u8"b.txt");
+}
+
+// 测试append与intern混用，以及超长名称
+TEST(PathStoreTest, AppendAndLongNames) {
+    PathArena arena;
+    PathId dir = arena.intern("/data");
+    std::u8string long_name(1 << 19, u8'x');
+    PathId file = arena.append(dir, long_name);
+    PathId other = arena.append(dir, u8"short");
+    EXPECT_EQ(arena.get_path(file), fs::path("/data") / long_name);
+    EXPECT_EQ(arena.get_path(other), fs::path("/data/short"));
+}
+
+// 测试多线程并发追加与读取
+TEST(PathStoreTest, ConcurrentAppend) {
+    PathArena arena;
+    PathId root = arena.intern("/root");
+    constexpr int THREAD_NUM = 8, PER_THREAD = 20000;
+    std::vector<std::vector<PathId>> ids(THREAD_NUM);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREAD_NUM; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < PER_THREAD; ++i) {
+                auto name = std::to_string(t) + "_" + std::to_string(i);
+                ids[t].push_back(arena.append(
+                    root, std::u8string(name.begin(), name.end())));
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    for (int t = 0; t < THREAD_NUM; ++t)
+        for (int i = 0; i < PER_THREAD; i += 997)
+            EXPECT_EQ(arena.get_path(ids[t][i]),
+                      fs::path("/root") /
+                          (std::to_string(t) + "_" + std::to_string(i)));
+}
+
+// 测试多线程并发驻留相同的路径得到相同的编号
+TEST(PathStoreTest, ConcurrentIntern) {
+    PathArena arena;
+    constexpr int THREAD_NUM = 8, PATHS = 5000;
+    std::vector<std::vector<PathId>> ids(THREAD_NUM);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREAD_NUM; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < PATHS; ++i)
+                ids[t].push_back(arena.intern(
+                    fs::path("/data") / std::to_string(i % 50) /
+                    std::to_string(i)));
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    for (int t = 1; t < THREAD_NUM; ++t)
+        EXPECT_EQ(ids[t], ids[0]);
+    // "/"、"data"、50个目录与各文件
+    EXPECT_EQ(arena.size(), 2u + 50 + PATHS);
+    EXPECT_EQ(arena.get_path(ids[3][1234]), fs::path("/data/34/1234"));
+}
@@ -0,0 +1,52 @@
+/// @file test_read_engine.cpp
+/// @brief 测试各读取方式得到相同的文件内容
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "read_engine.hpp"
+
+namespace fs = std::filesystem;
+using config::ReadEngine;
+
+namespace {
+std::string read_all(const fs::path &path, ReadEngine engine) {
+    std::string content;
+    readengine::read_file(path, engine, [&](const char *data, size_t size) {
+        content.append(data, size);
+    });
+    return content;
+}
+} // namespace
+
+// 测试空文件、小文件、恰为缓冲区大小和跨多个缓冲区的文件
+TEST(ReadEngineTest, SameContent) {
+    fs::path file = fs::temp_directory_path() / "test_read_engine.bin";
+    for (size_t size : {size_t(0), size_t(1), size_t(4097), size_t(1) << 16,
+                        (size_t(1) << 22) * 2 + 12345}) {
+        std::string expected(size, '\0');
+        for (size_t i = 0; i < size; ++i)
+            expected[i] = static_cast<char>(i * 131 + (i >> 12));
+        std::ofstream(file, std::ios::binary) << expected;
+        for (auto engine : {ReadEngine::STREAM, ReadEngine::PREAD,
+                            ReadEngine::DIRECT, ReadEngine::MMAP})
+            EXPECT_EQ(read_all(file, engine), expected)
+                << readengine::read_engine_name(engine) << ", size " << size;
+    }
+    fs::remove(file);
+}
+
+// 测试名称解析与打开失败
+TEST(ReadEngineTest, NamesAndErrors) {
+    ReadEngine engine = ReadEngine::STREAM;
+    EXPECT_TRUE(readengine::parse_read_engine("mmap", engine));
+    EXPECT_EQ(engine, ReadEngine::MMAP);
+    EXPECT_FALSE(readengine::parse_read_engine("aio", engine));
+    EXPECT_EQ(engine, ReadEngine::MMAP);
+
+    fs::path missing = fs::temp_directory_path() / "test_read_engine_missing";
+    EXPECT_THROW(read_all(missing, ReadEngine::PREAD), std::runtime_error);
+    EXPECT_THROW(read_all(missing, ReadEngine::STREAM), std::runtime_error);
+}
@@ -0,0 +1,36 @@
+/// @file test_siphash.cpp
+/// @brief 测试SipHash-2-4-128
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "siphash.hpp"
+
+namespace {
+// 参考实现测试向量使用的密钥 00 01 … 0f
+constexpr unsigned long long K0 = 0x0706050403020100ull;
+constexpr unsigned long long K1 = 0x0f0e0d0c0b0a0908ull;
+} // namespace
+
+// 测试与参考实现的测试向量（空输入）一致
+TEST(SipHashTest, ReferenceVector) {
+    const auto key = siphash::hash128(K0, K1, "");
+    EXPECT_EQ(key.low, 0xe6a825ba047f81a3ull);
+    EXPECT_EQ(key.high, 0x930255c71472f66dull);
+}
+
+// 测试各种长度的输入：结果互不相同，且依赖于密钥
+TEST(SipHashTest, LengthsAndKeys) {
+    std::string data;
+    std::vector<hashcache::Key> keys;
+    for (int length = 0; length < 40; ++length) {
+        keys.push_back(siphash::hash128(K0, K1, data));
+        data.push_back(static_cast<char>(length));
+    }
+    for (size_t i = 0; i < keys.size(); ++i)
+        for (size_t j = i + 1; j < keys.size(); ++j)
+            EXPECT_FALSE(keys[i] == keys[j]) << i << " " << j;
+    EXPECT_FALSE(siphash::hash128(K0, K1, data) ==
+                 siphash::hash128(K0 + 1, K1, data));
+}
@@ -0,0 +1,92 @@
+/// @file test_tree_hash.cpp
+/// @brief 测试分块树哈希
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "content_hash.hpp"
+#include "tree_hash.hpp"
+
+namespace fs = std::filesystem;
+using config::HashAlgorithm;
+
+namespace {
+contenthash::Digest digest_of(HashAlgorithm algorithm,
+                              const std::string &data) {
+    contenthash::Hasher hasher(algorithm);
+    hasher.update(data.data(), data.size());
+    return hasher.final();
+}
+
+class TreeHashTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        content.resize(5500);
+        for (size_t i = 0; i < content.size(); ++i)
+            content[i] = static_cast<char>(i * 7 + (i >> 9));
+        std::ofstream(file, std::ios::binary) << content;
+    }
+    void TearDown() override { fs::remove(file); }
+
+    fs::path file = fs::temp_directory_path() / "test_tree_hash.bin";
+    std::string content;
+};
+} // namespace
+
+// 测试根哈希值与逐块计算的结果一致，且与线程数无关
+TEST_F(TreeHashTest, MatchesChunkDigests) {
+    std::vector<contenthash::Digest> expected;
+    for (size_t offset = 0; offset < content.size(); offset += 1000)
+        expected.push_back(
+            digest_of(HashAlgorithm::SHA256, content.substr(offset, 1000)));
+
+    auto single = treehash::hash_file(file, HashAlgorithm::SHA256, 1000, 1);
+    auto parallel = treehash::hash_file(file, HashAlgorithm::SHA256, 1000, 4);
+    EXPECT_EQ(single.chunks, expected);
+    EXPECT_EQ(parallel.chunks, expected);
+    EXPECT_EQ(single.root, parallel.root);
+    EXPECT_EQ(single.root,
+              treehash::combine(HashAlgorithm::SHA256, 1000, expected));
+
+    // 块大小参与根哈希值的计算
+    EXPECT_NE(treehash::hash_file(file, HashAlgorithm::SHA256, 2000, 2).root,
+              single.root);
+    EXPECT_NE(single.root, digest_of(HashAlgorithm::SHA256, content));
+}
+
+// 测试树哈希副本名
+TEST_F(TreeHashTest, ObjectName) {
+    EXPECT_EQ(contenthash::object_name(HashAlgorithm::MD5,
+                                       contenthash::Digest("\xab"), true),
+              "md5-tree-AB");
+}
+
+// 测试多个文件同时计算时共用协助线程，结果不变
+TEST_F(TreeHashTest, ConcurrentFiles) {
+    const auto expected =
+        treehash::hash_file(file, HashAlgorithm::SHA256, 100, 1).root;
+    std::vector<std::thread> callers;
+    std::atomic<int> matches = 0;
+    for (int i = 0; i < 8; ++i)
+        callers.emplace_back([&] {
+            for (int j = 0; j < 20; ++j)
+                matches += treehash::hash_file(file, HashAlgorithm::SHA256,
+                                               100, 4)
+                               .root == expected;
+        });
+    for (auto &caller : callers)
+        caller.join();
+    EXPECT_EQ(matches, 160);
+}
+
+// 测试不存在的文件
+TEST_F(TreeHashTest, MissingFile) {
+    EXPECT_ANY_THROW(treehash::hash_file(
+        fs::temp_directory_path() / "test_tree_hash_missing",
+        HashAlgorithm::MD5, 1024, 2));
+}